@@ -0,0 +1,996 @@
+////////////////////////////////////////////////////////////////
+//
+// RwgTex / microbenchmarks
+// (c) Pavel [VorteX] Timofeyev
+// See LICENSE text file for a license agreement
+//
+////////////////////////////////
+
+#include "main.h"
+#include "bench.h"
+#include "cpu.h"
+#include "scale2x.h"
+#include "scale2x_simd.h"
+#include "freeimage.h"
+#include "mipmap.h"
+#include "filecache.h"
+#include "hash.h"
+#include <math.h>
+
+#define BENCH_WIDTH  2048
+#define BENCH_HEIGHT 2048
+#define BENCH_RUNS   5
+#define BENCH_SUPER2X_PSNR 30.0 // native super2x should be at least this close to FreeImage passes
+#define BENCH_FILECACHE_LINEAR 10000 // largest files cache that is also searched linearly
+#define BENCH_HASH_SIZE  (64 * 1048576)
+#define BENCH_HASH_BLOCK 4096
+#define BENCH_HASH_SHORT 200 // lengths 1..BENCH_HASH_SHORT are checked against reference
+
+/*
+==========================================================================================
+
+  Helpers
+
+  Every image kernel is a row of bench_cases: reference (code which was used before)
+  and new kernel run on the same test image, kernel output is compared with reference.
+  Kernels with several code paths are run once per path
+
+==========================================================================================
+*/
+
+static int bench_mismatches; // results which differ from reference, makes Bench_Run fail
+
+typedef struct
+{
+	int    width;
+	int    height;
+	int    bpp;
+	int    parm;      // kernel parameter from bench_cases
+	byte  *src;       // test image
+	size_t srcsize;
+	byte  *out;       // output of a run, kernels working in place get a copy of src in it
+	size_t outsize;
+	byte  *refout;    // reference output
+	byte  *firstout;  // output of first code path
+	char   note[64];  // difference from reference, set by compare function
+} BenchData;
+
+typedef struct
+{
+	const char *title;
+	int         width;
+	int         height;
+	int         bpp;
+	int         parm;
+	int         refruns;                        // reference may be too slow to run BENCH_RUNS times
+	bool        inplace;
+	void      (*prepare)(BenchData *b);         // adjust test image, may be NULL
+	size_t    (*outsize)(BenchData *b);         // NULL if output is same size as test image
+	const char *refname;
+	void      (*reference)(BenchData *b);
+	const char *name;
+	void      (*kernel)(BenchData *b);
+	bool      (*usebackend)(const char *name);  // selects kernel code path, NULL if there is only one
+	bool      (*compare)(BenchData *b);         // NULL compares output bytes
+} BenchCase;
+
+// test image: gradients with some noise, like a typical texture
+static byte *Bench_CreateImage(int width, int height, int bpp)
+{
+	byte *data, *out;
+	unsigned int seed = 12345;
+	int x, y, c;
+
+	data = (byte *)mem_alloc(width * height * bpp);
+	out = data;
+	for (y = 0; y < height; y++)
+	{
+		for (x = 0; x < width; x++)
+		{
+			for (c = 0; c < bpp; c++)
+			{
+				seed = seed * 1103515245 + 12345;
+				out[c] = (byte)(((x * (c + 1) + y * (3 - c)) / 8 + ((seed >> 16) & 15)) & 255);
+			}
+			out += bpp;
+		}
+	}
+	return data;
+}
+
+// run routine several times, return best time in seconds
+static double Bench_Time(const BenchCase *bc, void (*func)(BenchData *b), BenchData *b, int runs)
+{
+	double start, time, best;
+	int i;
+
+	best = 0;
+	for (i = 0; i < runs; i++)
+	{
+		if (bc->inplace)
+			memcpy(b->out, b->src, b->srcsize);
+		start = I_DoubleTime();
+		func(b);
+		time = I_DoubleTime() - start;
+		if (i == 0 || time < best)
+			best = time;
+	}
+	return best;
+}
+
+// PSNR of result against reference
+static double Bench_Difference(const byte *reference, const byte *result, size_t size, int *maxerror)
+{
+	double error;
+	size_t i;
+	int diff;
+
+	error = 0;
+	*maxerror = 0;
+	for (i = 0; i < size; i++)
+	{
+		diff = abs((int)reference[i] - (int)result[i]);
+		*maxerror = max(*maxerror, diff);
+		error += diff * diff;
+	}
+	if (size)
+		error /= (double)size;
+	return (error > 0) ? 10.0 * log10(255.0 * 255.0 / error) : 99.0;
+}
+
+static void Bench_PrintResult(const char *name, double time, double reference, bool match)
+{
+	if (!match)
+		bench_mismatches++;
+	if (reference > 0)
+		Print("  %-22s %9.2f ms %7.1fx%s\n", name, time * 1000.0, reference / max(time, 0.000001), match ? "" : " MISMATCH");
+	else
+		Print("  %-22s %9.2f ms%s\n", name, time * 1000.0, match ? "" : " MISMATCH");
+}
+
+static void Bench_RunCase(const BenchCase *bc)
+{
+	const char *backends[] = { "generic", "SSE2", "AVX2" };
+	double reference, time;
+	char name[64];
+	BenchData b;
+	bool first, match;
+	int i;
+
+	memset(&b, 0, sizeof(b));
+	b.width = bc->width;
+	b.height = bc->height;
+	b.bpp = bc->bpp;
+	b.parm = bc->parm;
+	b.srcsize = (size_t)b.width * b.height * b.bpp;
+	b.src = Bench_CreateImage(b.width, b.height, b.bpp);
+	if (bc->prepare)
+		bc->prepare(&b);
+	b.outsize = bc->outsize ? bc->outsize(&b) : b.srcsize;
+	b.out = (byte *)mem_alloc(b.outsize);
+	b.refout = (byte *)mem_alloc(b.outsize);
+	b.firstout = (byte *)mem_alloc(b.outsize);
+	Print("%s, %ix%i %s:\n", bc->title, b.width, b.height, (b.bpp == 4) ? "RGBA" : "RGB");
+
+	memset(b.out, 0, b.outsize);
+	reference = Bench_Time(bc, bc->reference, &b, bc->refruns);
+	memcpy(b.refout, b.out, b.outsize);
+	Bench_PrintResult(bc->refname, reference, 0, true);
+	first = true;
+	for (i = 0; i < 3; i++)
+	{
+		if (bc->usebackend)
+		{
+			if (!bc->usebackend(backends[i]))
+				continue;
+			sprintf(name, "%s (%s)", bc->name, backends[i]);
+		}
+		else
+			strlcpy(name, bc->name, sizeof(name));
+		memset(b.out, 0, b.outsize);
+		time = Bench_Time(bc, bc->kernel, &b, BENCH_RUNS);
+		if (first)
+			memcpy(b.firstout, b.out, b.outsize);
+		first = false;
+		b.note[0] = 0;
+		match = bc->compare ? bc->compare(&b) : !memcmp(b.refout, b.out, b.outsize);
+		Bench_PrintResult(name, time, reference, match);
+		if (b.note[0])
+			Print("  %-22s %s\n", "difference", b.note);
+		if (!bc->usebackend)
+			break;
+	}
+	if (bc->usebackend)
+		bc->usebackend(NULL);
+
+	mem_free(b.src);
+	mem_free(b.out);
+	mem_free(b.refout);
+	mem_free(b.firstout);
+}
+
+/*
+==========================================================================================
+
+  sRGB conversion
+
+  parm is 1 for linear to sRGB, 0 for sRGB to linear
+
+==========================================================================================
+*/
+
+// per-pixel math which was used before conversion tables
+static void Bench_SRGB_Reference(BenchData *b)
+{
+	byte *in, *end;
+	float c;
+	int i;
+
+	in = b->out;
+	end = in + b->srcsize;
+	for (; in < end; in += b->bpp)
+	{
+		for (i = 0; i < 3; i++)
+		{
+			c = (float)in[i] / 255.0f;
+			if (b->parm)
+				c = (c < 0.0031308f) ? c * 12.92f : 1.055f * (float)pow(c, 1.0f/2.4f) - 0.055f;
+			else
+				c = (c <= 0.04045f) ? c * (1.0f / 12.92f) : (float)pow((c + 0.055f)*(1.0f/1.055f), 2.4f);
+			in[i] = (byte)floor(c * 255.0f + 0.5f);
+		}
+	}
+}
+
+static void Bench_SRGB(BenchData *b)
+{
+	ImageData_ConvertSRGB(b->out, b->width, b->height, b->width * b->bpp, b->bpp, b->parm ? false : true, b->parm ? true : false);
+}
+
+/*
+==========================================================================================
+
+  Map preprocessing
+
+  parm is index in bench_preprocess
+
+==========================================================================================
+*/
+
+typedef struct
+{
+	bool   binaryAlpha;
+	bool   toSRGB;
+	bool   swap;
+	void (*swizzle)(byte *data, int width, int height, int pitch, int bpp, bool rgbSwap, bool sRGB, bool decode);
+} BenchPreprocess;
+
+static BenchPreprocess bench_preprocess[] =
+{
+	{ false, true, true, NULL },
+	{ true,  true, true, NULL },
+	{ false, true, true, Swizzle_YCoCg }
+};
+
+static void Bench_PreprocessMap(BenchData *b, bool fused)
+{
+	BenchPreprocess *p = &bench_preprocess[b->parm];
+	MapProcessParms parms;
+	ImageMap map;
+
+	memset(&map, 0, sizeof(map));
+	memset(&parms, 0, sizeof(parms));
+	map.width = b->width;
+	map.height = b->height;
+	map.data = b->out;
+	parms.BinaryAlpha = p->binaryAlpha;
+	parms.ConvertTosRGB = p->toSRGB;
+	parms.SwapColors = p->swap;
+	parms.ColorSwizzle = p->swizzle;
+	if (fused)
+		PreprocessMap_SelectKernel(&parms, b->bpp);
+	PreprocessMap(&map, &parms, b->bpp, false);
+}
+
+static void Bench_Preprocess_Reference(BenchData *b)
+{
+	Bench_PreprocessMap(b, false);
+}
+
+static void Bench_Preprocess(BenchData *b)
+{
+	Bench_PreprocessMap(b, true);
+}
+
+/*
+==========================================================================================
+
+  Image statistics
+
+  Output is ImageStats
+
+==========================================================================================
+*/
+
+static size_t Bench_Stats_Size(BenchData *b)
+{
+	return sizeof(ImageStats);
+}
+
+// separate passes which were done before statistics: alpha type, color range, average color, sRGB probe
+// arithmetic matches ImageData_CalcStats, so every field callers read is compared exactly
+static void Bench_Stats_Reference(BenchData *b)
+{
+	ImageStats *stats = (ImageStats *)b->out;
+	double avgcolor[3], samples;
+	size_t num_grad, need_grad, pixels;
+	unsigned int luma;
+	byte *in, *end;
+	int c;
+
+	memset(stats, 0, sizeof(ImageStats));
+	pixels = (size_t)b->width * b->height;
+	end = b->src + b->srcsize;
+	stats->valid = true;
+	stats->pixels = pixels;
+	if (b->bpp == 4)
+	{
+		for (in = b->src; in < end; in += 4)
+			stats->alphaHistogram[in[3]]++;
+		num_grad = 0;
+		need_grad = (int)(b->width*b->height*(100.0f - tex_binaryAlphaThreshold)/100.0f);
+		for (c = tex_binaryAlphaMin; c <= tex_binaryAlphaMax; c++)
+			num_grad += stats->alphaHistogram[c];
+		stats->gradientAlpha = (pixels > 0 && num_grad > need_grad) ? true : false;
+	}
+	for (c = 0; c < 4; c++)
+	{
+		stats->minColor[c] = 255;
+		stats->maxColor[c] = (c < b->bpp) ? 0 : 255;
+	}
+	for (in = b->src; in < end; in += b->bpp)
+	{
+		for (c = 0; c < b->bpp; c++)
+		{
+			stats->minColor[c] = min(stats->minColor[c], in[c]);
+			stats->maxColor[c] = max(stats->maxColor[c], in[c]);
+		}
+	}
+	avgcolor[0] = avgcolor[1] = avgcolor[2] = samples = 0;
+	for (in = b->src; in < end; in += b->bpp)
+	{
+		if (in[0] != 0 || in[1] != 0 || in[2] != 0)
+		{
+			avgcolor[0] += in[0];
+			avgcolor[1] += in[1];
+			avgcolor[2] += in[2];
+			samples++;
+		}
+	}
+	for (c = 0; c < 3 && samples > 0; c++)
+		stats->averageColor[c] = (byte)min(255.0, avgcolor[c] / samples);
+	for (in = b->src; in < end; in += b->bpp)
+	{
+		if ((in[0] == 0 && in[1] == 0 && in[2] == 0) || (b->bpp == 4 && in[3] == 0))
+			continue;
+		luma = in[0] * 299 + in[1] * 587 + in[2] * 114;
+		if (luma > 30000)
+			stats->brightPixels++;
+		else
+			stats->darkPixels++;
+	}
+}
+
+static void Bench_Stats(BenchData *b)
+{
+	ImageData_CalcStats(b->src, b->width, b->height, b->width * b->bpp, b->bpp, false, (ImageStats *)b->out);
+}
+
+// all fields but state, which is filled by Image_GetStats
+static bool Bench_Stats_Compare(BenchData *b)
+{
+	const ImageStats *a = (const ImageStats *)b->refout;
+	const ImageStats *s = (const ImageStats *)b->out;
+
+	if (a->valid != s->valid || a->pixels != s->pixels || a->gradientAlpha != s->gradientAlpha)
+		return false;
+	if (memcmp(a->alphaHistogram, s->alphaHistogram, sizeof(a->alphaHistogram)))
+		return false;
+	if (memcmp(a->minColor, s->minColor, sizeof(a->minColor)) || memcmp(a->maxColor, s->maxColor, sizeof(a->maxColor)))
+		return false;
+	if (memcmp(a->averageColor, s->averageColor, sizeof(a->averageColor)))
+		return false;
+	return (a->darkPixels == s->darkPixels && a->brightPixels == s->brightPixels) ? true : false;
+}
+
+/*
+==========================================================================================
+
+  Scale2x
+
+  parm is scale factor
+
+==========================================================================================
+*/
+
+// few colors, so edges are found
+static void Bench_Scale2x_Prepare(BenchData *b)
+{
+	size_t i;
+
+	for (i = 0; i < b->srcsize; i++)
+		b->src[i] &= 0xC0;
+}
+
+static size_t Bench_Scale2x_Size(BenchData *b)
+{
+	return b->srcsize * b->parm * b->parm;
+}
+
+// sxScale takes only 32-bit pixels, so 24-bit images were converted to 32 bit and back
+static void Bench_Scale2x_Reference(BenchData *b)
+{
+	byte *src32, *dst32, *in, *out, *end;
+	int factor = b->parm;
+
+	if (b->bpp == 4)
+	{
+		sxScale(factor, b->out, b->width * factor * 4, b->src, b->width * 4, 4, b->width, b->height);
+		return;
+	}
+	src32 = (byte *)Thread_Scratch(NULL, 0, (size_t)b->width * b->height * 4);
+	dst32 = (byte *)Thread_Scratch(NULL, 1, (size_t)b->width * b->height * factor * factor * 4);
+	end = b->src + b->srcsize;
+	for (in = b->src, out = src32; in < end; in += 3, out += 4)
+	{
+		out[0] = in[0];
+		out[1] = in[1];
+		out[2] = in[2];
+		out[3] = 0;
+	}
+	sxScale(factor, dst32, b->width * factor * 4, src32, b->width * 4, 4, b->width, b->height);
+	end = dst32 + (size_t)b->width * b->height * factor * factor * 4;
+	for (in = dst32, out = b->out; in < end; in += 4, out += 3)
+	{
+		out[0] = in[0];
+		out[1] = in[1];
+		out[2] = in[2];
+	}
+}
+
+static void Bench_Scale2x(BenchData *b)
+{
+	Scale2x_Scale(b->parm, b->out, b->width * b->parm * b->bpp, b->src, b->width * b->bpp, b->bpp, b->width, b->height);
+}
+
+/*
+==========================================================================================
+
+  Super2x
+
+  FreeImage passes against native fused implementation, which is not bit-exact
+  (resamplers differ at edges and in rounding), so it's compared by PSNR.
+  Image setup is timed too, it is small next to scaling
+
+==========================================================================================
+*/
+
+// few colors so scale2x finds edges, half of pixels are transparent
+static void Bench_Super2x_Prepare(BenchData *b)
+{
+	size_t i;
+
+	for (i = 0; i < b->srcsize; i++)
+		b->src[i] &= (b->bpp == 4 && (i & 3) == 3) ? 0x80 : 0xC0;
+}
+
+static size_t Bench_Super2x_Size(BenchData *b)
+{
+	return b->srcsize * 4;
+}
+
+static void Bench_Super2x_Scale(BenchData *b, bool native)
+{
+	LoadedImage *image;
+	byte *data;
+	int y, pitch;
+	bool saved;
+
+	saved = tex_nativeSuper2x;
+	tex_nativeSuper2x = native;
+	image = Image_Create();
+	Image_Generate(image, b->width, b->height, b->bpp);
+	data = fiGetData(image->bitmap, &pitch);
+	for (y = 0; y < b->height; y++)
+		memcpy(data + y * pitch, b->src + y * b->width * b->bpp, b->width * b->bpp);
+	Image_ScaleBy2(image, IMAGE_SCALER_SUPER2X, false, NULL);
+	if (image->width == b->width * 2 && image->height == b->height * 2 && image->bpp == b->bpp)
+	{
+		data = fiGetData(image->bitmap, &pitch);
+		for (y = 0; y < image->height; y++)
+			memcpy(b->out + y * image->width * b->bpp, data + y * pitch, image->width * b->bpp);
+	}
+	Image_Delete(image);
+	tex_nativeSuper2x = saved;
+}
+
+static void Bench_Super2x_Reference(BenchData *b)
+{
+	Bench_Super2x_Scale(b, false);
+}
+
+static void Bench_Super2x(BenchData *b)
+{
+	Bench_Super2x_Scale(b, true);
+}
+
+static bool Bench_Super2x_Compare(BenchData *b)
+{
+	double psnr;
+	int maxerror;
+
+	psnr = Bench_Difference(b->refout, b->out, b->outsize, &maxerror);
+	sprintf(b->note, "%9.2f dB, max error %i", psnr, maxerror);
+	return (psnr >= BENCH_SUPER2X_PSNR) ? true : false;
+}
+
+/*
+==========================================================================================
+
+  Mipmaps
+
+  FreeImage lanczos rescale, which generated mips before, against native downsampler,
+  parm is 1 for sRGB. Code paths are checked against generic one, it may differ by 1
+  if compiler keeps floats in x87 registers. Native filters sRGB images in linear light,
+  so difference from FreeImage is only shown for linear data
+
+==========================================================================================
+*/
+
+static size_t Bench_Mip_Size(BenchData *b)
+{
+	return (size_t)(b->width / 2) * (b->height / 2) * b->bpp;
+}
+
+static void Bench_Mip_Reference(BenchData *b)
+{
+	FIBITMAP *bitmap, *scaled;
+	byte *data;
+	int y, pitch, linesize;
+
+	bitmap = fiCreate(b->width, b->height, b->bpp, "Bench_Mip");
+	data = fiGetData(bitmap, &pitch);
+	for (y = 0; y < b->height; y++)
+		memcpy(data + y * pitch, b->src + y * b->width * b->bpp, b->width * b->bpp);
+	scaled = fiRescale(bitmap, b->width / 2, b->height / 2, FILTER_LANCZOS3, true);
+	data = fiGetData(scaled, &pitch);
+	linesize = (b->width / 2) * b->bpp;
+	for (y = 0; y < b->height / 2; y++)
+		memcpy(b->out + y * linesize, data + y * pitch, linesize);
+	fiFree(scaled);
+}
+
+static void Bench_Mip(BenchData *b)
+{
+	Mip_Downsample(b->src, b->width, b->height, b->width * b->bpp, b->out, b->width / 2, b->height / 2, (b->width / 2) * b->bpp, b->bpp, IMAGE_SCALER_LANCZOS, b->parm ? true : false);
+}
+
+static bool Bench_Mip_Compare(BenchData *b)
+{
+	double psnr;
+	int maxerror;
+
+	if (!b->parm)
+	{
+		psnr = Bench_Difference(b->refout, b->out, b->outsize, &maxerror);
+		sprintf(b->note, "%9.2f dB, max error %i", psnr, maxerror);
+	}
+	Bench_Difference(b->firstout, b->out, b->outsize, &maxerror);
+	return (maxerror <= 1) ? true : false;
+}
+
+/*
+==========================================================================================
+
+  Image kernels
+
+==========================================================================================
+*/
+
+#define BENCH_SRGB(title, bpp, parm) { title, BENCH_WIDTH, BENCH_HEIGHT, bpp, parm, 1, true, NULL, NULL, "pow", Bench_SRGB_Reference, "table", Bench_SRGB, NULL, NULL }
+#define BENCH_STATS(bpp) { "Image statistics", BENCH_WIDTH, BENCH_HEIGHT, bpp, 0, BENCH_RUNS, false, NULL, Bench_Stats_Size, "separate passes", Bench_Stats_Reference, "single pass", Bench_Stats, NULL, Bench_Stats_Compare }
+#define BENCH_SCALE2X(title, bpp, factor) { title, BENCH_WIDTH / 2, BENCH_HEIGHT / 2, bpp, factor, BENCH_RUNS, false, Bench_Scale2x_Prepare, Bench_Scale2x_Size, (bpp == 4) ? "sxScale" : "sxScale + conversion", Bench_Scale2x_Reference, "rows", Bench_Scale2x, Scale2x_UseBackend, NULL }
+#define BENCH_SUPER2X(bpp) { "Super2x", BENCH_WIDTH / 4, BENCH_HEIGHT / 4, bpp, 0, BENCH_RUNS, false, Bench_Super2x_Prepare, Bench_Super2x_Size, "FreeImage passes", Bench_Super2x_Reference, "native", Bench_Super2x, Scale2x_UseBackend, Bench_Super2x_Compare }
+#define BENCH_MIP(title, bpp, sRGB) { title, BENCH_WIDTH, BENCH_HEIGHT, bpp, sRGB, BENCH_RUNS, false, NULL, Bench_Mip_Size, "FreeImage lanczos", Bench_Mip_Reference, "native", Bench_Mip, Mip_UseBackend, Bench_Mip_Compare }
+#define BENCH_PREPROCESS(title, bpp, parm) { title, BENCH_WIDTH, BENCH_HEIGHT, bpp, parm, BENCH_RUNS, true, NULL, NULL, "separate passes", Bench_Preprocess_Reference, "fused kernel", Bench_Preprocess, NULL, NULL }
+
+static BenchCase bench_cases[] =
+{
+	BENCH_SRGB("sRGB conversion, linear to sRGB", 3, 1),
+	BENCH_SRGB("sRGB conversion, sRGB to linear", 3, 0),
+	BENCH_SRGB("sRGB conversion, linear to sRGB", 4, 1),
+	BENCH_SRGB("sRGB conversion, sRGB to linear", 4, 0),
+	BENCH_STATS(3),
+	BENCH_STATS(4),
+	BENCH_SCALE2X("Scale2x", 3, 2),
+	BENCH_SCALE2X("Scale3x", 3, 3),
+	BENCH_SCALE2X("Scale4x", 3, 4),
+	BENCH_SCALE2X("Scale2x", 4, 2),
+	BENCH_SCALE2X("Scale3x", 4, 3),
+	BENCH_SCALE2X("Scale4x", 4, 4),
+	BENCH_SUPER2X(3),
+	BENCH_SUPER2X(4),
+	BENCH_MIP("Mipmaps, lanczos", 3, 0),
+	BENCH_MIP("Mipmaps, lanczos, sRGB", 3, 1),
+	BENCH_MIP("Mipmaps, lanczos", 4, 0),
+	BENCH_MIP("Mipmaps, lanczos, sRGB", 4, 1),
+	BENCH_PREPROCESS("Map preprocessing, sRGB + swap", 3, 0),
+	BENCH_PREPROCESS("Map preprocessing, sRGB + swap", 4, 0),
+	BENCH_PREPROCESS("Map preprocessing, binary alpha + sRGB + swap", 4, 1),
+	BENCH_PREPROCESS("Map preprocessing, sRGB + YCoCg + swap", 4, 2),
+	{ NULL }
+};
+
+/*
+==========================================================================================
+
+  Files cache
+
+  Binary cache (mapped hash table) against linear search in a list of entries,
+  like files cache was before. List is O(n^2) for a tree, so only smallest size is tried
+
+==========================================================================================
+*/
+
+typedef struct
+{
+	char         filename[MAX_FPATH];
+	unsigned int crc;
+	bool         used;
+} BenchCacheEntry;
+
+static void Bench_FileCache_Key(char *key, int i)
+{
+	sprintf(key, "textures/set%03i/texture_%07i.tga", i % 997, i);
+}
+
+static unsigned int Bench_FileCache_CRC(int i)
+{
+	return (unsigned int)i * 2654435761u;
+}
+
+static void Bench_FileCache_FindThread(ThreadData *thread)
+{
+	FileCacheInfo info;
+	char key[MAX_FPATH];
+	int work;
+
+	while((work = GetWorkForThread(thread)) != -1)
+	{
+		Bench_FileCache_Key(key, work);
+		if (!FileCache_Find(key, &info) || info.crc != Bench_FileCache_CRC(work))
+			Thread_AtomicAdd((volatile int *)thread->data, 1);
+	}
+}
+
+static void Bench_FileCache(void)
+{
+	int sizes[] = { 10000, 100000, 1000000 };
+	BenchCacheEntry *list;
+	FileCacheInfo info;
+	char key[MAX_FPATH], filename[MAX_FPATH], name[64];
+	double start, time, reference;
+	volatile int missing;
+	int i, j, n, s;
+	FILE *f;
+
+	TempFileName(filename);
+	for (s = 0; s < 3; s++)
+	{
+		n = sizes[s];
+		Print("Files cache, %i entries:\n", n);
+		memset(&info, 0, sizeof(info));
+
+		// old linear list
+		reference = 0;
+		if (n <= BENCH_FILECACHE_LINEAR)
+		{
+			list = (BenchCacheEntry *)mem_alloc(sizeof(BenchCacheEntry) * n);
+			for (i = 0; i < n; i++)
+			{
+				Bench_FileCache_Key(list[i].filename, i);
+				list[i].crc = Bench_FileCache_CRC(i);
+				list[i].used = false;
+			}
+			missing = 0;
+			start = I_DoubleTime();
+			for (i = 0; i < n; i++)
+			{
+				Bench_FileCache_Key(key, i);
+				for (j = 0; j < n; j++)
+					if (!strnicmp(list[j].filename, key, MAX_FPATH))
+						break;
+				if (j == n || list[j].crc != Bench_FileCache_CRC(i))
+					missing++;
+				else
+					list[j].used = true;
+			}
+			reference = I_DoubleTime() - start;
+			Bench_PrintResult("find (linear list)", reference, 0, !missing);
+			mem_free(list);
+		}
+
+		// fill, save, load and look up all entries
+		FileCache_Free();
+		start = I_DoubleTime();
+		for (i = 0; i < n; i++)
+		{
+			Bench_FileCache_Key(key, i);
+			info.crc = Bench_FileCache_CRC(i);
+			FileCache_Update(key, &info, true);
+		}
+		Bench_PrintResult("update", I_DoubleTime() - start, 0, FileCache_NumEntries() == n);
+		start = I_DoubleTime();
+		FileCache_Save(filename);
+		Bench_PrintResult("save", I_DoubleTime() - start, 0, true);
+		start = I_DoubleTime();
+		FileCache_Load(filename);
+		Bench_PrintResult("load (mapped)", I_DoubleTime() - start, 0, FileCache_NumEntries() == n);
+		missing = 0;
+		start = I_DoubleTime();
+		for (i = 0; i < n; i++)
+		{
+			Bench_FileCache_Key(key, i);
+			if (!FileCache_Find(key, &info) || info.crc != Bench_FileCache_CRC(i))
+				missing++;
+		}
+		time = I_DoubleTime() - start;
+		Bench_PrintResult("find", time, reference, !missing);
+		missing = 0;
+		start = I_DoubleTime();
+		ParallelThreads(max(1, numthreads), n, (void *)&missing, Bench_FileCache_FindThread);
+		sprintf(name, "find (%i threads)", max(1, numthreads));
+		Bench_PrintResult(name, I_DoubleTime() - start, reference, !missing);
+		for (i = 0; i < n; i++)
+		{
+			Bench_FileCache_Key(key, n + i);
+			if (FileCache_Find(key, &info))
+				missing++;
+		}
+		if (missing)
+			Print("  %i lookups failed\n", missing);
+
+		// resave loaded cache, entries are taken from mapped file
+		start = I_DoubleTime();
+		FileCache_Save(filename);
+		Bench_PrintResult("resave", I_DoubleTime() - start, 0, true);
+		f = fopen(filename, "rb");
+		if (f)
+		{
+			fseek(f, 0, SEEK_END);
+			Print("  %-22s %9.2f mb\n", "file size", ftell(f) / 1048576.0);
+			fclose(f);
+		}
+	}
+	FileCache_Free();
+	remove(filename);
+}
+
+/*
+==========================================================================================
+
+  Hashing
+
+  CRC32 code paths against byte-at-a-time table which was used before, on a big buffer
+  (source files, ZIP entries) and on small blocks, where setup costs show up.
+  Short and odd lengths at unaligned addresses, and crc of a buffer hashed in two parts,
+  are checked separately as they go through tail code of vectorized paths.
+  64-bit hash is checked against known values with and without seed, and compared by speed
+
+==========================================================================================
+*/
+
+typedef unsigned int (*BenchHash)(unsigned int crc, const void *data, size_t size);
+
+static unsigned int bench_crcTable[256];
+
+static unsigned int Bench_CRC32_Reference(unsigned int crc, const void *data, size_t size)
+{
+	const byte *in = (const byte *)data;
+
+	crc = ~crc;
+	for (; size > 0; size--, in++)
+		crc = (crc >> 8) ^ bench_crcTable[(crc ^ *in) & 0xFF];
+	return ~crc;
+}
+
+static unsigned int Bench_Hash64(unsigned int crc, const void *data, size_t size)
+{
+	return (unsigned int)Hash_64(data, size, crc);
+}
+
+// best time of hashing buffer by blocks, hashes of blocks are xor-ed into result
+static double Bench_Hash_Time(BenchHash func, const byte *data, size_t size, size_t blocksize, unsigned int *result)
+{
+	double start, time, best;
+	size_t offset;
+	int i;
+
+	best = 0;
+	for (i = 0; i < BENCH_RUNS; i++)
+	{
+		start = I_DoubleTime();
+		*result = 0;
+		for (offset = 0; offset < size; offset += blocksize)
+			*result ^= func(0, data + offset, min(blocksize, size - offset));
+		time = I_DoubleTime() - start;
+		if (i == 0 || time < best)
+			best = time;
+	}
+	return best;
+}
+
+static void Bench_Hash_PrintSpeed(const char *name, double time, double reference, bool match)
+{
+	double speed = BENCH_HASH_SIZE / max(time, 0.000001) / 1073741824.0;
+
+	if (!match)
+		bench_mismatches++;
+	if (reference > 0)
+		Print("  %-22s %9.2f ms %7.1fx %6.2f GB/s%s\n", name, time * 1000.0, reference / max(time, 0.000001), speed, match ? "" : " MISMATCH");
+	else
+		Print("  %-22s %9.2f ms %15.2f GB/s%s\n", name, time * 1000.0, speed, match ? "" : " MISMATCH");
+}
+
+static void Bench_Hash_PrintCheck(const char *name, bool match)
+{
+	if (!match)
+		bench_mismatches++;
+	Print("  %-22s %s\n", name, match ? "ok" : "MISMATCH");
+}
+
+// xxHash64 of bytes i*7+3, lengths go through stripe loop and every tail path
+typedef struct
+{
+	size_t           length;
+	unsigned __int64 seed;
+	unsigned __int64 hash;
+} BenchHashVector;
+
+static BenchHashVector bench_xxh64Vectors[] =
+{
+	{ 0,   0,     0xEF46DB3751D8E999ull },
+	{ 1,   0,     0x1F25C8D0BC1F4BB6ull },
+	{ 4,   0,     0x9BB64B7D66EE9FDAull },
+	{ 8,   0,     0xDAB99D95C6F90092ull },
+	{ 31,  0,     0xA2AA5F33CC4A6119ull },
+	{ 32,  0,     0x23C3C17EF790FD97ull },
+	{ 103, 0,     0x9CE1E302796DFBC9ull },
+	{ 0,   12345, 0x95584AF7701F808Dull },
+	{ 1,   12345, 0x9102786A712FF044ull },
+	{ 4,   12345, 0x6A3181371BBC2026ull },
+	{ 8,   12345, 0xBBCC4601A016B1E4ull },
+	{ 31,  12345, 0x8086BF60119A7308ull },
+	{ 32,  12345, 0x244C3905CF320C2Dull },
+	{ 103, 12345, 0x44D3BA994DE6A947ull },
+	{ 0 }
+};
+
+static bool Bench_Hash64_Check(void)
+{
+	byte data[256];
+	int i;
+
+	for (i = 0; i < 256; i++)
+		data[i] = (byte)(i * 7 + 3);
+	for (i = 0; bench_xxh64Vectors[i].hash; i++)
+		if (Hash_64(data, bench_xxh64Vectors[i].length, bench_xxh64Vectors[i].seed) != bench_xxh64Vectors[i].hash)
+			return false;
+	return true;
+}
+
+// current crc32 code path against reference on short, odd and split buffers
+static bool Bench_Hash_Check(const byte *data)
+{
+	size_t lengths[BENCH_HASH_SHORT + 1];
+	size_t len, split;
+	unsigned int reference;
+	int i, offset;
+
+	for (i = 0; i < BENCH_HASH_SHORT; i++)
+		lengths[i] = i + 1;
+	lengths[BENCH_HASH_SHORT] = BENCH_HASH_BLOCK + 7;
+	for (i = 0; i <= BENCH_HASH_SHORT; i++)
+	{
+		len = lengths[i];
+		for (offset = 0; offset < 4; offset++)
+		{
+			reference = Bench_CRC32_Reference(0, data + offset, len);
+			if (Hash_CRC32(0, data + offset, len) != reference)
+				return false;
+			for (split = 1; split < len; split += 1 + split / 2)
+				if (Hash_CRC32(Hash_CRC32(0, data + offset, split), data + offset + split, len - split) != reference)
+					return false;
+		}
+	}
+	return true;
+}
+
+static void Bench_Hash(void)
+{
+	const char *backends[] = { "slice8", "PCLMUL" };
+	unsigned int crc, reference, result;
+	double reftime, time;
+	size_t blocksize;
+	char name[64];
+	byte *data;
+	bool xxh64;
+	int i, j, pass;
+
+	for (i = 0; i < 256; i++)
+	{
+		crc = (unsigned int)i;
+		for (j = 0; j < 8; j++)
+			crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : (crc >> 1);
+		bench_crcTable[i] = crc;
+	}
+	data = Bench_CreateImage(BENCH_WIDTH, BENCH_HASH_SIZE / BENCH_WIDTH / 4, 4);
+	Print("Hashing, short and odd lengths:\n");
+	for (i = 0; i < 2; i++)
+	{
+		if (!Hash_UseBackend(backends[i]))
+			continue;
+		sprintf(name, "crc32 (%s)", backends[i]);
+		Bench_Hash_PrintCheck(name, Bench_Hash_Check(data));
+	}
+	Hash_UseBackend(NULL);
+	xxh64 = Bench_Hash64_Check();
+	Bench_Hash_PrintCheck("xxHash64 (vectors)", xxh64);
+	for (pass = 0; pass < 2; pass++)
+	{
+		blocksize = pass ? BENCH_HASH_BLOCK : BENCH_HASH_SIZE;
+		Print("Hashing, %i MB %s:\n", BENCH_HASH_SIZE / 1048576, pass ? "in 4 KB blocks" : "buffer");
+		reftime = Bench_Hash_Time(Bench_CRC32_Reference, data, BENCH_HASH_SIZE, blocksize, &reference);
+		Bench_Hash_PrintSpeed("crc32 (byte table)", reftime, 0, true);
+		for (i = 0; i < 2; i++)
+		{
+			if (!Hash_UseBackend(backends[i]))
+				continue;
+			time = Bench_Hash_Time(Hash_CRC32, data, BENCH_HASH_SIZE, blocksize, &result);
+			sprintf(name, "crc32 (%s)", backends[i]);
+			Bench_Hash_PrintSpeed(name, time, reftime, result == reference);
+		}
+		Hash_UseBackend(NULL);
+		time = Bench_Hash_Time(Bench_Hash64, data, BENCH_HASH_SIZE, blocksize, &result);
+		Bench_Hash_PrintSpeed("xxHash64", time, reftime, xxh64);
+	}
+	mem_free(data);
+}
+
+/*
+==========================================================================================
+
+  Main
+
+==========================================================================================
+*/
+
+// returns 1 if any code path gave result different from reference
+int Bench_Run(void)
+{
+	int i;
+
+	bench_mismatches = 0;
+	Print("Benchmarking (%s):\n", CPU_Features());
+	for (i = 0; bench_cases[i].title; i++)
+		Bench_RunCase(&bench_cases[i]);
+	Bench_FileCache();
+	Bench_Hash();
+	Print("\n");
+	if (bench_mismatches)
+	{
+		Print("%i results MISMATCH reference\n", bench_mismatches);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,9 @@
+// bench.h
+#ifndef H_TEX_BENCH_H
+#define H_TEX_BENCH_H
+
+// microbenchmarks of speed critical routines (-bench)
+// every test checks that optimized code gives the same results as reference one
+int Bench_Run(void);
+
+#endif
@@ -20,6 +20,7 @@
 #include "mem.h"
 #include "main.h"
 #include "thread.h"
+#include "hash.h"
 
 // console stuff
 bool verbose;
@@ -1409,48 +1410,20 @@ unsigned short CRC_Value(unsigned short crcvalue)
 
 //=======================================================
 
-/* Return a 32-bit CRC of the contents of the buffer. */
-unsigned int crc_tab[256];
-bool crc_initialized = false;
-
+/* Pick crc32 code path for this CPU, before threads are started. */
 void crc32_init()
 {
-	unsigned long crc, poly;
-	int i, j;
-
-	poly = 0xEDB88320L;
-	for (i = 0; i < 256; i++)
-	{
-		crc = i;
-		for (j = 8; j > 0; j--)
-		{
-			if (crc & 1)
-			{
-				crc = (crc >> 1) ^ poly;
-			}
-			else
-			{
-				crc >>= 1;
-			}
-		}
-		crc_tab[i] = crc;
-	}
-
-	crc_initialized = true;
+	Hash_UseBackend(NULL);
 }
 
+/* Return a 32-bit CRC of the contents of the buffer. */
 unsigned int crc32(unsigned char *block, unsigned int length)
 {
-   register unsigned long crc;
-   unsigned long i;
-
-   if (!crc_initialized)
-	   crc32_init();
+   return crc32_update(0, block, length);
+}
 
-   crc = 0xFFFFFFFF;
-   for (i = 0; i < length; i++)
-   {
-      crc = ((crc >> 8) & 0x00FFFFFF) ^ crc_tab[(crc ^ *block++) & 0xFF];
-   }
-   return (crc ^ 0xFFFFFFFF);
+/* Continue a 32-bit CRC with more data, crc32_update(crc32(a), b) == crc32(ab). */
+unsigned int crc32_update(unsigned int crcvalue, const unsigned char *block, unsigned int length)
+{
+   return Hash_CRC32(crcvalue, block, length);
 }
\ No newline at end of file
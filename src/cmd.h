@@ -141,6 +141,7 @@ extern void CRC_ProcessByte(unsigned short *crcvalue, byte data);
 extern unsigned short CRC_Value(unsigned short crcvalue);
 
 unsigned int crc32(unsigned char *block, unsigned int length);
+unsigned int crc32_update(unsigned int crcvalue, const unsigned char *block, unsigned int length);
 
 extern void COM_CreatePath (char *path);
 extern void crc32_init();
@@ -198,10 +198,7 @@ void Swizzle_Premult(byte *data, int width, int height, int pitch, int bpp, bool
 		byte *end = in + width*bpp;
 		while(in < end)
 		{
-			float mod = (float)in[3] / 255.0f;
-			in[0] = (byte)(in[0] * mod);
-			in[1] = (byte)(in[1] * mod);
-			in[2] = (byte)(in[2] * mod);
+			SwizzlePixel_Premult(in, rgbSwap);
 			in += bpp;
 		}
 		data += pitch;
@@ -239,8 +236,7 @@ void Swizzle_XGBR(byte *data, int width, int height, int pitch, int bpp, bool rg
 		byte *end = in + width*bpp;
 		while(in < end)
 		{
-			in[3] = in[2];
-			in[2] = 0;
+			SwizzlePixel_XGBR(in, rgbSwap);
 			in += bpp;
 		}
 		data += pitch;
@@ -274,25 +270,13 @@ void Swizzle_AGBR(byte *data, int width, int height, int pitch, int bpp, bool rg
 		return;
 	}
 	// encode
-	byte saved;
 	for (y = 0; y < height; y++)
 	{
 		byte *in = data;
 		byte *end = in + width*bpp;
 		while(in < end)
 		{
-			if (rgbSwap == false)
-			{
-				saved = in[0];
-				in[0] = in[3];
-				in[3] = saved;
-			}
-			else
-			{
-				saved = in[2];
-				in[2] = in[3];
-				in[3] = saved;
-			}
+			SwizzlePixel_AGBR(in, rgbSwap);
 			in += bpp;
 		}
 		data += pitch;
@@ -341,26 +325,13 @@ void Swizzle_YCoCg(byte *data, int width, int height, int pitch, int bpp, bool r
 		return;
 	}
 	// encode
-	byte Y, Co, Cg;
 	for (y = 0; y < height; y++)
 	{
 		byte *in = data;
 		byte *end = in + width*bpp;
 		while(in < end)
 		{
-			Y  = ((in[2] + (in[1] << 1) + in[0]) + 2) >> 2;
-			Co = ((((in[2] << 1) - (in[0] << 1)) + 2) >> 2) + 128;
-			Cg = (((-in[2] + (in[1] << 1) - in[0]) + 2) >> 2) + 128;
-			in[0] = in[3];
-			in[1] = (Cg > 255 ? 255 : (Cg < 0 ? 0 : Cg));
-			in[2] = (Co > 255 ? 255 : (Co < 0 ? 0 : Co));
-			in[3] = (Y  > 255 ? 255 : (Y  < 0 ? 0 :  Y));
-			if (rgbSwap == false)
-			{
-				Y = in[2];
-				in[2] = in[0];
-				in[0] = Y;
-			}
+			SwizzlePixel_YCoCg(in, rgbSwap);
 			in += bpp;
 		}
 		data += pitch;
@@ -412,29 +383,13 @@ void Swizzle_YCoCg_Gamma2(byte *data, int width, int height, int pitch, int bpp,
 		return;
 	}
 	// encode
-	byte Y, Co, Cg, R, G, B;
 	for (y = 0; y < height; y++)
 	{
 		byte *in = data;
 		byte *end = in + width*bpp;
 		while(in < end)
 		{
-			R  = (byte)floor(sqrt((float)in[0] / 255.0f) * 255.0f + 0.5f);
-			G  = (byte)floor(sqrt((float)in[1] / 255.0f) * 255.0f + 0.5f);
-			B  = (byte)floor(sqrt((float)in[2] / 255.0f) * 255.0f + 0.5f);
-			Y  = ((B + (G << 1) + R) + 2) >> 2;
-			Co = ((((B << 1) - (R << 1)) + 2) >> 2) + 128;
-			Cg = (((-B + (G << 1) - R) + 2) >> 2) + 128;
-			in[0] = in[3];
-			in[1] = (Cg > 255 ? 255 : (Cg < 0 ? 0 : Cg));
-			in[2] = (Co > 255 ? 255 : (Co < 0 ? 0 : Co));
-			in[3] = (Y  > 255 ? 255 : (Y  < 0 ? 0 :  Y));
-			if (rgbSwap == false)
-			{
-				Y = in[2];
-				in[2] = in[0];
-				in[0] = Y;
-			}
+			SwizzlePixel_YCoCg_Gamma2(in, rgbSwap);
 			in += bpp;
 		}
 		data += pitch;
@@ -486,27 +441,14 @@ void Swizzle_YCoCgScaled(byte *data, int width, int height, int pitch, int bpp,
 		}
 		return;
 	}
-	// encode YCoCg (scale will be applied during compression)
-	byte Y, Co, Cg;
+	// encode
 	for (y = 0; y < height; y++)
 	{
 		byte *in = data;
 		byte *end = in + width*bpp;
 		while(in < end)
 		{
-			Y  = ((in[2] + (in[1] << 1) + in[0]) + 2) >> 2;
-			Co = ((((in[2] << 1) - (in[0] << 1)) + 2) >> 2) + 128;
-			Cg = (((-in[2] + (in[1] << 1) - in[0]) + 2) >> 2) + 128;
-			in[0] = 0;
-			in[1] = (Cg > 255 ? 255 : (Cg < 0 ? 0 : Cg));
-			in[2] = (Co > 255 ? 255 : (Co < 0 ? 0 : Co));
-			in[3] = (Y  > 255 ? 255 : (Y  < 0 ? 0 :  Y));
-			if (rgbSwap == false)
-			{
-				Y = in[2];
-				in[2] = in[0];
-				in[0] = Y;
-			}
+			SwizzlePixel_YCoCgScaled(in, rgbSwap);
 			in += bpp;
 		}
 		data += pitch;
@@ -561,30 +503,14 @@ void Swizzle_YCoCgScaled_Gamma2(byte *data, int width, int height, int pitch, in
 		}
 		return;
 	}
-	// encode YCoCg (scale will be applied during compression)
-	byte Y, Co, Cg, R, G, B;
+	// encode
 	for (y = 0; y < height; y++)
 	{
 		byte *in = data;
 		byte *end = in + width*bpp;
 		while(in < end)
 		{
-			R  = (byte)floor(sqrt((float)in[0] / 255.0f) * 255.0f + 0.5f);
-			G  = (byte)floor(sqrt((float)in[1] / 255.0f) * 255.0f + 0.5f);
-			B  = (byte)floor(sqrt((float)in[2] / 255.0f) * 255.0f + 0.5f);
-			Y  = ((B + (G << 1) + R) + 2) >> 2;
-			Co = ((((B << 1) - (R << 1)) + 2) >> 2) + 128;
-			Cg = (((-B + (G << 1) - R) + 2) >> 2) + 128;
-			in[0] = 0;
-			in[1] = (Cg > 255 ? 255 : (Cg < 0 ? 0 : Cg));
-			in[2] = (Co > 255 ? 255 : (Co < 0 ? 0 : Co));
-			in[3] = (Y  > 255 ? 255 : (Y  < 0 ? 0 :  Y));
-			if (rgbSwap == false)
-			{
-				Y = in[2];
-				in[2] = in[0];
-				in[0] = Y;
-			}
+			SwizzlePixel_YCoCgScaled_Gamma2(in, rgbSwap);
 			in += bpp;
 		}
 		data += pitch;
@@ -39,4 +39,114 @@ void Swizzle_YCoCg_Gamma2(byte *data, int width, int height, int pitch, int bpp,
 void Swizzle_YCoCgScaled(byte *data, int width, int height, int pitch, int bpp, bool rgbSwap, bool sRGB, bool decode);
 void Swizzle_YCoCgScaled_Gamma2(byte *data, int width, int height, int pitch, int bpp, bool rgbSwap, bool sRGB, bool decode);
 
+// per-pixel encoders, shared by swizzle functions and fused map preprocessing
+inline void SwizzlePixel_Premult(byte *in, bool rgbSwap)
+{
+	float mod = (float)in[3] / 255.0f;
+	in[0] = (byte)(in[0] * mod);
+	in[1] = (byte)(in[1] * mod);
+	in[2] = (byte)(in[2] * mod);
+}
+
+inline void SwizzlePixel_XGBR(byte *in, bool rgbSwap)
+{
+	in[3] = in[2];
+	in[2] = 0;
+}
+
+inline void SwizzlePixel_AGBR(byte *in, bool rgbSwap)
+{
+	byte saved;
+	if (rgbSwap == false)
+	{
+		saved = in[0];
+		in[0] = in[3];
+		in[3] = saved;
+	}
+	else
+	{
+		saved = in[2];
+		in[2] = in[3];
+		in[3] = saved;
+	}
+}
+
+inline void SwizzlePixel_YCoCg(byte *in, bool rgbSwap)
+{
+	byte Y, Co, Cg;
+	Y  = ((in[2] + (in[1] << 1) + in[0]) + 2) >> 2;
+	Co = ((((in[2] << 1) - (in[0] << 1)) + 2) >> 2) + 128;
+	Cg = (((-in[2] + (in[1] << 1) - in[0]) + 2) >> 2) + 128;
+	in[0] = in[3];
+	in[1] = (Cg > 255 ? 255 : (Cg < 0 ? 0 : Cg));
+	in[2] = (Co > 255 ? 255 : (Co < 0 ? 0 : Co));
+	in[3] = (Y  > 255 ? 255 : (Y  < 0 ? 0 :  Y));
+	if (rgbSwap == false)
+	{
+		Y = in[2];
+		in[2] = in[0];
+		in[0] = Y;
+	}
+}
+
+inline void SwizzlePixel_YCoCg_Gamma2(byte *in, bool rgbSwap)
+{
+	byte Y, Co, Cg, R, G, B;
+	R  = (byte)floor(sqrt((float)in[0] / 255.0f) * 255.0f + 0.5f);
+	G  = (byte)floor(sqrt((float)in[1] / 255.0f) * 255.0f + 0.5f);
+	B  = (byte)floor(sqrt((float)in[2] / 255.0f) * 255.0f + 0.5f);
+	Y  = ((B + (G << 1) + R) + 2) >> 2;
+	Co = ((((B << 1) - (R << 1)) + 2) >> 2) + 128;
+	Cg = (((-B + (G << 1) - R) + 2) >> 2) + 128;
+	in[0] = in[3];
+	in[1] = (Cg > 255 ? 255 : (Cg < 0 ? 0 : Cg));
+	in[2] = (Co > 255 ? 255 : (Co < 0 ? 0 : Co));
+	in[3] = (Y  > 255 ? 255 : (Y  < 0 ? 0 :  Y));
+	if (rgbSwap == false)
+	{
+		Y = in[2];
+		in[2] = in[0];
+		in[0] = Y;
+	}
+}
+
+inline void SwizzlePixel_YCoCgScaled(byte *in, bool rgbSwap)
+{
+	byte Y, Co, Cg;
+	Y  = ((in[2] + (in[1] << 1) + in[0]) + 2) >> 2;
+	Co = ((((in[2] << 1) - (in[0] << 1)) + 2) >> 2) + 128;
+	Cg = (((-in[2] + (in[1] << 1) - in[0]) + 2) >> 2) + 128;
+	in[0] = 0;
+	in[1] = (Cg > 255 ? 255 : (Cg < 0 ? 0 : Cg));
+	in[2] = (Co > 255 ? 255 : (Co < 0 ? 0 : Co));
+	in[3] = (Y  > 255 ? 255 : (Y  < 0 ? 0 :  Y));
+	if (rgbSwap == false)
+	{
+		Y = in[2];
+		in[2] = in[0];
+		in[0] = Y;
+	}
+}
+
+inline void SwizzlePixel_YCoCgScaled_Gamma2(byte *in, bool rgbSwap)
+{
+	byte Y, Co, Cg, R, G, B;
+	R  = (byte)floor(sqrt((float)in[0] / 255.0f) * 255.0f + 0.5f);
+	G  = (byte)floor(sqrt((float)in[1] / 255.0f) * 255.0f + 0.5f);
+	B  = (byte)floor(sqrt((float)in[2] / 255.0f) * 255.0f + 0.5f);
+	Y  = ((B + (G << 1) + R) + 2) >> 2;
+	Co = ((((B << 1) - (R << 1)) + 2) >> 2) + 128;
+	Cg = (((-B + (G << 1) - R) + 2) >> 2) + 128;
+	in[0] = 0;
+	in[1] = (Cg > 255 ? 255 : (Cg < 0 ? 0 : Cg));
+	in[2] = (Co > 255 ? 255 : (Co < 0 ? 0 : Co));
+	in[3] = (Y  > 255 ? 255 : (Y  < 0 ? 0 :  Y));
+	if (rgbSwap == false)
+	{
+		Y = in[2];
+		in[2] = in[0];
+		in[0] = Y;
+	}
+}
+
 #endif
\ No newline at end of file
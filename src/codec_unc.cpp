@@ -127,10 +127,7 @@ void Swizzle_AlphaInRGB6(byte *data, int width, int height, int pitch, int bpp,
 		byte *end = in + width*bpp;
 		while(in < end)
 		{
-			byte a = (byte)(floor((float)in[3] * (63.0f / 255.0f) + 0.5f));
-			in[0] = (byte)(floor((float)in[0] * (63.0f / 255.0f) + 0.5f) + ((a & 0x3) << 6));
-			in[1] = (byte)(floor((float)in[1] * (63.0f / 255.0f) + 0.5f) + (((a >> 2) & 0x3) << 6));
-			in[2] = (byte)(floor((float)in[2] * (63.0f / 255.0f) + 0.5f) + (((a >> 4) & 0x3) << 6));
+			SwizzlePixel_AlphaInRGB6(in, rgbSwap);
 			in += bpp;
 		}
 		data += pitch;
@@ -171,10 +168,7 @@ void Swizzle_AlphaInRGB3(byte *data, int width, int height, int pitch, int bpp,
 		byte *end = in + width*bpp;
 		while(in < end)
 		{
-			byte a = (byte)(floor((float)in[3] * (7.0f   / 255.0f) + 0.5f));
-			in[0] = (byte)(floor((float)in[0] * (127.0f / 255.0f) + 0.5f) + ((a & 0x1) << 7));
-			in[1] = (byte)(floor((float)in[1] * (127.0f / 255.0f) + 0.5f) + (((a >> 1) & 0x1) << 7));
-			in[2] = (byte)(floor((float)in[2] * (127.0f / 255.0f) + 0.5f) + (((a >> 2) & 0x1) << 7));
+			SwizzlePixel_AlphaInRGB3(in, rgbSwap);
 			in += bpp;
 		}
 		data += pitch;
@@ -213,7 +207,7 @@ void Swizzle_AlphaInRGB1(byte *data, int width, int height, int pitch, int bpp,
 		byte *end = in + width*bpp;
 		while(in < end)
 		{
-			in[2] = min(0x7F, (byte)floor((float)in[2] * (127.0f / 255.0f) + 0.5f) + ((in[3] > tex_binaryAlphaCenter) ? 0x80 : 0));
+			SwizzlePixel_AlphaInRGB1(in, rgbSwap);
 			in += bpp;
 		}
 		data += pitch;
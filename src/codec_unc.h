@@ -29,4 +29,27 @@ void Swizzle_AlphaInRGB6(byte *data, int width, int height, int pitch, int bpp,
 void Swizzle_AlphaInRGB3(byte *data, int width, int height, int pitch, int bpp, bool rgbSwap, bool sRGB, bool decode);
 void Swizzle_AlphaInRGB1(byte *data, int width, int height, int pitch, int bpp, bool rgbSwap, bool sRGB, bool decode);
 
+// per-pixel encoders, shared by swizzle functions and fused map preprocessing
+inline void SwizzlePixel_AlphaInRGB6(byte *in, bool rgbSwap)
+{
+	byte a = (byte)(floor((float)in[3] * (63.0f / 255.0f) + 0.5f));
+	in[0] = (byte)(floor((float)in[0] * (63.0f / 255.0f) + 0.5f) + ((a & 0x3) << 6));
+	in[1] = (byte)(floor((float)in[1] * (63.0f / 255.0f) + 0.5f) + (((a >> 2) & 0x3) << 6));
+	in[2] = (byte)(floor((float)in[2] * (63.0f / 255.0f) + 0.5f) + (((a >> 4) & 0x3) << 6));
+}
+
+inline void SwizzlePixel_AlphaInRGB3(byte *in, bool rgbSwap)
+{
+	byte a = (byte)(floor((float)in[3] * (7.0f   / 255.0f) + 0.5f));
+	in[0] = (byte)(floor((float)in[0] * (127.0f / 255.0f) + 0.5f) + ((a & 0x1) << 7));
+	in[1] = (byte)(floor((float)in[1] * (127.0f / 255.0f) + 0.5f) + (((a >> 1) & 0x1) << 7));
+	in[2] = (byte)(floor((float)in[2] * (127.0f / 255.0f) + 0.5f) + (((a >> 2) & 0x1) << 7));
+}
+
+extern byte tex_binaryAlphaCenter;
+inline void SwizzlePixel_AlphaInRGB1(byte *in, bool rgbSwap)
+{
+	in[2] = min(0x7F, (byte)floor((float)in[2] * (127.0f / 255.0f) + 0.5f) + ((in[3] > tex_binaryAlphaCenter) ? 0x80 : 0));
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,129 @@
+////////////////////////////////////////////////////////////////
+//
+// RwgTex / CPU features detection
+// (c) Pavel [VorteX] Timofeyev
+// See LICENSE text file for a license agreement
+//
+////////////////////////////////
+
+#include "main.h"
+#include "cpu.h"
+
+#ifdef CPU_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+typedef struct
+{
+	bool checked;
+	bool sse2;
+	bool sse41;
+	bool avx2;
+	bool pclmul;
+}CPUFeatures;
+
+static CPUFeatures cpu = { false };
+
+#ifdef CPU_X86
+
+static void CPU_Id(unsigned int leaf, unsigned int subleaf, unsigned int regs[4])
+{
+#ifdef _MSC_VER
+	int r[4];
+	__cpuidex(r, (int)leaf, (int)subleaf);
+	regs[0] = r[0]; regs[1] = r[1]; regs[2] = r[2]; regs[3] = r[3];
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// OS saves AVX registers on context switch
+static bool CPU_OSSavesYMM(void)
+{
+#if defined(_MSC_VER) && _MSC_VER >= 1600
+	return ((_xgetbv(0) & 6) == 6) ? true : false;
+#elif defined(__GNUC__)
+	unsigned int eax, edx;
+	__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((eax & 6) == 6) ? true : false;
+#else
+	return false;
+#endif
+}
+
+#endif
+
+static void CPU_Check(void)
+{
+	if (cpu.checked)
+		return;
+#ifdef CPU_X86
+	unsigned int regs[4], maxleaf;
+
+	CPU_Id(0, 0, regs);
+	maxleaf = regs[0];
+	if (maxleaf >= 1)
+	{
+		CPU_Id(1, 0, regs);
+		cpu.sse2 = (regs[3] & (1 << 26)) ? true : false;
+		cpu.sse41 = (regs[2] & (1 << 19)) ? true : false;
+		cpu.pclmul = (regs[2] & (1 << 1)) ? true : false;
+		// AVX2 needs OSXSAVE, AVX and leaf 7 bit
+		if ((regs[2] & (1 << 27)) && (regs[2] & (1 << 28)) && maxleaf >= 7 && CPU_OSSavesYMM())
+		{
+			CPU_Id(7, 0, regs);
+			cpu.avx2 = (regs[1] & (1 << 5)) ? true : false;
+		}
+	}
+#endif
+	cpu.checked = true;
+}
+
+bool CPU_HasSSE2(void)
+{
+	CPU_Check();
+	return cpu.sse2;
+}
+
+bool CPU_HasSSE41(void)
+{
+	CPU_Check();
+	return cpu.sse41;
+}
+
+bool CPU_HasAVX2(void)
+{
+#ifdef CPU_AVX2_INTRINSICS
+	CPU_Check();
+	return cpu.avx2;
+#else
+	return false;
+#endif
+}
+
+bool CPU_HasPCLMUL(void)
+{
+	CPU_Check();
+	return cpu.pclmul;
+}
+
+const char *CPU_Features(void)
+{
+	static char features[64];
+
+	CPU_Check();
+	features[0] = 0;
+	if (cpu.sse2)   strlcat(features, "SSE2 ", sizeof(features));
+	if (cpu.sse41)  strlcat(features, "SSE4.1 ", sizeof(features));
+	if (CPU_HasAVX2()) strlcat(features, "AVX2 ", sizeof(features));
+	if (cpu.pclmul) strlcat(features, "PCLMUL ", sizeof(features));
+	if (features[0])
+		features[strlen(features) - 1] = 0;
+	else
+		strlcpy(features, "none", sizeof(features));
+	return features;
+}
@@ -0,0 +1,38 @@
+// cpu.h
+#ifndef H_TEX_CPU_H
+#define H_TEX_CPU_H
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPU_X86
+#endif
+
+// SSE2 intrinsics are available on any x86 compiler we use,
+// AVX2 ones need VS2010 or GCC/Clang target attribute
+#ifdef CPU_X86
+#define CPU_SSE2_INTRINSICS
+#if defined(__GNUC__) || (defined(_MSC_VER) && _MSC_VER >= 1600)
+#define CPU_AVX2_INTRINSICS
+#endif
+// carry-less multiply came with VS2008 SP1
+#if defined(__GNUC__) || (defined(_MSC_FULL_VER) && _MSC_FULL_VER >= 150030729)
+#define CPU_PCLMUL_INTRINSICS
+#endif
+#endif
+
+// let compiler generate instructions for a function even if they are not enabled for whole file
+#if defined(__GNUC__) && defined(CPU_X86)
+#define CPU_TARGET(features) __attribute__((target(features)))
+#else
+#define CPU_TARGET(features)
+#endif
+
+// runtime checks
+bool CPU_HasSSE2(void);
+bool CPU_HasSSE41(void);
+bool CPU_HasAVX2(void);
+bool CPU_HasPCLMUL(void);
+
+// short description of detected features
+const char *CPU_Features(void);
+
+#endif
@@ -112,12 +112,13 @@ byte *DDS_CreateHeader(LoadedImage *image, TexFormat *format, size_t *outsize)
 		memcpy(dds->cComment, tex_sign, 8);
 
 	// fill average color information
-	if (image->hasAverageColor)
+	ImageStats *stats = Image_GetStats(image);
+	if (stats->valid)
 	{
 		dds->ddckAvgColor.cFlag = 0x41; 
-		dds->ddckAvgColor.ucRGB[0] = image->averagecolor[0];
-		dds->ddckAvgColor.ucRGB[1] = image->averagecolor[1];
-		dds->ddckAvgColor.ucRGB[2] = image->averagecolor[2];
+		dds->ddckAvgColor.ucRGB[0] = stats->averageColor[0];
+		dds->ddckAvgColor.ucRGB[1] = stats->averageColor[1];
+		dds->ddckAvgColor.ucRGB[2] = stats->averageColor[2];
 	}
 
 	// fill alphapixels information, ensure that our texture have actual alpha channel
@@ -138,8 +138,9 @@ byte *KTX_CreateHeader(LoadedImage *image, TexFormat *format, size_t *outsize)
 	KTX_WriteKeyPair("fourCC", (byte *)format->fourCC, 4, &keyData, &keyDataSize);
 	if (tex_useSign)
 		KTX_WriteKeyPair("comment", tex_sign, &keyData, &keyDataSize);
-	if (image->hasAverageColor)
-		KTX_WriteKeyPair("avgColor", image->averagecolor, 3, &keyData, &keyDataSize);
+	ImageStats *stats = Image_GetStats(image);
+	if (stats->valid)
+		KTX_WriteKeyPair("avgColor", stats->averageColor, 3, &keyData, &keyDataSize);
 	if (image->maps->sRGB)
 		KTX_WriteKeyPair("sRGBcolorspace", 0, 0, &keyData, &keyDataSize);
 	if (image->datatype == IMAGE_NORMALMAP)
@@ -0,0 +1,484 @@
+////////////////////////////////////////////////////////////////
+//
+// RwgTex / files cache
+// (c) Pavel [VorteX] Timofeyev
+// See LICENSE text file for a license agreement
+//
+////////////////////////////////
+
+#include "main.h"
+#include "filecache.h"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+==========================================================================================
+
+  File format
+
+  Header, entries, hash index and zero-terminated keys. Index is a power-of-two
+  table of entry numbers + 1 (0 is empty bucket) with linear probing, at most half full.
+  File is used in place, so entries are kept 8-byte aligned.
+
+==========================================================================================
+*/
+
+#define FILECACHE_MAGIC   FOURCC('R','T','F','C')
+#define FILECACHE_VERSION 1
+#define FILECACHE_MINBUCKETS 1024
+
+typedef struct
+{
+	unsigned int     magic;
+	unsigned int     version;
+	unsigned int     numentries;
+	unsigned int     numbuckets;
+	unsigned int     keyssize;
+	unsigned int     reserved;
+} FileCacheHeader;
+
+typedef struct
+{
+	unsigned int     hash;     // hash of lowercased key
+	unsigned int     key;      // offset of key in keys
+	FileCacheInfo    info;
+} FileCacheEntry;
+
+typedef struct
+{
+	// loaded from file
+	byte            *mapped;
+	size_t           mappedsize;
+	FileCacheEntry  *entries;
+	unsigned int    *buckets;
+	const char      *keys;
+	unsigned int     numentries;
+	unsigned int     numbuckets;
+	unsigned int     keyssize;
+	byte            *used;     // set without locking, every entry has it's own byte
+	byte            *replaced; // entry has newer version in added ones
+#ifdef WIN32
+	HANDLE           hFile;
+	HANDLE           hMapping;
+#endif
+
+	// added during this run, guarded by mutex
+	vector<FileCacheEntry> added;
+	vector<byte>           addedUsed;
+	vector<char>           addedKeys;
+	vector<unsigned int>   addedBuckets;
+	ThreadMutex            mutex;
+	bool                   initialized;
+} FileCacheData;
+
+static FileCacheData filecache;
+
+/*
+==========================================================================================
+
+  Hash tables
+
+==========================================================================================
+*/
+
+// FNV-1a of lowercased key
+static unsigned int FileCache_Hash(const char *key)
+{
+	unsigned int hash = 2166136261u;
+
+	while(*key)
+	{
+		hash ^= (unsigned int)(byte)tolower((byte)*key++);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// returns entry number or -1
+static int FileCache_Lookup(const FileCacheEntry *entries, unsigned int numentries, const unsigned int *buckets, unsigned int numbuckets, const char *keys, unsigned int keyssize, const char *key, unsigned int hash)
+{
+	unsigned int mask, b, i, e;
+
+	if (!numbuckets)
+		return -1;
+	mask = numbuckets - 1;
+	b = hash & mask;
+	for (i = 0; i < numbuckets; i++, b = (b + 1) & mask)
+	{
+		e = buckets[b];
+		if (!e || e > numentries)
+			return -1;
+		e--;
+		if (entries[e].hash == hash && entries[e].key < keyssize && !stricmp(keys + entries[e].key, key))
+			return (int)e;
+	}
+	return -1;
+}
+
+static void FileCache_Insert(unsigned int *buckets, unsigned int numbuckets, unsigned int hash, unsigned int entry)
+{
+	unsigned int mask, b;
+
+	mask = numbuckets - 1;
+	for (b = hash & mask; buckets[b]; b = (b + 1) & mask);
+	buckets[b] = entry + 1;
+}
+
+static unsigned int FileCache_NumBuckets(unsigned int numentries)
+{
+	unsigned int numbuckets;
+
+	numbuckets = FILECACHE_MINBUCKETS;
+	while(numbuckets < numentries * 2)
+		numbuckets *= 2;
+	return numbuckets;
+}
+
+static void FileCache_Init(void)
+{
+	if (filecache.initialized)
+		return;
+	Thread_MutexInit(&filecache.mutex);
+	filecache.initialized = true;
+}
+
+/*
+==========================================================================================
+
+  Loading
+
+==========================================================================================
+*/
+
+static void FileCache_Unmap(void)
+{
+#ifdef WIN32
+	if (filecache.mapped)
+		UnmapViewOfFile(filecache.mapped);
+	if (filecache.hMapping)
+		CloseHandle(filecache.hMapping);
+	if (filecache.hFile && filecache.hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(filecache.hFile);
+	filecache.hMapping = NULL;
+	filecache.hFile = NULL;
+#else
+	if (filecache.mapped)
+		munmap(filecache.mapped, filecache.mappedsize);
+#endif
+	if (filecache.used)
+		mem_free(filecache.used);
+	if (filecache.replaced)
+		mem_free(filecache.replaced);
+	filecache.mapped = NULL;
+	filecache.mappedsize = 0;
+	filecache.entries = NULL;
+	filecache.buckets = NULL;
+	filecache.keys = NULL;
+	filecache.numentries = filecache.numbuckets = filecache.keyssize = 0;
+	filecache.used = filecache.replaced = NULL;
+}
+
+static bool FileCache_Map(const char *filename)
+{
+#ifdef WIN32
+	LARGE_INTEGER size;
+
+	filecache.hFile = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (filecache.hFile == INVALID_HANDLE_VALUE)
+	{
+		filecache.hFile = NULL;
+		return false;
+	}
+	if (!GetFileSizeEx(filecache.hFile, &size) || size.QuadPart < (LONGLONG)sizeof(FileCacheHeader) || size.QuadPart > 0x7FFFFFFF)
+		return false;
+	filecache.hMapping = CreateFileMapping(filecache.hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!filecache.hMapping)
+		return false;
+	filecache.mapped = (byte *)MapViewOfFile(filecache.hMapping, FILE_MAP_READ, 0, 0, 0);
+	if (!filecache.mapped)
+		return false;
+	filecache.mappedsize = (size_t)size.QuadPart;
+#else
+	struct stat st;
+	void *data;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return false;
+	if (fstat(fd, &st) || st.st_size < (off_t)sizeof(FileCacheHeader) || st.st_size > 0x7FFFFFFF)
+	{
+		close(fd);
+		return false;
+	}
+	data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return false;
+	filecache.mapped = (byte *)data;
+	filecache.mappedsize = (size_t)st.st_size;
+#endif
+	return true;
+}
+
+bool FileCache_Load(const char *filename)
+{
+	FileCacheHeader *header;
+	size_t size;
+
+	FileCache_Free();
+	FileCache_Init();
+	if (!FileCache_Map(filename))
+	{
+		FileCache_Unmap();
+		return false;
+	}
+
+	// check header, a cache of different version is dropped
+	header = (FileCacheHeader *)filecache.mapped;
+	if (header->magic != FILECACHE_MAGIC || header->version != FILECACHE_VERSION)
+	{
+		Warning("%s: unknown files cache version, ignored", filename);
+		FileCache_Unmap();
+		return false;
+	}
+	size = 0;
+	if (header->numentries <= filecache.mappedsize / sizeof(FileCacheEntry) && header->numbuckets <= filecache.mappedsize / sizeof(unsigned int) && header->keyssize <= filecache.mappedsize)
+		size = sizeof(FileCacheHeader) + (size_t)header->numentries * sizeof(FileCacheEntry) + (size_t)header->numbuckets * sizeof(unsigned int) + header->keyssize;
+	if (size != filecache.mappedsize || (header->numbuckets & (header->numbuckets - 1)) || header->numbuckets < header->numentries || (header->keyssize && filecache.mapped[size - 1]))
+	{
+		Warning("%s: damaged files cache, ignored", filename);
+		FileCache_Unmap();
+		return false;
+	}
+	filecache.numentries = header->numentries;
+	filecache.numbuckets = header->numbuckets;
+	filecache.keyssize = header->keyssize;
+	filecache.entries = (FileCacheEntry *)(filecache.mapped + sizeof(FileCacheHeader));
+	filecache.buckets = (unsigned int *)(filecache.entries + filecache.numentries);
+	filecache.keys = (const char *)(filecache.buckets + filecache.numbuckets);
+	filecache.used = (byte *)mem_alloc(filecache.numentries + 1);
+	filecache.replaced = (byte *)mem_alloc(filecache.numentries + 1);
+	memset(filecache.used, 0, filecache.numentries + 1);
+	memset(filecache.replaced, 0, filecache.numentries + 1);
+	return true;
+}
+
+void FileCache_Free(void)
+{
+	FileCache_Unmap();
+	filecache.added.clear();
+	filecache.addedUsed.clear();
+	filecache.addedKeys.clear();
+	filecache.addedBuckets.clear();
+}
+
+int FileCache_NumEntries(void)
+{
+	return (int)(filecache.numentries + filecache.added.size());
+}
+
+/*
+==========================================================================================
+
+  Lookup and update
+
+==========================================================================================
+*/
+
+static int FileCache_LookupAdded(const char *key, unsigned int hash)
+{
+	if (filecache.added.empty())
+		return -1;
+	return FileCache_Lookup(&filecache.added[0], (unsigned int)filecache.added.size(), &filecache.addedBuckets[0], (unsigned int)filecache.addedBuckets.size(), &filecache.addedKeys[0], (unsigned int)filecache.addedKeys.size(), key, hash);
+}
+
+bool FileCache_Find(const char *key, FileCacheInfo *info)
+{
+	unsigned int hash;
+	int e;
+
+	FileCache_Init();
+	hash = FileCache_Hash(key);
+
+	// added during this run
+	Thread_MutexLock(&filecache.mutex);
+	e = FileCache_LookupAdded(key, hash);
+	if (e >= 0)
+	{
+		filecache.addedUsed[e] = 1;
+		*info = filecache.added[e].info;
+		Thread_MutexUnlock(&filecache.mutex);
+		return true;
+	}
+	Thread_MutexUnlock(&filecache.mutex);
+
+	// loaded, mapped data is never changed so no locking is needed
+	e = FileCache_Lookup(filecache.entries, filecache.numentries, filecache.buckets, filecache.numbuckets, filecache.keys, filecache.keyssize, key, hash);
+	if (e < 0)
+		return false;
+	filecache.used[e] = 1;
+	*info = filecache.entries[e].info;
+	return true;
+}
+
+void FileCache_Update(const char *key, const FileCacheInfo *info, bool used)
+{
+	FileCacheEntry entry;
+	unsigned int hash, i;
+	int e;
+
+	FileCache_Init();
+	hash = FileCache_Hash(key);
+	Thread_MutexLock(&filecache.mutex);
+	e = FileCache_LookupAdded(key, hash);
+	if (e >= 0)
+	{
+		filecache.added[e].info = *info;
+		if (used)
+			filecache.addedUsed[e] = 1;
+		Thread_MutexUnlock(&filecache.mutex);
+		return;
+	}
+
+	// newer version of loaded entry
+	e = FileCache_Lookup(filecache.entries, filecache.numentries, filecache.buckets, filecache.numbuckets, filecache.keys, filecache.keyssize, key, hash);
+	if (e >= 0)
+	{
+		filecache.replaced[e] = 1;
+		if (filecache.used[e])
+			used = true;
+	}
+
+	// add
+	entry.hash = hash;
+	entry.key = (unsigned int)filecache.addedKeys.size();
+	entry.info = *info;
+	filecache.addedKeys.insert(filecache.addedKeys.end(), key, key + strlen(key) + 1);
+	filecache.added.push_back(entry);
+	filecache.addedUsed.push_back(used ? 1 : 0);
+
+	// grow index
+	if (filecache.added.size() * 2 > filecache.addedBuckets.size())
+	{
+		filecache.addedBuckets.assign(FileCache_NumBuckets((unsigned int)filecache.added.size()), 0);
+		for (i = 0; i < filecache.added.size(); i++)
+			FileCache_Insert(&filecache.addedBuckets[0], (unsigned int)filecache.addedBuckets.size(), filecache.added[i].hash, i);
+	}
+	else
+		FileCache_Insert(&filecache.addedBuckets[0], (unsigned int)filecache.addedBuckets.size(), hash, (unsigned int)filecache.added.size() - 1);
+	Thread_MutexUnlock(&filecache.mutex);
+}
+
+/*
+==========================================================================================
+
+  Saving
+
+==========================================================================================
+*/
+
+static void FileCache_Store(byte *data, unsigned int *numentries, unsigned int *keyssize, const FileCacheEntry *entry, const char *key)
+{
+	FileCacheHeader *header;
+	FileCacheEntry *entries;
+	unsigned int *buckets;
+	char *keys;
+	size_t len;
+
+	header = (FileCacheHeader *)data;
+	entries = (FileCacheEntry *)(data + sizeof(FileCacheHeader));
+	buckets = (unsigned int *)(entries + header->numentries);
+	keys = (char *)(buckets + header->numbuckets);
+	len = strlen(key) + 1;
+	entries[*numentries] = *entry;
+	entries[*numentries].key = *keyssize;
+	memcpy(keys + *keyssize, key, len);
+	FileCache_Insert(buckets, header->numbuckets, entry->hash, *numentries);
+	*keyssize += (unsigned int)len;
+	*numentries += 1;
+}
+
+bool FileCache_Save(const char *filename)
+{
+	FileCacheHeader *header;
+	char tempname[MAX_FPATH];
+	unsigned int i, numentries, keyssize;
+	size_t size;
+	byte *data;
+	FILE *f;
+	bool written;
+
+	// count used entries
+	header = NULL;
+	numentries = keyssize = 0;
+	for (i = 0; i < filecache.numentries; i++)
+	{
+		if (!filecache.used[i] || filecache.replaced[i] || filecache.entries[i].key >= filecache.keyssize)
+			continue;
+		numentries++;
+		keyssize += (unsigned int)strlen(filecache.keys + filecache.entries[i].key) + 1;
+	}
+	for (i = 0; i < filecache.added.size(); i++)
+	{
+		if (!filecache.addedUsed[i])
+			continue;
+		numentries++;
+		keyssize += (unsigned int)strlen(&filecache.addedKeys[filecache.added[i].key]) + 1;
+	}
+
+	// build whole file in memory
+	size = sizeof(FileCacheHeader) + (size_t)numentries * sizeof(FileCacheEntry) + (size_t)FileCache_NumBuckets(numentries) * sizeof(unsigned int) + keyssize;
+	data = (byte *)mem_alloc(size);
+	memset(data, 0, size);
+	header = (FileCacheHeader *)data;
+	header->magic = FILECACHE_MAGIC;
+	header->version = FILECACHE_VERSION;
+	header->numentries = numentries;
+	header->numbuckets = FileCache_NumBuckets(numentries);
+	header->keyssize = keyssize;
+	numentries = keyssize = 0;
+	for (i = 0; i < filecache.numentries; i++)
+		if (filecache.used[i] && !filecache.replaced[i] && filecache.entries[i].key < filecache.keyssize)
+			FileCache_Store(data, &numentries, &keyssize, &filecache.entries[i], filecache.keys + filecache.entries[i].key);
+	for (i = 0; i < filecache.added.size(); i++)
+		if (filecache.addedUsed[i])
+			FileCache_Store(data, &numentries, &keyssize, &filecache.added[i], &filecache.addedKeys[filecache.added[i].key]);
+
+	// old file is still mapped and cannot be replaced
+	FileCache_Free();
+
+	// write to temporary file and replace cache with it, so cache is never left half-written
+	sprintf(tempname, "%s.tmp", filename);
+	f = fopen(tempname, "wb");
+	if (!f)
+	{
+		Warning("FileCache_Save: cannot open %s for writing (%s)", tempname, strerror(errno));
+		mem_free(data);
+		return false;
+	}
+	written = (fwrite(data, size, 1, f) == 1);
+	if (fclose(f))
+		written = false;
+	mem_free(data);
+	if (written)
+	{
+#ifdef WIN32
+		written = MoveFileEx(tempname, filename, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) ? true : false;
+#else
+		written = rename(tempname, filename) ? false : true;
+#endif
+	}
+	if (!written)
+	{
+		Warning("FileCache_Save: cannot write %s", filename);
+		remove(tempname);
+		return false;
+	}
+	return true;
+}
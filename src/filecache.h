@@ -0,0 +1,29 @@
+// filecache.h
+#ifndef H_TEX_FILECACHE_H
+#define H_TEX_FILECACHE_H
+
+#include "main.h"
+
+// what is known about a source file when it was encoded
+typedef struct
+{
+	unsigned int     crc;      // source content crc32
+	unsigned int     options;  // options fingerprint
+	unsigned __int64 filesize;
+	unsigned __int64 mtime;
+	unsigned __int64 inode;
+} FileCacheInfo;
+
+// files cache: binary hash table written by previous run is memory-mapped and used in place,
+// entries added or changed during this run are kept in memory until FileCache_Save
+// keys are compared case-insensitive, Find and Update can be called from any thread
+bool FileCache_Load(const char *filename);
+bool FileCache_Find(const char *key, FileCacheInfo *info); // found entry is marked as used
+void FileCache_Update(const char *key, const FileCacheInfo *info, bool used);
+int  FileCache_NumEntries(void);
+
+// writes used entries to temporary file which then replaces cache file, frees cache
+bool FileCache_Save(const char *filename);
+void FileCache_Free(void);
+
+#endif
@@ -50,6 +50,9 @@ bool fiBindToImage(FIBITMAP *bitmap, LoadedImage *image, FREE_IMAGE_FORMAT forma
 // load bitmap from memory
 bool fiLoadData(FREE_IMAGE_FORMAT format, FS_File *file, byte *data, size_t datasize, LoadedImage *image);
 
+// get image dimensions from file header
+bool fiProbeData(FREE_IMAGE_FORMAT format, FS_File *file, byte *data, size_t datasize, int *width, int *height);
+
 // load bitmap from raw data
 bool fiLoadDataRaw(int width, int height, int bpp, byte *data, size_t datasize, byte *palette, bool dataIsBGR, LoadedImage *image);
 
@@ -9,11 +9,16 @@
 #include "main.h"
 #include "zip.h"
 #include "unzip.h"
-#include "crc32.h"
+#include "hash.h"
+#include "filecache.h"
 #include "tex.h"
+#ifndef WIN32
+#include <sys/stat.h>
+#endif
 
 vector<FS_File> textures;
 int texturesSkipped;
+volatile int texturesHashed;
 
 void FS_SetFile(FS_File *file, char *fullpath)
 {
@@ -89,96 +94,230 @@ void FS_FreeFile(FS_File *file)
 ==========================================================================================
 */
 
-typedef struct
-{
-	char            filename[MAX_FPATH];
-	unsigned int    crc;
-	bool            used;
-}
-FileCacheS;
-vector<FileCacheS> FileCache;
-
-bool FS_LoadCache(char *filename)
+// old text cache (filescrc.txt) is imported if there is no binary one
+static bool FS_ImportTextCache(char *filename)
 {
-	char line[2048], *crcstr;
-	FileCacheS NewFC;
+	char line[MAX_FPATH + 128], *c;
+	unsigned __int64 fields[5];
+	FileCacheInfo info;
 	FILE *f;
+	int linenum, numfields;
 
-	FileCache.clear();
 	f = fopen(filename, "r");
 	if (!f)
 		return false;
-	while(fgets(line, 100, f) != NULL)
+	linenum = 0;
+	while(fgets(line, sizeof(line), f) != NULL)
 	{
+		linenum++;
 		if (line[0] == '#' || (line[0] == '/' && line[1] == '/'))
 			continue;
-		// load line
-		crcstr = strstr(line, " 0x");
-		if (!crcstr)
-			Error("FS_LoadCache: damaged line '%s'", line); 
-		memset(NewFC.filename, 0, MAX_FPATH);
-		strncpy(NewFC.filename, line, crcstr - line);
-		NewFC.crc = ParseNum(crcstr + 1);
-		NewFC.used = false;
-		FileCache.push_back(NewFC);
+		while(c = strstr(line, "\n")) c[0] = 0;
+		// load line, fields are parsed from the end so file names may have spaces
+		// oldest caches have only crc or crc and options
+		for (numfields = 0; numfields < 5; numfields++)
+		{
+			c = strrchr(line, ' ');
+			if (!c || strncmp(c, " 0x", 3))
+				break;
+			fields[numfields] = _strtoui64(c + 1, NULL, 16);
+			c[0] = 0;
+		}
+		if (!numfields)
+		{
+			Warning("%s:%i: damaged line, ignored", filename, linenum);
+			continue;
+		}
+		memset(&info, 0, sizeof(info));
+		info.crc = (unsigned int)fields[numfields - 1];
+		if (numfields > 1)
+			info.options = (unsigned int)fields[numfields - 2];
+		if (numfields > 4)
+		{
+			info.filesize = fields[2];
+			info.mtime = fields[1];
+			info.inode = fields[0];
+		}
+		FileCache_Update(line, &info, false);
 	}
 	fclose(f);
 	return true;
 }
 
+bool FS_LoadCache(char *filename)
+{
+	char textname[MAX_FPATH];
+
+	if (FileCache_Load(filename))
+		return true;
+	StripFileExtension(filename, textname);
+	strlcat(textname, ".txt", sizeof(textname));
+	return FS_ImportTextCache(textname);
+}
+
 void FS_SaveCache(char *filename)
 {
-	FILE *f;
+	FileCache_Save(filename);
+}
 
-	f = SafeOpen(filename, "w");
-	fprintf(f, "# Crc32 table for source files\n");
-	fprintf(f, "# generated automatically, do not modify\n");
-	for (std::vector<FileCacheS>::iterator file = FileCache.begin(); file < FileCache.end(); file++)
-		if (file->used)
-			fprintf(f, "%s 0x%08X\n", file->filename, file->crc);
-	fclose(f);
+bool FS_CRC32(char *filename, unsigned int *crc)
+{
+	return Hash_FileCRC32(filename, crc);
 }
 
-unsigned int FS_CRC32(char *filename)
+// unique file index on volume, changes if file was replaced even if size and time are same
+static unsigned __int64 FS_FileIndex(char *filename)
 {
-	DWORD crc;
-	FileCrc32Assembly(filename, crc);
-	return (unsigned int)crc;
+#ifdef WIN32
+	BY_HANDLE_FILE_INFORMATION info;
+	HANDLE hFile;
+	bool ok;
+
+	hFile = CreateFile(filename, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return 0;
+	ok = GetFileInformationByHandle(hFile, &info) ? true : false;
+	CloseHandle(hFile);
+	if (!ok)
+		return 0;
+	return ((unsigned __int64)info.nFileIndexHigh << 32) | info.nFileIndexLow;
+#else
+	struct stat st;
+
+	if (stat(filename, &st))
+		return 0;
+	return (unsigned __int64)st.st_ino;
+#endif
 }
 
-// check if file was modified and updates cache
-bool FS_CheckCache(const char *filepath, unsigned int *fileCRC)
+// cache key is a path relative to source dir, ZIP entries are prefixed with archive path
+void FS_CacheKey(FS_File *file, char *key, size_t keysize)
 {
-	char filename[MAX_FPATH];
-	unsigned int crc;
+	const char *zipfile;
+	size_t len;
 
-	// get crc
-	sprintf(filename, "%s%s", tex_srcDir, filepath);
-	if (!fileCRC)
-		crc = FS_CRC32(filename);
-	else
-		crc = *fileCRC;
+	key[0] = 0;
+	if (!file->zipfile.empty())
+	{
+		zipfile = file->zipfile.c_str();
+		len = strlen(tex_srcDir);
+		if (!strnicmp(zipfile, tex_srcDir, len))
+			zipfile += len;
+		strlcpy(key, zipfile, keysize);
+		strlcat(key, ":", keysize);
+	}
+	strlcat(key, file->fullpath.c_str(), keysize);
+}
 
-	// find in cache
-	for (std::vector<FileCacheS>::iterator file = FileCache.begin(); file < FileCache.end(); file++)
+// check if file or options were changed since file was encoded last time
+// changed entry is kept, but not updated until file gets encoded, can be called from any thread
+bool FS_CheckCache(FS_File *file, unsigned int options)
+{
+	char key[MAX_FPATH], filename[MAX_FPATH];
+	FileCacheInfo cached;
+	bool found, hashed;
+
+	FS_CacheKey(file, key, sizeof(key));
+	found = FileCache_Find(key, &cached);
+	hashed = false;
+
+	// get crc, ZIP entries have it from archive directory
+	// file is read only if its size, modification time or index differ from cached ones
+	if (!file->hascrc)
 	{
-		if (!strnicmp(file->filename, filepath, MAX_FPATH))
+		sprintf(filename, "%s%s", tex_srcDir, file->fullpath.c_str());
+		if (found && !tex_paranoid && cached.filesize == file->filesize && cached.mtime == file->mtime)
 		{
-			file->used = true;
-			if (crc == file->crc)
-				return false;
-			file->crc = crc;
-			return true;
+			file->inode = FS_FileIndex(filename);
+			if (cached.inode == file->inode)
+			{
+				file->crc = cached.crc;
+				file->hascrc = true;
+			}
+		}
+		if (!file->hascrc)
+		{
+			if (!FS_CRC32(filename, &file->crc))
+				return true;
+			file->inode = FS_FileIndex(filename);
+			file->hascrc = true;
+			hashed = true;
+			Thread_AtomicAdd(&texturesHashed, 1);
 		}
 	}
 
-	// not found in cache, add
-	FileCacheS NewFC;
-	strncpy(NewFC.filename, filepath, MAX_FPATH);
-	NewFC.crc = crc;
-	NewFC.used = true;
-	FileCache.push_back(NewFC);
-	return true; 
+	// compare
+	if (!found)
+		return true;
+	if (cached.crc != file->crc || cached.options != options)
+		return true;
+
+	// contents are same but file was touched or copied, store new size, time and index
+	// so it is not read again on next run
+	if (hashed)
+		FS_UpdateCache(file, options);
+	return false;
+}
+
+// store crc of encoded file
+void FS_UpdateCache(FS_File *file, unsigned int options)
+{
+	char key[MAX_FPATH];
+	FileCacheInfo info;
+
+	if (!file->hascrc)
+		return;
+	FS_CacheKey(file, key, sizeof(key));
+	info.crc = file->crc;
+	info.options = options;
+	info.filesize = file->filesize;
+	info.mtime = file->mtime;
+	info.inode = file->inode;
+	FileCache_Update(key, &info, true);
+}
+
+typedef struct
+{
+	unsigned int options;
+	byte        *changed;
+} FS_CheckData;
+
+static void FS_CheckCacheThread(ThreadData *thread)
+{
+	FS_CheckData *data;
+	int work;
+
+	data = (FS_CheckData *)thread->data;
+	while((work = GetWorkForThread(thread)) != -1)
+		data->changed[work] = FS_CheckCache(&textures[work], data->options) ? 1 : 0;
+}
+
+// check all textures against cache, source files that have to be hashed are read by all threads
+// unchanged textures are removed from list if skip is set
+void FS_CheckTextures(unsigned int options, bool skip)
+{
+	FS_CheckData data;
+	size_t i, numchanged;
+
+	if (!textures.size())
+		return;
+	data.options = options;
+	data.changed = (byte *)mem_alloc(textures.size());
+	ParallelThreads(max(1, numthreads), (int)textures.size(), &data, FS_CheckCacheThread);
+	numchanged = 0;
+	for (i = 0; i < textures.size(); i++)
+	{
+		if (skip && !data.changed[i])
+		{
+			texturesSkipped++;
+			continue;
+		}
+		if (numchanged != i)
+			textures[numchanged] = textures[i];
+		numchanged++;
+	}
+	textures.resize(numchanged);
+	mem_free(data.changed);
 }
 
 /*
@@ -483,6 +622,12 @@ bool AddFile(FS_File &file, bool checkinclude, unsigned int *fileCRC)
 		if (!AllowFile(&file))
 			return false;
 	// passed
+	file.crc = fileCRC ? *fileCRC : 0;
+	file.hascrc = fileCRC ? true : false;
+	file.encoded = false;
+	file.cost = 0;
+	file.probed = false;
+	file.width = file.height = 0;
 	textures.push_back(file);
 	return true;
 }
@@ -521,6 +666,7 @@ bool AddArchive(FS_File &archive_file, bool checkinclude)
 		FS_SetFile(&file, ze.name);
 		            file.zipfile = filepath;
 		            file.zipindex = i;
+		            file.filesize = ze.unc_size;
 		AddFile(file, true, &ze.crc32);
 	}
 	CloseZip(zh);
@@ -573,6 +719,8 @@ void FS_ScanPath(char *basepath, const char *singlefile, char *addpath)
 			continue;
 		}
 		FS_SetFile(&file, path, n_file.cFileName);
+		file.filesize = (size_t)(((unsigned __int64)n_file.nFileSizeHigh << 32) | n_file.nFileSizeLow);
+		file.mtime = ((unsigned __int64)n_file.ftLastWriteTime.dwHighDateTime << 32) | n_file.ftLastWriteTime.dwLowDateTime;
 
 		// add
 		if (FS_FileMatchList(&file, tex_archiveFiles))
@@ -646,6 +794,51 @@ byte *FS_LoadFile(FS_File *file, size_t *filesize)
 	return filedata;
 }
 
+// read beginning of the file (for header probing), ZIP entries are unpacked only that far
+// archive is opened here unless caller has it open (opening parses whole directory)
+byte *FS_LoadFileHeader(FS_File *file, size_t maxsize, size_t *datasize, HZIP zip)
+{
+	char filepath[MAX_FPATH];
+	byte *data;
+	FILE *f;
+
+	if (!file->zipfile.empty())
+	{
+		HZIP zh = zip ? zip : OpenZip(file->zipfile.c_str(), "");
+		if (!zh)
+			return NULL;
+		ZIPENTRY ze;
+		data = NULL;
+		if (GetZipItem(zh, file->zipindex, &ze) == ZR_OK && ze.unc_size > 0)
+		{
+			*datasize = min(maxsize, (size_t)ze.unc_size);
+			data = (byte *)mem_alloc(*datasize);
+			ZRESULT zr = UnzipItem(zh, file->zipindex, data, (unsigned int)*datasize);
+			if (zr != ZR_OK && zr != ZR_MORE)
+			{
+				mem_free(data);
+				data = NULL;
+			}
+		}
+		if (!zip)
+			CloseZip(zh);
+		return data;
+	}
+	sprintf(filepath, "%s%s%s.%s", tex_srcDir, file->path.c_str(), file->name.c_str(), file->ext.c_str());
+	f = fopen(filepath, "rb");
+	if (!f)
+		return NULL;
+	data = (byte *)mem_alloc(maxsize);
+	*datasize = fread(data, 1, maxsize, f);
+	fclose(f);
+	if (!*datasize)
+	{
+		mem_free(data);
+		return NULL;
+	}
+	return data;
+}
+
 /*
 ==========================================================================================
 
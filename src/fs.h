@@ -25,15 +25,33 @@ typedef struct
 	// zip info
 	string zipfile;
 	size_t zipindex;
+
+	// incremental build info
+	unsigned int crc;  // source content crc32 (from archive directory for ZIP entries)
+	bool   hascrc;
+	unsigned __int64 mtime; // last write time, 0 for ZIP entries
+	unsigned __int64 inode; // file index, taken when crc is checked
+	bool   encoded;    // all codecs are done with it, cache may be updated
+
+	// scheduling info
+	size_t filesize; // file size (unpacked size for ZIP entries)
+	double cost;     // estimated processing cost
+	bool   probed;   // file header was probed for dimensions
+	int    width;    // image dimensions from header probe, 0 if unknown
+	int    height;
 }
 FS_File;
 
 bool         FS_LoadCache(char *filename);
 void         FS_SaveCache(char *filename);
-unsigned int FS_CRC32(char *filename);
-bool         FS_CheckCache(const char *filepath, unsigned int *fileCRC);
+bool         FS_CRC32(char *filename, unsigned int *crc);
+void         FS_CacheKey(FS_File *file, char *key, size_t keysize);
+bool         FS_CheckCache(FS_File *file, unsigned int options);
+void         FS_UpdateCache(FS_File *file, unsigned int options);
+void         FS_CheckTextures(unsigned int options, bool skip);
 void         FS_ScanPath(char *basepath, const char *singlefile, char *addpath);
 byte        *FS_LoadFile(FS_File *file, size_t *filesize);
+byte        *FS_LoadFileHeader(FS_File *file, size_t maxsize, size_t *datasize, HZIP zip = NULL); // zip is file's archive if it's open already
 
 typedef struct
 {
@@ -45,6 +63,7 @@ typedef struct
 
 extern vector<FS_File> textures;
 extern int texturesSkipped;
+extern volatile int texturesHashed;
 
 bool FS_FindDir(char *pattern);
 bool FS_FindFile(char *pattern);
@@ -0,0 +1,353 @@
+////////////////////////////////////////////////////////////////
+//
+// RwgTex / hashing
+// (c) Pavel [VorteX] Timofeyev
+// See LICENSE text file for a license agreement
+//
+////////////////////////////////
+
+#include "main.h"
+#include "hash.h"
+#include "cpu.h"
+
+#ifdef CPU_PCLMUL_INTRINSICS
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+#define HASH_FILE_BUFFER 262144
+
+// crc32 of non-inverted crc value
+typedef unsigned int (*HashCRC32)(unsigned int crc, const byte *data, size_t size);
+
+static bool        hash_initialized = false;
+static HashCRC32   hash_crc32;
+static const char *hash_backend = "slice8";
+static unsigned int hash_crcTable[8][256];
+
+/*
+==========================================================================================
+
+  CRC32, slicing-by-8
+
+  Same reflected 0xEDB88320 polynomial as ZIP. Table n gives crc of a byte followed
+  by n zero bytes, so 8 bytes are done with 8 independent lookups.
+
+==========================================================================================
+*/
+
+static void Hash_InitTables(void)
+{
+	unsigned int crc;
+	int i, j;
+
+	for (i = 0; i < 256; i++)
+	{
+		crc = (unsigned int)i;
+		for (j = 0; j < 8; j++)
+			crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : (crc >> 1);
+		hash_crcTable[0][i] = crc;
+	}
+	for (i = 0; i < 256; i++)
+		for (j = 1; j < 8; j++)
+			hash_crcTable[j][i] = (hash_crcTable[j-1][i] >> 8) ^ hash_crcTable[0][hash_crcTable[j-1][i] & 0xFF];
+}
+
+static unsigned int Hash_CRC32_Slice8(unsigned int crc, const byte *data, size_t size)
+{
+	unsigned int a, b;
+
+	for (; size >= 8; size -= 8, data += 8)
+	{
+		a = crc ^ (data[0] | (data[1] << 8) | (data[2] << 16) | ((unsigned int)data[3] << 24));
+		b = data[4] | (data[5] << 8) | (data[6] << 16) | ((unsigned int)data[7] << 24);
+		crc = hash_crcTable[7][a & 0xFF] ^ hash_crcTable[6][(a >> 8) & 0xFF] ^ hash_crcTable[5][(a >> 16) & 0xFF] ^ hash_crcTable[4][a >> 24] ^
+		      hash_crcTable[3][b & 0xFF] ^ hash_crcTable[2][(b >> 8) & 0xFF] ^ hash_crcTable[1][(b >> 16) & 0xFF] ^ hash_crcTable[0][b >> 24];
+	}
+	for (; size > 0; size--, data++)
+		crc = (crc >> 8) ^ hash_crcTable[0][(crc ^ *data) & 0xFF];
+	return crc;
+}
+
+/*
+==========================================================================================
+
+  CRC32, PCLMULQDQ folding
+
+  Intel "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction":
+  four 128-bit lanes are folded over 64-byte blocks, then folded into one,
+  reduced to 64 bits and Barrett-reduced to crc. Constants are for reflected
+  0xEDB88320 polynomial. Tail shorter than 16 bytes goes to slicing-by-8.
+
+==========================================================================================
+*/
+
+#ifdef CPU_PCLMUL_INTRINSICS
+
+#define HASH_PCLMUL_MINSIZE 64
+
+CPU_TARGET("sse2,pclmul") static unsigned int Hash_CRC32_PCLMUL(unsigned int crc, const byte *data, size_t size)
+{
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, mask;
+	size_t tail;
+
+	if (size < HASH_PCLMUL_MINSIZE)
+		return Hash_CRC32_Slice8(crc, data, size);
+	tail = size & 15;
+	size -= tail;
+
+	// first 64 bytes
+	x1 = _mm_loadu_si128((const __m128i *)(data + 0x00));
+	x2 = _mm_loadu_si128((const __m128i *)(data + 0x10));
+	x3 = _mm_loadu_si128((const __m128i *)(data + 0x20));
+	x4 = _mm_loadu_si128((const __m128i *)(data + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+	x0 = _mm_set_epi32(0x00000001, 0xC6E41596, 0x00000001, 0x54442BD4); // k1, k2
+	data += 64;
+	size -= 64;
+
+	// fold 4 lanes by 64 bytes
+	while (size >= 64)
+	{
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *)(data + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *)(data + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *)(data + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *)(data + 0x30)));
+		data += 64;
+		size -= 64;
+	}
+
+	// fold lanes into one
+	x0 = _mm_set_epi32(0x00000000, 0xCCAA009E, 0x00000001, 0x751997D0); // k3, k4
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	// fold remaining 16-byte blocks
+	while (size >= 16)
+	{
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i *)data)), x5);
+		data += 16;
+		size -= 16;
+	}
+
+	// 128 to 64 bits
+	mask = _mm_set_epi32(0, -1, 0, -1);
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	x0 = _mm_set_epi32(0x00000000, 0x00000000, 0x00000001, 0x63CD6124); // k5
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, mask);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	// Barrett reduction to 32 bits
+	x0 = _mm_set_epi32(0x00000001, 0xF7011641, 0x00000001, 0xDB710641); // P(x), u
+	x2 = _mm_and_si128(x1, mask);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, mask);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+	crc = (unsigned int)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+	return Hash_CRC32_Slice8(crc, data, tail);
+}
+
+#endif
+
+/*
+==========================================================================================
+
+  CRC32 dispatch
+
+==========================================================================================
+*/
+
+bool Hash_UseBackend(const char *name)
+{
+	if (!hash_initialized)
+	{
+		Hash_InitTables();
+		hash_crc32 = Hash_CRC32_Slice8;
+		hash_initialized = true;
+	}
+	if (!name)
+	{
+		// pick best code path
+		hash_crc32 = Hash_CRC32_Slice8;
+		hash_backend = "slice8";
+#ifdef CPU_PCLMUL_INTRINSICS
+		if (CPU_HasSSE2() && CPU_HasPCLMUL())
+		{
+			hash_crc32 = Hash_CRC32_PCLMUL;
+			hash_backend = "PCLMUL";
+		}
+#endif
+		return true;
+	}
+	if (!stricmp(name, "slice8"))
+	{
+		hash_crc32 = Hash_CRC32_Slice8;
+		hash_backend = "slice8";
+		return true;
+	}
+#ifdef CPU_PCLMUL_INTRINSICS
+	if (!stricmp(name, "PCLMUL") && CPU_HasSSE2() && CPU_HasPCLMUL())
+	{
+		hash_crc32 = Hash_CRC32_PCLMUL;
+		hash_backend = "PCLMUL";
+		return true;
+	}
+#endif
+	return false;
+}
+
+const char *Hash_Backend(void)
+{
+	if (!hash_initialized)
+		Hash_UseBackend(NULL);
+	return hash_backend;
+}
+
+unsigned int Hash_CRC32(unsigned int crc, const void *data, size_t size)
+{
+	if (!hash_initialized)
+		Hash_UseBackend(NULL);
+	return ~hash_crc32(~crc, (const byte *)data, size);
+}
+
+bool Hash_FileCRC32(const char *filename, unsigned int *crc)
+{
+	byte *buffer;
+	size_t read;
+	bool ok;
+	FILE *f;
+
+	f = fopen(filename, "rb");
+	if (!f)
+		return false;
+	buffer = (byte *)mem_alloc(HASH_FILE_BUFFER);
+	*crc = 0;
+	while((read = fread(buffer, 1, HASH_FILE_BUFFER, f)) > 0)
+		*crc = Hash_CRC32(*crc, buffer, read);
+	ok = ferror(f) ? false : true;
+	fclose(f);
+	mem_free(buffer);
+	return ok;
+}
+
+/*
+==========================================================================================
+
+  64-bit hash
+
+  xxHash64 by Yann Collet, 4 independent lanes over 32-byte stripes,
+  input is read as little-endian
+
+==========================================================================================
+*/
+
+#define HASH_PRIME64_1 11400714785074694791ull
+#define HASH_PRIME64_2 14029467366897019727ull
+#define HASH_PRIME64_3 1609587929392839161ull
+#define HASH_PRIME64_4 9650029242287828579ull
+#define HASH_PRIME64_5 2870177450012600261ull
+
+#define HASH_ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static inline unsigned __int64 Hash_Read64(const byte *p)
+{
+	unsigned __int64 v;
+	memcpy(&v, p, 8);
+	return v;
+}
+
+static inline unsigned int Hash_Read32(const byte *p)
+{
+	unsigned int v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static inline unsigned __int64 Hash_Round(unsigned __int64 acc, unsigned __int64 input)
+{
+	acc += input * HASH_PRIME64_2;
+	acc = HASH_ROTL64(acc, 31);
+	return acc * HASH_PRIME64_1;
+}
+
+static inline unsigned __int64 Hash_MergeRound(unsigned __int64 acc, unsigned __int64 val)
+{
+	acc ^= Hash_Round(0, val);
+	return acc * HASH_PRIME64_1 + HASH_PRIME64_4;
+}
+
+unsigned __int64 Hash_64(const void *data, size_t size, unsigned __int64 seed)
+{
+	const byte *p = (const byte *)data, *end = p + size;
+	unsigned __int64 h, v1, v2, v3, v4;
+
+	if (size >= 32)
+	{
+		v1 = seed + HASH_PRIME64_1 + HASH_PRIME64_2;
+		v2 = seed + HASH_PRIME64_2;
+		v3 = seed;
+		v4 = seed - HASH_PRIME64_1;
+		for (; end - p >= 32; p += 32)
+		{
+			v1 = Hash_Round(v1, Hash_Read64(p));
+			v2 = Hash_Round(v2, Hash_Read64(p + 8));
+			v3 = Hash_Round(v3, Hash_Read64(p + 16));
+			v4 = Hash_Round(v4, Hash_Read64(p + 24));
+		}
+		h = HASH_ROTL64(v1, 1) + HASH_ROTL64(v2, 7) + HASH_ROTL64(v3, 12) + HASH_ROTL64(v4, 18);
+		h = Hash_MergeRound(h, v1);
+		h = Hash_MergeRound(h, v2);
+		h = Hash_MergeRound(h, v3);
+		h = Hash_MergeRound(h, v4);
+	}
+	else
+		h = seed + HASH_PRIME64_5;
+	h += (unsigned __int64)size;
+
+	// tail
+	for (; end - p >= 8; p += 8)
+	{
+		h ^= Hash_Round(0, Hash_Read64(p));
+		h = HASH_ROTL64(h, 27) * HASH_PRIME64_1 + HASH_PRIME64_4;
+	}
+	if (end - p >= 4)
+	{
+		h ^= (unsigned __int64)Hash_Read32(p) * HASH_PRIME64_1;
+		h = HASH_ROTL64(h, 23) * HASH_PRIME64_2 + HASH_PRIME64_3;
+		p += 4;
+	}
+	for (; p < end; p++)
+	{
+		h ^= (unsigned __int64)(*p) * HASH_PRIME64_5;
+		h = HASH_ROTL64(h, 11) * HASH_PRIME64_1;
+	}
+
+	// avalanche
+	h ^= h >> 33;
+	h *= HASH_PRIME64_2;
+	h ^= h >> 29;
+	h *= HASH_PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
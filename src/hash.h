@@ -0,0 +1,22 @@
+// hash.h
+#ifndef H_TEX_HASH_H
+#define H_TEX_HASH_H
+
+#include <stddef.h>
+
+// hashing of file contents for files cache, output cache and ZIP code
+// header does not include main.h, so ZIP code can use it as well
+
+// zip-compatible crc32, slicing-by-8 or PCLMULQDQ folding
+// crc of concatenated blocks is Hash_CRC32(Hash_CRC32(0, a), b)
+unsigned int     Hash_CRC32(unsigned int crc, const void *data, size_t size);
+bool             Hash_FileCRC32(const char *filename, unsigned int *crc);
+
+// fast 64-bit non-cryptographic hash (xxHash64) for cache keys
+unsigned __int64 Hash_64(const void *data, size_t size, unsigned __int64 seed);
+
+// force crc32 code path ("slice8", "PCLMUL"), NULL picks the best one, returns false if CPU does not support it
+bool             Hash_UseBackend(const char *name);
+const char      *Hash_Backend(void);
+
+#endif
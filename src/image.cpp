@@ -12,8 +12,15 @@
 #include "freeimage.h"
 #include "omnilib/dpomnilib.h"
 #include "scale2x.h"
+#include "scale2x_simd.h"
 #include "scalexBR.h"
+#include "mipmap.h"
+#include "super2x.h"
+#include "cpu.h"
 #include "tex.h"
+#ifdef CPU_SSE2_INTRINSICS
+#include <emmintrin.h>
+#endif
 
 using namespace omnilib;
 
@@ -34,15 +41,9 @@ void FreeImageBitmap(LoadedImage *image)
 
 void FreeImageMaps(LoadedImage *image)
 {
-	ImageMap *map, *next;
-
-	for (map = image->maps; map != NULL; map = next)
-	{
-		next = map->next;
-		if (map->data && map->external == false)
-			mem_free(map->data);
-		mem_free(map);
-	}
+	if (image->mapData)
+		mem_free(image->mapData);
+	image->mapData = NULL;
 	image->maps = NULL;
 }
 
@@ -52,6 +53,7 @@ void ClearImage(LoadedImage *image)
 	FreeImageMaps(image);
 	memset(image->texname, 0, 128); 
 	image->useTexname = false;
+	image->stats.valid = false;
 }
 
 LoadedImage *Image_Create(void)
@@ -117,11 +119,32 @@ void ImageData_SwapRB(byte *data, int width, int height, int pitch, int bpp)
 
 // ImageData_ConvertSRGB
 // convert RGB->sRGB colorspace
+// 8-bit channels have only 256 values, so conversion is done with tables built once by Image_Init
 #define linear_to_srgb(c) (((c) < 0.0031308f) ? (c) * 12.92f : 1.055f * (float)pow((c), 1.0f/2.4f) - 0.055f)
 #define srgb_to_linear(c) (((c) <= 0.04045f) ? (c) * (1.0f / 12.92f) : (float)pow(((c) + 0.055f)*(1.0f/1.055f), 2.4f))
+static byte image_linearToSRGB[256];
+static byte image_sRGBToLinear[256];
+
+static void ImageData_InitSRGB(void)
+{
+	int i;
+
+	for (i = 0; i < 256; i++)
+	{
+		image_linearToSRGB[i] = (byte)floor(linear_to_srgb((float)i / 255.0f) * 255.0f + 0.5f);
+		image_sRGBToLinear[i] = (byte)floor(srgb_to_linear((float)i / 255.0f) * 255.0f + 0.5f);
+	}
+}
+
+// table used by ImageData_ConvertSRGB, for code which fuses conversion with other per-pixel work
+const byte *ImageData_SRGBTable(bool toSRGB)
+{
+	return toSRGB ? image_linearToSRGB : image_sRGBToLinear;
+}
+
 void ImageData_ConvertSRGB(byte *data, int width, int height, int pitch, int bpp, bool srcSRGB, bool dstSRGB)
 {
-	byte *in, *end, *lines;
+	byte *in, *end, *lines, *table;
 	int y;
 
 	if (!data)
@@ -129,26 +152,7 @@ void ImageData_ConvertSRGB(byte *data, int width, int height, int pitch, int bpp
 	if (srcSRGB == dstSRGB)
 		return;
 
-	if (dstSRGB == true)
-	{
-		// linear->sRGB
-		lines = data;
-		for (y = 0; y < height; y++)
-		{
-			in = lines;
-			end = in + width*bpp;
-			while(in < end)
-			{
-				in[0] = (byte)floor(linear_to_srgb((float)in[0] / 255.0f) * 255.0f + 0.5f);
-				in[1] = (byte)floor(linear_to_srgb((float)in[1] / 255.0f) * 255.0f + 0.5f);
-				in[2] = (byte)floor(linear_to_srgb((float)in[2] / 255.0f) * 255.0f + 0.5f);
-				in += bpp;
-			}
-			lines += pitch;
-		}
-		return;
-	}
-	// sRGB->linear
+	table = dstSRGB ? image_linearToSRGB : image_sRGBToLinear;
 	lines = data;
 	for (y = 0; y < height; y++)
 	{
@@ -156,73 +160,221 @@ void ImageData_ConvertSRGB(byte *data, int width, int height, int pitch, int bpp
 		end = in + width*bpp;
 		while(in < end)
 		{
-			in[0] = (byte)floor(srgb_to_linear((float)in[0] / 255.0f) * 255.0f + 0.5f);
-			in[1] = (byte)floor(srgb_to_linear((float)in[1] / 255.0f) * 255.0f + 0.5f);
-			in[2] = (byte)floor(srgb_to_linear((float)in[2] / 255.0f) * 255.0f + 0.5f);
+			in[0] = table[in[0]];
+			in[1] = table[in[1]];
+			in[2] = table[in[2]];
 			in += bpp;
 		}
 		lines += pitch;
 	}
 }
 
-// probe linear image for 16-bit color sRGB conversion, if overall quality will increase, return true
-// smart conversion: if sRGB colorspace will cause a quality increase (i.e. image contains many dark pixels), convert it
-bool ImageData_ProbeLinearToSRGB_16bit(byte *data, int width, int height, int pitch, int bpp, bool rgbSwap)
+// running totals of ImageData_CalcStats
+typedef struct
+{
+	unsigned int histogram[4][256]; // one per pixel lane, so runs of same alpha don't serialize on one counter
+	byte         mins[4];
+	byte         maxs[4];
+	double       sums[3];           // RGB order
+	double       samples;
+	size_t       dark;
+	size_t       bright;
+} ImageStatsAccum;
+
+// dark pixels are visible ones with luma up to 30, they get 2.5-4x more precision if stored as sRGB
+#define STATS_LUMA_R         299
+#define STATS_LUMA_G         587
+#define STATS_LUMA_B         114
+#define STATS_LUMA_THRESHOLD 30000
+
+template <int bpp>
+static void ImageData_StatsRow(byte *in, int width, int r, int b, ImageStatsAccum *acc)
 {
-	int h;
-	float grayscale;
-	size_t lowpixels = 0, highpixels = 0;
-	byte *in, *end;
-	if (rgbSwap)
+	unsigned int sum[3], samples, luma, x, visible;
+	size_t dark, bright;
+	byte mins[4], maxs[4];
+	int c;
+
+	sum[0] = sum[1] = sum[2] = samples = 0;
+	dark = bright = 0;
+	for (c = 0; c < 4; c++)
+	{
+		mins[c] = acc->mins[c];
+		maxs[c] = acc->maxs[c];
+	}
+	for (x = 0; x < (unsigned int)width; x++, in += bpp)
 	{
-		for (h = 0; h < height; h++)
+		for (c = 0; c < bpp; c++)
 		{
-			in = data;
-			end = in + width * bpp;
-			while(in < end)
-			{
-				grayscale = (float)in[0] * 0.299f + (float)in[1] * 0.587f + (float)in[2] * 0.114f;
-				if (bpp == 4 && in[3] == 0)
-					grayscale = 0;
-				if (grayscale > 0) // skip black and transparent pixels
-				{
-					if (grayscale > 30)
-						highpixels++;
-					else
-						lowpixels++;
-				}
-				in += bpp;
-			}
-			data += pitch;
+			mins[c] = min(mins[c], in[c]);
+			maxs[c] = max(maxs[c], in[c]);
 		}
+		if (bpp == 4)
+			acc->histogram[x & 3][in[3]]++;
+		// black pixels add nothing to sums and are not counted, branchless as they are mixed randomly with others
+		sum[0] += in[r];
+		sum[1] += in[1];
+		sum[2] += in[b];
+		visible = (in[0] | in[1] | in[2]) ? 1 : 0;
+		samples += visible;
+		if (bpp == 4)
+			visible &= in[3] ? 1 : 0;
+		luma = in[r] * STATS_LUMA_R + in[1] * STATS_LUMA_G + in[b] * STATS_LUMA_B;
+		bright += visible & (luma > STATS_LUMA_THRESHOLD ? 1 : 0);
+		dark += visible & (luma > STATS_LUMA_THRESHOLD ? 0 : 1);
 	}
-	else
+	for (c = 0; c < 4; c++)
+	{
+		acc->mins[c] = mins[c];
+		acc->maxs[c] = maxs[c];
+	}
+	acc->sums[0] += sum[0];
+	acc->sums[1] += sum[1];
+	acc->sums[2] += sum[2];
+	acc->samples += samples;
+	acc->dark += dark;
+	acc->bright += bright;
+}
+
+#ifdef CPU_SSE2_INTRINSICS
+
+static const int stats_bits[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+// 4 pixels at once, only alpha histogram is scalar
+static void ImageData_StatsRow4_SSE2(byte *in, int width, int r, int b, ImageStatsAccum *acc)
+{
+	__m128i zero, weights, colorMask, alphaMask, threshold, mins, maxs, sum16, sum32;
+	__m128i p, lo, hi, m0, m1, luma, black, hidden, bright;
+	unsigned int samples, sum[4];
+	short w[8];
+	byte lanes[2][16];
+	int x, i, block, hiddenBits, brightBits;
+
+	w[r] = w[r + 4] = STATS_LUMA_R;
+	w[1] = w[5] = STATS_LUMA_G;
+	w[b] = w[b + 4] = STATS_LUMA_B;
+	w[3] = w[7] = 0;
+	zero = _mm_setzero_si128();
+	weights = _mm_loadu_si128((__m128i *)w);
+	colorMask = _mm_set1_epi32(0x00FFFFFF);
+	alphaMask = _mm_set1_epi32((int)0xFF000000);
+	threshold = _mm_set1_epi32(STATS_LUMA_THRESHOLD);
+	mins = _mm_set1_epi32(*(int *)acc->mins);
+	maxs = _mm_set1_epi32(*(int *)acc->maxs);
+	sum32 = zero;
+	samples = 0;
+	x = 0;
+	while (x + 4 <= width)
 	{
-		for (h = 0; h < height; h++)
+		// 16-bit sums hold 128 iterations
+		block = min(128, (width - x) / 4);
+		sum16 = zero;
+		for (i = 0; i < block; i++, in += 16, x += 4)
 		{
-			in = data;
-			end = in + width * bpp;
-			while(in < end)
-			{
-				grayscale = (float)in[2] * 0.299f + (float)in[1] * 0.587f + (float)in[0] * 0.114f;
-				if (bpp == 4 && in[3] == 0)
-					grayscale = 0;
-				if (grayscale > 0) // skip black and transparent pixels
-				{
-					if (grayscale > 30) // pixels < 30 have 2.5-4x more precision 
-						highpixels++;
-					else
-						lowpixels++;
-				}
-				in += bpp;
-			}
-			data += pitch;
+			p = _mm_loadu_si128((__m128i *)in);
+			mins = _mm_min_epu8(mins, p);
+			maxs = _mm_max_epu8(maxs, p);
+			lo = _mm_unpacklo_epi8(p, zero);
+			hi = _mm_unpackhi_epi8(p, zero);
+			sum16 = _mm_add_epi16(sum16, _mm_add_epi16(lo, hi));
+			m0 = _mm_madd_epi16(lo, weights);
+			m1 = _mm_madd_epi16(hi, weights);
+			luma = _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(m0), _mm_castsi128_ps(m1), _MM_SHUFFLE(2, 0, 2, 0))), _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(m0), _mm_castsi128_ps(m1), _MM_SHUFFLE(3, 1, 3, 1))));
+			black = _mm_cmpeq_epi32(_mm_and_si128(p, colorMask), zero);
+			hidden = _mm_or_si128(black, _mm_cmpeq_epi32(_mm_and_si128(p, alphaMask), zero));
+			bright = _mm_andnot_si128(hidden, _mm_cmpgt_epi32(luma, threshold));
+			hiddenBits = _mm_movemask_ps(_mm_castsi128_ps(hidden));
+			brightBits = _mm_movemask_ps(_mm_castsi128_ps(bright));
+			samples += 4 - stats_bits[_mm_movemask_ps(_mm_castsi128_ps(black))];
+			acc->bright += stats_bits[brightBits];
+			acc->dark += 4 - stats_bits[hiddenBits] - stats_bits[brightBits];
+			acc->histogram[0][in[3]]++;
+			acc->histogram[1][in[7]]++;
+			acc->histogram[2][in[11]]++;
+			acc->histogram[3][in[15]]++;
 		}
+		sum32 = _mm_add_epi32(sum32, _mm_add_epi32(_mm_unpacklo_epi16(sum16, zero), _mm_unpackhi_epi16(sum16, zero)));
 	}
-	//printf("lowpixels %i, highpixels %i\n", lowpixels, highpixels); 
-	if (lowpixels > highpixels)
-		return true;
-	return false;
+
+	// gather lanes
+	_mm_storeu_si128((__m128i *)sum, sum32);
+	acc->sums[0] += sum[r];
+	acc->sums[1] += sum[1];
+	acc->sums[2] += sum[b];
+	acc->samples += samples;
+	_mm_storeu_si128((__m128i *)lanes[0], mins);
+	_mm_storeu_si128((__m128i *)lanes[1], maxs);
+	for (i = 0; i < 4; i++)
+	{
+		acc->mins[i] = min(min(lanes[0][i], lanes[0][i + 4]), min(lanes[0][i + 8], lanes[0][i + 12]));
+		acc->maxs[i] = max(max(lanes[1][i], lanes[1][i + 4]), max(lanes[1][i + 8], lanes[1][i + 12]));
+	}
+	if (x < width)
+		ImageData_StatsRow<4>(in, width - x, r, b, acc);
+}
+
+#endif
+
+// gather image statistics in one pass
+void ImageData_CalcStats(byte *data, int width, int height, int pitch, int bpp, bool rgbSwap, ImageStats *stats)
+{
+	ImageStatsAccum *acc;
+	int y, r, b, c, i, need_grad;
+	size_t num_grad;
+	bool sse2;
+
+	memset(stats, 0, sizeof(ImageStats));
+	acc = (ImageStatsAccum *)mem_alloc(sizeof(ImageStatsAccum));
+	memset(acc, 0, sizeof(ImageStatsAccum));
+	memset(acc->mins, 255, 4);
+	r = rgbSwap ? 2 : 0;
+	b = rgbSwap ? 0 : 2;
+	sse2 = false;
+#ifdef CPU_SSE2_INTRINSICS
+	sse2 = CPU_HasSSE2();
+#endif
+	for (y = 0; y < height; y++, data += pitch)
+	{
+#ifdef CPU_SSE2_INTRINSICS
+		if (bpp == 4 && sse2)
+		{
+			ImageData_StatsRow4_SSE2(data, width, r, b, acc);
+			continue;
+		}
+#endif
+		if (bpp == 4)
+			ImageData_StatsRow<4>(data, width, r, b, acc);
+		else
+			ImageData_StatsRow<3>(data, width, r, b, acc);
+	}
+
+	// store
+	stats->valid = true;
+	stats->pixels = (size_t)width * height;
+	for (c = 0; c < 4; c++)
+	{
+		stats->minColor[c] = (c < bpp) ? acc->mins[c] : 255;
+		stats->maxColor[c] = (c < bpp) ? acc->maxs[c] : 255;
+	}
+	if (acc->samples > 0)
+		for (c = 0; c < 3; c++)
+			stats->averageColor[c] = (byte)min(255.0, acc->sums[c] / acc->samples);
+	stats->darkPixels = acc->dark;
+	stats->brightPixels = acc->bright;
+
+	// alpha type
+	if (bpp == 4)
+	{
+		for (c = 0; c < 256; c++)
+			for (i = 0; i < 4; i++)
+				stats->alphaHistogram[c] += acc->histogram[i][c];
+		num_grad = 0;
+		need_grad = (int)(width*height*(100.0f - tex_binaryAlphaThreshold)/100.0f);
+		for (c = tex_binaryAlphaMin; c <= tex_binaryAlphaMax; c++)
+			num_grad += stats->alphaHistogram[c];
+		stats->gradientAlpha = (stats->pixels > 0 && (double)num_grad > need_grad) ? true : false;
+	}
+	mem_free(acc);
 }
 
 /*
@@ -289,61 +441,79 @@ void Image_SwapColors(LoadedImage *image, bool swappedColor)
 	image->colorSwap = swappedColor;
 }
 
-// calculate image averaged color
-void Image_CalcAverageColor(LoadedImage *image)
+// get statistics, they are gathered again if image was altered after load
+ImageStats *Image_GetStats(LoadedImage *image)
+{
+	byte *data;
+	int pitch;
+
+	if (!image->bitmap)
+		return &image->stats;
+	if (image->stats.valid && !memcmp(&image->stats.state, &image->width, sizeof(ImageState)))
+		return &image->stats;
+	data = fiGetData(image->bitmap, &pitch);
+	ImageData_CalcStats(data, image->width, image->height, pitch, image->bpp, image->colorSwap, &image->stats);
+	memcpy(&image->stats.state, &image->width, sizeof(ImageState));
+	return &image->stats;
+}
+
+// create base map and numMaps-1 halved levels in one allocation, only base level pixels are filled
+// base level uses bitmap pixels in place if lines are tight, unless copyBase is set (map will be changed)
+// headersOnly makes maps without pixels, for code that makes level data by parts (tiled compression)
+ImageMap *Image_CreateMaps(LoadedImage *image, int numMaps, bool copyBase, bool headersOnly)
 {
-	double avgcolor[3];
-	long samples;
-	int w, r, g, b, pitch, y;
+	ImageMap *map;
+	size_t headersize, datasize;
+	byte *base, *chain, *out;
+	int l, w, h, pitch, y;
 
-	samples = 0;
-	avgcolor[0] = 0;
-	avgcolor[1] = 0;
-	avgcolor[2] = 0;
-	byte *data = fiGetData(image->bitmap, &pitch);
-	if (image->colorSwap == true)
-	{
-		r = 2;
-		g = 1;
-		b = 0;
-	}
-	else
-	{
-		r = 0;
-		g = 1;
-		b = 2;
-	}
-	w = FreeImage_GetWidth(image->bitmap);
-	for (y = 0; y < image->height; y++)
+	FreeImageMaps(image);
+	base = fiGetData(image->bitmap, &pitch);
+	if (pitch != image->width*image->bpp)
+		copyBase = true;
+	if (headersOnly)
+		copyBase = false;
+
+	// layout
+	headersize = (sizeof(ImageMap)*numMaps + IMAGE_MAP_ALIGN - 1) / IMAGE_MAP_ALIGN * IMAGE_MAP_ALIGN;
+	datasize = 0;
+	for (l = 0, w = image->width, h = image->height; l < numMaps; l++, w /= 2, h /= 2)
+		if ((l > 0 || copyBase) && !headersOnly)
+			datasize += w*h*image->bpp;
+	image->mapData = mem_alloc(headersize + datasize + IMAGE_MAP_ALIGN - 1);
+	chain = (byte *)(((size_t)image->mapData + IMAGE_MAP_ALIGN - 1) / IMAGE_MAP_ALIGN * IMAGE_MAP_ALIGN);
+	memset(chain, 0, headersize);
+	image->maps = (ImageMap *)chain;
+
+	// fill map headers
+	out = chain + headersize;
+	for (l = 0, w = image->width, h = image->height; l < numMaps; l++, w /= 2, h /= 2)
 	{
-		byte *in = data;
-		byte *end = in + w*image->bpp;
-		while(in < end)
+		map = &image->maps[l];
+		map->level = l;
+		map->width = w;
+		map->height = h;
+		map->datasize = w*h*image->bpp;
+		if (headersOnly)
+			map->data = NULL;
+		else if (l == 0 && !copyBase)
+			map->data = base;
+		else
 		{
-			// only use not-black pixels
-			if (in[0] != 0 || in[1] != 0 || in[2] != 0)
-			{
-				avgcolor[0] += (float)in[r] / 255.0f;
-				avgcolor[1] += (float)in[g] / 255.0f;
-				avgcolor[2] += (float)in[b] / 255.0f;
-				samples++;
-			}
-			in += image->bpp;
+			map->data = out;
+			out += map->datasize;
 		}
-		data += pitch;
+		map->next = (l < numMaps - 1) ? &image->maps[l + 1] : NULL;
 	}
-	if (samples)
+
+	// copy base level
+	if (copyBase)
 	{
-		avgcolor[0] = min(1.0f, max(0.0f, avgcolor[0] / samples));
-		avgcolor[1] = min(1.0f, max(0.0f, avgcolor[1] / samples));
-		avgcolor[2] = min(1.0f, max(0.0f, avgcolor[2] / samples));
+		out = image->maps->data;
+		for (y = 0; y < image->height; y++, base += pitch, out += image->width*image->bpp)
+			memcpy(out, base, image->width*image->bpp);
 	}
-
-	// store
-	image->hasAverageColor = true;
-	image->averagecolor[0] = (byte)(avgcolor[0] * 255.0f);
-	image->averagecolor[1] = (byte)(avgcolor[1] * 255.0f);
-	image->averagecolor[2] = (byte)(avgcolor[2] * 255.0f);
+	return image->maps;
 }
 
 void Image_FreeMaps(LoadedImage *image)
@@ -359,8 +529,27 @@ int NextPowerOfTwo(int n)
     return 1 << ((((int*)&d)[1]>>20)-1022); 
 }
 
+// same algorithm on thread's scratch buffers with stages fused, see super2x.h
+static void Image_Scale2x_Super2x_Native(LoadedImage *image, int nw, int nh, ThreadData *thread)
+{
+	int pitch, scaled_pitch;
+
+	if (image->bpp != 4 && (image->hasAlpha || image->bpp != 3))
+		Image_ConvertBPP(image, 4);
+	if (!Super2x_Check(image->width, image->height))
+		return;
+	int bpp = image->hasAlpha ? 4 : 3;
+	FIBITMAP *scaled = fiCreate(nw, nh, bpp, "Image_Scale2x_Super2x");
+	byte *data_scaled = fiGetData(scaled, &scaled_pitch);
+	byte *data_bitmap = fiGetData(image->bitmap, &pitch);
+	Super2x_Scale(data_bitmap, pitch, image->bpp, image->width, image->height, image->hasAlpha, tex_binaryAlphaMin, data_scaled, scaled_pitch, nw, nh, thread);
+	fiBindToImage(scaled, image);
+	image->bpp = bpp;
+	image->scaled = true;
+}
+
 // scale for 4x and then backscale 1/2 for better quality
-void Image_Scale2x_Super2x(LoadedImage *image, bool makePowerOfTwo)
+void Image_Scale2x_Super2x(LoadedImage *image, bool makePowerOfTwo, ThreadData *thread)
 {
 	byte *in, *end, *out;
 	byte palette[1024];
@@ -368,6 +557,19 @@ void Image_Scale2x_Super2x(LoadedImage *image, bool makePowerOfTwo)
 	if (!image->bitmap)
 		return;
 
+	if (tex_nativeSuper2x)
+	{
+		int nw = image->width * 2;
+		int nh = image->height * 2;
+		if (makePowerOfTwo)
+		{
+			nw = NextPowerOfTwo(nw);
+			nh = NextPowerOfTwo(nh);
+		}
+		Image_Scale2x_Super2x_Native(image, nw, nh, thread);
+		return;
+	}
+
 	// scale2x does not allows BPP = 3
 	// convert to 4 (and convert back after finish)
 	if (image->bpp != 4)
@@ -451,23 +653,22 @@ void Image_Scale2x(LoadedImage *image, int factor)
 	if (!image->bitmap)
 		return;
 
-	// scale2x does not allows BPP = 3
-	// convert to 4 (and convert back after finish)
-	if (image->bpp != 4)
+	// SIMD scaler takes both 24 and 32 bit pixels, others are converted to 4 (and converted back after finish)
+	if (image->bpp != 3 && image->bpp != 4)
 		Image_ConvertBPP(image, 4);
 
 	// check if we can scale
-	if (sxCheck(factor, image->bpp, image->width, image->height) != SCALEX_OK)
+	if (!Scale2x_Check(factor, image->bpp, image->width, image->height))
 		return;
 
 	// scale
-	// vortex: since BPP is 4, data is always properly aligned, so we dont need pitch
 	int w = image->width;
 	int h = image->height;
-	FIBITMAP *scaled = fiCreate(w*factor, h*factor, 4, "Image_Scale2x");
-	byte *data_scaled = fiGetData(scaled, NULL);
-	byte *data_bitmap = fiGetData(image->bitmap, NULL);
-	sxScale(factor, data_scaled, w*factor*4, data_bitmap, w*4, 4, w, h);
+	int pitch, scaled_pitch;
+	FIBITMAP *scaled = fiCreate(w*factor, h*factor, image->bpp, "Image_Scale2x");
+	byte *data_scaled = fiGetData(scaled, &scaled_pitch);
+	byte *data_bitmap = fiGetData(image->bitmap, &pitch);
+	Scale2x_Scale(factor, data_scaled, scaled_pitch, data_bitmap, pitch, image->bpp, w, h);
 	fiBindToImage(scaled, image);
 
 	// finish
@@ -476,8 +677,45 @@ void Image_Scale2x(LoadedImage *image, int factor)
 	image->scaled = true;
 }
 
+// source pixels per xBRZ job, so slice and it's scaled rows stay in cache
+#define XBRZ_SLICE_PIXELS 16384
+
+typedef struct
+{
+	int                    factor;
+	const uint32_t        *src;
+	uint32_t              *dst;
+	int                    width;
+	int                    height;
+	int                    rows;
+	const xbrz::ScalerCfg *cfg;
+} XbrzSlices;
+
+static void Image_ScalexBR_Job(void *data, int job)
+{
+	XbrzSlices *slices = (XbrzSlices *)data;
+
+	xbrz::scale(slices->factor, slices->src, slices->dst, slices->width, slices->height, *slices->cfg, job * slices->rows, min(slices->height, (job + 1) * slices->rows));
+}
+
+// xBRZ scale by slices of rows spread over idle threads
+// each slice preprocesses row above it on it's own, so result is same as with a single call
+static void Image_ScalexBR_Slices(ThreadData *thread, int factor, byte *src, byte *dst, int width, int height, const xbrz::ScalerCfg *cfg)
+{
+	XbrzSlices slices;
+
+	slices.factor = factor;
+	slices.src = (const uint32_t *)src;
+	slices.dst = (uint32_t *)dst;
+	slices.width = width;
+	slices.height = height;
+	slices.rows = max(2, XBRZ_SLICE_PIXELS / max(1, width));
+	slices.cfg = cfg;
+	ParallelJobs(thread, (height + slices.rows - 1) / slices.rows, &slices, Image_ScalexBR_Job);
+}
+
 // scale using xBR scaler
-void Image_ScalexBR(LoadedImage *image, int factor)
+void Image_ScalexBR(LoadedImage *image, int factor, ThreadData *thread)
 {
 	xbrz::ScalerCfg scalerconfig;
 
@@ -509,12 +747,12 @@ void Image_ScalexBR(LoadedImage *image, int factor)
 			out += 4;
 		}
 		// alpha scale
-		xbrz::scale(factor, (uint32_t *)alpha, (uint32_t *)fiGetData(scaled, NULL), image->width, image->height, scalerconfig, 0, image->height);
+		Image_ScalexBR_Slices(thread, factor, alpha, fiGetData(scaled, NULL), image->width, image->height, &scalerconfig);
 		mem_free(alpha);
 		// RGB scale
 		Image_SetAlpha(image, 0);
 		FIBITMAP *rgb_scaled = fiCreate(image->width*factor, image->height*factor, 4, "fiCreate");
-		xbrz::scale(factor, (uint32_t *)fiGetData(image->bitmap, NULL), (uint32_t *)fiGetData(rgb_scaled, NULL), image->width, image->height, scalerconfig, 0, image->height);
+		Image_ScalexBR_Slices(thread, factor, fiGetData(image->bitmap, NULL), fiGetData(rgb_scaled, NULL), image->width, image->height, &scalerconfig);
 		// combine and return
 		fiCombine(rgb_scaled, scaled, COMBINE_R_TO_ALPHA, 1, true);
 		fiBindToImage(rgb_scaled, image);
@@ -525,7 +763,7 @@ void Image_ScalexBR(LoadedImage *image, int factor)
 	// RGB scale
 	Image_ConvertBPP(image, 4);
 	Image_SetAlpha(image, 0);
-	xbrz::scale(factor, (uint32_t *)fiGetData(image->bitmap, NULL), (uint32_t *)fiGetData(scaled, NULL), image->width, image->height, scalerconfig, 0, image->height);
+	Image_ScalexBR_Slices(thread, factor, fiGetData(image->bitmap, NULL), fiGetData(scaled, NULL), image->width, image->height, &scalerconfig);
 	fiBindToImage(scaled, image);
 	Image_ConvertBPP(image, 3);
 	image->scaled = true;
@@ -533,7 +771,7 @@ void Image_ScalexBR(LoadedImage *image, int factor)
 
 // Image_ScalexBR_Super2x
 // scale to 4x then backscale to 2x using xBR scaling
-void Image_ScalexBR_Super2x(LoadedImage *image, bool makePowerOfTwo)
+void Image_ScalexBR_Super2x(LoadedImage *image, bool makePowerOfTwo, ThreadData *thread)
 {
 	FIBITMAP *backscale1;
 
@@ -544,7 +782,7 @@ void Image_ScalexBR_Super2x(LoadedImage *image, bool makePowerOfTwo)
 		dstwidth = NextPowerOfTwo(dstwidth);
 		dstheight = NextPowerOfTwo(dstheight);
 	}
-	Image_ScalexBR(image, 4);
+	Image_ScalexBR(image, 4, thread);
 	if (image->bpp == 4)
 	{
 		// backscale RGB with interpolation
@@ -563,14 +801,14 @@ void Image_ScalexBR_Super2x(LoadedImage *image, bool makePowerOfTwo)
 }
 
 // scale image by 2x using different scale technique
-void Image_ScaleBy2(LoadedImage *image, ImageScaler scaler, bool makePowerOfTwo)
+void Image_ScaleBy2(LoadedImage *image, ImageScaler scaler, bool makePowerOfTwo, ThreadData *thread)
 {
 	if (!image->bitmap)
 		return;
 
 	if (scaler == IMAGE_SCALER_SUPER2X)
 	{
-		Image_Scale2x_Super2x(image, makePowerOfTwo);
+		Image_Scale2x_Super2x(image, makePowerOfTwo, thread);
 		return;
 	}
 	if (scaler == IMAGE_SCALER_SCALE2X)
@@ -580,12 +818,12 @@ void Image_ScaleBy2(LoadedImage *image, ImageScaler scaler, bool makePowerOfTwo)
 	}
 	if (scaler == IMAGE_SCALER_XBRZ)
 	{
-		Image_ScalexBR(image, 2);
+		Image_ScalexBR(image, 2, thread);
 		return;
 	}
 	if (scaler == IMAGE_SCALER_SBRZ)
 	{
-		Image_ScalexBR_Super2x(image, makePowerOfTwo);
+		Image_ScalexBR_Super2x(image, makePowerOfTwo, thread);
 		return;
 	}
 
@@ -615,12 +853,12 @@ void Image_ScaleBy2(LoadedImage *image, ImageScaler scaler, bool makePowerOfTwo)
 }
 
 // scale image by 4x using different scale technique
-void Image_ScaleBy4(LoadedImage *image, ImageScaler scaler, ImageScaler scaler2, bool makePowerOfTwo)
+void Image_ScaleBy4(LoadedImage *image, ImageScaler scaler, ImageScaler scaler2, bool makePowerOfTwo, ThreadData *thread)
 {
 	// instand 4x scale
 	if (scaler == IMAGE_SCALER_XBRZ && scaler2 == IMAGE_SCALER_XBRZ)
 	{
-		Image_ScalexBR(image, 4);
+		Image_ScalexBR(image, 4, thread);
 		return;
 	}
 	if (scaler == IMAGE_SCALER_SCALE2X && scaler2 == IMAGE_SCALER_SCALE2X)
@@ -629,8 +867,8 @@ void Image_ScaleBy4(LoadedImage *image, ImageScaler scaler, ImageScaler scaler2,
 		return;
 	}
 	// apply 2x scale two times
-	Image_ScaleBy2(image, scaler, false);
-	Image_ScaleBy2(image, scaler2, makePowerOfTwo);
+	Image_ScaleBy2(image, scaler, false, thread);
+	Image_ScaleBy2(image, scaler2, makePowerOfTwo, thread);
 }
 
 // scale for 4x and then backscale 1/2 for best quality
@@ -681,6 +919,7 @@ void Image_MakeAlphaBinary(LoadedImage *image, int thresh)
 	}
 	image->hasGradientAlpha = false;
 	image->swizzled = true;
+	image->stats.valid = false;
 }
 
 // force alpha to certain value
@@ -696,6 +935,7 @@ void Image_SetAlpha(LoadedImage *image, byte value)
 		data += image->bpp;
 	}
 	image->swizzled = true;
+	image->stats.valid = false;
 }
 
 byte *Image_GetData(LoadedImage *image, size_t *datasize, int *pitch)
@@ -728,6 +968,7 @@ void Image_StoreUnalignedData(LoadedImage *image, byte *dataptr, size_t datasize
 	if (!image->bitmap)
 		return;
 	fiStoreUnalignedData(image->bitmap, dataptr, image->width, image->height, image->bpp);
+	image->stats.valid = false;
 }
 
 void Image_FreeUnalignedData(byte *dataptr, bool data_allocated)
@@ -894,39 +1135,19 @@ void Image_LoadFinish(LoadedImage *image)
 	else if (image->bpp != 3 && image->bpp != 4)
 		Image_ConvertBPP(image, 3);
 
+	// gather statistics (alpha type, average color etc.)
+	image->stats.valid = false;
+	Image_GetStats(image);
+
 	// check alpha
-	image->hasAlpha = false;
+	image->hasAlpha = (image->bpp == 4) ? true : false;
 	image->hasGradientAlpha = false;
 	if (image->bpp == 4)
-	{
-		int num_grad = 0;
-		int need_grad = (int)(image->width*image->height*(100.0f - tex_binaryAlphaThreshold)/100.0f);
-		long pixels = image->width*image->height*image->bpp;
-		// vortex: since BPP is 4, data is always properly aligned, so we dont need pitch
-		byte *data = fiGetData(image->bitmap, NULL);
-		image->hasAlpha = true;
-		if (!tex_detectBinaryAlpha)
-			image->hasGradientAlpha = true;
-		else
-		{
-			for (long i = 0; i < pixels; i+= image->bpp)
-			{
-				if (data[i+3] >= tex_binaryAlphaMin && data[i+3] <= tex_binaryAlphaMax)
-					num_grad++;
-				if (num_grad > need_grad)
-				{
-					image->hasGradientAlpha = true;
-					break;
-				}
-			}
-		}
-	}
-
-	// calc average color
-	Image_CalcAverageColor(image);
+		image->hasGradientAlpha = tex_detectBinaryAlpha ? image->stats.gradientAlpha : true;
 
 	// save the loaded state (for comparison if image was altered)
 	memcpy(&image->loadedState, &image->width, sizeof(ImageState));
+	memcpy(&image->stats.state, &image->width, sizeof(ImageState));
 }
 
 byte quake_palette[768] = { 0,0,0,15,15,15,31,31,31,47,47,47,63,63,63,75,75,75,91,91,91,107,107,107,123,123,123,139,139,139,155,155,155,171,171,171,187,187,187,203,203,203,219,219,219,235,235,235,15,11,7,23,15,11,31,23,11,39,27,15,47,35,19,55,43,23,63,47,23,75,55,27,83,59,27,91,67,31,99,75,31,107,83,31,115,87,31,123,95,35,131,103,35,143,111,35,11,11,15,19,19,27,27,27,39,39,39,51,47,47,63,55,55,75,63,63,87,71,71,103,79,79,115,91,91,127,99,99,139,107,107,151,115,115,163,123,123,175,131,131,187,139,139,203,0,0,0,7,7,0,11,11,0,19,19,0,27,27,0,35,35,0,43,43,7,47,47,7,55,55,7,63,63,7,71,71,7,75,75,11,83,83,11,91,91,11,99,99,11,107,107,15,7,0,0,15,0,0,23,0,0,31,0,0,39,0,0,47,0,0,55,0,0,63,0,0,71,0,0,79,0,0,87,0,0,95,0,0,103,0,0,111,0,0,119,0,0,127,0,0,19,19,0,27,27,0,35,35,0,47,43,0,55,47,0,67,55,0,75,59,7,87,67,7,95,71,7,107,75,11,119,83,15,131,87,19,139,91,19,151,95,27,163,99,31,175,103,35,35,19,7,47,23,11,59,31,15,75,35,19,87,43,23,99,47,31,115,55,35,127,59,43,143,67,51,159,79,51,175,99,47,191,119,47,207,143,43,223,171,39,239,203,31,255,243,27,11,7,0,27,19,0,43,35,15,55,43,19,71,51,27,83,55,35,99,63,43,111,71,51,127,83,63,139,95,71,155,107,83,167,123,95,183,135,107,195,147,123,211,163,139,227,179,151,171,139,163,159,127,151,147,115,135,139,103,123,127,91,111,119,83,99,107,75,87,95,63,75,87,55,67,75,47,55,67,39,47,55,31,35,43,23,27,35,19,19,23,11,11,15,7,7,187,115,159,175,107,143,163,95,131,151,87,119,139,79,107,127,75,95,115,67,83,107,59,75,95,51,63,83,43,55,71,35,43,59,31,35,47,23,27,35,19,19,23,11,11,15,7,7,219,195,187,203,179,167,191,163,155,175,151,139,163,135,123,151,123,111,135,111,95,123,99,83,107,87,71,95,75,59,83,63,51,67,51,39,55,43,31,39,31,23,27,19,15,15,11,7,111,131,123,103,123,111,95,115,103,87,107,95,79,99,87,71,91,79,63,83,71,55,75,63,47,67,55,43,59,47,35,51,39,31,43,31,23,35,23,15,27,19,11,19,11,7,11,7,255,243,27,239,223,23,219,203,19,203,183,15,187,167,15,171,151,11,155,131,7,139,115,7,123,99,7,107,83,0,91,71,0,75,55,0,59,43,0,43,31,0,27,15,0,11,7,0,0,0,255,11,11,239,19,19,223,27,27,207,35,35,191,43,43,175,47,47,159,47,47,143,47,47,127,47,47,111,47,47,95,43,43,79,35,35,63,27,27,47,19,19,31,11,11,15,43,0,0,59,0,0,75,7,0,95,7,0,111,15,0,127,23,7,147,31,7,163,39,11,183,51,15,195,75,27,207,99,43,219,127,59,227,151,79,231,171,95,239,191,119,247,211,139,167,123,59,183,155,55,199,195,55,231,227,87,127,191,255,171,231,255,215,255,255,103,0,0,139,0,0,179,0,0,215,0,0,255,0,0,255,243,147,255,247,199,255,255,255,159,91,83 };
@@ -1032,7 +1253,12 @@ void Image_Load(FS_File *file, LoadedImage *image)
 	filedata = FS_LoadFile(file, &filesize);
 	if (!filedata)
 		return;
+	Image_LoadData(file, filedata, filesize, image);
+}
 
+// decode file contents already read from disk, filedata is freed
+void Image_LoadData(FS_File *file, byte *filedata, size_t filesize, LoadedImage *image)
+{
 	ClearImage(image);
 	unsigned int fourCC = *(unsigned int *)filedata;
 	if (fourCC == FOURCC('I','D','S','P'))
@@ -1043,6 +1269,24 @@ void Image_Load(FS_File *file, LoadedImage *image)
 		LoadImage_Generic(file, filedata, filesize, image);
 }
 
+// get image dimensions without decoding it, only a beginning of file is read
+bool Image_Probe(FS_File *file, int *width, int *height, HZIP zip)
+{
+	size_t datasize;
+	byte *data;
+	bool res;
+
+	data = FS_LoadFileHeader(file, IMAGE_PROBE_BYTES, &datasize, zip);
+	if (!data)
+		return false;
+	res = false;
+	unsigned int fourCC = (datasize >= 4) ? *(unsigned int *)data : 0;
+	if (fourCC != FOURCC('I','D','S','P') && fourCC != 29)
+		res = fiProbeData(FIF_UNKNOWN, file, data, datasize, width, height);
+	mem_free(data);
+	return res;
+}
+
 /*
 ==========================================================================================
 
@@ -1106,6 +1350,11 @@ void Image_Init(void)
 #endif
 	FreeImage_SetOutputMessage(FreeImageErrorHandler);
 
+	// colorspace conversion tables
+	ImageData_InitSRGB();
+	Mip_Init();
+	Scale2x_Init();
+
 	// init omnilib
 	OmnilibSetMemFunc(omnilib_malloc, omnilib_realloc, omnilib_free);
 	OmnilibSetMessageFunc(omnilib_print_message, omnilib_error);
@@ -6,6 +6,9 @@
 #include "fs.h"
 #include "options.h"
 
+// how much of file is read to get image dimensions
+#define IMAGE_PROBE_BYTES 16384
+
 typedef struct ImageMap_s
 {
 	int         level;
@@ -13,11 +16,14 @@ typedef struct ImageMap_s
 	int         height;
 	byte       *data;
 	size_t      datasize; // size of data
-	bool        external; // using external data, do not free
 	bool        sRGB;     // using sRGB colorspace
 	ImageMap_s *next;
 }ImageMap;
 
+// maps are laid out in one allocation (map headers, then levels tightly packed one after another)
+// so tools may treat consecutive levels as one chain, pixel data starts at this alignment
+#define IMAGE_MAP_ALIGN 16
+
 // data type
 typedef enum
 {
@@ -75,6 +81,21 @@ typedef struct ImageState_s
 	bool         unused3;  
 } ImageState;
 
+// image statistics, gathered in one pass over pixels when image is loaded
+typedef struct ImageStats_s
+{
+	bool         valid;
+	ImageState   state;              // image state statistics were gathered for
+	size_t       pixels;
+	size_t       alphaHistogram[256];
+	bool         gradientAlpha;      // alpha values between tex_binaryAlphaMin and tex_binaryAlphaMax exceed tex_binaryAlphaThreshold
+	byte         minColor[4];        // per channel, in memory order
+	byte         maxColor[4];
+	byte         averageColor[3];    // average of non-black pixels, RGB order
+	size_t       darkPixels;         // visible pixels which gain precision if stored as sRGB
+	size_t       brightPixels;       // visible pixels which do not
+} ImageStats;
+
 typedef struct LoadedImage_s
 {
 	// load-time parameters
@@ -103,12 +124,12 @@ typedef struct LoadedImage_s
 
 	// special
 	ImageMap    *maps;          // generated maps
+	void        *mapData;       // allocation holding maps and their pixels
 	char         texname[128];  // null if there is no custom texture name
 	bool         useTexname;
 
-	// texture average color (used by exporter)
-	byte         averagecolor[3];
-	bool         hasAverageColor;
+	// pixel statistics, use Image_GetStats() to get them up to date
+	ImageStats   stats;
 
 	// set by texture tool
 	ImageType    datatype;
@@ -121,12 +142,15 @@ LoadedImage;
 LoadedImage *Image_Create(void);
 void  Image_Generate(LoadedImage *image, int width, int height, int bpp);
 void  Image_Load(FS_File *file, LoadedImage *image);
+void  Image_LoadData(FS_File *file, byte *filedata, size_t filesize, LoadedImage *image);
+bool  Image_Probe(FS_File *file, int *width, int *height, HZIP zip = NULL);
 void  Image_LoadFinish(LoadedImage *image);
 bool  Image_Changed(LoadedImage *image);
 void  Image_GenerateMaps(LoadedImage *image, bool overwrite, bool miplevels, bool binaryalpha, bool srgb);
+ImageMap *Image_CreateMaps(LoadedImage *image, int numMaps, bool copyBase, bool headersOnly);
 void  Image_FreeMaps(LoadedImage *image);
-void  Image_ScaleBy2(LoadedImage *image, ImageScaler scaler, bool makePowerOfTwo);
-void  Image_ScaleBy4(LoadedImage *image, ImageScaler scaler, ImageScaler scaler2, bool makePowerOfTwo);
+void  Image_ScaleBy2(LoadedImage *image, ImageScaler scaler, bool makePowerOfTwo, ThreadData *thread);
+void  Image_ScaleBy4(LoadedImage *image, ImageScaler scaler, ImageScaler scaler2, bool makePowerOfTwo, ThreadData *thread);
 void  Image_MakeDimensions(LoadedImage *image, bool powerOfTwo, bool square);
 void  Image_MakeAlphaBinary(LoadedImage *image, int thresh);
 void  Image_SetAlpha(LoadedImage *image, byte value);
@@ -140,13 +164,14 @@ void  Image_Delete(LoadedImage *image);
 // raw data functions
 void ImageData_SwapRB(byte *data, int width, int height, int pitch, int bpp);
 void ImageData_ConvertSRGB(byte *data, int width, int height, int pitch, int bpp, bool srcSRGB, bool dstSRGB);
-bool ImageData_ProbeLinearToSRGB_16bit(byte *data, int width, int height, int pitch, int bpp, bool rgbSwap);
+const byte *ImageData_SRGBTable(bool toSRGB);
+void ImageData_CalcStats(byte *data, int width, int height, int pitch, int bpp, bool rgbSwap, ImageStats *stats);
 
 // internal color conversion
 void  Image_ConvertBPP(LoadedImage *image, int bpp);
 void  Image_ConvertSRGB(LoadedImage *image, bool useSRGB);
 void  Image_SwapColors(LoadedImage *image, bool swappedColor);
-void  Image_CalcAverageColor(LoadedImage *image);
+ImageStats *Image_GetStats(LoadedImage *image);
 byte *Image_GenerateTarga(size_t *outsize, int width, int height, int bpp, byte *data, bool flip, bool rgb, bool grayscale);
 bool  Image_Save(LoadedImage *image, char *filename);
 byte *Image_ExportTarga(LoadedImage *image, size_t *tgasize);
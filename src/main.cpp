@@ -29,6 +29,7 @@ int Help(void)
 	"    -opt X: load custom option file\n"
 	"   -errlog: write errlog.txt on error\n"
 	"  -version: show external modules and their version\n"
+	"    -bench: run benchmarks of optimized routines\n"
 	"\n");
 	Tex_PrintCodecs();
 	Tex_PrintTools();
@@ -126,7 +127,8 @@ int main(int argc, char **argv)
 	FS_Init();
 	Image_Init();
 	Thread_Init();
-	if (!numthreads)
+	bool autothreads = numthreads ? false : true;
+	if (autothreads)
 		numthreads = num_cpu_cores;
 	Tex_Init();
 
@@ -136,6 +138,8 @@ int main(int argc, char **argv)
 		Print(" RwgTex v%s.%s by Pavel [VorteX] Timofeyev\n", RWGTEX_VERSION_MAJOR, RWGTEX_VERSION_MINOR);
 		Print("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
 		Print("%i threads", numthreads);
+		if (autothreads && num_cpu_limit[0])
+			Print(" (limited by %s)", num_cpu_limit);
 		if (memstats)
 			Print(", showing memstats");
 		if (waitforkey)
@@ -151,6 +155,9 @@ int main(int argc, char **argv)
 	}
 	else if (CheckParm("-version"))
 		returncode = PrintModules();
+	//COMMANDLINEPARM: -bench: run benchmarks of optimized routines
+	else if (CheckParm("-bench"))
+		returncode = Bench_Run();
 	else
 		returncode = Help();
 	Print("\n");
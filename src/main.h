@@ -11,6 +11,8 @@
 #include "dll.h"
 #include "options.h"
 #include "thread.h"
+#include "writer.h"
+#include "bench.h"
 #include "image.h"
 #include "tex.h"
 #include "fs.h"
@@ -10,6 +10,12 @@
 #include "mem.h"
 #include <string>
 #include <vector>
+#ifdef WIN32
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
 using namespace std;
 
 typedef struct
@@ -27,8 +33,16 @@ size_t              total_allocated;
 size_t              total_active;
 size_t              total_active_peak;
 vector<memsentinel> sentinels;
-HANDLE              sentinelMutex = NULL;
-HANDLE              sentinelMutex2 = NULL;
+ThreadMutex         sentinelMutex;
+ThreadMutex         sentinelMutex2;
+
+// memory admission
+size_t              mem_budget;
+size_t              mem_reserved;
+size_t              mem_reserved_peak;
+int                 mem_reserve_waiters;
+ThreadMutex         mem_reserve_mutex;
+ThreadSemaphore     mem_reserve_signal;
 
 void Mem_Error(char *message_format, ...) 
 {
@@ -52,8 +66,15 @@ void Mem_Init(void)
 	total_active_peak = 0;
 
 	sentinels.clear();
-	sentinelMutex = CreateMutex(NULL, FALSE, NULL);
-	sentinelMutex2 = CreateMutex(NULL, FALSE, NULL);
+	Thread_MutexInit(&sentinelMutex);
+	Thread_MutexInit(&sentinelMutex2);
+
+	mem_budget = 0;
+	mem_reserved = 0;
+	mem_reserved_peak = 0;
+	mem_reserve_waiters = 0;
+	Thread_MutexInit(&mem_reserve_mutex);
+	Thread_SemaphoreInit(&mem_reserve_signal, 0);
 }
 
 void Mem_Shutdown(void)
@@ -77,6 +98,8 @@ void Mem_Shutdown(void)
 		Print(" Dynamic memory usage stats\n");
 		Print("----------------------------------------\n");
 		Print("        Peak allocated: %.3f Mb\n", (double)total_active_peak / 1048576.0 );
+		if (mem_budget)
+			Print("         Peak reserved: %.3f Mb (budget %.3f Mb)\n", (double)mem_reserved_peak / 1048576.0, (double)mem_budget / 1048576.0 );
 		Print("       total allocated: %.3f Mb\n", (double)total_allocated / 1048576.0 );
 		Print("                 leaks: %.3f Mb\n", (double)leaked / 1048576.0 );
 		if (leaks)
@@ -91,14 +114,18 @@ void Mem_Shutdown(void)
 	}
 	initialized = false;
 	sentinels.clear();
+	Thread_MutexDestroy(&sentinelMutex);
+	Thread_MutexDestroy(&sentinelMutex2);
+	Thread_MutexDestroy(&mem_reserve_mutex);
+	Thread_SemaphoreDestroy(&mem_reserve_signal);
 }
 
 void _mem_sentinel(char *name, void *ptr, size_t size, char *file, int line)
 {
-	if (!memstats)
+	if (!memstats || !initialized)
 		return;
 
-	WaitForSingleObject(sentinelMutex, INFINITE);
+	Thread_MutexLock(&sentinelMutex);
 
 	// create sentinel
 	// pick free one or allocate
@@ -135,15 +162,15 @@ void _mem_sentinel(char *name, void *ptr, size_t size, char *file, int line)
 	if (total_active > total_active_peak)
 		total_active_peak = total_active;
 
-	ReleaseMutex(sentinelMutex);
+	Thread_MutexUnlock(&sentinelMutex);
 }
 
 bool _mem_sentinel_free(char *name, void *ptr, char *file, int line)
 {
-	if (!memstats)
+	if (!memstats || !initialized)
 		return true;
 
-	WaitForSingleObject(sentinelMutex2, INFINITE);
+	Thread_MutexLock(&sentinelMutex2);
 	// find sentinel for pointer
 	int found = -1;
 	for (std::vector<memsentinel>::iterator s = sentinels.begin(); s < sentinels.end(); s++)
@@ -170,7 +197,7 @@ bool _mem_sentinel_free(char *name, void *ptr, char *file, int line)
 			break;
 		}
 	}
-	ReleaseMutex(sentinelMutex2);
+	Thread_MutexUnlock(&sentinelMutex2);
 	// oops, this pointer was not allocated
 	if (found == 1)
 		return true;
@@ -274,3 +301,130 @@ void _mem_free(void **data, char *file, int line)
 	free(ptr);
 	*data = NULL;
 }
+
+/*
+==========================================================================================
+
+  Memory admission
+
+  Workers reserve estimated memory use of a texture before loading it and
+  wait if it does not fit into the budget. A reservation bigger than the
+  whole budget is let through when nothing else is reserved.
+
+==========================================================================================
+*/
+
+// detect how much memory this process may use
+size_t Mem_DetectLimit(void)
+{
+	unsigned long long limit = 0;
+
+#ifdef WIN32
+	MEMORYSTATUSEX status;
+
+	status.dwLength = sizeof(status);
+	if (GlobalMemoryStatusEx(&status))
+		limit = min(status.ullTotalPhys, status.ullTotalVirtual);
+#else
+	long pages = sysconf(_SC_PHYS_PAGES);
+	long pagesize = sysconf(_SC_PAGESIZE);
+	if (pages > 0 && pagesize > 0)
+		limit = (unsigned long long)pages * (unsigned long long)pagesize;
+	// container limit (cgroup v2, then v1)
+	const char *cgroupfiles[] = { "/sys/fs/cgroup/memory.max", "/sys/fs/cgroup/memory/memory.limit_in_bytes", NULL };
+	for (int i = 0; cgroupfiles[i]; i++)
+	{
+		FILE *f = fopen(cgroupfiles[i], "r");
+		if (!f)
+			continue;
+		unsigned long long cgroup_limit = 0;
+		char line[64];
+		if (fgets(line, sizeof(line), f) && strncmp(line, "max", 3))
+			cgroup_limit = strtoull(line, NULL, 10);
+		fclose(f);
+		if (cgroup_limit > 0 && (!limit || cgroup_limit < limit))
+			limit = cgroup_limit;
+		break;
+	}
+#endif
+	if ((unsigned long long)(size_t)limit != limit)
+		return (size_t)-1;
+	return (size_t)limit;
+}
+
+// set memory budget in bytes, 0 picks 3/4 of detected memory limit
+void Mem_SetBudget(size_t budget)
+{
+	if (!budget)
+	{
+		budget = Mem_DetectLimit();
+		budget = budget / 4 * 3;
+	}
+	mem_budget = budget;
+}
+
+size_t Mem_GetBudget(void)
+{
+	return mem_budget;
+}
+
+// reserve memory, blocks until it fits into the budget
+void Mem_Reserve(size_t size)
+{
+	if (!size)
+		return;
+	Thread_MutexLock(&mem_reserve_mutex);
+	while(mem_budget && mem_reserved > 0 && mem_reserved + size > mem_budget)
+	{
+		mem_reserve_waiters++;
+		Thread_MutexUnlock(&mem_reserve_mutex);
+		Thread_SemaphoreWait(&mem_reserve_signal);
+		Thread_MutexLock(&mem_reserve_mutex);
+	}
+	mem_reserved += size;
+	if (mem_reserved > mem_reserved_peak)
+		mem_reserved_peak = mem_reserved;
+	Thread_MutexUnlock(&mem_reserve_mutex);
+}
+
+// release reserved memory, waiting threads are woken to try again
+void Mem_Release(size_t size)
+{
+	if (!size)
+		return;
+	Thread_MutexLock(&mem_reserve_mutex);
+	mem_reserved -= min(size, mem_reserved);
+	Thread_SemaphorePost(&mem_reserve_signal, mem_reserve_waiters);
+	mem_reserve_waiters = 0;
+	Thread_MutexUnlock(&mem_reserve_mutex);
+}
+
+// true if some thread waits for budget, so memory held outside of reservations should be given back
+bool Mem_Pressure(void)
+{
+	bool pressure;
+
+	if (!mem_budget)
+		return false;
+	Thread_MutexLock(&mem_reserve_mutex);
+	pressure = mem_reserve_waiters > 0;
+	Thread_MutexUnlock(&mem_reserve_mutex);
+	return pressure;
+}
+
+// peak physical memory used by process (working set), 0 if unknown
+size_t Mem_PeakUsage(void)
+{
+#ifdef WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+
+	if (!getrusage(RUSAGE_SELF, &usage))
+		return (size_t)usage.ru_maxrss * 1024;
+#endif
+	return 0;
+}
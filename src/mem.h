@@ -19,4 +19,13 @@ void _mem_sentinel(char *name, void *ptr, size_t size, char *file, int line);
 bool _mem_sentinel_free(char *name, void *ptr, char *file, int line);
 #define mem_sentinel_free(name, ptr) _mem_sentinel_free(name, ptr, __FILE__, __LINE__)
 
+// memory admission
+size_t Mem_DetectLimit(void);
+void   Mem_SetBudget(size_t budget);
+size_t Mem_GetBudget(void);
+void   Mem_Reserve(size_t size);
+void   Mem_Release(size_t size);
+bool   Mem_Pressure(void);
+size_t Mem_PeakUsage(void);
+
 #endif
\ No newline at end of file
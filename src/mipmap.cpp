@@ -0,0 +1,579 @@
+////////////////////////////////////////////////////////////////
+//
+// RwgTex / mipmap generation
+// (c) Pavel [VorteX] Timofeyev
+// See LICENSE text file for a license agreement
+//
+////////////////////////////////
+
+#include "main.h"
+#include "mipmap.h"
+#include "cpu.h"
+#include <math.h>
+
+#ifdef CPU_SSE2_INTRINSICS
+#include <emmintrin.h>
+#endif
+#ifdef CPU_AVX2_INTRINSICS
+#include <immintrin.h>
+#endif
+
+#define MIP_PI          3.14159265358979323846
+#define MIP_ENCODE_SIZE 65536 // linear to sRGB table entries, fine enough to round exactly
+
+// weights of one axis, for each output pixel there are 'taps' source pixels
+typedef struct
+{
+	int    taps;
+	int   *index;   // source pixel, clamped to edges
+	float *weight;  // normalized
+}MipWeights;
+
+static bool  mip_initialized = false;
+static float mip_toFloat[256];
+static float mip_toLinear[256];
+static byte  mip_toSRGB[MIP_ENCODE_SIZE];
+static const char *mip_backend = "generic";
+
+static void (*mip_horizontal)(const float *line, float *out, const MipWeights *wx, int width);
+static void (*mip_vertical)(float **rows, const float *weights, int taps, float *out, int count);
+
+/*
+==========================================================================================
+
+  Filter kernels
+
+==========================================================================================
+*/
+
+static double Mip_Sinc(double x)
+{
+	if (x == 0)
+		return 1.0;
+	x *= MIP_PI;
+	return sin(x) / x;
+}
+
+// Mitchell-Netravali family of cubics
+static double Mip_Cubic(double x, double B, double C)
+{
+	x = fabs(x);
+	if (x < 1)
+		return ((12 - 9*B - 6*C)*x*x*x + (-18 + 12*B + 6*C)*x*x + (6 - 2*B)) / 6;
+	if (x < 2)
+		return ((-B - 6*C)*x*x*x + (6*B + 30*C)*x*x + (-12*B - 48*C)*x + (8*B + 24*C)) / 6;
+	return 0;
+}
+
+static double Mip_FilterSupport(ImageScaler filter)
+{
+	if (filter == IMAGE_SCALER_BOX)        return 0.5;
+	if (filter == IMAGE_SCALER_BILINEAR)   return 1.0;
+	if (filter == IMAGE_SCALER_BICUBIC)    return 2.0;
+	if (filter == IMAGE_SCALER_BSPLINE)    return 2.0;
+	if (filter == IMAGE_SCALER_CATMULLROM) return 2.0;
+	return 3.0;
+}
+
+static double Mip_FilterWeight(ImageScaler filter, double x)
+{
+	if (filter == IMAGE_SCALER_BOX)
+		return (x >= -0.5 && x < 0.5) ? 1.0 : 0.0;
+	if (filter == IMAGE_SCALER_BILINEAR)
+		return (fabs(x) < 1.0) ? 1.0 - fabs(x) : 0.0;
+	if (filter == IMAGE_SCALER_BICUBIC)
+		return Mip_Cubic(x, 1.0/3.0, 1.0/3.0);
+	if (filter == IMAGE_SCALER_BSPLINE)
+		return Mip_Cubic(x, 1.0, 0.0);
+	if (filter == IMAGE_SCALER_CATMULLROM)
+		return Mip_Cubic(x, 0.0, 0.5);
+	return (fabs(x) < 3.0) ? Mip_Sinc(x) * Mip_Sinc(x / 3.0) : 0.0;
+}
+
+// precompute weights for resampling an axis, when downscaling kernel is stretched by scale factor
+// leading and trailing zero weights are trimmed so box and bilinear don't waste taps
+static void Mip_BuildWeights(MipWeights *weights, int srcsize, int dstsize, ImageScaler filter)
+{
+	double ratio, scale, support, center, total, w;
+	int i, k, taps, first, last, left, *index;
+	double *wt;
+
+	ratio = (double)srcsize / (double)dstsize;
+	scale = max(ratio, 1.0);
+	support = Mip_FilterSupport(filter) * scale;
+	taps = (int)ceil(support * 2) + 1;
+	wt = (double *)mem_alloc(sizeof(double) * taps);
+	index = (int *)mem_alloc(sizeof(int) * dstsize * 2);
+
+	// find widest span of non-zero weights
+	weights->taps = 1;
+	for (i = 0; i < dstsize; i++)
+	{
+		center = (i + 0.5) * ratio;
+		left = (int)floor(center - support);
+		first = -1;
+		last = -1;
+		for (k = 0; k < taps; k++)
+		{
+			if (Mip_FilterWeight(filter, (left + k + 0.5 - center) / scale) != 0)
+			{
+				if (first < 0)
+					first = k;
+				last = k;
+			}
+		}
+		if (first < 0)
+		{
+			// no coverage, nearest pixel
+			first = last = (int)(center - left);
+		}
+		index[i*2] = left + first;
+		index[i*2 + 1] = last - first + 1;
+		if (weights->taps < last - first + 1)
+			weights->taps = last - first + 1;
+	}
+
+	// fill tables, padding taps repeat last pixel with zero weight
+	weights->index = (int *)mem_alloc(sizeof(int) * dstsize * weights->taps);
+	weights->weight = (float *)mem_alloc(sizeof(float) * dstsize * weights->taps);
+	for (i = 0; i < dstsize; i++)
+	{
+		center = (i + 0.5) * ratio;
+		left = index[i*2];
+		total = 0;
+		for (k = 0; k < index[i*2 + 1]; k++)
+		{
+			wt[k] = Mip_FilterWeight(filter, (left + k + 0.5 - center) / scale);
+			total += wt[k];
+		}
+		if (total == 0)
+		{
+			wt[0] = 1.0;
+			total = 1.0;
+		}
+		for (k = 0; k < weights->taps; k++)
+		{
+			w = (k < index[i*2 + 1]) ? wt[k] / total : 0.0;
+			weights->index[i*weights->taps + k] = max(0, min(srcsize - 1, left + min(k, index[i*2 + 1] - 1)));
+			weights->weight[i*weights->taps + k] = (float)w;
+		}
+	}
+	mem_free(wt);
+	mem_free(index);
+}
+
+static void Mip_FreeWeights(MipWeights *weights)
+{
+	mem_free(weights->index);
+	mem_free(weights->weight);
+}
+
+/*
+==========================================================================================
+
+  Row processing
+
+  Pixels are kept as 4 floats (alpha is 1 for 3-channel images), so each pixel is one SSE register
+
+==========================================================================================
+*/
+
+static void Mip_DecodeRow(const byte *in, float *out, int width, int bpp, const float *colorTable)
+{
+	const byte *end = in + width * bpp;
+
+	if (bpp == 4)
+	{
+		for (; in < end; in += 4, out += 4)
+		{
+			out[0] = colorTable[in[0]];
+			out[1] = colorTable[in[1]];
+			out[2] = colorTable[in[2]];
+			out[3] = mip_toFloat[in[3]];
+		}
+		return;
+	}
+	for (; in < end; in += bpp, out += 4)
+	{
+		out[0] = colorTable[in[0]];
+		out[1] = colorTable[in[1]];
+		out[2] = colorTable[in[2]];
+		out[3] = 1.0f;
+	}
+}
+
+// colors go through linear to sRGB table, alpha is always linear
+static void Mip_EncodeRow(const float *in, byte *out, int width, int bpp, bool sRGB)
+{
+	float scale = sRGB ? (float)(MIP_ENCODE_SIZE - 1) : 255.0f;
+	int x, c, v;
+
+	for (x = 0; x < width; x++, in += 4, out += bpp)
+	{
+		for (c = 0; c < 3; c++)
+		{
+			v = (int)(in[c] * scale + 0.5f);
+			v = (in[c] <= 0) ? 0 : min(v, (int)scale);
+			out[c] = sRGB ? mip_toSRGB[v] : (byte)v;
+		}
+		if (bpp == 4)
+		{
+			v = (int)(in[3] * 255.0f + 0.5f);
+			out[3] = (in[3] <= 0) ? 0 : (byte)min(v, 255);
+		}
+	}
+}
+
+static void Mip_Horizontal_Generic(const float *line, float *out, const MipWeights *wx, int width)
+{
+	const int *index = wx->index;
+	const float *weight = wx->weight;
+	const float *s;
+	float r, g, b, a;
+	int x, k;
+
+	for (x = 0; x < width; x++, out += 4)
+	{
+		r = g = b = a = 0;
+		for (k = 0; k < wx->taps; k++, index++, weight++)
+		{
+			s = line + *index * 4;
+			r += *weight * s[0];
+			g += *weight * s[1];
+			b += *weight * s[2];
+			a += *weight * s[3];
+		}
+		out[0] = r;
+		out[1] = g;
+		out[2] = b;
+		out[3] = a;
+	}
+}
+
+static void Mip_Vertical_Generic(float **rows, const float *weights, int taps, float *out, int count)
+{
+	float v;
+	int i, k;
+
+	for (i = 0; i < count; i++)
+	{
+		v = 0;
+		for (k = 0; k < taps; k++)
+			v += weights[k] * rows[k][i];
+		out[i] = v;
+	}
+}
+
+#ifdef CPU_SSE2_INTRINSICS
+
+static void Mip_Horizontal_SSE2(const float *line, float *out, const MipWeights *wx, int width)
+{
+	const int *index = wx->index;
+	const float *weight = wx->weight;
+	__m128 acc;
+	int x, k;
+
+	for (x = 0; x < width; x++, out += 4)
+	{
+		acc = _mm_setzero_ps();
+		for (k = 0; k < wx->taps; k++, index++, weight++)
+			acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(*weight), _mm_loadu_ps(line + *index * 4)));
+		_mm_storeu_ps(out, acc);
+	}
+}
+
+static void Mip_Vertical_SSE2(float **rows, const float *weights, int taps, float *out, int count)
+{
+	__m128 acc;
+	int i, k;
+
+	for (i = 0; i < count; i += 4)
+	{
+		acc = _mm_setzero_ps();
+		for (k = 0; k < taps; k++)
+			acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(rows[k] + i)));
+		_mm_storeu_ps(out + i, acc);
+	}
+}
+
+#endif
+
+#ifdef CPU_AVX2_INTRINSICS
+
+// two output pixels per register, same order of operations as SSE2 so results match bit to bit,
+// generic path may differ in last bit if compiler keeps floats in x87 registers (-bench checks all paths)
+CPU_TARGET("avx2") static void Mip_Horizontal_AVX2(const float *line, float *out, const MipWeights *wx, int width)
+{
+	const int *ia, *ib;
+	const float *wa, *wb;
+	__m256 acc, w, s;
+	__m128 acc1;
+	int x, k, taps = wx->taps;
+
+	for (x = 0; x + 1 < width; x += 2, out += 8)
+	{
+		ia = wx->index + x * taps;
+		ib = ia + taps;
+		wa = wx->weight + x * taps;
+		wb = wa + taps;
+		acc = _mm256_setzero_ps();
+		for (k = 0; k < taps; k++)
+		{
+			w = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(wa[k])), _mm_set1_ps(wb[k]), 1);
+			s = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(line + ia[k] * 4)), _mm_loadu_ps(line + ib[k] * 4), 1);
+			acc = _mm256_add_ps(acc, _mm256_mul_ps(w, s));
+		}
+		_mm256_storeu_ps(out, acc);
+	}
+	if (x < width)
+	{
+		ia = wx->index + x * taps;
+		wa = wx->weight + x * taps;
+		acc1 = _mm_setzero_ps();
+		for (k = 0; k < taps; k++)
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_set1_ps(wa[k]), _mm_loadu_ps(line + ia[k] * 4)));
+		_mm_storeu_ps(out, acc1);
+	}
+}
+
+CPU_TARGET("avx2") static void Mip_Vertical_AVX2(float **rows, const float *weights, int taps, float *out, int count)
+{
+	__m256 acc;
+	__m128 acc1;
+	int i, k;
+
+	for (i = 0; i + 8 <= count; i += 8)
+	{
+		acc = _mm256_setzero_ps();
+		for (k = 0; k < taps; k++)
+			acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(rows[k] + i)));
+		_mm256_storeu_ps(out + i, acc);
+	}
+	if (i < count)
+	{
+		acc1 = _mm_setzero_ps();
+		for (k = 0; k < taps; k++)
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(rows[k] + i)));
+		_mm_storeu_ps(out + i, acc1);
+	}
+}
+
+#endif
+
+/*
+==========================================================================================
+
+  Downsampler
+
+==========================================================================================
+*/
+
+static double Mip_SRGBToLinear(double v)
+{
+	return (v <= 0.04045) ? v / 12.92 : pow((v + 0.055) / 1.055, 2.4);
+}
+
+static double Mip_LinearToSRGB(double v)
+{
+	return (v <= 0.0031308) ? v * 12.92 : 1.055 * pow(v, 1.0 / 2.4) - 0.055;
+}
+
+void Mip_Init(void)
+{
+	int i;
+
+	if (mip_initialized)
+		return;
+	mip_initialized = true;
+
+	// tables
+	for (i = 0; i < 256; i++)
+	{
+		mip_toFloat[i] = (float)(i / 255.0);
+		mip_toLinear[i] = (float)Mip_SRGBToLinear(i / 255.0);
+	}
+	for (i = 0; i < MIP_ENCODE_SIZE; i++)
+		mip_toSRGB[i] = (byte)max(0, min(255, (int)floor(Mip_LinearToSRGB((double)i / (MIP_ENCODE_SIZE - 1)) * 255.0 + 0.5)));
+
+	Mip_UseBackend(NULL);
+}
+
+// select code path by name, NULL picks the best one, returns false if it is not available
+bool Mip_UseBackend(const char *name)
+{
+	Mip_Init();
+	if (!name)
+	{
+		mip_horizontal = Mip_Horizontal_Generic;
+		mip_vertical = Mip_Vertical_Generic;
+		mip_backend = "generic";
+#ifdef CPU_SSE2_INTRINSICS
+		if (CPU_HasSSE2())
+		{
+			mip_horizontal = Mip_Horizontal_SSE2;
+			mip_vertical = Mip_Vertical_SSE2;
+			mip_backend = "SSE2";
+		}
+#endif
+#ifdef CPU_AVX2_INTRINSICS
+		if (CPU_HasAVX2())
+		{
+			mip_horizontal = Mip_Horizontal_AVX2;
+			mip_vertical = Mip_Vertical_AVX2;
+			mip_backend = "AVX2";
+		}
+#endif
+		return true;
+	}
+	if (!stricmp(name, "generic"))
+	{
+		mip_horizontal = Mip_Horizontal_Generic;
+		mip_vertical = Mip_Vertical_Generic;
+		mip_backend = "generic";
+		return true;
+	}
+#ifdef CPU_SSE2_INTRINSICS
+	if (!stricmp(name, "SSE2") && CPU_HasSSE2())
+	{
+		mip_horizontal = Mip_Horizontal_SSE2;
+		mip_vertical = Mip_Vertical_SSE2;
+		mip_backend = "SSE2";
+		return true;
+	}
+#endif
+#ifdef CPU_AVX2_INTRINSICS
+	if (!stricmp(name, "AVX2") && CPU_HasAVX2())
+	{
+		mip_horizontal = Mip_Horizontal_AVX2;
+		mip_vertical = Mip_Vertical_AVX2;
+		mip_backend = "AVX2";
+		return true;
+	}
+#endif
+	return false;
+}
+
+const char *Mip_Backend(void)
+{
+	return mip_backend;
+}
+
+/*
+==========================================================================================
+
+  Row streaming
+
+  Source rows are filtered horizontally as they come and kept in a ring of vertical taps size,
+  so each source row is decoded and filtered only once. An output row is made as soon as
+  all of it's taps are in the ring, so the whole source never has to be in memory
+
+==========================================================================================
+*/
+
+struct MipStream_s
+{
+	MipWeights   wx;
+	MipWeights   wy;
+	const float *colorTable;
+	float       *line;
+	float       *ring;
+	float       *out;
+	float      **rows;
+	int         *ringRow;
+	int          rowFloats;
+	int          srcwidth;
+	int          dstheight;
+	int          bpp;
+	bool         sRGB;
+	int          pushed; // source rows pushed
+	int          pulled; // output rows made
+};
+
+MipStream *Mip_BeginStream(int srcwidth, int srcheight, int dstwidth, int dstheight, int bpp, ImageScaler filter, bool sRGB)
+{
+	MipStream *stream;
+	int k;
+
+	Mip_Init();
+	if (filter > IMAGE_SCALER_LANCZOS)
+		filter = IMAGE_SCALER_LANCZOS;
+	stream = (MipStream *)mem_alloc(sizeof(MipStream));
+	memset(stream, 0, sizeof(MipStream));
+	Mip_BuildWeights(&stream->wx, srcwidth, dstwidth, filter);
+	Mip_BuildWeights(&stream->wy, srcheight, dstheight, filter);
+	stream->colorTable = sRGB ? mip_toLinear : mip_toFloat;
+	stream->rowFloats = dstwidth * 4;
+	stream->srcwidth = srcwidth;
+	stream->dstheight = dstheight;
+	stream->bpp = bpp;
+	stream->sRGB = sRGB;
+	stream->line = (float *)mem_alloc(sizeof(float) * srcwidth * 4);
+	stream->ring = (float *)mem_alloc(sizeof(float) * stream->rowFloats * stream->wy.taps);
+	stream->out = (float *)mem_alloc(sizeof(float) * stream->rowFloats);
+	stream->rows = (float **)mem_alloc(sizeof(float *) * stream->wy.taps);
+	stream->ringRow = (int *)mem_alloc(sizeof(int) * stream->wy.taps);
+	for (k = 0; k < stream->wy.taps; k++)
+		stream->ringRow[k] = -1;
+	return stream;
+}
+
+// take next source row, rows before the taps of next output row are not needed and skipped
+// taps of an output row are consecutive source rows, so they never share a ring slot
+void Mip_PushRow(MipStream *stream, const byte *row)
+{
+	int sy, slot;
+
+	sy = stream->pushed++;
+	if (stream->pulled >= stream->dstheight || sy < stream->wy.index[stream->pulled * stream->wy.taps])
+		return;
+	slot = sy % stream->wy.taps;
+	Mip_DecodeRow(row, stream->line, stream->srcwidth, stream->bpp, stream->colorTable);
+	mip_horizontal(stream->line, stream->ring + slot * stream->rowFloats, &stream->wx, stream->rowFloats / 4);
+	stream->ringRow[slot] = sy;
+}
+
+// make next output row if all it's source rows were pushed
+// should be called until it returns false after each pushed row, otherwise ring slots are overwritten
+bool Mip_PullRow(MipStream *stream, byte *out)
+{
+	int y, k, taps;
+
+	y = stream->pulled;
+	taps = stream->wy.taps;
+	if (y >= stream->dstheight || stream->wy.index[y * taps + taps - 1] >= stream->pushed)
+		return false;
+	for (k = 0; k < taps; k++)
+		stream->rows[k] = stream->ring + (stream->wy.index[y * taps + k] % taps) * stream->rowFloats;
+	mip_vertical(stream->rows, stream->wy.weight + y * taps, taps, stream->out, stream->rowFloats);
+	Mip_EncodeRow(stream->out, out, stream->rowFloats / 4, stream->bpp, stream->sRGB);
+	stream->pulled++;
+	return true;
+}
+
+void Mip_EndStream(MipStream *stream)
+{
+	mem_free(stream->line);
+	mem_free(stream->ring);
+	mem_free(stream->out);
+	mem_free(stream->rows);
+	mem_free(stream->ringRow);
+	Mip_FreeWeights(&stream->wx);
+	Mip_FreeWeights(&stream->wy);
+	mem_free(stream);
+}
+
+// downsample 3 or 4 channel 8-bit image
+void Mip_Downsample(byte *src, int srcwidth, int srcheight, int srcpitch, byte *dst, int dstwidth, int dstheight, int dstpitch, int bpp, ImageScaler filter, bool sRGB)
+{
+	MipStream *stream;
+	int sy, y;
+
+	stream = Mip_BeginStream(srcwidth, srcheight, dstwidth, dstheight, bpp, filter, sRGB);
+	for (sy = 0, y = 0; sy < srcheight; sy++)
+	{
+		Mip_PushRow(stream, src + sy * srcpitch);
+		while(Mip_PullRow(stream, dst + y * dstpitch))
+			y++;
+	}
+	Mip_EndStream(stream);
+}
@@ -0,0 +1,23 @@
+// mipmap.h
+#ifndef H_TEX_MIPMAP_H
+#define H_TEX_MIPMAP_H
+
+#include "image.h"
+
+// native mipmap downsampler
+// separable polyphase filter (weights are computed once per axis), vertical pass is SSE2/AVX2
+// sRGB images are filtered in linear light through decode/encode tables, alpha is always linear
+// dst may be larger than src too, then kernel is not stretched (used by native super2x)
+void        Mip_Init(void);
+void        Mip_Downsample(byte *src, int srcwidth, int srcheight, int srcpitch, byte *dst, int dstwidth, int dstheight, int dstpitch, int bpp, ImageScaler filter, bool sRGB);
+const char *Mip_Backend(void);
+bool        Mip_UseBackend(const char *name);
+
+// row streaming, source rows are pushed in order and each output row is pulled once it's taps are in
+typedef struct MipStream_s MipStream;
+MipStream  *Mip_BeginStream(int srcwidth, int srcheight, int dstwidth, int dstheight, int bpp, ImageScaler filter, bool sRGB);
+void        Mip_PushRow(MipStream *stream, const byte *row);
+bool        Mip_PullRow(MipStream *stream, byte *out);
+void        Mip_EndStream(MipStream *stream);
+
+#endif
@@ -0,0 +1,484 @@
+////////////////////////////////////////////////////////////////
+//
+// RwgTex / output cache
+// (c) Pavel [VorteX] Timofeyev
+// See LICENSE text file for a license agreement
+//
+////////////////////////////////
+
+#include "main.h"
+#include "outcache.h"
+#include "hash.h"
+#include <algorithm>
+
+#ifdef WIN32
+#include <process.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+/*
+==========================================================================================
+
+  Entry format
+
+  Entries are stored as <cachedir>/xx/xxxxxxxxxxxxxxxx.rtc, named by hex key and spread
+  over 256 subdirectories by its first byte. Entry is a header followed by records of
+  zero-terminated file name (relative to output path) and file data. Header and records
+  also keep stats encoder counted for the source, to be added to stats on a hit.
+
+  Entries are written to temporary file which is then renamed, so several processes can
+  share cache. Modification time of entry is its last use time, it is updated on every hit
+  and drives least recently used eviction.
+
+==========================================================================================
+*/
+
+#define OUTCACHE_MAGIC   FOURCC('R','T','O','C')
+#define OUTCACHE_VERSION 4
+#define OUTCACHE_EXT     "rtc"
+
+typedef struct
+{
+	unsigned int     magic;
+	unsigned int     version;
+	unsigned __int64 key;
+	unsigned int     numfiles;
+	unsigned int     numexported;
+	unsigned int     datasize; // size of records
+	unsigned int     reserved;
+	double           originalMB;
+} OutCacheHeader;
+
+typedef struct
+{
+	unsigned int      namesize; // including terminating zero
+	unsigned int      datasize;
+	OutCacheFileStats stats;
+} OutCacheRecord;
+
+struct OutCacheEntry_s
+{
+	unsigned __int64 key;
+	int              numfiles;
+	int              numexported;
+	double           originalMB;
+	byte            *data;      // records
+	size_t           datasize;
+	size_t           maxsize;
+	size_t           next;      // offset of next record to read
+	int              nextfile;
+};
+
+typedef struct
+{
+	char             dir[MAX_FPATH];
+	double           maxsize;   // bytes
+	bool             active;
+	ThreadMutex      mutex;
+	volatile int     tempfiles;
+} OutCacheData;
+
+typedef struct
+{
+	string           path;
+	unsigned __int64 size;
+	unsigned __int64 mtime;
+} OutCacheFile;
+
+static OutCacheData outcache;
+OutCacheStats outcacheStats;
+
+void OutCache_Init(const char *dir, int maxsizeMB)
+{
+	memset(&outcacheStats, 0, sizeof(outcacheStats));
+	outcache.active = false;
+	if (!dir || !dir[0])
+		return;
+	strlcpy(outcache.dir, dir, sizeof(outcache.dir));
+	AddSlash(outcache.dir);
+	outcache.maxsize = (double)max(maxsizeMB, 1) * 1048576.0;
+	outcache.tempfiles = 0;
+	Thread_MutexInit(&outcache.mutex);
+	outcache.active = true;
+}
+
+bool OutCache_Active(void)
+{
+	return outcache.active;
+}
+
+// chained 64-bit hashes of source bytes, options and lowercased source path
+unsigned __int64 OutCache_Key(const byte *data, size_t datasize, unsigned __int64 options, const char *path)
+{
+	unsigned __int64 hash;
+	char lowpath[MAX_FPATH];
+	size_t i;
+
+	for (i = 0; path[i] && i < sizeof(lowpath) - 1; i++)
+		lowpath[i] = (char)tolower((byte)path[i]);
+	hash = Hash_64(data, datasize, OUTCACHE_VERSION);
+	hash = Hash_64(&options, sizeof(options), hash);
+	return Hash_64(lowpath, i, hash);
+}
+
+static void OutCache_EntryPath(unsigned __int64 key, char *path, size_t pathsize)
+{
+	char name[64];
+
+	sprintf(name, "%02x/%08x%08x.%s", (unsigned int)(key >> 56), (unsigned int)(key >> 32), (unsigned int)key, OUTCACHE_EXT);
+	strlcpy(path, outcache.dir, pathsize);
+	strlcat(path, name, pathsize);
+}
+
+/*
+==========================================================================================
+
+  Lookup
+
+==========================================================================================
+*/
+
+// marks entry as most recently used
+static void OutCache_Touch(const char *path)
+{
+#ifdef WIN32
+	FILETIME now;
+	HANDLE hFile;
+
+	hFile = CreateFile(path, FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return;
+	GetSystemTimeAsFileTime(&now);
+	SetFileTime(hFile, NULL, NULL, &now);
+	CloseHandle(hFile);
+#else
+	utime(path, NULL);
+#endif
+}
+
+// checks that records fit entry data
+static bool OutCache_Validate(OutCacheEntry *entry)
+{
+	OutCacheRecord record;
+	size_t offset;
+	int i;
+
+	offset = 0;
+	for (i = 0; i < entry->numfiles; i++)
+	{
+		if (entry->datasize - offset < sizeof(OutCacheRecord))
+			return false;
+		memcpy(&record, entry->data + offset, sizeof(OutCacheRecord));
+		offset += sizeof(OutCacheRecord);
+		if (!record.namesize || record.namesize > MAX_FPATH || record.namesize > entry->datasize - offset || entry->data[offset + record.namesize - 1])
+			return false;
+		offset += record.namesize;
+		if (record.datasize > entry->datasize - offset)
+			return false;
+		offset += record.datasize;
+	}
+	return offset == entry->datasize;
+}
+
+OutCacheEntry *OutCache_Find(unsigned __int64 key)
+{
+	OutCacheHeader header;
+	OutCacheEntry *entry;
+	char path[MAX_FPATH];
+	bool valid;
+	FILE *f;
+
+	if (!outcache.active)
+		return NULL;
+	OutCache_EntryPath(key, path, sizeof(path));
+	f = fopen(path, "rb");
+	if (!f)
+	{
+		Thread_AtomicAdd(&outcacheStats.misses, 1);
+		return NULL;
+	}
+
+	// read whole entry
+	entry = NULL;
+	valid = false;
+	if (fread(&header, sizeof(header), 1, f) == 1 && header.magic == OUTCACHE_MAGIC && header.version == OUTCACHE_VERSION && header.key == key && Q_filelength(f) == sizeof(header) + header.datasize)
+	{
+		entry = OutCache_NewEntry(key);
+		entry->numfiles = (int)header.numfiles;
+		entry->numexported = (int)header.numexported;
+		entry->originalMB = header.originalMB;
+		entry->datasize = entry->maxsize = header.datasize;
+		entry->data = (byte *)mem_alloc(entry->datasize + 1);
+		if (fread(entry->data, 1, entry->datasize, f) == entry->datasize)
+			valid = OutCache_Validate(entry);
+	}
+	fclose(f);
+
+	// damaged entries (or entries of other version) are dropped
+	if (!valid)
+	{
+		if (entry)
+			OutCache_FreeEntry(entry);
+		remove(path);
+		Thread_AtomicAdd(&outcacheStats.misses, 1);
+		return NULL;
+	}
+	OutCache_Touch(path);
+	Thread_AtomicAdd(&outcacheStats.hits, 1);
+	return entry;
+}
+
+int OutCache_NumFiles(OutCacheEntry *entry)
+{
+	return entry->numfiles;
+}
+
+int OutCache_NumExported(OutCacheEntry *entry)
+{
+	return entry->numexported;
+}
+
+double OutCache_OriginalMB(OutCacheEntry *entry)
+{
+	return entry->originalMB;
+}
+
+// files should be read in order they were added
+const char *OutCache_GetFile(OutCacheEntry *entry, int filenum, byte **data, size_t *datasize, OutCacheFileStats *stats)
+{
+	OutCacheRecord record;
+	const char *name;
+
+	if (filenum < entry->nextfile)
+	{
+		entry->next = 0;
+		entry->nextfile = 0;
+	}
+	while(1)
+	{
+		memcpy(&record, entry->data + entry->next, sizeof(OutCacheRecord));
+		name = (const char *)entry->data + entry->next + sizeof(OutCacheRecord);
+		entry->next += sizeof(OutCacheRecord) + record.namesize + record.datasize;
+		if (entry->nextfile++ == filenum)
+			break;
+	}
+	*datasize = record.datasize;
+	if (stats)
+		memcpy(stats, &record.stats, sizeof(OutCacheFileStats));
+	*data = (byte *)mem_alloc(record.datasize);
+	memcpy(*data, name + record.namesize, record.datasize);
+	return name;
+}
+
+void OutCache_FreeEntry(OutCacheEntry *entry)
+{
+	if (entry->data)
+		mem_free(entry->data);
+	mem_free(entry);
+}
+
+/*
+==========================================================================================
+
+  Storing
+
+==========================================================================================
+*/
+
+OutCacheEntry *OutCache_NewEntry(unsigned __int64 key)
+{
+	OutCacheEntry *entry;
+
+	entry = (OutCacheEntry *)mem_alloc(sizeof(OutCacheEntry));
+	memset(entry, 0, sizeof(OutCacheEntry));
+	entry->key = key;
+	return entry;
+}
+
+void OutCache_AddFile(OutCacheEntry *entry, const char *name, const byte *data, size_t datasize, const OutCacheFileStats *stats)
+{
+	OutCacheRecord record;
+	size_t size;
+
+	memset(&record, 0, sizeof(record));
+	record.namesize = (unsigned int)strlen(name) + 1;
+	record.datasize = (unsigned int)datasize;
+	if (stats)
+		memcpy(&record.stats, stats, sizeof(OutCacheFileStats));
+	else
+		record.stats.codec = -1;
+	size = sizeof(OutCacheRecord) + record.namesize + datasize;
+	if (entry->datasize + size > entry->maxsize)
+	{
+		entry->maxsize = max(entry->maxsize * 2, entry->datasize + size);
+		entry->data = (byte *)mem_realloc(entry->data, entry->maxsize);
+	}
+	memcpy(entry->data + entry->datasize, &record, sizeof(OutCacheRecord));
+	memcpy(entry->data + entry->datasize + sizeof(OutCacheRecord), name, record.namesize);
+	memcpy(entry->data + entry->datasize + sizeof(OutCacheRecord) + record.namesize, data, datasize);
+	entry->datasize += size;
+	entry->numfiles++;
+}
+
+void OutCache_Store(OutCacheEntry *entry, int numexported, double originalMB)
+{
+	OutCacheHeader header;
+	char path[MAX_FPATH], tempname[MAX_FPATH];
+	bool written;
+	FILE *f;
+
+	if (!outcache.active || entry->datasize > 0x7FFFFFFF)
+	{
+		OutCache_FreeEntry(entry);
+		return;
+	}
+	memset(&header, 0, sizeof(header));
+	header.magic = OUTCACHE_MAGIC;
+	header.version = OUTCACHE_VERSION;
+	header.key = entry->key;
+	header.numfiles = (unsigned int)entry->numfiles;
+	header.numexported = (unsigned int)numexported;
+	header.datasize = (unsigned int)entry->datasize;
+	header.originalMB = originalMB;
+
+	// temporary name is unique for process and thread, so concurrent writers never collide
+	OutCache_EntryPath(entry->key, path, sizeof(path));
+	CreatePath(path);
+#ifdef WIN32
+	sprintf(tempname, "%s.%u.%i.tmp", path, (unsigned int)_getpid(), Thread_AtomicAdd(&outcache.tempfiles, 1));
+#else
+	sprintf(tempname, "%s.%u.%i.tmp", path, (unsigned int)getpid(), Thread_AtomicAdd(&outcache.tempfiles, 1));
+#endif
+	written = false;
+	f = fopen(tempname, "wb");
+	if (f)
+	{
+		written = (fwrite(&header, sizeof(header), 1, f) == 1);
+		if (written && entry->datasize)
+			written = (fwrite(entry->data, entry->datasize, 1, f) == 1);
+		if (fclose(f))
+			written = false;
+	}
+	if (written)
+	{
+#ifdef WIN32
+		written = MoveFileEx(tempname, path, MOVEFILE_REPLACE_EXISTING) ? true : false;
+#else
+		written = rename(tempname, path) ? false : true;
+#endif
+	}
+	if (!written)
+	{
+		// cache is optional, failed entry is just missing next time
+		remove(tempname);
+		OutCache_FreeEntry(entry);
+		return;
+	}
+	Thread_AtomicAdd(&outcacheStats.stored, 1);
+	Thread_MutexLock(&outcache.mutex);
+	outcacheStats.storedMB += (double)(sizeof(header) + entry->datasize) / 1048576.0;
+	Thread_MutexUnlock(&outcache.mutex);
+	OutCache_FreeEntry(entry);
+}
+
+/*
+==========================================================================================
+
+  Eviction
+
+==========================================================================================
+*/
+
+static bool OutCache_OlderFile(const OutCacheFile &a, const OutCacheFile &b)
+{
+	return a.mtime < b.mtime;
+}
+
+static void OutCache_ScanDir(const char *dir, vector<OutCacheFile> &files)
+{
+	OutCacheFile file;
+#ifdef WIN32
+	WIN32_FIND_DATA n_file;
+	char pattern[MAX_FPATH];
+	HANDLE hFile;
+
+	sprintf(pattern, "%s*.%s", dir, OUTCACHE_EXT);
+	hFile = FindFirstFile(pattern, &n_file);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return;
+	do
+	{
+		if (n_file.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+		file.path = dir;
+		file.path += n_file.cFileName;
+		file.size = ((unsigned __int64)n_file.nFileSizeHigh << 32) | n_file.nFileSizeLow;
+		file.mtime = ((unsigned __int64)n_file.ftLastWriteTime.dwHighDateTime << 32) | n_file.ftLastWriteTime.dwLowDateTime;
+		files.push_back(file);
+	}
+	while(FindNextFile(hFile, &n_file));
+	FindClose(hFile);
+#else
+	struct dirent *de;
+	struct stat st;
+	size_t len;
+	DIR *d;
+
+	d = opendir(dir);
+	if (!d)
+		return;
+	while((de = readdir(d)) != NULL)
+	{
+		len = strlen(de->d_name);
+		if (len <= strlen(OUTCACHE_EXT) + 1 || strcmp(de->d_name + len - strlen(OUTCACHE_EXT), OUTCACHE_EXT) || de->d_name[len - strlen(OUTCACHE_EXT) - 1] != '.')
+			continue;
+		file.path = dir;
+		file.path += de->d_name;
+		if (stat(file.path.c_str(), &st) || !S_ISREG(st.st_mode))
+			continue;
+		file.size = (unsigned __int64)st.st_size;
+		file.mtime = (unsigned __int64)st.st_mtime;
+		files.push_back(file);
+	}
+	closedir(d);
+#endif
+}
+
+// cache only grows when entries are stored, so it is trimmed only after such runs
+void OutCache_Shutdown(void)
+{
+	vector<OutCacheFile> files;
+	char dir[MAX_FPATH];
+	double size;
+	size_t i;
+
+	if (!outcache.active)
+		return;
+	outcache.active = false;
+	if (!outcacheStats.stored)
+		return;
+
+	// least recently used entries go first
+	for (i = 0; i < 256; i++)
+	{
+		sprintf(dir, "%s%02x/", outcache.dir, (unsigned int)i);
+		OutCache_ScanDir(dir, files);
+	}
+	size = 0;
+	for (i = 0; i < files.size(); i++)
+		size += (double)files[i].size;
+	stable_sort(files.begin(), files.end(), OutCache_OlderFile);
+	for (i = 0; i < files.size() && size > outcache.maxsize; i++)
+	{
+		if (remove(files[i].path.c_str()))
+			continue;
+		size -= (double)files[i].size;
+		outcacheStats.evicted++;
+		outcacheStats.evictedMB += (double)files[i].size / 1048576.0;
+	}
+	outcacheStats.sizeMB = size / 1048576.0;
+}
@@ -0,0 +1,58 @@
+// outcache.h
+#ifndef H_TEX_OUTCACHE_H
+#define H_TEX_OUTCACHE_H
+
+#include "main.h"
+
+// output cache: directory of encoded files shared between runs, branches and checkouts
+// entry holds all files generated from one source, it is addressed by a hash of
+// source bytes, options fingerprint (tool versions included) and source path
+typedef struct OutCacheEntry_s OutCacheEntry;
+
+// what encoder counted for a stored file, so stats of a run with cache hits are same as without (except encoding time)
+typedef struct
+{
+	int              codec;    // index of codec which made the file
+	unsigned int     disksize; // encoded size (before -testcompression decoding)
+	unsigned int     ramsize;  // encoded size without container header
+	unsigned int     images;   // encoded images (frame and it's levels)
+	double           inputDiskMB;
+	double           inputRamMB;
+	double           inputPOTRamMB;
+	double           pixels;
+} OutCacheFileStats;
+
+typedef struct
+{
+	volatile int hits;
+	volatile int misses;
+	volatile int stored;
+	double       storedMB;
+	int          evicted;
+	double       evictedMB;
+	double       sizeMB;   // cache size after eviction
+} OutCacheStats;
+
+extern OutCacheStats outcacheStats;
+
+void             OutCache_Init(const char *dir, int maxsizeMB);
+bool             OutCache_Active(void);
+unsigned __int64 OutCache_Key(const byte *data, size_t datasize, unsigned __int64 options, const char *path);
+
+// lookup, found entry becomes most recently used
+OutCacheEntry   *OutCache_Find(unsigned __int64 key);
+int              OutCache_NumFiles(OutCacheEntry *entry);
+int              OutCache_NumExported(OutCacheEntry *entry);
+double           OutCache_OriginalMB(OutCacheEntry *entry);
+const char      *OutCache_GetFile(OutCacheEntry *entry, int filenum, byte **data, size_t *datasize, OutCacheFileStats *stats); // data is a copy
+void             OutCache_FreeEntry(OutCacheEntry *entry);
+
+// storing, files are copied so they can be given to writer right after
+OutCacheEntry   *OutCache_NewEntry(unsigned __int64 key);
+void             OutCache_AddFile(OutCacheEntry *entry, const char *name, const byte *data, size_t datasize, const OutCacheFileStats *stats);
+void             OutCache_Store(OutCacheEntry *entry, int numexported, double originalMB); // writes and frees entry, numexported is -1 if source is not counted in stats
+
+// evicts least recently used entries until cache fits size limit
+void             OutCache_Shutdown(void);
+
+#endif
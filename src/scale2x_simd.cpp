@@ -0,0 +1,609 @@
+////////////////////////////////////////////////////////////////
+//
+// RwgTex / Scale2x SIMD kernels
+// (c) Pavel [VorteX] Timofeyev
+// See LICENSE text file for a license agreement
+//
+////////////////////////////////
+
+#include "main.h"
+#include "scale2x.h"
+#include "scale2x_simd.h"
+#include "cpu.h"
+
+#ifdef CPU_SSE2_INTRINSICS
+#include <emmintrin.h>
+#endif
+#ifdef CPU_AVX2_INTRINSICS
+#include <immintrin.h>
+#endif
+
+// scaled rows of one source row, a - row above, e - source row, c - row below
+typedef void (*SxRow2)(uint *dst0, uint *dst1, const uint *a, const uint *e, const uint *c, int width);
+typedef void (*SxRow3)(uint *dst0, uint *dst1, uint *dst2, const uint *a, const uint *e, const uint *c, int width);
+
+static bool        sx_initialized = false;
+static SxRow2      sx_row2;
+static SxRow3      sx_row3;
+static const char *sx_backend = "generic";
+
+/*
+==========================================================================================
+
+  Generic kernels
+
+  Same rules as Scale2x project ones, neighbours outside of the image are clamped to edge,
+  pixel names are
+    A B C
+    D E F
+    G H I
+
+==========================================================================================
+*/
+
+static void Sx_Row2_Range(uint *dst0, uint *dst1, const uint *a, const uint *e, const uint *c, int width, int x, int end)
+{
+	uint B, D, E, F, H;
+	int l, r;
+
+	for (; x < end; x++)
+	{
+		l = (x > 0) ? x - 1 : x;
+		r = (x < width - 1) ? x + 1 : x;
+		B = a[x];
+		D = e[l];
+		E = e[x];
+		F = e[r];
+		H = c[x];
+		if (B != H && D != F)
+		{
+			dst0[x*2]   = (D == B) ? B : E;
+			dst0[x*2+1] = (F == B) ? B : E;
+			dst1[x*2]   = (D == H) ? H : E;
+			dst1[x*2+1] = (F == H) ? H : E;
+		}
+		else
+		{
+			dst0[x*2]   = E;
+			dst0[x*2+1] = E;
+			dst1[x*2]   = E;
+			dst1[x*2+1] = E;
+		}
+	}
+}
+
+static void Sx_Row3_Range(uint *dst0, uint *dst1, uint *dst2, const uint *a, const uint *e, const uint *c, int width, int x, int end)
+{
+	uint A, B, C, D, E, F, G, H, I;
+	int l, r;
+
+	for (; x < end; x++)
+	{
+		l = (x > 0) ? x - 1 : x;
+		r = (x < width - 1) ? x + 1 : x;
+		A = a[l]; B = a[x]; C = a[r];
+		D = e[l]; E = e[x]; F = e[r];
+		G = c[l]; H = c[x]; I = c[r];
+		if (B != H && D != F)
+		{
+			dst0[x*3]   = (D == B) ? D : E;
+			dst0[x*3+1] = ((D == B && E != C) || (B == F && E != A)) ? B : E;
+			dst0[x*3+2] = (B == F) ? F : E;
+			dst1[x*3]   = ((D == B && E != G) || (D == H && E != A)) ? D : E;
+			dst1[x*3+1] = E;
+			dst1[x*3+2] = ((B == F && E != I) || (H == F && E != C)) ? F : E;
+			dst2[x*3]   = (D == H) ? D : E;
+			dst2[x*3+1] = ((D == H && E != I) || (H == F && E != G)) ? H : E;
+			dst2[x*3+2] = (H == F) ? F : E;
+		}
+		else
+		{
+			dst0[x*3] = dst0[x*3+1] = dst0[x*3+2] = E;
+			dst1[x*3] = dst1[x*3+1] = dst1[x*3+2] = E;
+			dst2[x*3] = dst2[x*3+1] = dst2[x*3+2] = E;
+		}
+	}
+}
+
+static void Sx_Row2_Generic(uint *dst0, uint *dst1, const uint *a, const uint *e, const uint *c, int width)
+{
+	Sx_Row2_Range(dst0, dst1, a, e, c, width, 0, width);
+}
+
+static void Sx_Row3_Generic(uint *dst0, uint *dst1, uint *dst2, const uint *a, const uint *e, const uint *c, int width)
+{
+	Sx_Row3_Range(dst0, dst1, dst2, a, e, c, width, 0, width);
+}
+
+/*
+==========================================================================================
+
+  SSE2 kernels
+
+  Each rule is a compare mask, pixels are picked with and/andnot so there are no branches.
+  Edge pixels (which need clamped neighbours) go to generic code
+
+==========================================================================================
+*/
+
+#ifdef CPU_SSE2_INTRINSICS
+
+#define SX_SELECT(m, a, b) _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b))
+
+static void Sx_Row2_SSE2(uint *dst0, uint *dst1, const uint *a, const uint *e, const uint *c, int width)
+{
+	__m128i B, D, E, F, H, keep, e0, e1, e2, e3;
+	int x;
+
+	Sx_Row2_Range(dst0, dst1, a, e, c, width, 0, 1);
+	for (x = 1; x + 5 <= width; x += 4)
+	{
+		B = _mm_loadu_si128((const __m128i *)(a + x));
+		D = _mm_loadu_si128((const __m128i *)(e + x - 1));
+		E = _mm_loadu_si128((const __m128i *)(e + x));
+		F = _mm_loadu_si128((const __m128i *)(e + x + 1));
+		H = _mm_loadu_si128((const __m128i *)(c + x));
+		keep = _mm_or_si128(_mm_cmpeq_epi32(B, H), _mm_cmpeq_epi32(D, F));
+		e0 = SX_SELECT(_mm_andnot_si128(keep, _mm_cmpeq_epi32(D, B)), B, E);
+		e1 = SX_SELECT(_mm_andnot_si128(keep, _mm_cmpeq_epi32(F, B)), B, E);
+		e2 = SX_SELECT(_mm_andnot_si128(keep, _mm_cmpeq_epi32(D, H)), H, E);
+		e3 = SX_SELECT(_mm_andnot_si128(keep, _mm_cmpeq_epi32(F, H)), H, E);
+		_mm_storeu_si128((__m128i *)(dst0 + x*2), _mm_unpacklo_epi32(e0, e1));
+		_mm_storeu_si128((__m128i *)(dst0 + x*2 + 4), _mm_unpackhi_epi32(e0, e1));
+		_mm_storeu_si128((__m128i *)(dst1 + x*2), _mm_unpacklo_epi32(e2, e3));
+		_mm_storeu_si128((__m128i *)(dst1 + x*2 + 4), _mm_unpackhi_epi32(e2, e3));
+	}
+	Sx_Row2_Range(dst0, dst1, a, e, c, width, max(x, 1), width);
+}
+
+// interleave 3 vectors of 4 pixels to a0 b0 c0 a1 | b1 c1 a2 b2 | c2 a3 b3 c3
+static inline void Sx_Store3_SSE2(uint *out, __m128i a, __m128i b, __m128i c)
+{
+	__m128 ab_lo = _mm_castsi128_ps(_mm_unpacklo_epi32(a, b)); // a0 b0 a1 b1
+	__m128 ab_hi = _mm_castsi128_ps(_mm_unpackhi_epi32(a, b)); // a2 b2 a3 b3
+	__m128 ca_lo = _mm_castsi128_ps(_mm_unpacklo_epi32(c, a)); // c0 a0 c1 a1
+	__m128 ca_hi = _mm_castsi128_ps(_mm_unpackhi_epi32(c, a)); // c2 a2 c3 a3
+	__m128 bc_lo = _mm_castsi128_ps(_mm_unpacklo_epi32(b, c)); // b0 c0 b1 c1
+	__m128 bc_hi = _mm_castsi128_ps(_mm_unpackhi_epi32(b, c)); // b2 c2 b3 c3
+
+	_mm_storeu_ps((float *)out,     _mm_shuffle_ps(ab_lo, ca_lo, _MM_SHUFFLE(3, 0, 1, 0)));
+	_mm_storeu_ps((float *)out + 4, _mm_shuffle_ps(bc_lo, ab_hi, _MM_SHUFFLE(1, 0, 3, 2)));
+	_mm_storeu_ps((float *)out + 8, _mm_shuffle_ps(ca_hi, bc_hi, _MM_SHUFFLE(3, 2, 3, 0)));
+}
+
+static void Sx_Row3_SSE2(uint *dst0, uint *dst1, uint *dst2, const uint *a, const uint *e, const uint *c, int width)
+{
+	__m128i A, B, C, D, E, F, G, H, I, keep, DB, BF, DH, HF, EA, EC, EG, EI;
+	int x;
+
+	Sx_Row3_Range(dst0, dst1, dst2, a, e, c, width, 0, 1);
+	for (x = 1; x + 5 <= width; x += 4)
+	{
+		A = _mm_loadu_si128((const __m128i *)(a + x - 1));
+		B = _mm_loadu_si128((const __m128i *)(a + x));
+		C = _mm_loadu_si128((const __m128i *)(a + x + 1));
+		D = _mm_loadu_si128((const __m128i *)(e + x - 1));
+		E = _mm_loadu_si128((const __m128i *)(e + x));
+		F = _mm_loadu_si128((const __m128i *)(e + x + 1));
+		G = _mm_loadu_si128((const __m128i *)(c + x - 1));
+		H = _mm_loadu_si128((const __m128i *)(c + x));
+		I = _mm_loadu_si128((const __m128i *)(c + x + 1));
+		keep = _mm_or_si128(_mm_cmpeq_epi32(B, H), _mm_cmpeq_epi32(D, F));
+		DB = _mm_andnot_si128(keep, _mm_cmpeq_epi32(D, B));
+		BF = _mm_andnot_si128(keep, _mm_cmpeq_epi32(B, F));
+		DH = _mm_andnot_si128(keep, _mm_cmpeq_epi32(D, H));
+		HF = _mm_andnot_si128(keep, _mm_cmpeq_epi32(H, F));
+		EA = _mm_cmpeq_epi32(E, A);
+		EC = _mm_cmpeq_epi32(E, C);
+		EG = _mm_cmpeq_epi32(E, G);
+		EI = _mm_cmpeq_epi32(E, I);
+		Sx_Store3_SSE2(dst0 + x*3,
+			SX_SELECT(DB, D, E),
+			SX_SELECT(_mm_or_si128(_mm_andnot_si128(EC, DB), _mm_andnot_si128(EA, BF)), B, E),
+			SX_SELECT(BF, F, E));
+		Sx_Store3_SSE2(dst1 + x*3,
+			SX_SELECT(_mm_or_si128(_mm_andnot_si128(EG, DB), _mm_andnot_si128(EA, DH)), D, E),
+			E,
+			SX_SELECT(_mm_or_si128(_mm_andnot_si128(EI, BF), _mm_andnot_si128(EC, HF)), F, E));
+		Sx_Store3_SSE2(dst2 + x*3,
+			SX_SELECT(DH, D, E),
+			SX_SELECT(_mm_or_si128(_mm_andnot_si128(EI, DH), _mm_andnot_si128(EG, HF)), H, E),
+			SX_SELECT(HF, F, E));
+	}
+	Sx_Row3_Range(dst0, dst1, dst2, a, e, c, width, max(x, 1), width);
+}
+
+#endif
+
+/*
+==========================================================================================
+
+  AVX2 kernels
+
+  Same as SSE2 ones on 8 pixels, unpacks work inside of 128-bit lanes
+  so lanes are put back in order before storing
+
+==========================================================================================
+*/
+
+#ifdef CPU_AVX2_INTRINSICS
+
+#define SX_SELECT256(m, a, b) _mm256_blendv_epi8(b, a, m)
+
+CPU_TARGET("avx2") static void Sx_Row2_AVX2(uint *dst0, uint *dst1, const uint *a, const uint *e, const uint *c, int width)
+{
+	__m256i B, D, E, F, H, keep, e0, e1, e2, e3, lo, hi;
+	int x;
+
+	Sx_Row2_Range(dst0, dst1, a, e, c, width, 0, 1);
+	for (x = 1; x + 9 <= width; x += 8)
+	{
+		B = _mm256_loadu_si256((const __m256i *)(a + x));
+		D = _mm256_loadu_si256((const __m256i *)(e + x - 1));
+		E = _mm256_loadu_si256((const __m256i *)(e + x));
+		F = _mm256_loadu_si256((const __m256i *)(e + x + 1));
+		H = _mm256_loadu_si256((const __m256i *)(c + x));
+		keep = _mm256_or_si256(_mm256_cmpeq_epi32(B, H), _mm256_cmpeq_epi32(D, F));
+		e0 = SX_SELECT256(_mm256_andnot_si256(keep, _mm256_cmpeq_epi32(D, B)), B, E);
+		e1 = SX_SELECT256(_mm256_andnot_si256(keep, _mm256_cmpeq_epi32(F, B)), B, E);
+		e2 = SX_SELECT256(_mm256_andnot_si256(keep, _mm256_cmpeq_epi32(D, H)), H, E);
+		e3 = SX_SELECT256(_mm256_andnot_si256(keep, _mm256_cmpeq_epi32(F, H)), H, E);
+		lo = _mm256_unpacklo_epi32(e0, e1);
+		hi = _mm256_unpackhi_epi32(e0, e1);
+		_mm256_storeu_si256((__m256i *)(dst0 + x*2), _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((__m256i *)(dst0 + x*2 + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+		lo = _mm256_unpacklo_epi32(e2, e3);
+		hi = _mm256_unpackhi_epi32(e2, e3);
+		_mm256_storeu_si256((__m256i *)(dst1 + x*2), _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((__m256i *)(dst1 + x*2 + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+	Sx_Row2_Range(dst0, dst1, a, e, c, width, max(x, 1), width);
+}
+
+// lane-wise 3-way interleave like Sx_Store3_SSE2, then lane 0 result goes first
+CPU_TARGET("avx2") static inline void Sx_Store3_AVX2(uint *out, __m256i a, __m256i b, __m256i c)
+{
+	__m256 ab_lo = _mm256_castsi256_ps(_mm256_unpacklo_epi32(a, b));
+	__m256 ab_hi = _mm256_castsi256_ps(_mm256_unpackhi_epi32(a, b));
+	__m256 ca_lo = _mm256_castsi256_ps(_mm256_unpacklo_epi32(c, a));
+	__m256 ca_hi = _mm256_castsi256_ps(_mm256_unpackhi_epi32(c, a));
+	__m256 bc_lo = _mm256_castsi256_ps(_mm256_unpacklo_epi32(b, c));
+	__m256 bc_hi = _mm256_castsi256_ps(_mm256_unpackhi_epi32(b, c));
+	__m256 o0 = _mm256_shuffle_ps(ab_lo, ca_lo, _MM_SHUFFLE(3, 0, 1, 0));
+	__m256 o1 = _mm256_shuffle_ps(bc_lo, ab_hi, _MM_SHUFFLE(1, 0, 3, 2));
+	__m256 o2 = _mm256_shuffle_ps(ca_hi, bc_hi, _MM_SHUFFLE(3, 2, 3, 0));
+
+	_mm256_storeu_ps((float *)out,      _mm256_permute2f128_ps(o0, o1, 0x20));
+	_mm256_storeu_ps((float *)out + 8,  _mm256_permute2f128_ps(o2, o0, 0x30));
+	_mm256_storeu_ps((float *)out + 16, _mm256_permute2f128_ps(o1, o2, 0x31));
+}
+
+CPU_TARGET("avx2") static void Sx_Row3_AVX2(uint *dst0, uint *dst1, uint *dst2, const uint *a, const uint *e, const uint *c, int width)
+{
+	__m256i A, B, C, D, E, F, G, H, I, keep, DB, BF, DH, HF, EA, EC, EG, EI;
+	int x;
+
+	Sx_Row3_Range(dst0, dst1, dst2, a, e, c, width, 0, 1);
+	for (x = 1; x + 9 <= width; x += 8)
+	{
+		A = _mm256_loadu_si256((const __m256i *)(a + x - 1));
+		B = _mm256_loadu_si256((const __m256i *)(a + x));
+		C = _mm256_loadu_si256((const __m256i *)(a + x + 1));
+		D = _mm256_loadu_si256((const __m256i *)(e + x - 1));
+		E = _mm256_loadu_si256((const __m256i *)(e + x));
+		F = _mm256_loadu_si256((const __m256i *)(e + x + 1));
+		G = _mm256_loadu_si256((const __m256i *)(c + x - 1));
+		H = _mm256_loadu_si256((const __m256i *)(c + x));
+		I = _mm256_loadu_si256((const __m256i *)(c + x + 1));
+		keep = _mm256_or_si256(_mm256_cmpeq_epi32(B, H), _mm256_cmpeq_epi32(D, F));
+		DB = _mm256_andnot_si256(keep, _mm256_cmpeq_epi32(D, B));
+		BF = _mm256_andnot_si256(keep, _mm256_cmpeq_epi32(B, F));
+		DH = _mm256_andnot_si256(keep, _mm256_cmpeq_epi32(D, H));
+		HF = _mm256_andnot_si256(keep, _mm256_cmpeq_epi32(H, F));
+		EA = _mm256_cmpeq_epi32(E, A);
+		EC = _mm256_cmpeq_epi32(E, C);
+		EG = _mm256_cmpeq_epi32(E, G);
+		EI = _mm256_cmpeq_epi32(E, I);
+		Sx_Store3_AVX2(dst0 + x*3,
+			SX_SELECT256(DB, D, E),
+			SX_SELECT256(_mm256_or_si256(_mm256_andnot_si256(EC, DB), _mm256_andnot_si256(EA, BF)), B, E),
+			SX_SELECT256(BF, F, E));
+		Sx_Store3_AVX2(dst1 + x*3,
+			SX_SELECT256(_mm256_or_si256(_mm256_andnot_si256(EG, DB), _mm256_andnot_si256(EA, DH)), D, E),
+			E,
+			SX_SELECT256(_mm256_or_si256(_mm256_andnot_si256(EI, BF), _mm256_andnot_si256(EC, HF)), F, E));
+		Sx_Store3_AVX2(dst2 + x*3,
+			SX_SELECT256(DH, D, E),
+			SX_SELECT256(_mm256_or_si256(_mm256_andnot_si256(EI, DH), _mm256_andnot_si256(EG, HF)), H, E),
+			SX_SELECT256(HF, F, E));
+	}
+	Sx_Row3_Range(dst0, dst1, dst2, a, e, c, width, max(x, 1), width);
+}
+
+#endif
+
+/*
+==========================================================================================
+
+  Bitmap scaling
+
+  32-bit source rows are used in place, 24-bit ones are widened into a ring of 3 rows
+  (with zero in 4th byte, so compares are done on RGB). Output rows of 24-bit images
+  are made in scratch rows and packed back
+
+==========================================================================================
+*/
+
+typedef struct
+{
+	int         factor;
+	int         bpp;
+	int         width;
+	int         height;
+	const byte *src;
+	int         srcpitch;
+	byte       *dst;
+	int         dstpitch;
+	void      (*rowFunc)(void *data, const byte *row); // takes output rows instead of dst
+	void       *rowData;
+	uint       *wide[3];    // widened source rows (24-bit)
+	int         wideRow[3];
+	uint       *mid[3][2];  // pairs of 2x rows (scale4x)
+	int         midRow[3];
+	uint       *out[4];     // scratch output rows (24-bit or rowFunc)
+	byte       *packed;     // 24-bit row for rowFunc
+}SxBitmap;
+
+static const uint *Sx_SourceRow(SxBitmap *b, int y)
+{
+	const byte *in, *end;
+	uint *out, w0, w1, w2;
+	int slot;
+
+	y = max(0, min(b->height - 1, y));
+	if (b->bpp == 4)
+		return (const uint *)(b->src + y * b->srcpitch);
+	slot = y % 3;
+	if (b->wideRow[slot] != y)
+	{
+		b->wideRow[slot] = y;
+		in = b->src + y * b->srcpitch;
+		end = in + b->width * 3;
+		out = b->wide[slot];
+		// 4 pixels are 3 dwords
+		for (; in + 12 <= end; in += 12, out += 4)
+		{
+			w0 = ((const uint *)in)[0];
+			w1 = ((const uint *)in)[1];
+			w2 = ((const uint *)in)[2];
+			out[0] = w0 & 0xFFFFFF;
+			out[1] = ((w0 >> 24) | (w1 << 8)) & 0xFFFFFF;
+			out[2] = ((w1 >> 16) | (w2 << 16)) & 0xFFFFFF;
+			out[3] = w2 >> 8;
+		}
+		for (; in < end; in += 3)
+			*out++ = (uint)in[0] | ((uint)in[1] << 8) | ((uint)in[2] << 16);
+	}
+	return b->wide[slot];
+}
+
+// 2x row of scale4x intermediate image
+static const uint *Sx_MidRow(SxBitmap *b, int m)
+{
+	int pair, slot;
+
+	m = max(0, min(b->height * 2 - 1, m));
+	pair = m >> 1;
+	slot = pair % 3;
+	if (b->midRow[slot] != pair)
+	{
+		b->midRow[slot] = pair;
+		sx_row2(b->mid[slot][0], b->mid[slot][1], Sx_SourceRow(b, pair - 1), Sx_SourceRow(b, pair), Sx_SourceRow(b, pair + 1), b->width);
+	}
+	return b->mid[slot][m & 1];
+}
+
+// output rows of source row y
+static void Sx_BeginRows(SxBitmap *b, int y, uint **rows)
+{
+	int i;
+
+	for (i = 0; i < b->factor; i++)
+		rows[i] = (b->bpp == 4 && !b->rowFunc) ? (uint *)(b->dst + (y * b->factor + i) * b->dstpitch) : b->out[i];
+}
+
+static void Sx_EndRows(SxBitmap *b, int y, uint **rows)
+{
+	const uint *in, *end;
+	byte *out;
+	int i;
+
+	for (i = 0; i < b->factor; i++)
+	{
+		if (b->bpp == 4)
+		{
+			if (b->rowFunc)
+				b->rowFunc(b->rowData, (const byte *)rows[i]);
+			continue;
+		}
+		out = (b->rowFunc) ? b->packed : b->dst + (y * b->factor + i) * b->dstpitch;
+		end = rows[i] + b->width * b->factor;
+		// 4 pixels to 3 dwords, 4th byte of pixel is always zero
+		for (in = rows[i]; in + 4 <= end; in += 4, out += 12)
+		{
+			((uint *)out)[0] = in[0] | (in[1] << 24);
+			((uint *)out)[1] = (in[1] >> 8) | (in[2] << 16);
+			((uint *)out)[2] = (in[2] >> 16) | (in[3] << 8);
+		}
+		for (; in < end; in++, out += 3)
+		{
+			out[0] = (byte)(*in);
+			out[1] = (byte)(*in >> 8);
+			out[2] = (byte)(*in >> 16);
+		}
+		if (b->rowFunc)
+			b->rowFunc(b->rowData, b->packed);
+	}
+}
+
+void Scale2x_Init(void)
+{
+	if (sx_initialized)
+		return;
+	sx_initialized = true;
+	Scale2x_UseBackend(NULL);
+}
+
+bool Scale2x_UseBackend(const char *name)
+{
+	if (!name)
+	{
+		// pick best code path
+		sx_row2 = Sx_Row2_Generic;
+		sx_row3 = Sx_Row3_Generic;
+		sx_backend = "generic";
+#ifdef CPU_SSE2_INTRINSICS
+		if (CPU_HasSSE2())
+		{
+			sx_row2 = Sx_Row2_SSE2;
+			sx_row3 = Sx_Row3_SSE2;
+			sx_backend = "SSE2";
+		}
+#endif
+#ifdef CPU_AVX2_INTRINSICS
+		if (CPU_HasAVX2())
+		{
+			sx_row2 = Sx_Row2_AVX2;
+			sx_row3 = Sx_Row3_AVX2;
+			sx_backend = "AVX2";
+		}
+#endif
+		return true;
+	}
+	sx_initialized = true;
+	if (!stricmp(name, "generic"))
+	{
+		sx_row2 = Sx_Row2_Generic;
+		sx_row3 = Sx_Row3_Generic;
+		sx_backend = "generic";
+		return true;
+	}
+#ifdef CPU_SSE2_INTRINSICS
+	if (!stricmp(name, "SSE2") && CPU_HasSSE2())
+	{
+		sx_row2 = Sx_Row2_SSE2;
+		sx_row3 = Sx_Row3_SSE2;
+		sx_backend = "SSE2";
+		return true;
+	}
+#endif
+#ifdef CPU_AVX2_INTRINSICS
+	if (!stricmp(name, "AVX2") && CPU_HasAVX2())
+	{
+		sx_row2 = Sx_Row2_AVX2;
+		sx_row3 = Sx_Row3_AVX2;
+		sx_backend = "AVX2";
+		return true;
+	}
+#endif
+	return false;
+}
+
+const char *Scale2x_Backend(void)
+{
+	return sx_backend;
+}
+
+// same size limits as sxCheck
+bool Scale2x_Check(int factor, int bpp, int width, int height)
+{
+	if (bpp != 3 && bpp != 4)
+		return false;
+	if (factor != 2 && factor != 3 && factor != 4)
+		return false;
+	return (sxCheck(factor, 4, width, height) == SCALEX_OK) ? true : false;
+}
+
+static void Sx_Scale(SxBitmap *bitmap)
+{
+	SxBitmap b = *bitmap;
+	uint *rows[4], *buffer, *p;
+	int i, y, factor, width, height;
+
+	// scratch memory
+	factor = b.factor;
+	width = b.width;
+	height = b.height;
+	buffer = (uint *)mem_alloc(sizeof(uint) * width * (3 + 3*2*2 + 4*4 + 3));
+	p = buffer;
+	for (i = 0; i < 3; i++)
+	{
+		b.wide[i] = p; p += width;
+		b.mid[i][0] = p; p += width * 2;
+		b.mid[i][1] = p; p += width * 2;
+		b.wideRow[i] = -1;
+		b.midRow[i] = -1;
+	}
+	for (i = 0; i < 4; i++)
+	{
+		b.out[i] = p;
+		p += width * 4;
+	}
+	b.packed = (byte *)p;
+
+	// scale
+	for (y = 0; y < height; y++)
+	{
+		Sx_BeginRows(&b, y, rows);
+		if (factor == 2)
+			sx_row2(rows[0], rows[1], Sx_SourceRow(&b, y - 1), Sx_SourceRow(&b, y), Sx_SourceRow(&b, y + 1), width);
+		else if (factor == 3)
+			sx_row3(rows[0], rows[1], rows[2], Sx_SourceRow(&b, y - 1), Sx_SourceRow(&b, y), Sx_SourceRow(&b, y + 1), width);
+		else
+		{
+			// scale2x of scale2x, pairs of intermediate rows y-1, y, y+1 have separate slots
+			sx_row2(rows[0], rows[1], Sx_MidRow(&b, y*2 - 1), Sx_MidRow(&b, y*2), Sx_MidRow(&b, y*2 + 1), width * 2);
+			sx_row2(rows[2], rows[3], Sx_MidRow(&b, y*2), Sx_MidRow(&b, y*2 + 1), Sx_MidRow(&b, y*2 + 2), width * 2);
+		}
+		Sx_EndRows(&b, y, rows);
+	}
+	mem_free(buffer);
+}
+
+void Scale2x_Scale(int factor, byte *dst, int dstpitch, const byte *src, int srcpitch, int bpp, int width, int height)
+{
+	SxBitmap b;
+
+	Scale2x_Init();
+	if (!Scale2x_Check(factor, bpp, width, height))
+		return;
+	memset(&b, 0, sizeof(b));
+	b.factor = factor;
+	b.bpp = bpp;
+	b.width = width;
+	b.height = height;
+	b.src = src;
+	b.srcpitch = srcpitch;
+	b.dst = dst;
+	b.dstpitch = dstpitch;
+	Sx_Scale(&b);
+}
+
+void Scale2x_ScaleRows(int factor, const byte *src, int srcpitch, int bpp, int width, int height, void (*rowFunc)(void *data, const byte *row), void *data)
+{
+	SxBitmap b;
+
+	Scale2x_Init();
+	if (!Scale2x_Check(factor, bpp, width, height))
+		return;
+	memset(&b, 0, sizeof(b));
+	b.factor = factor;
+	b.bpp = bpp;
+	b.width = width;
+	b.height = height;
+	b.src = src;
+	b.srcpitch = srcpitch;
+	b.rowFunc = rowFunc;
+	b.rowData = data;
+	Sx_Scale(&b);
+}
@@ -0,0 +1,20 @@
+// scale2x_simd.h
+#ifndef H_TEX_SCALE2X_SIMD_H
+#define H_TEX_SCALE2X_SIMD_H
+
+#include "main.h"
+
+// Scale2x/Scale3x/Scale4x for 24 and 32-bit pixels with SSE2/AVX2 row kernels
+// output is bit-exact with sxScale(), 24-bit pixels are compared by RGB so no conversion to 32 bit is needed
+// pixels are handled a row at a time, scale4x keeps only 3 pairs of intermediate 2x rows
+void        Scale2x_Init(void);
+bool        Scale2x_Check(int factor, int bpp, int width, int height);
+void        Scale2x_Scale(int factor, byte *dst, int dstpitch, const byte *src, int srcpitch, int bpp, int width, int height);
+// same, but scaled rows are passed in order to rowFunc, so the scaled image does not have to be in memory
+void        Scale2x_ScaleRows(int factor, const byte *src, int srcpitch, int bpp, int width, int height, void (*rowFunc)(void *data, const byte *row), void *data);
+const char *Scale2x_Backend(void);
+
+// force code path ("generic", "SSE2", "AVX2"), NULL picks the best one, returns false if CPU does not support it
+bool        Scale2x_UseBackend(const char *name);
+
+#endif
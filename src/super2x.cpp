@@ -0,0 +1,646 @@
+////////////////////////////////////////////////////////////////
+//
+// RwgTex / native super2x scaler
+// (c) Pavel [VorteX] Timofeyev
+// See LICENSE text file for a license agreement
+//
+////////////////////////////////
+
+#include "main.h"
+#include "super2x.h"
+#include "scale2x_simd.h"
+#include "mipmap.h"
+#include <math.h>
+
+#define SUPER2X_SHARPEN_COLOR 1.1f
+#define SUPER2X_SHARPEN_ALPHA 1.2f
+#define SUPER2X_BLEND         0.4f
+
+// scratch slots
+#define SUPER2X_SLOT_SOURCE   0 // source colors, later alpha widened to 24 bit
+#define SUPER2X_SLOT_ALPHA    1 // source alpha
+#define SUPER2X_SLOT_LAYER    2 // lanczos layer, later scaled alpha
+#define SUPER2X_SLOT_BLUR1    3
+#define SUPER2X_SLOT_BLUR2    4
+#define SUPER2X_SLOT_QUANTIZE 5
+#define SUPER2X_SLOT_ROWS     6
+
+/*
+==========================================================================================
+
+  Blur and sharpen
+
+  Same math as fiFilter() and fiSharpen(), including their quirks, so results stay close
+
+==========================================================================================
+*/
+
+static inline byte Super2x_Tap(const byte *in, int pixel, int last, int bpp, int c)
+{
+	return in[max(0, min(last, pixel)) * bpp + c];
+}
+
+// 1 2 1 kernel as done by fiFilter: bottom-left tap is taken instead of bottom-right, first and last rows
+// repeat themselves instead of missing neighbour row, left and right columns are sampled shifted
+// by one pixel (so right column reads next row), corners are kept
+static void Super2x_Blur(const byte *in, byte *out, int width, int height, int bpp)
+{
+	const byte *a, *b, *d;
+	byte *o;
+	int x, y, c, p, pitch, last;
+
+	pitch = width * bpp;
+	last = width * height - 1;
+
+	// interior
+	for (y = 1; y < height - 1; y++)
+	{
+		a = in + (size_t)(y - 1) * pitch;
+		b = a + pitch;
+		d = b + pitch;
+		o = out + (size_t)y * pitch;
+		for (x = bpp; x < pitch - bpp; x++)
+			o[x] = (byte)((a[x-bpp] + 2*a[x] + a[x+bpp] + 2*b[x-bpp] + 4*b[x] + 2*b[x+bpp] + 2*d[x-bpp] + 2*d[x]) >> 4);
+	}
+
+	// corners
+	for (c = 0; c < bpp; c++)
+	{
+		out[c] = in[c];
+		out[pitch - bpp + c] = in[pitch - bpp + c];
+		out[(size_t)(height - 1) * pitch + c] = in[(size_t)(height - 1) * pitch + c];
+		out[(size_t)height * pitch - bpp + c] = in[(size_t)height * pitch - bpp + c];
+	}
+
+	// first and last row
+	if (height > 1)
+	{
+		b = in;
+		d = in + pitch;
+		for (x = bpp; x < pitch - bpp; x++)
+			out[x] = (byte)((3*b[x-bpp] + 6*b[x] + 3*b[x+bpp] + 2*d[x-bpp] + 2*d[x]) >> 4);
+		a = in + (size_t)(height - 2) * pitch;
+		b = a + pitch;
+		o = out + (size_t)(height - 1) * pitch;
+		for (x = bpp; x < pitch - bpp; x++)
+			o[x] = (byte)((a[x-bpp] + 2*a[x] + a[x+bpp] + 4*b[x-bpp] + 6*b[x] + 2*b[x+bpp]) >> 4);
+	}
+
+	// left and right columns
+	for (y = 1; y < height - 1; y++)
+	{
+		for (p = y * width; p < y * width + width; p += max(1, width - 1))
+		{
+			for (c = 0; c < bpp; c++)
+			{
+				out[p*bpp + c] = (byte)((
+					  Super2x_Tap(in, p - width, last, bpp, c) + 2*Super2x_Tap(in, p - width + 1, last, bpp, c) + Super2x_Tap(in, p - width + 2, last, bpp, c)
+					+ 2*Super2x_Tap(in, p, last, bpp, c) + 4*Super2x_Tap(in, p + 1, last, bpp, c) + 2*Super2x_Tap(in, p + 2, last, bpp, c)
+					+ Super2x_Tap(in, p + width, last, bpp, c) + 2*Super2x_Tap(in, p + width + 1, last, bpp, c) + Super2x_Tap(in, p + width + 2, last, bpp, c)) >> 4);
+			}
+		}
+	}
+}
+
+// fiSharpen, iterations are done against the same blurred image
+static inline byte Super2x_Sharpen(int s, int blurred, float factor, int iterations)
+{
+	float rf = 1 - factor;
+
+	for (; iterations > 0; iterations--)
+		s = min(255, max(0, (int)(blurred*rf + s*factor)));
+	return (byte)s;
+}
+
+/*
+==========================================================================================
+
+  Wu quantizer
+
+  FreeImage_ColorQuantizeEx(FIQ_WUQUANT) with 256 colors and reserved grey palette,
+  which was the way Super2x restored palette of lanczos layer. Colors are requantized
+  in place, histogram cells are 5 bits per channel
+
+==========================================================================================
+*/
+
+#define WU_SIZE   33
+#define WU_CELLS  (WU_SIZE * WU_SIZE * WU_SIZE)
+#define WU_COLORS 256
+#define WU_INDEX(r,g,b) ((r) * WU_SIZE * WU_SIZE + (g) * WU_SIZE + (b))
+
+typedef struct
+{
+	int r0, r1;
+	int g0, g1;
+	int b0, b1;
+	int vol;
+}WuBox;
+
+typedef struct
+{
+	int   *wt;
+	int   *mr;
+	int   *mg;
+	int   *mb;
+	float *m2;
+	byte  *tag;
+}WuMoments;
+
+static int Wu_Vol(const WuBox *cube, const int *m)
+{
+	return m[WU_INDEX(cube->r1, cube->g1, cube->b1)] - m[WU_INDEX(cube->r1, cube->g1, cube->b0)]
+	     - m[WU_INDEX(cube->r1, cube->g0, cube->b1)] + m[WU_INDEX(cube->r1, cube->g0, cube->b0)]
+	     - m[WU_INDEX(cube->r0, cube->g1, cube->b1)] + m[WU_INDEX(cube->r0, cube->g1, cube->b0)]
+	     + m[WU_INDEX(cube->r0, cube->g0, cube->b1)] - m[WU_INDEX(cube->r0, cube->g0, cube->b0)];
+}
+
+// part of volume which does not depend on cut position
+static int Wu_Bottom(const WuBox *cube, int dir, const int *m)
+{
+	if (dir == 0)
+		return - m[WU_INDEX(cube->r0, cube->g1, cube->b1)] + m[WU_INDEX(cube->r0, cube->g1, cube->b0)]
+		       + m[WU_INDEX(cube->r0, cube->g0, cube->b1)] - m[WU_INDEX(cube->r0, cube->g0, cube->b0)];
+	if (dir == 1)
+		return - m[WU_INDEX(cube->r1, cube->g0, cube->b1)] + m[WU_INDEX(cube->r1, cube->g0, cube->b0)]
+		       + m[WU_INDEX(cube->r0, cube->g0, cube->b1)] - m[WU_INDEX(cube->r0, cube->g0, cube->b0)];
+	return - m[WU_INDEX(cube->r1, cube->g1, cube->b0)] + m[WU_INDEX(cube->r1, cube->g0, cube->b0)]
+	       + m[WU_INDEX(cube->r0, cube->g1, cube->b0)] - m[WU_INDEX(cube->r0, cube->g0, cube->b0)];
+}
+
+// rest of volume if box is cut at pos
+static int Wu_Top(const WuBox *cube, int dir, int pos, const int *m)
+{
+	if (dir == 0)
+		return m[WU_INDEX(pos, cube->g1, cube->b1)] - m[WU_INDEX(pos, cube->g1, cube->b0)]
+		     - m[WU_INDEX(pos, cube->g0, cube->b1)] + m[WU_INDEX(pos, cube->g0, cube->b0)];
+	if (dir == 1)
+		return m[WU_INDEX(cube->r1, pos, cube->b1)] - m[WU_INDEX(cube->r1, pos, cube->b0)]
+		     - m[WU_INDEX(cube->r0, pos, cube->b1)] + m[WU_INDEX(cube->r0, pos, cube->b0)];
+	return m[WU_INDEX(cube->r1, cube->g1, pos)] - m[WU_INDEX(cube->r1, cube->g0, pos)]
+	     - m[WU_INDEX(cube->r0, cube->g1, pos)] + m[WU_INDEX(cube->r0, cube->g0, pos)];
+}
+
+static float Wu_Var(const WuMoments *w, const WuBox *cube)
+{
+	float dr, dg, db, xx;
+	const float *m2 = w->m2;
+
+	dr = (float)Wu_Vol(cube, w->mr);
+	dg = (float)Wu_Vol(cube, w->mg);
+	db = (float)Wu_Vol(cube, w->mb);
+	xx = m2[WU_INDEX(cube->r1, cube->g1, cube->b1)] - m2[WU_INDEX(cube->r1, cube->g1, cube->b0)]
+	   - m2[WU_INDEX(cube->r1, cube->g0, cube->b1)] + m2[WU_INDEX(cube->r1, cube->g0, cube->b0)]
+	   - m2[WU_INDEX(cube->r0, cube->g1, cube->b1)] + m2[WU_INDEX(cube->r0, cube->g1, cube->b0)]
+	   + m2[WU_INDEX(cube->r0, cube->g0, cube->b1)] - m2[WU_INDEX(cube->r0, cube->g0, cube->b0)];
+	return xx - (dr*dr + dg*dg + db*db) / (float)Wu_Vol(cube, w->wt);
+}
+
+static float Wu_Maximize(const WuMoments *w, const WuBox *cube, int dir, int first, int last, int *cut, int whole_r, int whole_g, int whole_b, int whole_w)
+{
+	int base_r, base_g, base_b, base_w, half_r, half_g, half_b, half_w, i;
+	float temp, best;
+
+	base_r = Wu_Bottom(cube, dir, w->mr);
+	base_g = Wu_Bottom(cube, dir, w->mg);
+	base_b = Wu_Bottom(cube, dir, w->mb);
+	base_w = Wu_Bottom(cube, dir, w->wt);
+	best = 0.0f;
+	*cut = -1;
+	for (i = first; i < last; i++)
+	{
+		half_r = base_r + Wu_Top(cube, dir, i, w->mr);
+		half_g = base_g + Wu_Top(cube, dir, i, w->mg);
+		half_b = base_b + Wu_Top(cube, dir, i, w->mb);
+		half_w = base_w + Wu_Top(cube, dir, i, w->wt);
+		// never split into an empty box
+		if (half_w == 0)
+			continue;
+		temp = ((float)half_r*half_r + (float)half_g*half_g + (float)half_b*half_b) / half_w;
+		half_r = whole_r - half_r;
+		half_g = whole_g - half_g;
+		half_b = whole_b - half_b;
+		half_w = whole_w - half_w;
+		if (half_w == 0)
+			continue;
+		temp += ((float)half_r*half_r + (float)half_g*half_g + (float)half_b*half_b) / half_w;
+		if (temp > best)
+		{
+			best = temp;
+			*cut = i;
+		}
+	}
+	return best;
+}
+
+static bool Wu_Cut(const WuMoments *w, WuBox *set1, WuBox *set2)
+{
+	int whole_r, whole_g, whole_b, whole_w, cutr, cutg, cutb;
+	float maxr, maxg, maxb;
+
+	whole_r = Wu_Vol(set1, w->mr);
+	whole_g = Wu_Vol(set1, w->mg);
+	whole_b = Wu_Vol(set1, w->mb);
+	whole_w = Wu_Vol(set1, w->wt);
+	maxr = Wu_Maximize(w, set1, 0, set1->r0 + 1, set1->r1, &cutr, whole_r, whole_g, whole_b, whole_w);
+	maxg = Wu_Maximize(w, set1, 1, set1->g0 + 1, set1->g1, &cutg, whole_r, whole_g, whole_b, whole_w);
+	maxb = Wu_Maximize(w, set1, 2, set1->b0 + 1, set1->b1, &cutb, whole_r, whole_g, whole_b, whole_w);
+	set2->r1 = set1->r1;
+	set2->g1 = set1->g1;
+	set2->b1 = set1->b1;
+	if (maxr >= maxg && maxr >= maxb)
+	{
+		if (cutr < 0)
+			return false;
+		set2->r0 = set1->r1 = cutr;
+		set2->g0 = set1->g0;
+		set2->b0 = set1->b0;
+	}
+	else if (maxg >= maxr && maxg >= maxb)
+	{
+		set2->g0 = set1->g1 = cutg;
+		set2->r0 = set1->r0;
+		set2->b0 = set1->b0;
+	}
+	else
+	{
+		set2->b0 = set1->b1 = cutb;
+		set2->r0 = set1->r0;
+		set2->g0 = set1->g0;
+	}
+	set1->vol = (set1->r1 - set1->r0) * (set1->g1 - set1->g0) * (set1->b1 - set1->b0);
+	set2->vol = (set2->r1 - set2->r0) * (set2->g1 - set2->g0) * (set2->b1 - set2->b0);
+	return true;
+}
+
+// cumulative moments, so volume of any box is 8 lookups
+static void Wu_Moments(WuMoments *w)
+{
+	int area[WU_SIZE], area_r[WU_SIZE], area_g[WU_SIZE], area_b[WU_SIZE];
+	int line, line_r, line_g, line_b, r, g, b, i, ind;
+	float area2[WU_SIZE], line2;
+
+	for (r = 1; r < WU_SIZE; r++)
+	{
+		for (i = 0; i < WU_SIZE; i++)
+		{
+			area[i] = area_r[i] = area_g[i] = area_b[i] = 0;
+			area2[i] = 0;
+		}
+		for (g = 1; g < WU_SIZE; g++)
+		{
+			line = line_r = line_g = line_b = 0;
+			line2 = 0;
+			for (b = 1; b < WU_SIZE; b++)
+			{
+				ind = WU_INDEX(r, g, b);
+				line += w->wt[ind];
+				line_r += w->mr[ind];
+				line_g += w->mg[ind];
+				line_b += w->mb[ind];
+				line2 += w->m2[ind];
+				area[b] += line;
+				area_r[b] += line_r;
+				area_g[b] += line_g;
+				area_b[b] += line_b;
+				area2[b] += line2;
+				w->wt[ind] = w->wt[ind - WU_SIZE*WU_SIZE] + area[b];
+				w->mr[ind] = w->mr[ind - WU_SIZE*WU_SIZE] + area_r[b];
+				w->mg[ind] = w->mg[ind - WU_SIZE*WU_SIZE] + area_g[b];
+				w->mb[ind] = w->mb[ind - WU_SIZE*WU_SIZE] + area_b[b];
+				w->m2[ind] = w->m2[ind - WU_SIZE*WU_SIZE] + area2[b];
+			}
+		}
+	}
+}
+
+static void Super2x_Quantize(byte *data, int numpixels, ThreadData *thread)
+{
+	WuMoments w;
+	WuBox cube[WU_COLORS];
+	float vv[WU_COLORS], temp;
+	byte palette[WU_COLORS][3], *in, *end;
+	int i, k, next, ind, maxw, weight, numcolors, r, g, b;
+
+	w.wt = (int *)Thread_Scratch(thread, SUPER2X_SLOT_QUANTIZE, WU_CELLS * (sizeof(int) * 4 + sizeof(float) + 1));
+	w.mr = w.wt + WU_CELLS;
+	w.mg = w.mr + WU_CELLS;
+	w.mb = w.mg + WU_CELLS;
+	w.m2 = (float *)(w.mb + WU_CELLS);
+	w.tag = (byte *)(w.m2 + WU_CELLS);
+	memset(w.wt, 0, WU_CELLS * (sizeof(int) * 4 + sizeof(float)));
+
+	// histogram (bytes are B, G, R)
+	end = data + numpixels * 3;
+	for (in = data; in < end; in += 3)
+	{
+		ind = WU_INDEX((in[2] >> 3) + 1, (in[1] >> 3) + 1, (in[0] >> 3) + 1);
+		w.wt[ind]++;
+		w.mr[ind] += in[2];
+		w.mg[ind] += in[1];
+		w.mb[ind] += in[0];
+		w.m2[ind] += (float)(in[2]*in[2] + in[1]*in[1] + in[0]*in[0]);
+	}
+
+	// reserved grey palette outweights any histogram cell
+	maxw = 0;
+	for (i = 0; i < WU_CELLS; i++)
+		maxw = max(maxw, w.wt[i]);
+	maxw++;
+	for (i = 0; i < 256; i++)
+	{
+		ind = WU_INDEX((i >> 3) + 1, (i >> 3) + 1, (i >> 3) + 1);
+		w.wt[ind] = maxw;
+		w.mr[ind] = w.mg[ind] = w.mb[ind] = maxw * i;
+		w.m2[ind] = maxw * (float)(i*i*3);
+	}
+	Wu_Moments(&w);
+
+	// split boxes by largest variance
+	cube[0].r0 = cube[0].g0 = cube[0].b0 = 0;
+	cube[0].r1 = cube[0].g1 = cube[0].b1 = WU_SIZE - 1;
+	next = 0;
+	numcolors = WU_COLORS;
+	for (i = 1; i < numcolors; i++)
+	{
+		if (Wu_Cut(&w, &cube[next], &cube[i]))
+		{
+			vv[next] = (cube[next].vol > 1) ? Wu_Var(&w, &cube[next]) : 0.0f;
+			vv[i] = (cube[i].vol > 1) ? Wu_Var(&w, &cube[i]) : 0.0f;
+		}
+		else
+		{
+			vv[next] = 0.0f;
+			i--;
+		}
+		next = 0;
+		temp = vv[0];
+		for (k = 1; k <= i; k++)
+		{
+			if (vv[k] > temp)
+			{
+				temp = vv[k];
+				next = k;
+			}
+		}
+		if (temp <= 0.0f)
+		{
+			numcolors = i + 1;
+			break;
+		}
+	}
+
+	// palette, and which box each cell went to
+	for (k = 0; k < numcolors; k++)
+	{
+		for (r = cube[k].r0 + 1; r <= cube[k].r1; r++)
+			for (g = cube[k].g0 + 1; g <= cube[k].g1; g++)
+				for (b = cube[k].b0 + 1; b <= cube[k].b1; b++)
+					w.tag[WU_INDEX(r, g, b)] = (byte)k;
+		weight = Wu_Vol(&cube[k], w.wt);
+		if (weight)
+		{
+			palette[k][2] = (byte)((float)Wu_Vol(&cube[k], w.mr) / (float)weight + 0.5f);
+			palette[k][1] = (byte)((float)Wu_Vol(&cube[k], w.mg) / (float)weight + 0.5f);
+			palette[k][0] = (byte)((float)Wu_Vol(&cube[k], w.mb) / (float)weight + 0.5f);
+		}
+		else
+			palette[k][0] = palette[k][1] = palette[k][2] = 0;
+	}
+
+	// remap
+	for (in = data; in < end; in += 3)
+	{
+		k = w.tag[WU_INDEX((in[2] >> 3) + 1, (in[1] >> 3) + 1, (in[0] >> 3) + 1)];
+		in[0] = palette[k][0];
+		in[1] = palette[k][1];
+		in[2] = palette[k][2];
+	}
+}
+
+/*
+==========================================================================================
+
+  Fused passes
+
+  scale4x rows go straight into the backscaling filter, each backscaled row
+  is blended with sharpened lanczos layer and written to output
+
+==========================================================================================
+*/
+
+typedef struct
+{
+	MipStream  *stream;
+	byte       *row;       // backscaled row
+	int         y;         // next backscaled row
+	int         width;
+	// color pass
+	const byte *layer;     // quantized lanczos layer
+	const byte *blurred;   // it's blur for sharpening
+	byte       *dst;
+	int         dstpitch;
+	int         dstbpp;
+	// alpha pass
+	byte       *alpha;     // backscaled alpha plane
+}Super2xPass;
+
+static void Super2x_ColorRow(void *data, const byte *row)
+{
+	Super2xPass *pass = (Super2xPass *)data;
+	const byte *layer, *blurred, *in;
+	float rb = 1 - SUPER2X_BLEND;
+	byte *out;
+	int x, c;
+
+	Mip_PushRow(pass->stream, row);
+	while(Mip_PullRow(pass->stream, pass->row))
+	{
+		layer = pass->layer + pass->y * pass->width * 3;
+		blurred = pass->blurred + pass->y * pass->width * 3;
+		in = pass->row;
+		out = pass->dst + pass->y * pass->dstpitch;
+		for (x = 0; x < pass->width; x++, in += 3, layer += 3, blurred += 3, out += pass->dstbpp)
+		{
+			for (c = 0; c < 3; c++)
+				out[c] = (byte)floor(in[c]*rb + Super2x_Sharpen(layer[c], blurred[c], SUPER2X_SHARPEN_COLOR, 3)*SUPER2X_BLEND + 0.5);
+			if (pass->dstbpp == 4)
+				out[3] = 255;
+		}
+		pass->y++;
+	}
+}
+
+static void Super2x_AlphaRow(void *data, const byte *row)
+{
+	Super2xPass *pass = (Super2xPass *)data;
+	byte *out;
+	int x;
+
+	Mip_PushRow(pass->stream, row);
+	while(Mip_PullRow(pass->stream, pass->row))
+	{
+		out = pass->alpha + pass->y * pass->width;
+		for (x = 0; x < pass->width; x++)
+			out[x] = pass->row[x * 3];
+		pass->y++;
+	}
+}
+
+// fiFixTransparentPixels: colors of not fully opaque pixels are mixed with average of visible neighbours
+// (wrapping around edges), done in place, original rows which are still needed are kept aside
+static void Super2x_FixTransparentPixels(byte *data, int pitch, int width, int height, int alphaMin, byte *rows)
+{
+	const byte *up, *down, *line, *n;
+	byte *first, *prev, *cur, *temp, *out;
+	int x, y, c, nc, nx[3], rgb[3], i, k;
+	float b, br;
+
+	first = rows;
+	prev = rows + width * 4;
+	cur = prev + width * 4;
+	memcpy(first, data, width * 4);
+	for (y = 0; y < height; y++)
+	{
+		out = data + (size_t)y * pitch;
+		memcpy(cur, out, width * 4);
+		if (y > 0)
+			up = prev;
+		else
+			up = (height > 1) ? data + (size_t)(height - 1) * pitch : cur;
+		down = (y < height - 1) ? data + (size_t)(y + 1) * pitch : first;
+		for (x = 0; x < width; x++)
+		{
+			if (cur[x*4 + 3] == 255)
+				continue;
+			nx[0] = (x > 0) ? x - 1 : width - 1;
+			nx[1] = x;
+			nx[2] = (x < width - 1) ? x + 1 : 0;
+			nc = 0;
+			rgb[0] = rgb[1] = rgb[2] = 0;
+			for (k = 0; k < 3; k++)
+			{
+				line = (k == 0) ? up : (k == 1) ? cur : down;
+				for (i = 0; i < 3; i++)
+				{
+					if (k == 1 && i == 1)
+						continue;
+					n = line + nx[i] * 4;
+					if (n[3] > alphaMin)
+					{
+						nc++;
+						rgb[0] += n[0];
+						rgb[1] += n[1];
+						rgb[2] += n[2];
+					}
+				}
+			}
+			if (!nc)
+				continue;
+			b = 1.0f - (float)cur[x*4 + 3] / 255.0f;
+			br = 1.0f - b;
+			for (c = 0; c < 3; c++)
+				out[x*4 + c] = (byte)min(255.0f, cur[x*4 + c]*br + ((float)rgb[c] / nc)*b);
+		}
+		temp = prev;
+		prev = cur;
+		cur = temp;
+	}
+}
+
+/*
+==========================================================================================
+
+  Super2x
+
+==========================================================================================
+*/
+
+bool Super2x_Check(int width, int height)
+{
+	return Scale2x_Check(4, 3, width, height);
+}
+
+void Super2x_Scale(const byte *src, int srcpitch, int bpp, int width, int height, bool hasAlpha, int alphaMin, byte *dst, int dstpitch, int dstwidth, int dstheight, ThreadData *thread)
+{
+	Super2xPass pass;
+	byte *colors, *alpha, *layer, *blur1, *blur2, *rows, *out;
+	const byte *in;
+	int i, x, y, dstbpp;
+	size_t numpixels;
+
+	if (!Super2x_Check(width, height) || (hasAlpha && bpp != 4))
+		return;
+	dstbpp = hasAlpha ? 4 : 3;
+	numpixels = (size_t)dstwidth * dstheight;
+
+	// colors, transparent ones are cleared for better scaling
+	colors = (byte *)Thread_Scratch(thread, SUPER2X_SLOT_SOURCE, (size_t)width * height * 3);
+	alpha = hasAlpha ? (byte *)Thread_Scratch(thread, SUPER2X_SLOT_ALPHA, (size_t)width * height) : NULL;
+	for (y = 0; y < height; y++)
+	{
+		in = src + (size_t)y * srcpitch;
+		out = colors + (size_t)y * width * 3;
+		for (x = 0; x < width; x++, in += bpp, out += 3)
+		{
+			if (alpha && in[3] < alphaMin)
+				out[0] = out[1] = out[2] = 0;
+			else
+			{
+				out[0] = in[0];
+				out[1] = in[1];
+				out[2] = in[2];
+			}
+			if (alpha)
+				alpha[(size_t)y * width + x] = in[3];
+		}
+	}
+
+	// lanczos layer, quantized and blurred for sharpening
+	layer = (byte *)Thread_Scratch(thread, SUPER2X_SLOT_LAYER, numpixels * 3);
+	blur1 = (byte *)Thread_Scratch(thread, SUPER2X_SLOT_BLUR1, numpixels * 3);
+	blur2 = (byte *)Thread_Scratch(thread, SUPER2X_SLOT_BLUR2, numpixels * 3);
+	rows = (byte *)Thread_Scratch(thread, SUPER2X_SLOT_ROWS, (size_t)dstwidth * 4 * 3);
+	Mip_Downsample(colors, width, height, width * 3, layer, dstwidth, dstheight, dstwidth * 3, 3, IMAGE_SCALER_LANCZOS, false);
+	Super2x_Quantize(layer, (int)numpixels, thread);
+	Super2x_Blur(layer, blur1, dstwidth, dstheight, 3);
+	Super2x_Blur(blur1, blur2, dstwidth, dstheight, 3);
+
+	// scale4x, backscale and blend sharpened lanczos layer
+	memset(&pass, 0, sizeof(pass));
+	pass.stream = Mip_BeginStream(width * 4, height * 4, dstwidth, dstheight, 3, IMAGE_SCALER_LANCZOS, false);
+	pass.row = rows;
+	pass.width = dstwidth;
+	pass.layer = layer;
+	pass.blurred = blur2;
+	pass.dst = dst;
+	pass.dstpitch = dstpitch;
+	pass.dstbpp = dstbpp;
+	Scale2x_ScaleRows(4, colors, width * 3, 3, width, height, Super2x_ColorRow, &pass);
+	Mip_EndStream(pass.stream);
+	if (!alpha)
+		return;
+
+	// alpha is scaled as grey colors, equal bytes compare same way as single ones
+	for (i = 0; i < width * height; i++)
+		colors[i*3] = colors[i*3 + 1] = colors[i*3 + 2] = alpha[i];
+	memset(&pass, 0, sizeof(pass));
+	pass.stream = Mip_BeginStream(width * 4, height * 4, dstwidth, dstheight, 3, IMAGE_SCALER_CATMULLROM, false);
+	pass.row = rows;
+	pass.width = dstwidth;
+	pass.alpha = layer;
+	Scale2x_ScaleRows(4, colors, width * 3, 3, width, height, Super2x_AlphaRow, &pass);
+	Mip_EndStream(pass.stream);
+
+	// sharpen into output
+	Super2x_Blur(layer, blur1, dstwidth, dstheight, 1);
+	Super2x_Blur(blur1, blur2, dstwidth, dstheight, 1);
+	for (y = 0; y < dstheight; y++)
+	{
+		in = layer + (size_t)y * dstwidth;
+		out = dst + (size_t)y * dstpitch;
+		for (x = 0; x < dstwidth; x++)
+			out[x*4 + 3] = Super2x_Sharpen(in[x], blur2[(size_t)y * dstwidth + x], SUPER2X_SHARPEN_ALPHA, 1);
+	}
+	Super2x_FixTransparentPixels(dst, dstpitch, dstwidth, dstheight, alphaMin, rows);
+}
@@ -0,0 +1,16 @@
+// super2x.h
+#ifndef H_TEX_SUPER2X_H
+#define H_TEX_SUPER2X_H
+
+#include "main.h"
+
+// native Super2x, same steps as FreeImage pipeline of Image_Scale2x_Super2x:
+// lanczos layer quantized to a palette and sharpened, blended over scale4x backscaled with lanczos,
+// alpha is scale4x backscaled with catmull-rom and sharpened, then transparent pixels are filled from neighbours
+// working memory is taken from Thread_Scratch and adjacent stages are fused, the 4x image is never stored
+// src is 24 or 32-bit, dst is 32-bit if hasAlpha and 24-bit otherwise
+// output matches FreeImage path within small tolerance (resamplers weight and round edges differently)
+bool Super2x_Check(int width, int height);
+void Super2x_Scale(const byte *src, int srcpitch, int bpp, int width, int height, bool hasAlpha, int alphaMin, byte *dst, int dstpitch, int dstwidth, int dstheight, ThreadData *thread);
+
+#endif
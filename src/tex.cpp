@@ -17,8 +17,11 @@ TexTool      *tex_tools          = NULL;
 TexFormat    *tex_formats        = NULL;
 TexContainer *tex_containers     = NULL;
 size_t        tex_containers_scanbytes = 0;
+int           tex_numCodecs      = 0;
 
 // options
+// NOTE: every option which changes encoded files has to be hashed in TexCompress_OptionsHash,
+// otherwise files cache and output cache give back files encoded with old value of it
 texmode       tex_mode = TEXMODE_NORMAL;
 char          tex_srcDir[MAX_FPATH];
 char          tex_srcFile[MAX_FPATH];
@@ -57,6 +60,15 @@ FCLIST        tex_scale2xFiles;
 FCLIST        tex_scale4xFiles;
 ImageScaler   tex_firstScaler;
 ImageScaler   tex_secondScaler;
+texmipgen     tex_mipGenerator;
+ImageScaler   tex_mipFilter;
+bool          tex_mipReport;
+bool          tex_nativeSuper2x;
+bool          tex_incremental;
+bool          tex_paranoid;
+string        tex_outputCache;
+int           tex_outputCacheSize;
+int           tex_tiledMegapixels;
 int           tex_useSuffix;
 bool          tex_testCompresion = false;
 bool          tex_testCompresionError = false;
@@ -64,6 +76,13 @@ bool          tex_testCompresionAllErrors = false;
 TexErrorMetric tex_errorMetric = ERRORMETRIC_AUTO;
 TexContainer *tex_container = NULL;
 texprofile    tex_profile;
+bool          tex_sortByCost;
+int           tex_memoryBudget;
+int           tex_loadThreads;
+int           tex_loadQueue;
+int           tex_writeQueue;
+int           tex_writeThreads;
+bool          tex_writeRing;
 
 /*
 ==========================================================================================
@@ -103,6 +122,7 @@ void RegisterCodec(TexCodec *codec)
 		for (c = tex_codecs; c; c = c->next) last = c;
 		last->next = codec;
 	}
+	codec->index = tex_numCodecs++;
 	// initialize
 	uint len = strlen(codec->parmName);
 	codec->cmdParm = (char *)mem_alloc(len + 2);
@@ -667,6 +687,18 @@ void CommandLineOptions(void)
 	if (CheckParm("-2xbrz"))      tex_secondScaler = IMAGE_SCALER_XBRZ;	
 	// COMMANDLINEPARM: -2sbrz: select sBRz filter for second scaler (4x)
 	if (CheckParm("-2sbrz"))      tex_secondScaler = IMAGE_SCALER_SBRZ;	
+	// COMMANDLINEPARM: -nosort: process files in scan order instead of largest-first
+	if (CheckParm("-nosort"))     tex_sortByCost = false;
+	// COMMANDLINEPARM: -nouring: write files with thread pool even if io_uring is available
+	if (CheckParm("-nouring"))    tex_writeRing = false;
+	// COMMANDLINEPARM: -mipreport: compare cascaded or native mips against direct lanczos mips and print quality report
+	if (CheckParm("-mipreport"))  tex_mipReport = true;
+	// COMMANDLINEPARM: -nativesuper2x: run super2x scaler natively on per-thread buffers instead of FreeImage passes
+	if (CheckParm("-nativesuper2x")) tex_nativeSuper2x = true;
+	// COMMANDLINEPARM: -rebuild: encode all files, even if they were not changed since last run (files cache is still updated)
+	if (CheckParm("-rebuild"))    tex_incremental = false;
+	// COMMANDLINEPARM: -paranoid: always read source files to check if they were changed, instead of trusting same size, modification time and file index
+	if (CheckParm("-paranoid"))   tex_paranoid = true;
 	// COMMANDLINEPARM: -nosign: do not add comment to generated texture files
 	if (CheckParm("-nosign"))     tex_useSign = false;
 	// COMMANDLINEPARM: -nosign: use GIMP comment for generated texture files
@@ -729,6 +761,70 @@ void CommandLineOptions(void)
 			i += 2;
 			continue;
 		}
+		// COMMANDLINEPARM: -membudget: memory budget (in megabytes) for textures being processed, default is 3/4 of RAM or container limit
+		if (!stricmp(myargv[i], "-membudget"))
+		{
+			i++;
+			if (i < myargc)
+				tex_memoryBudget = max(0, atoi(myargv[i]));
+			continue;
+		}
+		// COMMANDLINEPARM: -tiled: textures of this many megapixels and more are decoded, downsampled and compressed by stripes (block-based tools only, native mip generator)
+		if (!stricmp(myargv[i], "-tiled"))
+		{
+			i++;
+			if (i < myargc)
+				tex_tiledMegapixels = max(0, atoi(myargv[i]));
+			continue;
+		}
+		// COMMANDLINEPARM: -loadthreads: number of threads that prefetch and decode files for encoders, 0 makes encoders load files themselves
+		if (!stricmp(myargv[i], "-loadthreads"))
+		{
+			i++;
+			if (i < myargc)
+				tex_loadThreads = max(0, atoi(myargv[i]));
+			continue;
+		}
+		// COMMANDLINEPARM: -loadqueue: how many decoded images may wait for encoders, default is number of encoder threads
+		if (!stricmp(myargv[i], "-loadqueue"))
+		{
+			i++;
+			if (i < myargc)
+				tex_loadQueue = max(0, atoi(myargv[i]));
+			continue;
+		}
+		// COMMANDLINEPARM: -writequeue: how many megabytes of encoded files may wait for writer, default is 1/4 of memory budget (256 max)
+		if (!stricmp(myargv[i], "-writequeue"))
+		{
+			i++;
+			if (i < myargc)
+				tex_writeQueue = max(0, atoi(myargv[i]));
+			continue;
+		}
+		// COMMANDLINEPARM: -writethreads: number of threads writing files in folder output mode (when io_uring is not available)
+		if (!stricmp(myargv[i], "-writethreads"))
+		{
+			i++;
+			if (i < myargc)
+				tex_writeThreads = max(1, atoi(myargv[i]));
+			continue;
+		}
+		// COMMANDLINEPARM: -cache: directory of encoded files cache, it may be shared by several source trees and output paths
+		if (!stricmp(myargv[i], "-cache"))
+		{
+			i++;
+			if (i < myargc)
+				tex_outputCache = myargv[i];
+			continue;
+		}
+		// COMMANDLINEPARM: -cachesize: encoded files cache size limit in megabytes, least recently used files are removed if it is exceeded
+		if (!stricmp(myargv[i], "-cachesize"))
+		{
+			i++;
+			if (i < myargc)
+				tex_outputCacheSize = max(1, atoi(myargv[i]));
+			continue;
+		}
 		// COMMANDLINEPARM: -scaler: set a filter to be used for scaling (2x and 4x)
 		if (!stricmp(myargv[i], "-scaler"))
 		{
@@ -745,6 +841,22 @@ void CommandLineOptions(void)
 				tex_secondScaler = (ImageScaler)OptionEnum(myargv[i], ImageScalers, IMAGE_SCALER_SUPER2X);
 			continue;
 		}
+		// COMMANDLINEPARM: -mipgen: set how mip levels are generated (direct - from base image, cascade - from previous level, native - from previous level with internal downsampler)
+		if (!stricmp(myargv[i], "-mipgen"))
+		{
+			i++;
+			if (i < myargc)
+				tex_mipGenerator = (texmipgen)OptionEnum(myargv[i], tex_mipGenerators, MIPGEN_DIRECT, "mip generator");
+			continue;
+		}
+		// COMMANDLINEPARM: -mipfilter: set a filter to be used for mip generation (nearest, bilinear, bicubic, bspline, catmullrom, lanczos)
+		if (!stricmp(myargv[i], "-mipfilter"))
+		{
+			i++;
+			if (i < myargc)
+				tex_mipFilter = (ImageScaler)OptionEnum(myargv[i], ImageScalers, IMAGE_SCALER_LANCZOS, "mip filter");
+			continue;
+		}
 		// COMMANDLINEPARM: -errormetric: set a metric to be used for compression error calculation
 		if (!stricmp(myargv[i], "-errormetric"))
 		{
@@ -860,6 +972,22 @@ void Tex_Init(void)
 	tex_zipAddFiles.clear();
 	tex_useSuffix = 0;
 	tex_testCompresion = false;
+	tex_sortByCost = true;
+	tex_memoryBudget = 0;
+	tex_mipGenerator = MIPGEN_DIRECT;
+	tex_mipFilter = IMAGE_SCALER_LANCZOS;
+	tex_mipReport = false;
+	tex_nativeSuper2x = false;
+	tex_incremental = true;
+	tex_paranoid = false;
+	tex_outputCache = "";
+	tex_outputCacheSize = 4096;
+	tex_tiledMegapixels = 0;
+	tex_loadThreads = 2;
+	tex_loadQueue = 0;
+	tex_writeQueue = 0;
+	tex_writeThreads = 4;
+	tex_writeRing = true;
 	tex_container = findContainer("DDS", false);
 }
 
@@ -927,8 +1055,24 @@ void Tex_Help(void)
 	"        -4x: apply 4x scale (2 pass scale)\n"
 	"  -scaler X: set a filter to be used for scaling\n"
 	" -scaler2 X: set a filter to be used for second scale pass\n"
+	"  -mipgen X: generate mips from base image (direct) or previous level (cascade, native)\n"
+	"-mipfilter X: set a filter to be used for mip generation\n"
+	" -mipreport: compare cascaded or native mips against direct lanczos mips\n"
+	"-nativesuper2x: faster super2x without FreeImage passes (output differs slightly)\n"
+	"  -tiled X: process textures of X+ megapixels by stripes to save memory (mipmaps need -mipgen native)\n"
 	"        -ap: additional archive path\n"
 	"  -zipmem X: speeds up compression by generating ZIP in memory\n"
+	"    -nosort: process files in scan order (default is most expensive first)\n"
+	"   -rebuild: encode all files (default is to skip files not changed since last run)\n"
+	"  -paranoid: check for changed files by contents even if size and time are same\n"
+	"  -cache dir: reuse encoded files from cache directory, shared between source trees\n"
+	"-cachesize X: cache size limit in MB (default 4096)\n"
+	"-membudget X: memory budget in MB (default is 3/4 of RAM)\n"
+	"-loadthreads X: threads prefetching files for encoders, taken from -threads (default 2)\n"
+	"-loadqueue X: max decoded images waiting for encoders\n"
+	"-writequeue X: max MB of encoded files waiting for writer\n"
+	"-writethreads X: file writing threads for folder output (default 4)\n"
+	"   -nouring: dont use io_uring for folder output\n"
 	"         -t: compress and decompress to a new file to inspect compression\n"
 	"       -stf: add Compressor tool/Format suffix to generated files\n"
 	"        -st: add Compressor tool suffix to generated files\n"
@@ -952,6 +1096,23 @@ void Tex_Help(void)
 	"\n");
 }
 
+// files cache only knows sources, so it is not used if output directories were deleted
+static bool TexOutputDirsExist(void)
+{
+	char dir[MAX_FPATH];
+	size_t len;
+
+	for (TexCodec *codec = tex_active_codecs; codec; codec = codec->nextActive)
+	{
+		sprintf(dir, "%s%s%s", tex_destPath, (!tex_testCompresion && tex_destPathUseCodecDir) ? codec->destDir : "", tex_addPath.c_str());
+		for (len = strlen(dir); len > 1 && (dir[len - 1] == '/' || dir[len - 1] == '\\') && dir[len - 2] != ':'; len--)
+			dir[len - 1] = 0;
+		if (dir[0] && !FileExists(dir))
+			return false;
+	}
+	return true;
+}
+
 int TexMain(int argc, char **argv)
 {
 	double timeelapsed;
@@ -1092,7 +1253,9 @@ int TexMain(int argc, char **argv)
 	Print("Entering \"%s%s\"\n", tex_srcDir, tex_srcFile);
 	textures.clear();
 	texturesSkipped = 0;
+	texturesHashed = 0;
 	FS_ScanPath(tex_srcDir, tex_srcFile, NULL);
+	bool dropped = drop_files.size() ? true : false;
 	if (drop_files.size())
 	{
 		for (vector<string>::iterator i = drop_files.begin(); i < drop_files.end(); i++)
@@ -1105,8 +1268,6 @@ int TexMain(int argc, char **argv)
 		}
 		drop_files.clear();
 	}
-	if (texturesSkipped)
-		Print("Skipping %i unchanged files\n", texturesSkipped);
 	if (!textures.size())
 	{
 		Print("No files to convert\n");
@@ -1123,16 +1284,103 @@ int TexMain(int argc, char **argv)
 	}
 
 	// run conversion
-	Print("%i files to encode\n", textures.size());
 	TexCompress_Load();
+
+	// files cache, files are encoded again only if source or options were changed
+	// archive is generated from scratch so it gets all files, dropped files are not relative to source dir
+	char cachefile[MAX_FPATH];
+	unsigned __int64 options = TexCompress_OptionsHash(argc, argv);
+	unsigned int cacheoptions = (unsigned int)(options ^ (options >> 32)); // files cache keeps 32 bits
+	cachefile[0] = 0;
+	if (tex_mode != TEXMODE_DROP_FILE && !dropped && !FS_FileMatchList(tex_destPath, tex_archiveFiles))
+	{
+		strlcpy(cachefile, tex_destPath, sizeof(cachefile));
+		AddSlash(cachefile);
+		strlcat(cachefile, "filescrc.dat", sizeof(cachefile));
+		if (TexOutputDirsExist())
+			FS_LoadCache(cachefile);
+		else
+			Verbose("Files cache: output directory is missing, encoding all files\n");
+		FS_CheckTextures(cacheoptions, tex_incremental);
+		Verbose("Files cache: %i files read to check if they were changed\n", texturesHashed);
+	}
+	if (texturesSkipped)
+		Print("Skipping %i unchanged files\n", texturesSkipped);
+	if (!textures.size())
+	{
+		Print("No files to convert\n");
+		if (cachefile[0])
+			FS_SaveCache(cachefile);
+		return 0;
+	}
+	Print("%i files to encode\n", textures.size());
+	if (tex_sortByCost)
+		TexCompress_SortByCost();
+	// memory budget, a part of it is left for pending writes
+	// budget of 0 means memory limit could not be detected, nothing is limited then
+	unsigned __int64 budget = (unsigned __int64)tex_memoryBudget * 1048576;
+	Mem_SetBudget((budget > (size_t)-1) ? (size_t)-1 : (size_t)budget);
+	size_t maxPendingWrite = tex_writeQueue ? (size_t)min((unsigned __int64)tex_writeQueue * 1048576, (unsigned __int64)(size_t)-1) : (size_t)MAX_PENDING_WRITE;
+	if (Mem_GetBudget())
+	{
+		maxPendingWrite = min(maxPendingWrite, Mem_GetBudget() / (tex_writeQueue ? 2 : 4));
+		maxPendingWrite = max(maxPendingWrite, (size_t)MIN_PENDING_WRITE);
+		if (maxPendingWrite < Mem_GetBudget())
+			Mem_SetBudget(Mem_GetBudget() - maxPendingWrite);
+		Print("Memory budget: %.0f MB\n", (Mem_GetBudget() + maxPendingWrite) / 1048576.0);
+	}
+	else
+		Print("Memory budget: unlimited\n");
+
+	// output cache, encoded files are found by source contents, path and options
+	OutCache_Init(tex_outputCache.c_str(), tex_outputCacheSize);
+	if (OutCache_Active())
+		Print("Output cache: %s (%i MB)\n", tex_outputCache.c_str(), tex_outputCacheSize);
+
+	// pipeline: loader threads, encoder threads and a writer (central thread)
 	TexCompressData SharedData;
 	memset(&SharedData, 0, sizeof(TexCompressData));
-	timeelapsed = ParallelThreads(numthreads, textures.size(), &SharedData, TexCompress_WorkerThread, TexCompress_MainThread);
+	// loaders decode files, so they are taken out of thread count, at least one encoder is kept
+	SharedData.num_loaders = min(min(tex_loadThreads, (int)textures.size()), max(0, numthreads - 1));
+	SharedData.num_encoders = max(1, numthreads - SharedData.num_loaders);
+	SharedData.stageLoad.threads = SharedData.num_loaders;
+	SharedData.stageEncode.threads = SharedData.num_encoders;
+	SharedData.stageWrite.threads = 1;
+	SharedData.options = options;
+	Thread_MutexInit(&SharedData.stats_mutex);
+	TexCompress_InitThreadStats(&SharedData, SharedData.num_encoders + SharedData.num_loaders + 1);
+	Thread_QueueInit(&SharedData.loadQueue, tex_loadQueue ? tex_loadQueue : SharedData.num_encoders);
+	Thread_QueueInit(&SharedData.writeQueue, maxPendingWrite);
+	if (SharedData.num_loaders)
+		Print("Pipeline: %i loader threads, %i encoder threads\n", SharedData.num_loaders, SharedData.num_encoders);
+	timeelapsed = ParallelThreads(SharedData.num_encoders + SharedData.num_loaders, textures.size(), &SharedData, TexCompress_WorkerThread, TexCompress_MainThread);
+	Thread_QueueDestroy(&SharedData.loadQueue);
+	Thread_QueueDestroy(&SharedData.writeQueue);
+	Thread_MutexDestroy(&SharedData.stats_mutex);
+	TexCompress_MergeThreadStats(&SharedData);
+	OutCache_Shutdown();
+
+	// store encoded files to files cache
+	// writer does not tell which files failed, so none of them are stored and all will be encoded next time
+	if (cachefile[0])
+	{
+		if (!SharedData.writerStats.failed)
+			for (vector<FS_File>::iterator f = textures.begin(); f < textures.end(); f++)
+				if (f->encoded)
+					FS_UpdateCache(&(*f), cacheoptions);
+		FS_SaveCache(cachefile);
+	}
 
 	// show stats
 	Print("Conversion finished!\n");
 	Print("--------\n");
 	Print("  files exported: %i\n", SharedData.num_exported_files);
+	if (SharedData.num_tiled_textures)
+		Print("  tiled textures: %i\n", SharedData.num_tiled_textures);
+	if (outcacheStats.hits || outcacheStats.misses)
+		Print("    output cache: %i hits, %i misses, %.2f mb stored\n", outcacheStats.hits, outcacheStats.misses, outcacheStats.storedMB);
+	if (outcacheStats.evicted)
+		Print("   cache evicted: %i files (%.2f mb), %.2f mb left\n", outcacheStats.evicted, outcacheStats.evictedMB, outcacheStats.sizeMB);
 	Print("    time elapsed: %i:%02.1f\n", (int)(timeelapsed / 60), (double)(timeelapsed - ((int)(timeelapsed / 60)*60)));
 	Print("     input files: %.2f mb\n", SharedData.size_original_files);
 	for (TexCodec *codec = tex_codecs; codec; codec = codec->next)
@@ -1142,8 +1390,12 @@ int TexMain(int argc, char **argv)
 		Print("%s:\n", codec->name);
 		Print("  input textures: %.2f mb (%.2f VRAM, %.2f PoT VRAM)\n", codec->stat_inputDiskMB, codec->stat_inputRamMB, codec->stat_inputPOTRamMB);
 		Print(" output textures: %.2f mb (%.2f VRAM)\n", codec->stat_outputDiskMB, codec->stat_outputRamMB);
+		if (codec->stat_encodeTime > 0)
+			Print("     encode time: %.1f s (%.2f mpixels/s, %.2f mb/s written per thread)\n", codec->stat_encodeTime, codec->stat_pixels / codec->stat_encodeTime / 1000000.0, codec->stat_outputDiskMB / codec->stat_encodeTime);
 	}
 	if (SharedData.zip_len)
 		Print("    archive size: %.2f mb\n", SharedData.zip_len / 1048576.0f);
+	TexCompress_PrintMipCompare(&SharedData);
+	TexCompress_PrintStageStats(&SharedData, timeelapsed);
 	return 0; 
 }
\ No newline at end of file
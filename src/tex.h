@@ -46,6 +46,25 @@ enum texprofile
 	extern OptionList tex_profiles[];
 #endif
 
+// mip generators
+typedef enum
+{
+	MIPGEN_DIRECT,  // every level is rescaled from base image
+	MIPGEN_CASCADE, // every level is rescaled from previous one
+	MIPGEN_NATIVE,  // cascade with internal SIMD downsampler, sRGB is filtered in linear light
+}texmipgen;
+#ifdef F_TEX_C
+	OptionList tex_mipGenerators[] = 
+	{ 
+		{ "direct", MIPGEN_DIRECT }, 
+		{ "cascade", MIPGEN_CASCADE }, 
+		{ "native", MIPGEN_NATIVE }, 
+		{ 0 }
+	};
+#else
+	extern OptionList tex_mipGenerators[];
+#endif
+
 // compression block
 typedef struct TexBlock_s
 {
@@ -88,6 +107,7 @@ typedef struct TexFormat_s
 #define TEXINPUT_BGRA        2
 #define TEXINPUT_RGB         4
 #define TEXINPUT_RGBA        8
+#define TEXINPUT_STRIPES     16 // every map is compressed by independent rows of blocks, so tool may be fed with stripes of image
 
 // texture compression/decompression tool
 typedef struct TexTool_s
@@ -108,6 +128,7 @@ typedef struct TexTool_s
 	char              *forceGroup;
 	FCLIST             forceFileList;
 	char              *suffix;
+	unsigned __int64   optionsHash; // hash of option file lines, part of options fingerprint
 	char              *featuredCodecs; // filled by Tex_LinkTools()
 	char              *featuredFormats; // filled by Tex_LinkTools()
 	TexTool_s         *next;
@@ -136,6 +157,9 @@ typedef struct TexCodec_s
 	bool               disabled;
 	FCLIST             discardList;
 	char               destDir[MAX_FPATH];
+	unsigned __int64   optionsHash; // hash of option file lines, part of options fingerprint
+	int                index; // index in per-thread stats
+	// stats, summed from threads when conversion is finished
 	double             stat_inputDiskMB;
 	double             stat_inputRamMB;
 	double             stat_inputPOTRamMB;
@@ -143,6 +167,8 @@ typedef struct TexCodec_s
 	double             stat_outputRamMB;
 	size_t             stat_numTextures;
 	size_t             stat_numImages;
+	double             stat_encodeTime;
+	double             stat_pixels;
 	TexCodec_s        *next;
 	TexCodec_s        *nextActive;
 } TexCodec;
@@ -217,6 +243,7 @@ extern TexTool      *tex_tools;
 extern TexFormat    *tex_formats;
 extern TexContainer *tex_containers;
 extern size_t        tex_containers_scanbytes;
+extern int           tex_numCodecs;
 
 // architecture functions
 TexCodec     *findCodec(const char *name, bool quiet);
@@ -300,6 +327,15 @@ extern FCLIST        tex_scale2xFiles;
 extern FCLIST        tex_scale4xFiles;
 extern ImageScaler   tex_firstScaler;
 extern ImageScaler   tex_secondScaler;
+extern texmipgen     tex_mipGenerator;
+extern ImageScaler   tex_mipFilter;
+extern bool          tex_mipReport;
+extern bool          tex_nativeSuper2x;
+extern bool          tex_incremental;
+extern bool          tex_paranoid;
+extern string        tex_outputCache;
+extern int           tex_outputCacheSize;
+extern int           tex_tiledMegapixels;
 extern int           tex_useSuffix;
 extern bool          tex_testCompresion;
 extern bool          tex_testCompresionError;
@@ -308,5 +344,12 @@ extern bool          tex_testCompresionAllErrors;
 extern TexErrorMetric tex_errorMetric;
 extern TexContainer *tex_container;
 extern texprofile    tex_profile;
+extern bool          tex_sortByCost;
+extern int           tex_memoryBudget;
+extern int           tex_loadThreads;
+extern int           tex_loadQueue;
+extern int           tex_writeQueue;
+extern int           tex_writeThreads;
+extern bool          tex_writeRing;
 
 #endif
\ No newline at end of file
@@ -8,6 +8,10 @@
 
 #include "main.h"
 #include "freeimage.h"
+#include "mipmap.h"
+#include "hash.h"
+#include "scale2x_simd.h"
+#include <algorithm>
 
 /*
 ==========================================================================================
@@ -17,17 +21,103 @@
 ==========================================================================================
 */
 
+inline void SwizzlePixel_None(byte *in, bool rgbSwap)
+{
+}
+
+// all preprocessing of a pixel in one go, so map is read and written once
+template <int bpp, bool swap, void (*swizzle)(byte *in, bool rgbSwap)>
+static void PreprocessKernel(byte *data, size_t pixels, const byte *colorTable, bool binaryAlpha, bool rgbSwap)
+{
+	byte *in, *end, saved, center, r, g, b;
+
+	center = tex_binaryAlphaCenter;
+	in = data;
+	end = in + pixels * bpp;
+	while(in < end)
+	{
+		if (bpp == 4 && binaryAlpha)
+			in[3] = (in[3] < center) ? 0 : 255;
+		if (colorTable)
+		{
+			r = colorTable[in[0]];
+			g = colorTable[in[1]];
+			b = colorTable[in[2]];
+			in[0] = r;
+			in[1] = g;
+			in[2] = b;
+		}
+		swizzle(in, rgbSwap);
+		if (swap)
+		{
+			saved = in[0];
+			in[0] = in[2];
+			in[2] = saved;
+		}
+		in += bpp;
+	}
+}
+
 typedef struct
 {
-	bool   BinaryAlpha;
-	bool   ConvertTosRGB;
-	bool   ConvertToLinear;
-	bool   SwapColors;
-	void (*ColorSwizzle)(byte *data, int width, int height, int pitch, int bpp, bool rgbSwap, bool sRGB, bool decode);
-} MapProcessParms;
+	void (*swizzle)(byte *data, int width, int height, int pitch, int bpp, bool rgbSwap, bool sRGB, bool decode);
+	TexPreprocessKernel kernels[2][2]; // [bpp == 4][swap]
+} PreprocessKernels;
+
+// swizzles need alpha channel, so they only have 4 bpp kernels
+#define PREPROCESS_SWIZZLE(swizzle, pixel) { swizzle, { { NULL, NULL }, { PreprocessKernel<4, false, pixel>, PreprocessKernel<4, true, pixel> } } }
+
+static PreprocessKernels preprocess_kernels[] =
+{
+	{ NULL, { { PreprocessKernel<3, false, SwizzlePixel_None>, PreprocessKernel<3, true, SwizzlePixel_None> }, { PreprocessKernel<4, false, SwizzlePixel_None>, PreprocessKernel<4, true, SwizzlePixel_None> } } },
+	PREPROCESS_SWIZZLE(Swizzle_Premult, SwizzlePixel_Premult),
+	PREPROCESS_SWIZZLE(Swizzle_XGBR, SwizzlePixel_XGBR),
+	PREPROCESS_SWIZZLE(Swizzle_AGBR, SwizzlePixel_AGBR),
+	PREPROCESS_SWIZZLE(Swizzle_YCoCg, SwizzlePixel_YCoCg),
+	PREPROCESS_SWIZZLE(Swizzle_YCoCg_Gamma2, SwizzlePixel_YCoCg_Gamma2),
+	PREPROCESS_SWIZZLE(Swizzle_YCoCgScaled, SwizzlePixel_YCoCgScaled),
+	PREPROCESS_SWIZZLE(Swizzle_YCoCgScaled_Gamma2, SwizzlePixel_YCoCgScaled_Gamma2),
+	PREPROCESS_SWIZZLE(Swizzle_AlphaInRGB6, SwizzlePixel_AlphaInRGB6),
+	PREPROCESS_SWIZZLE(Swizzle_AlphaInRGB3, SwizzlePixel_AlphaInRGB3),
+	PREPROCESS_SWIZZLE(Swizzle_AlphaInRGB1, SwizzlePixel_AlphaInRGB1),
+};
+
+// pick fused kernel for conversions, unknown swizzles and odd combinations stay with separate passes
+void PreprocessMap_SelectKernel(MapProcessParms *parms, int bpp)
+{
+	int i;
+
+	parms->Kernel = NULL;
+	parms->ColorTable = NULL;
+	if (bpp != 3 && bpp != 4)
+		return;
+	if (parms->BinaryAlpha && bpp != 4)
+		return;
+	for (i = 0; i < (int)(sizeof(preprocess_kernels) / sizeof(preprocess_kernels[0])); i++)
+	{
+		if (preprocess_kernels[i].swizzle == parms->ColorSwizzle)
+		{
+			parms->Kernel = preprocess_kernels[i].kernels[(bpp == 4) ? 1 : 0][parms->SwapColors ? 1 : 0];
+			break;
+		}
+	}
+	if (parms->ConvertTosRGB)
+		parms->ColorTable = ImageData_SRGBTable(true);
+	else if (parms->ConvertToLinear)
+		parms->ColorTable = ImageData_SRGBTable(false);
+}
 
 void PreprocessMap(ImageMap *map, MapProcessParms *parms, int bpp, bool rgbSwap)
 {
+	if (parms->Kernel)
+	{
+		parms->Kernel(map->data, (size_t)map->width * map->height, parms->ColorTable, parms->BinaryAlpha, rgbSwap);
+		if (parms->ConvertTosRGB)
+			map->sRGB = true;
+		if (parms->ConvertToLinear)
+			map->sRGB = false;
+		return;
+	}
 	if (parms->BinaryAlpha)
 	{
 		byte *in = map->data;
@@ -54,75 +144,440 @@ void PreprocessMap(ImageMap *map, MapProcessParms *parms, int bpp, bool rgbSwap)
 		ImageData_SwapRB(map->data, map->width, map->height, map->width*bpp, bpp);
 }
 
+FREE_IMAGE_FILTER MipFilter(ImageScaler scaler)
+{
+	if (scaler == IMAGE_SCALER_BOX)        return FILTER_BOX;
+	if (scaler == IMAGE_SCALER_BILINEAR)   return FILTER_BILINEAR;
+	if (scaler == IMAGE_SCALER_BICUBIC)    return FILTER_BICUBIC;
+	if (scaler == IMAGE_SCALER_BSPLINE)    return FILTER_BSPLINE;
+	if (scaler == IMAGE_SCALER_CATMULLROM) return FILTER_CATMULLROM;
+	return FILTER_LANCZOS3;
+}
+
+// add difference between tested and direct mip level to thread's comparison stats
+void CompareMip(TexEncodeTask *task, byte *in1, int pitch1, byte *in2, int pitch2, int width, int height, int bpp)
+{
+	TexThreadStats *stats;
+	int x, y, d;
+	double error, psnr;
+
+	stats = TexCompress_GetThreadStats(task->thread);
+	if (!stats)
+		return;
+	error = 0;
+	for (y = 0; y < height; y++)
+	{
+		for (x = 0; x < width * bpp; x++)
+		{
+			d = (int)in1[x] - (int)in2[x];
+			error += d * d;
+		}
+		in1 += pitch1;
+		in2 += pitch2;
+	}
+	psnr = (error > 0) ? 10.0 * log10(255.0 * 255.0 * width * height * bpp / error) : 99.0;
+	stats->mipCompare.levels++;
+	stats->mipCompare.error += error;
+	stats->mipCompare.samples += (double)width * height * bpp;
+	if (!stats->mipCompare.worstFile || psnr < stats->mipCompare.worstPSNR)
+	{
+		stats->mipCompare.worstPSNR = psnr;
+		stats->mipCompare.worstFile = task->file;
+	}
+}
+
+// number of maps to generate (base and mip levels)
+static int MapsCount(TexEncodeTask *task)
+{
+	int s, numMaps;
+
+	numMaps = 1;
+	if (!tex_noMipmaps && !FS_FileMatchList(task->file, task->image, tex_noMipFiles) && !(task->format->features & FF_NOMIP))
+		for (s = min(task->image->width, task->image->height); s > 1; s = s / 2)
+			numMaps++;
+	return numMaps;
+}
+
+// conversions maps needs for tool and format, returns false if there is nothing to do
+static bool MapsConversions(TexEncodeTask *task, bool sRGB, MapProcessParms *conversions)
+{
+	LoadedImage *image = task->image;
+
+	memset(conversions, 0, sizeof(MapProcessParms));
+	conversions->ConvertTosRGB = (image->sRGB != sRGB && sRGB == true);
+	conversions->ConvertToLinear = (image->sRGB != sRGB && sRGB == false);
+	conversions->BinaryAlpha = (task->format->features & FF_BINARYALPHA && image->hasAlpha) ? true : false;
+	conversions->ColorSwizzle = task->format->colorSwizzle;
+	conversions->SwapColors = ((image->colorSwap == true && !(task->tool->inputflags & (TEXINPUT_BGR|TEXINPUT_BGRA))) || (image->colorSwap == false && !(task->tool->inputflags & (TEXINPUT_RGB|TEXINPUT_RGBA)))) ? true : false;
+	if (!conversions->BinaryAlpha && !conversions->ConvertTosRGB && !conversions->ConvertToLinear && !conversions->SwapColors && conversions->ColorSwizzle == NULL)
+		return false;
+	PreprocessMap_SelectKernel(conversions, image->bpp);
+	return true;
+}
+
 void GenerateMipMaps(TexEncodeTask *task, bool sRGB)
 {
 	ImageMap *map;
 	LoadedImage *image;
-	int s, w, h, l, pitch, y;
-	bool data_allocated, any_conversions, mipLevels;
-	MapProcessParms conversions = { 0 };
-	FIBITMAP *mipbitmap;
+	TexThreadStats *stats;
+	int w, h, pitch, y, srcwidth, srcheight, srcpitch, directpitch, numMaps;
+	bool any_conversions, mipLevels, cascade, native;
+	MapProcessParms conversions;
+	FIBITMAP *mipbitmap, *cascaded, *previous, *direct;
+	FREE_IMAGE_FILTER filter;
+	byte *src, *in, *out;
+	double start;
 
 	// cleanup
 	image = task->image;
 	Image_FreeMaps(image);
 
 	// conversions needed
-	mipLevels = (!tex_noMipmaps && !FS_FileMatchList(task->file, image, tex_noMipFiles) && !(task->format->features & FF_NOMIP)) ? true : false;
-	conversions.ConvertTosRGB = (image->sRGB != sRGB && sRGB == true);
-	conversions.ConvertToLinear = (image->sRGB != sRGB && sRGB == false);
-	conversions.BinaryAlpha = (task->format->features & FF_BINARYALPHA && image->hasAlpha) ? true : false;
-	conversions.ColorSwizzle = task->format->colorSwizzle;
-	conversions.SwapColors = ((image->colorSwap == true && !(task->tool->inputflags & (TEXINPUT_BGR|TEXINPUT_BGRA))) || (image->colorSwap == false && !(task->tool->inputflags & (TEXINPUT_RGB|TEXINPUT_RGBA)))) ? true : false;
-	any_conversions = (conversions.BinaryAlpha || conversions.ConvertTosRGB || conversions.ConvertToLinear || conversions.SwapColors || conversions.ColorSwizzle != NULL) ? true : false;
-
-	// create base map
-	mem_calloc(&map, sizeof(ImageMap));
-	map->width = image->width;
-	map->height = image->height;
-	map->data = Image_GetUnalignedData(image, &map->datasize, &data_allocated, any_conversions );
-	map->sRGB = sRGB;
-	PreprocessMap(map, &conversions, image->bpp, image->colorSwap);
-	if (data_allocated == false)
-		map->external = true;
-	image->maps = map;
+	numMaps = MapsCount(task);
+	mipLevels = (numMaps > 1) ? true : false;
+	any_conversions = MapsConversions(task, sRGB, &conversions);
+
+	// create maps, base map uses bitmap pixels if they are not going to be changed
+	Image_CreateMaps(image, numMaps, any_conversions, false);
+	for (map = image->maps; map; map = map->next)
+		map->sRGB = sRGB;
 
 	// create miplevels
 	if (mipLevels)
 	{
-		s = min(image->width, image->height);
-		w = image->width;
-		h = image->height;
-		l = 0;
-		while(s > 1)
-		{
-			l++;
-			w = w / 2;
-			h = h / 2;
-			s = s / 2;
-			mem_calloc(&map->next, sizeof(ImageMap));
-			map = map->next;
-			map->level = l;
-			map->width = w;
-			map->height = h;
-			map->datasize = map->width*map->height*image->bpp;
-			map->data = (byte *)mem_alloc(map->datasize);
-			map->sRGB = sRGB;
-			// create mip
-			mipbitmap = fiRescale(image->bitmap, w, h, FILTER_LANCZOS3, false);
-			byte *in = fiGetData(mipbitmap, &pitch);
-			byte *out = map->data;
+		stats = tex_mipReport ? TexCompress_GetThreadStats(task->thread) : NULL;
+		filter = MipFilter(tex_mipFilter);
+		native = (tex_mipGenerator == MIPGEN_NATIVE) ? true : false;
+		cascade = (tex_mipGenerator == MIPGEN_CASCADE || (tex_mipReport && tex_mipGenerator == MIPGEN_DIRECT)) ? true : false;
+		previous = image->bitmap;
+		cascaded = NULL;
+		// native generator works on unprocessed data of previous level, maps are preprocessed once all levels are done
+		src = fiGetData(image->bitmap, &srcpitch);
+		srcwidth = image->width;
+		srcheight = image->height;
+		for (map = image->maps->next; map; map = map->next)
+		{
+			w = map->width;
+			h = map->height;
+			start = I_DoubleTime();
+			if (native)
+			{
+				Mip_Downsample(src, srcwidth, srcheight, srcpitch, map->data, w, h, w*image->bpp, image->bpp, tex_mipFilter, image->sRGB);
+				src = map->data;
+				srcpitch = w*image->bpp;
+				srcwidth = w;
+				srcheight = h;
+				if (stats)
+					stats->mipCompare.time += I_DoubleTime() - start;
+				if (tex_mipReport)
+				{
+					direct = fiRescale(image->bitmap, w, h, FILTER_LANCZOS3, false);
+					CompareMip(task, src, srcpitch, fiGetData(direct, &directpitch), directpitch, w, h, image->bpp);
+					fiFree(direct);
+				}
+				continue;
+			}
+			// create mip, cascade derives it from previous level which is much smaller than base
+			if (tex_mipGenerator == MIPGEN_CASCADE)
+				mipbitmap = cascaded = fiRescale(previous, w, h, filter, false);
+			else
+				mipbitmap = fiRescale(image->bitmap, w, h, filter, false);
+			if (stats)
+				stats->mipCompare.time += I_DoubleTime() - start;
+			if (tex_mipReport)
+			{
+				if (tex_mipGenerator == MIPGEN_DIRECT)
+					cascaded = fiRescale(previous, w, h, filter, false);
+				direct = (tex_mipGenerator == MIPGEN_DIRECT && filter == FILTER_LANCZOS3) ? mipbitmap : fiRescale(image->bitmap, w, h, FILTER_LANCZOS3, false);
+				CompareMip(task, fiGetData(cascaded, &pitch), pitch, fiGetData(direct, &directpitch), directpitch, w, h, image->bpp);
+				if (direct != mipbitmap)
+					fiFree(direct);
+			}
+			in = fiGetData(mipbitmap, &pitch);
+			out = map->data;
 			for (y = 0; y < h; y++)
 			{
 				memcpy(out, in, map->width*image->bpp);
 				out += map->width*image->bpp;
 				in += pitch;
 			}
-			if (mipbitmap != image->bitmap)
+			if (mipbitmap != image->bitmap && mipbitmap != cascaded)
 				fiFree(mipbitmap);
+			if (cascade)
+			{
+				if (previous != image->bitmap)
+					fiFree(previous);
+				previous = cascaded;
+			}
+		}
+		if (previous != image->bitmap)
+			fiFree(previous);
+	}
+
+	// preprocess
+	if (any_conversions)
+		for (map = image->maps; map; map = map->next)
 			PreprocessMap(map, &conversions, image->bpp, image->colorSwap);
+}
+
+/*
+==========================================================================================
+
+  Tiled compression
+
+  Very big images are downsampled and compressed by stripes, so mip levels and preprocessed
+  copy of image are never held whole. Each level has a band of rows, rows are passed to the
+  downsampler of next level as they come, and filled band is compressed as a map of it's own.
+  Small levels at the end of chain are kept whole and compressed together.
+
+==========================================================================================
+*/
+
+// rows in band, multiple of block height
+#define TILED_BAND_ROWS 64
+
+typedef struct
+{
+	ImageMap     *map;      // level header, has no pixels
+	ImageMap      band;     // rows being filled, height is number of rows filled
+	MipStream    *mip;      // makes next level from rows of this one
+	byte         *stream;   // where level data goes
+	size_t        rowSize;  // compressed size of one row of blocks
+	int           bandRows; // band capacity
+	int           bandY;    // first level row in band
+	bool          tail;     // level is kept whole and compressed with other small levels
+} TiledLevel;
+
+typedef struct
+{
+	TexEncodeTask  *task;
+	TiledLevel     *levels;
+	int             numLevels;
+	MapProcessParms conversions;
+	bool            any_conversions;
+	bool            failed;   // tool failed on some band
+} TiledData;
+
+// image is big enough and tool can be fed with stripes
+// stripes are downsampled by native mip generator, other generators need whole levels
+static bool Tiled_Accept(TexEncodeTask *task)
+{
+	if (!tex_tiledMegapixels || tex_mipReport || !(task->tool->inputflags & TEXINPUT_STRIPES))
+		return false;
+	if ((double)task->image->width * (double)task->image->height < tex_tiledMegapixels * 1000000.0)
+		return false;
+	// other mip generators need whole image, it was warned when options were loaded
+	if (tex_mipGenerator != MIPGEN_NATIVE && MapsCount(task) > 1)
+		return false;
+	return true;
+}
+
+// map headers for container, pixels are made by Tiled_Compress
+static void Tiled_CreateMaps(TexEncodeTask *task, bool sRGB)
+{
+	ImageMap *map;
+
+	Image_CreateMaps(task->image, MapsCount(task), false, true);
+	for (map = task->image->maps; map; map = map->next)
+		map->sRGB = sRGB;
+}
+
+static void Tiled_PrepareBand(TiledData *tiled, TiledLevel *level)
+{
+	level->band.datasize = level->band.width * level->band.height * tiled->task->image->bpp;
+	if (tiled->any_conversions)
+		PreprocessMap(&level->band, &tiled->conversions, tiled->task->image->bpp, tiled->task->image->colorSwap);
+}
+
+static void Tiled_CompressBand(TiledData *tiled, TiledLevel *level)
+{
+	TexEncodeTask *task = tiled->task;
+
+	Tiled_PrepareBand(tiled, level);
+	task->image->maps = &level->band;
+	task->stream = level->stream + (level->bandY / task->format->block->height) * level->rowSize;
+	if (!task->tool->fCompress(task))
+		tiled->failed = true;
+	level->bandY += level->band.height;
+	level->band.height = 0;
+}
+
+// row was added to band, pass it to next level and compress band if it's full
+static void Tiled_AddRow(TiledData *tiled, int l)
+{
+	TiledLevel *level, *next;
+	int bpp;
+	byte *row;
+
+	level = &tiled->levels[l];
+	bpp = tiled->task->image->bpp;
+	row = level->band.data + level->band.height * level->band.width * bpp;
+	level->band.height++;
+	if (level->mip)
+	{
+		next = &tiled->levels[l + 1];
+		Mip_PushRow(level->mip, row);
+		while(Mip_PullRow(level->mip, next->band.data + next->band.height * next->band.width * bpp))
+			Tiled_AddRow(tiled, l + 1);
+	}
+	if (!level->tail && (level->band.height == level->bandRows || level->bandY + level->band.height == level->map->height))
+		Tiled_CompressBand(tiled, level);
+}
+
+// returns false if tool failed on any band
+static bool Tiled_Compress(TexEncodeTask *task, bool sRGB)
+{
+	TiledData tiled;
+	TiledLevel *level;
+	ImageMap *maps, *map;
+	TexBlock *block;
+	byte *stream, *src;
+	int l, y, pitch, bpp;
+	bool tail;
+
+	maps = task->image->maps;
+	block = task->format->block;
+	bpp = task->image->bpp;
+	memset(&tiled, 0, sizeof(tiled));
+	tiled.task = task;
+	tiled.any_conversions = MapsConversions(task, sRGB, &tiled.conversions);
+	for (map = maps; map; map = map->next)
+		tiled.numLevels++;
+	tiled.levels = (TiledLevel *)mem_alloc(sizeof(TiledLevel) * tiled.numLevels);
+	memset(tiled.levels, 0, sizeof(TiledLevel) * tiled.numLevels);
+
+	// layout levels, stripes are used while level size is a whole number of block rows
+	stream = task->stream;
+	tail = false;
+	for (map = maps, l = 0; map; map = map->next, l++)
+	{
+		level = &tiled.levels[l];
+		if (map->width % block->width || map->height % block->height || map->height <= TILED_BAND_ROWS)
+			tail = true;
+		level->map = map;
+		level->band = *map;
+		level->band.height = 0;
+		level->band.next = NULL;
+		level->bandRows = tail ? map->height : TILED_BAND_ROWS;
+		level->band.data = (byte *)mem_alloc(map->width * level->bandRows * bpp);
+		level->rowSize = (map->width / block->width) * block->bitlength / 8;
+		level->stream = stream;
+		level->tail = tail;
+		if (!tail)
+			stream += level->rowSize * (map->height / block->height);
+		if (map->next)
+			level->mip = Mip_BeginStream(map->width, map->height, map->next->width, map->next->height, bpp, tex_mipFilter, task->image->sRGB);
+	}
+
+	// feed base level rows
+	src = fiGetData(task->image->bitmap, &pitch);
+	level = &tiled.levels[0];
+	for (y = 0; y < task->image->height; y++, src += pitch)
+	{
+		memcpy(level->band.data + level->band.height * level->band.width * bpp, src, level->band.width * bpp);
+		Tiled_AddRow(&tiled, 0);
+	}
+
+	// compress small levels as one chain
+	for (l = 0; l < tiled.numLevels && !tiled.levels[l].tail; l++);
+	if (l < tiled.numLevels)
+	{
+		for (y = l; y < tiled.numLevels; y++)
+		{
+			Tiled_PrepareBand(&tiled, &tiled.levels[y]);
+			if (y < tiled.numLevels - 1)
+				tiled.levels[y].band.next = &tiled.levels[y + 1].band;
 		}
+		task->image->maps = &tiled.levels[l].band;
+		task->stream = tiled.levels[l].stream;
+		if (!task->tool->fCompress(task))
+			tiled.failed = true;
 	}
+
+	// cleanup
+	for (l = 0; l < tiled.numLevels; l++)
+	{
+		mem_free(tiled.levels[l].band.data);
+		if (tiled.levels[l].mip)
+			Mip_EndStream(tiled.levels[l].mip);
+	}
+	mem_free(tiled.levels);
+	task->image->maps = maps;
+	return !tiled.failed;
+}
+
+/*
+==========================================================================================
+
+  Block rows splitting
+
+==========================================================================================
+*/
+
+// pixels per job, small enough so big textures give work to all threads
+#define BLOCKROWS_JOB_PIXELS 65536
+
+typedef struct
+{
+	TexBlockMap *map;
+	int          firstRow;
+	int          numRows;
+} BlockRowsJob;
+
+typedef struct
+{
+	TexEncodeTask *task;
+	BlockRowsJob  *jobs;
+	void          *parms;
+	void         (*compressRows)(TexEncodeTask *task, TexBlockMap *map, int firstRow, int numRows, void *parms);
+} BlockRowsData;
+
+static void BlockRows_Job(void *data, int job)
+{
+	BlockRowsData *rows = (BlockRowsData *)data;
+	BlockRowsJob *j = &rows->jobs[job];
+
+	rows->compressRows(rows->task, j->map, j->firstRow, j->numRows, rows->parms);
+}
+
+// compress maps by bands of block rows, bands are spread over idle threads
+// each band writes own part of stream so the output is same as when compressed serially
+void TexCompress_BlockRows(TexEncodeTask *task, TexBlockMap *maps, int nummaps, void *parms, void (*compressRows)(TexEncodeTask *task, TexBlockMap *map, int firstRow, int numRows, void *parms))
+{
+	BlockRowsData data;
+	int i, row, rows, numjobs;
+
+	// count jobs
+	numjobs = 0;
+	for (i = 0; i < nummaps; i++)
+	{
+		rows = max(1, BLOCKROWS_JOB_PIXELS / max(1, maps[i].map->width * 4));
+		numjobs += (maps[i].blockRows + rows - 1) / rows;
+	}
+	if (numjobs <= 0)
+		return;
+
+	// make jobs
+	data.task = task;
+	data.parms = parms;
+	data.compressRows = compressRows;
+	data.jobs = (BlockRowsJob *)mem_alloc(sizeof(BlockRowsJob) * numjobs);
+	numjobs = 0;
+	for (i = 0; i < nummaps; i++)
+	{
+		rows = max(1, BLOCKROWS_JOB_PIXELS / max(1, maps[i].map->width * 4));
+		for (row = 0; row < maps[i].blockRows; row += rows)
+		{
+			data.jobs[numjobs].map = &maps[i];
+			data.jobs[numjobs].firstRow = row;
+			data.jobs[numjobs].numRows = min(rows, maps[i].blockRows - row);
+			numjobs++;
+		}
+	}
+
+	// run
+	ParallelJobs(task->thread, numjobs, &data, BlockRows_Job);
+	mem_free(data.jobs);
 }
 
 /*
@@ -133,9 +588,10 @@ void GenerateMipMaps(TexEncodeTask *task, bool sRGB)
 ==========================================================================================
 */
 
-void Compress(TexEncodeTask *task)
+// returns false if tool failed, stream is allocated anyway
+bool Compress(TexEncodeTask *task)
 {
-	bool sRGB, powerOfTwo, squareSize;
+	bool sRGB, powerOfTwo, squareSize, tiled, compressed;
 
 	// force tool
 	if (task->codec->forceTool)
@@ -184,9 +640,8 @@ void Compress(TexEncodeTask *task)
 		sRGB = (task->image->sRGB  || tex_sRGB_forceconvert || FS_FileMatchList(task->file, task->image, tex_sRGBcolorspace));
 		if (tex_sRGB_autoconvert && !sRGB && (task->image->sRGB == false))
 		{
-			int pitch;
-			byte *data = Image_GetData(task->image, NULL, &pitch);
-			sRGB = ImageData_ProbeLinearToSRGB_16bit(data, task->image->width, task->image->height, pitch, task->image->bpp, task->image->colorSwap);
+			ImageStats *stats = Image_GetStats(task->image);
+			sRGB = (stats->darkPixels > stats->brightPixels) ? true : false;
 		}
 	}
 	Verbose("Compressing %s as %s:%s (%s%s/%s)\n", task->file->fullpath.c_str(), task->tool->name, task->format->name, (sRGB == true) ? "sRGB_" : "", task->format->block->name, OptionEnumName(tex_profile, tex_profiles));
@@ -205,13 +660,17 @@ void Compress(TexEncodeTask *task)
 	powerOfTwo = (tex_allowNPOT && !(task->format->features & FF_POT)) ? false : true;
 	squareSize = (task->format->features & FF_SQUARE) ? true : false;
 	if (FS_FileMatchList(task->file, task->image, tex_scale4xFiles) || tex_forceScale4x)
-		Image_ScaleBy4(task->image, tex_firstScaler, tex_secondScaler, powerOfTwo);
+		Image_ScaleBy4(task->image, tex_firstScaler, tex_secondScaler, powerOfTwo, task->thread);
 	else if (FS_FileMatchList(task->file, task->image, tex_scale2xFiles) || tex_forceScale2x)
-		Image_ScaleBy2(task->image, tex_firstScaler, powerOfTwo);
+		Image_ScaleBy2(task->image, tex_firstScaler, powerOfTwo, task->thread);
 	Image_MakeDimensions(task->image, powerOfTwo, squareSize);
 
-	// generate mipmaps
-	GenerateMipMaps(task, sRGB);
+	// generate mipmaps, very big images are processed by stripes
+	tiled = Tiled_Accept(task);
+	if (tiled)
+		Tiled_CreateMaps(task, sRGB);
+	else
+		GenerateMipMaps(task, sRGB);
 
 	// allocate memory for destination file
 	size_t headersize;
@@ -223,44 +682,464 @@ void Compress(TexEncodeTask *task)
 	mem_free(header);
 
 	// compress
-	task->tool->fCompress(task);
+	if (tiled)
+	{
+		compressed = Tiled_Compress(task, sRGB);
+		TexCompress_GetThreadStats(task->thread)->num_tiled_textures++;
+	}
+	else
+		compressed = task->tool->fCompress(task);
 	task->stream = stream;
+	return compressed;
 }
 
-void TexCompress_WorkerThread(ThreadData *thread)
+/*
+==========================================================================================
+
+  Work ordering
+
+==========================================================================================
+*/
+
+// get image dimensions from file header, result is kept in file
+bool TexCompress_ProbeFile(FS_File *file, HZIP zip = NULL)
+{
+	if (!file->probed)
+	{
+		file->probed = true;
+		if (!Image_Probe(file, &file->width, &file->height, zip))
+			file->width = file->height = 0;
+	}
+	return (file->width > 0 && file->height > 0) ? true : false;
+}
+
+// scale factor which will be applied to file
+int TexCompress_FileScale(FS_File *file)
+{
+	if (FS_FileMatchList(file, tex_scale4xFiles) || tex_forceScale4x)
+		return 4;
+	if (FS_FileMatchList(file, tex_scale2xFiles) || tex_forceScale2x)
+		return 2;
+	return 1;
+}
+
+// estimate how long file will take to process, only relative values matters
+// codecs and profile are same for all files, so cost is pixels to encode
+double TexCompress_EstimateCost(FS_File *file)
+{
+	double pixels;
+	int scale;
+
+	// unknown dimensions are guessed for a well-compressed source (8 bytes of RGBA per file byte, as in TexCompress_EstimateMemory)
+	if (TexCompress_ProbeFile(file))
+		pixels = (double)file->width * (double)file->height;
+	else
+		pixels = (double)file->filesize * 2;
+	scale = TexCompress_FileScale(file);
+	pixels *= scale * scale;
+	if (!tex_noMipmaps && !FS_FileMatchList(file, tex_noMipFiles))
+		pixels = pixels * 4 / 3;
+	return pixels;
+}
+
+// estimate peak memory needed to process a file
+size_t TexCompress_EstimateMemory(FS_File *file)
+{
+	double source, scaled, mem;
+	int scale;
+
+	// decoded image, unknown dimensions are guessed for a well-compressed source
+	if (TexCompress_ProbeFile(file))
+		source = (double)file->width * (double)file->height * 4;
+	else
+		source = (double)file->filesize * 8;
+	scale = TexCompress_FileScale(file);
+	scaled = source * scale * scale;
+
+	// file data and decoded image
+	mem = (double)file->filesize + source;
+	// scaler intermediates (super2x works at twice the target size)
+	if (scale > 1)
+		mem += scaled * 4;
+	// mip chain, tool buffers and output stream
+	// tiled compression keeps only bands of levels, so output stream is what remains (assuming block-based tool)
+	if (tex_tiledMegapixels && scaled / 4 >= tex_tiledMegapixels * 1000000.0)
+		mem += scaled * 4 / 3;
+	else
+		mem += scaled * 4 / 3 * 3;
+	return (size_t)min(mem, (double)((size_t)-1 / 2));
+}
+
+static bool TexCompress_CostGreater(const FS_File &a, const FS_File &b)
+{
+	return a.cost > b.cost;
+}
+
+// file headers are probed by all threads, work is a run of files from the same source
+// so entries of an archive are probed with one open of it
+static void TexCompress_ProbeThread(ThreadData *thread)
+{
+	vector<size_t> *runs;
+	FS_File *file, *end;
+	HZIP zip;
+	int work;
+
+	runs = (vector<size_t> *)thread->data;
+	while((work = GetWorkForThread(thread)) != -1)
+	{
+		file = &textures[(*runs)[work]];
+		end = &textures[0] + (*runs)[work + 1];
+		zip = file->zipfile.empty() ? NULL : OpenZip(file->zipfile.c_str(), "");
+		for (; file < end; file++)
+			TexCompress_ProbeFile(file, zip);
+		if (zip)
+			CloseZip(zip);
+	}
+}
+
+// longest-processing-time first, so big textures don't finish last alone
+void TexCompress_SortByCost(void)
+{
+	vector<size_t> runs;
+	double start;
+	size_t i;
+
+	if (textures.size() < 2)
+		return;
+	start = I_DoubleTime();
+	for (i = 0; i < textures.size(); i++)
+		if (!i || textures[i].zipfile.empty() || textures[i].zipfile != textures[i - 1].zipfile)
+			runs.push_back(i);
+	runs.push_back(textures.size());
+	ParallelThreads(max(1, numthreads), (int)runs.size() - 1, &runs, TexCompress_ProbeThread);
+	for (vector<FS_File>::iterator file = textures.begin(); file < textures.end(); file++)
+		file->cost = TexCompress_EstimateCost(&(*file));
+	stable_sort(textures.begin(), textures.end(), TexCompress_CostGreater);
+	Verbose("Sorted %i files by estimated cost in %.2f seconds\n", textures.size(), I_DoubleTime() - start);
+}
+
+/*
+==========================================================================================
+
+  Statistics
+
+==========================================================================================
+*/
+
+void TexCompress_InitThreadStats(TexCompressData *SharedData, int numthreads)
+{
+	size_t size;
+
+	size = sizeof(TexThreadStats) + sizeof(TexCodecStats) * max(0, tex_numCodecs - 1);
+	SharedData->thread_stats_stride = (size + THREAD_CACHE_LINE - 1) / THREAD_CACHE_LINE * THREAD_CACHE_LINE;
+	SharedData->thread_stats_num = numthreads;
+	SharedData->thread_stats = mem_alloc(SharedData->thread_stats_stride * numthreads + THREAD_CACHE_LINE);
+	memset(SharedData->thread_stats, 0, SharedData->thread_stats_stride * numthreads + THREAD_CACHE_LINE);
+}
+
+static TexThreadStats *TexCompress_ThreadStats(TexCompressData *SharedData, int num)
+{
+	size_t base;
+
+	base = ((size_t)SharedData->thread_stats + THREAD_CACHE_LINE - 1) / THREAD_CACHE_LINE * THREAD_CACHE_LINE;
+	return (TexThreadStats *)(base + SharedData->thread_stats_stride * num);
+}
+
+// stats of conversion thread, NULL if thread is not one
+TexThreadStats *TexCompress_GetThreadStats(ThreadData *thread)
+{
+	TexCompressData *SharedData;
+
+	if (!thread || !thread->data || thread->pool->work_func != TexCompress_WorkerThread)
+		return NULL;
+	SharedData = (TexCompressData *)thread->data;
+	if (thread->num >= SharedData->thread_stats_num)
+		return NULL;
+	return TexCompress_ThreadStats(SharedData, thread->num);
+}
+
+// sum thread stats into codecs and shared data
+void TexCompress_MergeThreadStats(TexCompressData *SharedData)
+{
+	TexThreadStats *ts;
+	TexCodecStats *cs;
+	TexCodec *codec;
+	int i;
+
+	for (i = 0; i < SharedData->thread_stats_num; i++)
+	{
+		ts = TexCompress_ThreadStats(SharedData, i);
+		SharedData->num_exported_files += ts->num_exported_files;
+		SharedData->num_tiled_textures += ts->num_tiled_textures;
+		SharedData->size_original_files += ts->size_original_files;
+		if (ts->mipCompare.levels)
+		{
+			if (!SharedData->mipCompare.worstFile || ts->mipCompare.worstPSNR < SharedData->mipCompare.worstPSNR)
+			{
+				SharedData->mipCompare.worstPSNR = ts->mipCompare.worstPSNR;
+				SharedData->mipCompare.worstFile = ts->mipCompare.worstFile;
+			}
+			SharedData->mipCompare.levels += ts->mipCompare.levels;
+			SharedData->mipCompare.error += ts->mipCompare.error;
+			SharedData->mipCompare.samples += ts->mipCompare.samples;
+			SharedData->mipCompare.time += ts->mipCompare.time;
+		}
+		for (codec = tex_codecs; codec; codec = codec->next)
+		{
+			cs = &ts->codecs[codec->index];
+			codec->stat_inputDiskMB += cs->inputDiskMB;
+			codec->stat_inputRamMB += cs->inputRamMB;
+			codec->stat_inputPOTRamMB += cs->inputPOTRamMB;
+			codec->stat_outputDiskMB += cs->outputDiskMB;
+			codec->stat_outputRamMB += cs->outputRamMB;
+			codec->stat_numTextures += cs->numTextures;
+			codec->stat_numImages += cs->numImages;
+			codec->stat_encodeTime += cs->encodeTime;
+			codec->stat_pixels += cs->pixels;
+		}
+	}
+	mem_free(SharedData->thread_stats);
+	SharedData->thread_stats_num = 0;
+}
+
+void TexCompress_PrintMipCompare(TexCompressData *SharedData)
+{
+	TexMipCompare *c = &SharedData->mipCompare;
+	double psnr;
+
+	if (!c->levels)
+		return;
+	psnr = (c->error > 0) ? 10.0 * log10(255.0 * 255.0 * c->samples / c->error) : 99.0;
+	Print("Mip comparison (%s %s vs direct lanczos):\n", (tex_mipGenerator == MIPGEN_NATIVE) ? "native" : "cascade", OptionEnumName(tex_mipFilter, ImageScalers, "unknown"));
+	if (tex_mipGenerator == MIPGEN_NATIVE)
+		Print("         backend: %s\n", Mip_Backend());
+	Print("          levels: %i\n", c->levels);
+	Print(" generation time: %.2f seconds (%s)\n", c->time, OptionEnumName(tex_mipGenerator, tex_mipGenerators, "unknown"));
+	Print("            PSNR: %.2f db\n", psnr);
+	Print("      worst PSNR: %.2f db (%s%s)\n", c->worstPSNR, c->worstFile->path.c_str(), c->worstFile->name.c_str());
+}
+
+static void TexCompress_MergeStageStats(TexCompressData *SharedData, TexStageStats *stage, TexStageStats *stats)
+{
+	Thread_MutexLock(&SharedData->stats_mutex);
+	stage->items += stats->items;
+	stage->busy += stats->busy;
+	stage->starved += stats->starved;
+	stage->blocked += stats->blocked;
+	Thread_MutexUnlock(&SharedData->stats_mutex);
+}
+
+// read source file and look up its encoded files in output cache, decode it if they are not found
+static void TexCompress_LoadCached(TexCompressData *SharedData, TexLoadData *LoadData)
+{
+	char key[MAX_FPATH];
+	unsigned __int64 options;
+	byte outmode[2];
+	size_t filesize;
+	byte *filedata;
+	FS_File *file;
+
+	file = &textures[LoadData->work];
+	filedata = FS_LoadFile(file, &filesize);
+	if (!filedata)
+		return;
+
+	// output names depend on output kind, it is known once writer is started
+	outmode[0] = tex_generateArchive ? 1 : 0;
+	outmode[1] = tex_destPathUseCodecDir ? 1 : 0;
+	options = Hash_64(outmode, sizeof(outmode), SharedData->options);
+	FS_CacheKey(file, key, sizeof(key));
+	LoadData->cachekey = OutCache_Key(filedata, filesize, options, key);
+	LoadData->usecache = true;
+	LoadData->cached = OutCache_Find(LoadData->cachekey);
+	if (LoadData->cached)
+	{
+		mem_free(filedata);
+		return;
+	}
+	Image_LoadData(file, filedata, filesize, LoadData->image);
+}
+
+// wait until there is enough memory for a texture and load it
+static TexLoadData *TexCompress_LoadImage(TexCompressData *SharedData, int work, TexStageStats *stats)
+{
+	TexLoadData *LoadData;
+	double start, admitted;
+
+	LoadData = (TexLoadData *)mem_alloc(sizeof(TexLoadData));
+	memset(LoadData, 0, sizeof(TexLoadData));
+	LoadData->work = work;
+	LoadData->image = Image_Create();
+	LoadData->reserved = TexCompress_EstimateMemory(&textures[work]);
+
+	start = I_DoubleTime();
+	Mem_Reserve(LoadData->reserved);
+	admitted = I_DoubleTime();
+	if (OutCache_Active())
+		TexCompress_LoadCached(SharedData, LoadData);
+	else
+		Image_Load(&textures[work], LoadData->image);
+	stats->blocked += admitted - start;
+	stats->busy += I_DoubleTime() - admitted;
+	stats->items++;
+	return LoadData;
+}
+
+// reads and decodes upcoming textures, so encoders dont have to wait for disk
+static void TexCompress_LoaderThread(ThreadData *thread)
+{
+	TexCompressData *SharedData;
+	TexLoadData *LoadData;
+	TexStageStats stats;
+	double start;
+	int work;
+
+	SharedData = (TexCompressData *)thread->data;
+	memset(&stats, 0, sizeof(stats));
+	while(1)
+	{
+		work = GetWorkForThread(thread);
+		if (work == -1)
+			break;
+		LoadData = TexCompress_LoadImage(SharedData, work, &stats);
+
+		// wait until encoders take some of prefetched images
+		start = I_DoubleTime();
+		Thread_QueueWaitSpace(&SharedData->loadQueue);
+		stats.blocked += I_DoubleTime() - start;
+		Thread_QueuePush(&SharedData->loadQueue, &LoadData->node, 1);
+	}
+	TexCompress_MergeStageStats(SharedData, &SharedData->stageLoad, &stats);
+
+	// last loader tells encoders there will be no more images
+	if (Thread_AtomicAdd(&SharedData->loaders_finished, 1) + 1 == SharedData->num_loaders)
+		Thread_QueueClose(&SharedData->loadQueue);
+}
+
+// pass files found in output cache to writer, as if they were encoded
+static void TexCompress_WriteCached(TexCompressData *SharedData, TexThreadStats *ts, OutCacheEntry *entry, TexStageStats *stats)
+{
+	TexWriteData *WriteData;
+	OutCacheFileStats filestats;
+	TexCodecStats *cs;
+	const char *name;
+	double start;
+	int i;
+
+	for (i = 0; i < OutCache_NumFiles(entry); i++)
+	{
+		WriteData = (TexWriteData *)mem_alloc(sizeof(TexWriteData));
+		memset(WriteData, 0, sizeof(TexWriteData));
+		name = OutCache_GetFile(entry, i, &WriteData->data, &WriteData->datasize, &filestats);
+		strlcpy(WriteData->outfile, tex_generateArchive ? "" : tex_destPath, sizeof(WriteData->outfile));
+		strlcat(WriteData->outfile, name, sizeof(WriteData->outfile));
+		Thread_QueuePush(&SharedData->writeQueue, &WriteData->node, WriteData->datasize);
+
+		// if too much data is pending, wait til it is recorded
+		start = I_DoubleTime();
+		Thread_QueueWaitSpace(&SharedData->writeQueue);
+		stats->blocked += I_DoubleTime() - start;
+
+		// input and output stats, as encoder counted them (there is no encoding time)
+		if (filestats.codec >= 0 && filestats.codec < tex_numCodecs)
+		{
+			cs = &ts->codecs[filestats.codec];
+			cs->inputDiskMB += filestats.inputDiskMB;
+			cs->inputRamMB += filestats.inputRamMB;
+			cs->inputPOTRamMB += filestats.inputPOTRamMB;
+			cs->pixels += filestats.pixels;
+			cs->outputDiskMB += (float)filestats.disksize/1048576.0f;
+			cs->outputRamMB += (float)filestats.ramsize/1048576.0f;
+			cs->numTextures++;
+			cs->numImages += filestats.images;
+		}
+	}
+
+	// global stats, source is counted only if first codec took it
+	if (OutCache_NumExported(entry) >= 0)
+	{
+		Thread_AtomicAdd(&SharedData->num_original_files, 1);
+		ts->num_exported_files += OutCache_NumExported(entry);
+		ts->size_original_files += OutCache_OriginalMB(entry);
+	}
+}
+
+static void TexCompress_EncoderThread(ThreadData *thread)
 {
 	LoadedImage *image, *frame;
 	TexCompressData *SharedData;
+	TexLoadData *LoadData;
 	TexWriteData *WriteData;
 	TexEncodeTask task = { 0 };
+	TexStageStats stats, loadStats;
+	TexThreadStats *ts;
+	TexCodecStats *cs;
 	TexCodec *codec;
+	OutCacheEntry *store;
+	OutCacheFileStats filestats;
+	double start, blocked, encodestart, storeoriginal;
+	bool loadfailed, failed;
+	size_t prefixlen;
 	char *ext;
-	int work;
+	int work, storeexported;
 
 	SharedData = (TexCompressData *)thread->data;
-
-	image = Image_Create();
+	ts = TexCompress_ThreadStats(SharedData, thread->num);
+	memset(&stats, 0, sizeof(stats));
+	memset(&loadStats, 0, sizeof(loadStats));
 	while(1)
 	{
-		work = GetWorkForThread(thread);
-		if (work == -1)
-			break; 
+		// get next image, prefetched by loaders or loaded here if there are none
+		if (SharedData->num_loaders > 0)
+		{
+			start = I_DoubleTime();
+			LoadData = (TexLoadData *)Thread_QueuePopShared(&SharedData->loadQueue);
+			stats.starved += I_DoubleTime() - start;
+			if (!LoadData)
+				break;
+			Thread_QueueRelease(&SharedData->loadQueue, 1);
+		}
+		else
+		{
+			work = GetWorkForThread(thread);
+			if (work == -1)
+				break;
+			LoadData = TexCompress_LoadImage(SharedData, work, &loadStats);
+		}
+		image = LoadData->image;
+		start = I_DoubleTime();
+		blocked = stats.blocked;
 
 		memset(&task, 0, sizeof(task));
-		task.file = &textures[work];
+		task.file = &textures[LoadData->work];
 		task.container = tex_container;
 		task.image = image;
+		task.thread = thread;
 		if (!task.container)
 			Error("TexCompress_WorkerThread: no container specified\n");
-		
-		// cycle all active codecs
-		for (codec = tex_active_codecs; codec; codec = codec->nextActive)
+
+		// encoded files are taken from output cache, or collected to be stored there
+		// names are stored relative to output path
+		if (LoadData->cached)
+			TexCompress_WriteCached(SharedData, ts, LoadData->cached, &stats);
+		store = (LoadData->usecache && !LoadData->cached) ? OutCache_NewEntry(LoadData->cachekey) : NULL;
+		storeexported = -1;
+		storeoriginal = 0;
+		prefixlen = tex_generateArchive ? 0 : strlen(tex_destPath);
+
+		// cycle all active codecs, there is nothing to encode for cached files
+		loadfailed = false;
+		failed = false;
+		for (codec = LoadData->cached ? NULL : tex_active_codecs; codec; codec = codec->nextActive)
 		{
 			// load image
 			if (image->bitmap == NULL)
 				Image_Load(task.file, image);
 			if (image->bitmap == NULL)
+			{
+				loadfailed = true;
 				continue;
+			}
 
 			// check if codec accepts task
 			// discarded files get fallback codec
@@ -278,7 +1157,10 @@ void TexCompress_WorkerThread(ThreadData *thread)
 
 			// global stats
 			if (task.codec == tex_active_codecs)
-				SharedData->size_original_files += image->width*image->height*image->bpp / 1048576.0f;
+			{
+				storeoriginal = image->width*image->height*image->bpp / 1048576.0f;
+				ts->size_original_files += storeoriginal;
+			}
 
 			// detect special texture types
 			image->datatype = IMAGE_COLOR;
@@ -293,22 +1175,30 @@ void TexCompress_WorkerThread(ThreadData *thread)
 			for (frame = image; frame != NULL; frame = frame->next, framenum++)
 			{
 				//Print("Processing %s frame %i %ix%i %i bpp for codec %s\n", task.file->name.c_str(), framenum, frame->width, frame->height, frame->bpp, codec->name);
-				// input stats
-				task.codec->stat_inputDiskMB += (frame->width*frame->height*frame->bpp) / 1048576.0f;
+				// input stats, kept for output cache as well
+				cs = &ts->codecs[task.codec->index];
+				filestats.inputDiskMB = (frame->width*frame->height*frame->bpp) / 1048576.0f;
+				filestats.pixels = (double)frame->width * (double)frame->height;
+				filestats.inputRamMB = 0;
+				filestats.inputPOTRamMB = 0;
 				if (tex_noMipmaps || FS_FileMatchList(task.file, frame, tex_noMipFiles))
 				{
-					task.codec->stat_inputRamMB += (frame->width*frame->height*frame->bpp) / 1048576.0f;
-					task.codec->stat_inputPOTRamMB += (NextPowerOfTwo(frame->width)*NextPowerOfTwo(frame->height)*frame->bpp)/1048576.0f;
+					filestats.inputRamMB += (frame->width*frame->height*frame->bpp) / 1048576.0f;
+					filestats.inputPOTRamMB += (NextPowerOfTwo(frame->width)*NextPowerOfTwo(frame->height)*frame->bpp)/1048576.0f;
 				}
 				else
 				{
 					int w = frame->width;
 					int h = frame->height;
-					while (w > 1 && h > 1) { task.codec->stat_inputRamMB += (w*h*frame->bpp) / 1048576.0f; w /= 2; h /= 2; }
+					while (w > 1 && h > 1) { filestats.inputRamMB += (w*h*frame->bpp) / 1048576.0f; w /= 2; h /= 2; }
 					w = NextPowerOfTwo(frame->width);
 					h = NextPowerOfTwo(frame->height);
-					while (w > 1 && h > 1) { task.codec->stat_inputPOTRamMB += (w*h*frame->bpp) / 1048576.0f; w /= 2; h /= 2; }
+					while (w > 1 && h > 1) { filestats.inputPOTRamMB += (w*h*frame->bpp) / 1048576.0f; w /= 2; h /= 2; }
 				}
+				cs->inputDiskMB += filestats.inputDiskMB;
+				cs->inputRamMB += filestats.inputRamMB;
+				cs->inputPOTRamMB += filestats.inputPOTRamMB;
+				cs->pixels += filestats.pixels;
 
 				// compress
 				task.image = frame;
@@ -316,15 +1206,24 @@ void TexCompress_WorkerThread(ThreadData *thread)
 				task.streamLen = 0;
 				task.tool = NULL;
 				task.format = NULL;
-				Compress(&task);
+				encodestart = I_DoubleTime();
+				if (!Compress(&task))
+					failed = true; // tool warns by itself
+				cs->encodeTime += I_DoubleTime() - encodestart;
 
 				// output stats
-				task.codec->stat_outputDiskMB += (float)task.streamLen/1048576.0f;
-				task.codec->stat_outputRamMB += (float)(task.streamLen - task.container->headerSize)/1048576.0f;
-				task.codec->stat_numTextures++;
-				task.codec->stat_numImages++;
+				cs->outputDiskMB += (float)task.streamLen/1048576.0f;
+				cs->outputRamMB += (float)(task.streamLen - task.container->headerSize)/1048576.0f;
+				cs->numTextures++;
+				cs->numImages++;
 				for (ImageMap *map = frame->maps; map; map = map->next)
-					codec->stat_numImages++;
+					ts->codecs[codec->index].numImages++;
+				filestats.codec = task.codec->index;
+				filestats.disksize = (unsigned int)task.streamLen;
+				filestats.ramsize = (unsigned int)(task.streamLen - task.container->headerSize);
+				filestats.images = 1;
+				for (ImageMap *map = frame->maps; map; map = map->next)
+					filestats.images++;
 
 				// save for saving thread
 				WriteData = (TexWriteData *)mem_alloc(sizeof(TexWriteData));
@@ -359,19 +1258,14 @@ void TexCompress_WorkerThread(ThreadData *thread)
 				strcat(WriteData->outfile, ext);
 				WriteData->data = task.stream;
 				WriteData->datasize = task.streamLen;
-				WriteData->next = SharedData->writeData;
-				SharedData->writeData = WriteData;
+				if (store)
+					OutCache_AddFile(store, WriteData->outfile + prefixlen, WriteData->data, WriteData->datasize, &filestats);
+				Thread_QueuePush(&SharedData->writeQueue, &WriteData->node, WriteData->datasize);
 
-				// If WriteData is too big (more than 256mb), wait til it is recorded
-				while(1)
-				{
-					size_t pending_write_datasize = 0;
-					for (TexWriteData *w = SharedData->writeData; w; w = w->next)
-						pending_write_datasize += w->datasize;
-					if(pending_write_datasize < 1024*1024*256)
-						break;
-					Sleep(100);
-				}
+				// if too much data is pending, wait til it is recorded
+				double waitstart = I_DoubleTime();
+				Thread_QueueWaitSpace(&SharedData->writeQueue);
+				stats.blocked += I_DoubleTime() - waitstart;
 
 				// output stats
 				numexported++;
@@ -385,17 +1279,55 @@ void TexCompress_WorkerThread(ThreadData *thread)
 			// global stats
 			if (codec == tex_active_codecs)
 			{
-				SharedData->num_original_files++;
-				SharedData->num_exported_files += numexported;
+				Thread_AtomicAdd(&SharedData->num_original_files, 1);
+				ts->num_exported_files += numexported;
+				storeexported = (int)numexported;
 			}
 		}
 
+		// files that failed to load or compress are not stored in output cache
+		if (store)
+		{
+			if (loadfailed || failed)
+				OutCache_FreeEntry(store);
+			else
+				OutCache_Store(store, storeexported, storeoriginal);
+		}
+		if (LoadData->cached)
+			OutCache_FreeEntry(LoadData->cached);
+
 		// we are finished with this image
-		Image_Unload(image);
+		// files that failed to load or compress are not stored in files cache, so they are tried again next time
+		if (!loadfailed && !failed)
+			task.file->encoded = true;
+		Image_Delete(image);
+		Thread_TrimScratch(thread);
+		Mem_Release(LoadData->reserved);
+		mem_free(LoadData);
+		stats.busy += I_DoubleTime() - start - (stats.blocked - blocked);
+		stats.items++;
 	}
-	Image_Delete(image);
+	TexCompress_MergeStageStats(SharedData, &SharedData->stageEncode, &stats);
+	TexCompress_MergeStageStats(SharedData, &SharedData->stageLoad, &loadStats);
+
+	// last encoder tells writer there will be no more files
+	if (Thread_AtomicAdd(&SharedData->encoders_finished, 1) + 1 == SharedData->num_encoders)
+		Thread_QueueClose(&SharedData->writeQueue);
 }
 
+void TexCompress_WorkerThread(ThreadData *thread)
+{
+	TexCompressData *SharedData;
+
+	// first workers (central thread is 0) are loaders
+	SharedData = (TexCompressData *)thread->data;
+	if (thread->num <= SharedData->num_loaders)
+		TexCompress_LoaderThread(thread);
+	else
+		TexCompress_EncoderThread(thread);
+}
+
+
 void TexAddZipFile(TexCompressData *SharedData, HZIP outzip, char *outfile, byte *data, int datasize)
 {
 	SharedData->zip_len = ZipGetMemoryWritten(outzip);
@@ -418,9 +1350,10 @@ void TexCompress_MainThread(ThreadData *thread)
 {
 	HZIP outzip = NULL;
 	TexCompressData *SharedData;
-	TexWriteData *WriteData, *PrevData;
+	TexWriteData *WriteData;
 	void *zipdata;
 	unsigned long zipdatalen;
+	double start;
 
 	SharedData = (TexCompressData *)thread->data;
 
@@ -430,6 +1363,9 @@ void TexCompress_MainThread(ThreadData *thread)
 		tex_generateArchive = false;
 		Print("Generating to \"%s\"\n", tex_destPath);
 		AddSlash(tex_destPath);
+		// writer gets half of pending writes limit
+		SharedData->writeQueue.maxbytes /= 2;
+		Writer_Init(tex_writeThreads, tex_writeRing, SharedData->writeQueue.maxbytes);
 	}
 	else
 	{
@@ -473,7 +1409,7 @@ void TexCompress_MainThread(ThreadData *thread)
 		Print("Additional path \"%s\"\n", tex_addPath.c_str());
 	thread->pool->started = true;
 
-	// write files
+	// write files as they come, until workers are finished
 	while(1)
 	{
 		// print pacifier
@@ -485,55 +1421,36 @@ void TexCompress_MainThread(ThreadData *thread)
 			PercentPacifier("%i", p);
 		}
 
-		// check if files to write, thats because they havent been added it, or we are finished
-		if (!SharedData->writeData)
-		{
-			if (thread->pool->finished == true)
-				break;
-			// todo: do some help?
-			Sleep(1);
-		}
+		// wait for a file
+		start = I_DoubleTime();
+		WriteData = (TexWriteData *)Thread_QueuePop(&SharedData->writeQueue);
+		SharedData->stageWrite.starved += I_DoubleTime() - start;
+		if (!WriteData)
+			break;
+		start = I_DoubleTime();
+
+		// write
+		if (outzip)
+			TexAddZipFile(SharedData, outzip, WriteData->outfile, WriteData->data, WriteData->datasize);
 		else
 		{
-			// get a last file from chain
-			PrevData = NULL;
-			for (WriteData = SharedData->writeData; WriteData->next; WriteData = WriteData->next)
-				PrevData = WriteData;
-			if (!PrevData)
-			{
-				WriteData = SharedData->writeData;
-				SharedData->writeData = NULL;
-			}
-			else
-			{
-				WriteData = PrevData->next;
-				PrevData->next = NULL;
-			}
-
-			// write
-			if (outzip)
-				TexAddZipFile(SharedData, outzip, WriteData->outfile, WriteData->data, WriteData->datasize);
-			else
-			{
-				// write file
-				CreatePath(WriteData->outfile);
-				FILE *f = fopen(WriteData->outfile, "wb");
-				if (!f)
-					Warning("TexCompress(%s): cannot open file (%s) for writing", WriteData->outfile, strerror(errno));
-				else
-				{
-					if (!fwrite(WriteData->data, WriteData->datasize, 1, f))
-						Warning("TexCompress(%s): cannot write file (%s)", WriteData->outfile, strerror(errno));
-					fclose(f);
-				}
-			}
-
-			// free
-			mem_free(WriteData->data);
-			mem_free(WriteData);
+			// hand over to writer, it frees data
+			Writer_Write(WriteData->outfile, WriteData->data, WriteData->datasize);
+			WriteData->data = NULL;
 		}
+
+		// free
+		Thread_QueueRelease(&SharedData->writeQueue, WriteData->datasize);
+		mem_free(WriteData->data);
+		mem_free(WriteData);
+		SharedData->stageWrite.busy += I_DoubleTime() - start;
+		SharedData->stageWrite.items++;
 	}
 
+	// wait for writer
+	if (!outzip)
+		Writer_Shutdown(&SharedData->writerStats);
+
 	// close zip
 	if (outzip)
 	{
@@ -561,6 +1478,38 @@ void TexCompress_MainThread(ThreadData *thread)
 	}
 }
 
+static void TexCompress_PrintStage(const char *name, TexStageStats *stage, double timeelapsed)
+{
+	double total;
+
+	if (!stage->threads)
+	{
+		Print("%10s: done by encoders, %i items, %.1f s busy, %.1f s waiting for memory\n", name, stage->items, stage->busy, stage->blocked);
+		return;
+	}
+	total = max(timeelapsed * stage->threads, 0.001);
+	Print("%10s: %i threads, %i items, %.0f%% busy, %.0f%% starved, %.0f%% blocked\n", name, stage->threads, stage->items, stage->busy * 100 / total, stage->starved * 100 / total, stage->blocked * 100 / total);
+}
+
+void TexCompress_PrintStageStats(TexCompressData *SharedData, double timeelapsed)
+{
+	Print("Pipeline stages:\n");
+	TexCompress_PrintStage("load", &SharedData->stageLoad, timeelapsed);
+	if (SharedData->num_loaders)
+		Print("%10s: peak %i of %i images\n", "load queue", (int)SharedData->loadQueue.peakbytes, (int)SharedData->loadQueue.maxbytes);
+	TexCompress_PrintStage("encode", &SharedData->stageEncode, timeelapsed);
+	Print("%10s: peak %.1f of %.1f mb\n", "write queue", SharedData->writeQueue.peakbytes / 1048576.0, SharedData->writeQueue.maxbytes / 1048576.0);
+	TexCompress_PrintStage("write", &SharedData->stageWrite, timeelapsed);
+	Print("%10s: %.1f mb process peak\n", "memory", Mem_PeakUsage() / 1048576.0);
+	if (SharedData->writerStats.backend)
+	{
+		WriterStats *w = &SharedData->writerStats;
+		Print("%10s: %s (%i threads), %i files, %.1f mb, %.1f mb/s, %.0f files/s\n", "writer", w->backend, w->threads, (int)w->files, w->bytes / 1048576.0, (w->time > 0) ? w->bytes / 1048576.0 / w->time : 0.0, (w->time > 0) ? w->files / w->time : 0.0);
+		if (w->failed)
+			Print("%10s: %i files failed to write\n", "writer", (int)w->failed);
+	}
+}
+
 /*
 ==========================================================================================
 
@@ -569,6 +1518,42 @@ void TexCompress_MainThread(ThreadData *thread)
 ==========================================================================================
 */
 
+// options fingerprint helpers
+static unsigned __int64 OptionsHash_Data(unsigned __int64 hash, const void *data, size_t size)
+{
+	return Hash_64(data, size, hash);
+}
+
+static unsigned __int64 OptionsHash_Int(unsigned __int64 hash, int val)
+{
+	return OptionsHash_Data(hash, &val, sizeof(val));
+}
+
+static unsigned __int64 OptionsHash_String(unsigned __int64 hash, const char *str)
+{
+	if (!str)
+		str = "";
+	return OptionsHash_Data(hash, str, strlen(str) + 1);
+}
+
+static unsigned __int64 OptionsHash_List(unsigned __int64 hash, FCLIST &list)
+{
+	hash = OptionsHash_Int(hash, (int)list.size());
+	for (FCLIST::iterator i = list.begin(); i < list.end(); i++)
+	{
+		hash = OptionsHash_String(hash, i->parm.c_str());
+		hash = OptionsHash_String(hash, i->pattern.c_str());
+	}
+	return hash;
+}
+
+static unsigned __int64 OptionsHash_Line(unsigned __int64 hash, const char *group, const char *key, const char *val)
+{
+	hash = OptionsHash_String(hash, group);
+	hash = OptionsHash_String(hash, key);
+	return OptionsHash_String(hash, val);
+}
+
 // TEXCOMPRESS section options
 void TexCompress_Option(const char *section, const char *group, const char *key, const char *val, const char *filename, int linenum)
 {
@@ -604,6 +1589,38 @@ void TexCompress_Option(const char *section, const char *group, const char *key,
 			tex_firstScaler = tex_secondScaler = (ImageScaler)OptionEnum(val, ImageScalers, IMAGE_SCALER_SUPER2X);
 		else if (!stricmp(key, "scaler2"))
 			tex_secondScaler = (ImageScaler)OptionEnum(val, ImageScalers, IMAGE_SCALER_SUPER2X);
+		else if (!stricmp(key, "mipgenerator"))
+			tex_mipGenerator = (texmipgen)OptionEnum(val, tex_mipGenerators, MIPGEN_DIRECT, "mip generator");
+		else if (!stricmp(key, "mipfilter"))
+			tex_mipFilter = (ImageScaler)OptionEnum(val, ImageScalers, IMAGE_SCALER_LANCZOS, "mip filter");
+		else if (!stricmp(key, "mipreport"))
+			tex_mipReport = OptionBoolean(val);
+		else if (!stricmp(key, "nativesuper2x"))
+			tex_nativeSuper2x = OptionBoolean(val);
+		else if (!stricmp(key, "incremental"))
+			tex_incremental = OptionBoolean(val);
+		else if (!stricmp(key, "paranoid"))
+			tex_paranoid = OptionBoolean(val);
+		else if (!stricmp(key, "outputcache"))
+			tex_outputCache = val;
+		else if (!stricmp(key, "outputcachesize"))
+			tex_outputCacheSize = max(1, atoi(val));
+		else if (!stricmp(key, "tiledmegapixels"))
+			tex_tiledMegapixels = max(0, atoi(val));
+		else if (!stricmp(key, "sortbycost"))
+			tex_sortByCost = OptionBoolean(val);
+		else if (!stricmp(key, "memorybudget"))
+			tex_memoryBudget = max(0, atoi(val));
+		else if (!stricmp(key, "loadthreads"))
+			tex_loadThreads = max(0, atoi(val));
+		else if (!stricmp(key, "loadqueue"))
+			tex_loadQueue = max(0, atoi(val));
+		else if (!stricmp(key, "writequeue"))
+			tex_writeQueue = max(0, atoi(val));
+		else if (!stricmp(key, "writethreads"))
+			tex_writeThreads = max(1, atoi(val));
+		else if (!stricmp(key, "iouring"))
+			tex_writeRing = OptionBoolean(val);
 		else if (!stricmp(key, "sign"))
 			tex_useSign = OptionBoolean(val);
 		else if (!stricmp(key, "signword"))
@@ -628,6 +1645,7 @@ void TexCompress_Option(const char *section, const char *group, const char *key,
 // CODEC: section options
 void TexCompress_CodecOption(TexCodec *codec, const char *group, const char *key, const char *val, const char *filename, int linenum)
 {
+	codec->optionsHash = OptionsHash_Line(codec->optionsHash, group, key, val);
 	if (!stricmp(group, "options"))
 	{
 		if (!stricmp(key, "disabled"))
@@ -711,6 +1729,7 @@ void TexCompress_CodecOption(TexCodec *codec, const char *group, const char *key
 // TOOL: section options
 void TexCompress_ToolOption(TexTool *tool, const char *group, const char *key, const char *val, const char *filename, int linenum)
 {
+	tool->optionsHash = OptionsHash_Line(tool->optionsHash, group, key, val);
 	tool->fOption(group, key, val, filename, linenum);
 }
 
@@ -792,11 +1811,32 @@ void TexCompress_Load(void)
 		Print("First scaler: %s\n", OptionEnumName(tex_firstScaler, ImageScalers, "unknown"));
 		if (tex_forceScale4x && (tex_secondScaler != tex_firstScaler))
 			Print("Second scaler: %s\n", OptionEnumName(tex_secondScaler, ImageScalers, "unknown"));
+		if (tex_firstScaler == IMAGE_SCALER_SCALE2X || tex_firstScaler == IMAGE_SCALER_SUPER2X || (tex_forceScale4x && tex_secondScaler == IMAGE_SCALER_SCALE2X))
+			Print("Scale2x backend: %s\n", Scale2x_Backend());
+		if (tex_nativeSuper2x && (tex_firstScaler == IMAGE_SCALER_SUPER2X || (tex_forceScale4x && tex_secondScaler == IMAGE_SCALER_SUPER2X)))
+			Print("Super2x: native\n");
 	}
 	if (tex_allowNPOT)
 		Print("Allowed non-power-of-two texture dimensions\n");
+	if (tex_mipFilter > IMAGE_SCALER_LANCZOS)
+	{
+		Warning("%s scaler cannot be used for mipmaps, using lanczos", OptionEnumName(tex_mipFilter, ImageScalers, "unknown"));
+		tex_mipFilter = IMAGE_SCALER_LANCZOS;
+	}
 	if (tex_noMipmaps)
 		Print("Not generating mipmaps\n");
+	else if (tex_mipGenerator == MIPGEN_NATIVE)
+		Print("Generating mipmaps: native (%s), %s filter\n", Mip_Backend(), OptionEnumName(tex_mipFilter, ImageScalers, "unknown"));
+	else if (tex_mipGenerator != MIPGEN_DIRECT || tex_mipFilter != IMAGE_SCALER_LANCZOS)
+		Print("Generating mipmaps: %s, %s filter\n", OptionEnumName(tex_mipGenerator, tex_mipGenerators, "unknown"), OptionEnumName(tex_mipFilter, ImageScalers, "unknown"));
+	if (tex_tiledMegapixels && (tex_noMipmaps || tex_mipGenerator == MIPGEN_NATIVE))
+		Print("Tiled compression of %i+ megapixel textures (native mipmaps, %s filter)\n", tex_tiledMegapixels, OptionEnumName(tex_mipFilter, ImageScalers, "unknown"));
+	else if (tex_tiledMegapixels)
+	{
+		// warned once here, Tiled_Accept silently skips textures with mipmaps
+		Print("Tiled compression of %i+ megapixel textures (only without mipmaps)\n", tex_tiledMegapixels);
+		Warning("%s mip generator needs whole image, textures with mipmaps are not tiled (use -mipgen native)", OptionEnumName(tex_mipGenerator, tex_mipGenerators, "unknown"));
+	}
 	if (tex_noAvgColor)
 		Print("Not generating texture average color info\n");
 	if (tex_useSuffix)
@@ -834,4 +1874,155 @@ void TexCompress_Load(void)
 			if ((*i)->fLoad)
 				(*i)->fLoad();
 	}
-}
\ No newline at end of file
+}
+
+/*
+==========================================================================================
+
+  Options fingerprint
+
+  Everything that may change generated files is hashed into one 64-bit value, it is
+  a part of output cache keys, and folded to 32 bits it is stored in files cache next
+  to source crc, so files get encoded again if options were changed.
+  Codec and tool options from option file are hashed by lines, tools also read
+  commandline by themselves, so whole commandline is hashed as well.
+
+==========================================================================================
+*/
+
+// commandline parms that do not change generated files, with number of values they take
+typedef struct
+{
+	const char *parm;
+	int         values;
+} TexRuntimeParm;
+
+static TexRuntimeParm tex_runtimeParms[] =
+{
+	{ "-o", 1 },
+	{ "-cd", 1 },
+	{ "-opt", 1 },
+	{ "-threads", 1 },
+	{ "-membudget", 1 },
+	{ "-loadthreads", 1 },
+	{ "-loadqueue", 1 },
+	{ "-writequeue", 1 },
+	{ "-writethreads", 1 },
+	{ "-zipmem", 1 },
+	{ "-zipcompression", 1 },
+	{ "-zipadd", 2 },
+	{ "-nosort", 0 },
+	{ "-nouring", 0 },
+	{ "-rebuild", 0 },
+	{ "-paranoid", 0 },
+	{ "-cache", 1 },
+	{ "-cachesize", 1 },
+	{ "-nc", 0 },
+	{ "-w", 0 },
+	{ "-", 0 },
+	{ "-mem", 0 },
+	{ "-v", 0 },
+	{ "-c", 0 },
+	{ "-f", 0 },
+	{ "-errlog", 0 },
+	{ NULL, 0 }
+};
+
+static unsigned __int64 OptionsHash_Codec(unsigned __int64 hash, TexCodec *codec)
+{
+	hash = OptionsHash_String(hash, codec->name);
+	hash = OptionsHash_Int(hash, codec->disabled);
+	hash = OptionsHash_String(hash, codec->fallback ? codec->fallback->name : NULL);
+	hash = OptionsHash_String(hash, codec->forceTool ? codec->forceTool->name : NULL);
+	hash = OptionsHash_String(hash, codec->forceFormat ? codec->forceFormat->name : NULL);
+	hash = OptionsHash_String(hash, codec->destDir);
+	hash = OptionsHash_List(hash, codec->discardList);
+	hash = OptionsHash_Data(hash, &codec->optionsHash, sizeof(codec->optionsHash));
+	for (vector<TexTool*>::iterator i = codec->tools.begin(); i < codec->tools.end(); i++)
+	{
+		hash = OptionsHash_String(hash, (*i)->name);
+		hash = OptionsHash_String(hash, (*i)->fGetVersion ? (*i)->fGetVersion() : NULL);
+		hash = OptionsHash_String(hash, (*i)->suffix);
+		hash = OptionsHash_List(hash, (*i)->forceFileList);
+		hash = OptionsHash_Data(hash, &(*i)->optionsHash, sizeof((*i)->optionsHash));
+	}
+	for (vector<TexFormat*>::iterator i = codec->formats.begin(); i < codec->formats.end(); i++)
+	{
+		hash = OptionsHash_String(hash, (*i)->name);
+		hash = OptionsHash_String(hash, (*i)->suffix);
+		hash = OptionsHash_List(hash, (*i)->forceFileList);
+	}
+	return hash;
+}
+
+// fingerprint of effective options, should be called after TexCompress_Load
+unsigned __int64 TexCompress_OptionsHash(int argc, char **argv)
+{
+	unsigned __int64 hash;
+	int i, j;
+
+	// global options, new ones that change encoded files go here (see options in tex.cpp)
+	hash = OptionsHash_String(0, RWGTEX_VERSION_MAJOR "." RWGTEX_VERSION_MINOR);
+	hash = OptionsHash_String(hash, tex_container->name);
+	hash = OptionsHash_Int(hash, tex_profile);
+	hash = OptionsHash_Int(hash, tex_destPathUseCodecDir);
+	hash = OptionsHash_String(hash, tex_addPath.c_str());
+	hash = OptionsHash_Int(hash, tex_allowNPOT);
+	hash = OptionsHash_Int(hash, tex_noMipmaps);
+	hash = OptionsHash_Int(hash, tex_noAvgColor);
+	hash = OptionsHash_Int(hash, tex_forceScale2x);
+	hash = OptionsHash_Int(hash, tex_forceScale4x);
+	hash = OptionsHash_Int(hash, tex_sRGB_allow);
+	hash = OptionsHash_Int(hash, tex_sRGB_autoconvert);
+	hash = OptionsHash_Int(hash, tex_sRGB_forceconvert);
+	hash = OptionsHash_Int(hash, tex_useSign);
+	hash = OptionsHash_String(hash, tex_sign);
+	hash = OptionsHash_Int(hash, tex_signVersion);
+	hash = OptionsHash_Int(hash, tex_forceBestPSNR);
+	hash = OptionsHash_Int(hash, tex_detectBinaryAlpha);
+	hash = OptionsHash_Int(hash, tex_binaryAlphaMin);
+	hash = OptionsHash_Int(hash, tex_binaryAlphaMax);
+	hash = OptionsHash_Int(hash, tex_binaryAlphaCenter);
+	hash = OptionsHash_Data(hash, &tex_binaryAlphaThreshold, sizeof(tex_binaryAlphaThreshold));
+	hash = OptionsHash_Int(hash, tex_firstScaler);
+	hash = OptionsHash_Int(hash, tex_secondScaler);
+	hash = OptionsHash_Int(hash, tex_mipGenerator);
+	hash = OptionsHash_Int(hash, tex_mipFilter);
+	hash = OptionsHash_Int(hash, tex_nativeSuper2x);
+	hash = OptionsHash_Int(hash, tex_tiledMegapixels);
+	hash = OptionsHash_Int(hash, tex_mipReport); // disables tiled compression
+	hash = OptionsHash_Int(hash, tex_useSuffix);
+	hash = OptionsHash_Int(hash, tex_testCompresion);
+	hash = OptionsHash_Int(hash, tex_testCompresionError);
+	hash = OptionsHash_Int(hash, tex_testCompresionAllErrors);
+	hash = OptionsHash_Int(hash, tex_errorMetric);
+	hash = OptionsHash_List(hash, tex_noMipFiles);
+	hash = OptionsHash_List(hash, tex_normalMapFiles);
+	hash = OptionsHash_List(hash, tex_grayScaleFiles);
+	hash = OptionsHash_List(hash, tex_sRGBcolorspace);
+	hash = OptionsHash_List(hash, tex_scale2xFiles);
+	hash = OptionsHash_List(hash, tex_scale4xFiles);
+
+	// codecs with their tools and formats
+	for (TexCodec *codec = tex_active_codecs; codec; codec = codec->nextActive)
+	{
+		hash = OptionsHash_Codec(hash, codec);
+		if (codec->fallback)
+			hash = OptionsHash_Codec(hash, codec->fallback);
+	}
+
+	// commandline, input path is first
+	for (i = 1; i < argc; i++)
+	{
+		for (j = 0; tex_runtimeParms[j].parm; j++)
+			if (!stricmp(argv[i], tex_runtimeParms[j].parm))
+				break;
+		if (tex_runtimeParms[j].parm)
+		{
+			i += tex_runtimeParms[j].values;
+			continue;
+		}
+		hash = OptionsHash_String(hash, argv[i]);
+	}
+	return hash;
+}
@@ -3,6 +3,7 @@
 #define H_TEX_COMPRESS_H
 
 #include "tex.h"
+#include "outcache.h"
 
 // a task that is shipped to codec
 // codec should fill it's own values (format type, colorSwizzle etc.)
@@ -20,39 +21,158 @@ typedef struct TexEncodeTask_s
 	// initialized right before shipping task to the tool
 	byte             *stream;
 	size_t            streamLen;
+	// worker thread which runs the task, tools may spread the work over idle threads
+	ThreadData       *thread;
 } TexEncodeTask;
 
+// map splitted by block rows, lets block-based tools compress bands of rows in parallel
+typedef struct TexBlockMap_s
+{
+	ImageMap         *map;
+	byte             *stream;    // where map data goes, same offset as with serial compression
+	int               blockRows; // number of 4-pixel block rows to compress
+	void             *data;      // tool-specific data
+} TexBlockMap;
+
+// map preprocessing before compression
+// per-pixel operations are fused into one loop specialized for (bpp, swap, swizzle), picked once per task
+typedef void (*TexPreprocessKernel)(byte *data, size_t pixels, const byte *colorTable, bool binaryAlpha, bool rgbSwap);
+
+typedef struct
+{
+	bool   BinaryAlpha;
+	bool   ConvertTosRGB;
+	bool   ConvertToLinear;
+	bool   SwapColors;
+	void (*ColorSwizzle)(byte *data, int width, int height, int pitch, int bpp, bool rgbSwap, bool sRGB, bool decode);
+	// set by PreprocessMap_SelectKernel, NULL kernel makes each operation a separate pass
+	TexPreprocessKernel Kernel;
+	const byte        *ColorTable;
+} MapProcessParms;
+
 // multithreaded write stuff
+// if this much written data is pending, workers wait for writer
+#define MAX_PENDING_WRITE (256 * 1024 * 1024)
+#define MIN_PENDING_WRITE (1024 * 1024)
+
+// image prefetched by loader threads
+typedef struct TexLoadData_s
+{
+	ThreadQueueNode node;     // should be first
+	int             work;     // index in textures[]
+	LoadedImage    *image;
+	size_t          reserved; // admitted memory, released when encoder is done with image
+	bool            usecache; // output cache key is known
+	unsigned __int64 cachekey;
+	OutCacheEntry  *cached;   // encoded files found in output cache, image is not loaded
+} TexLoadData;
+
 typedef struct TexWriteData_s
 {
+	ThreadQueueNode node; // should be first
 	char            outfile[MAX_FPATH];
 	byte           *data;
 	size_t          datasize;
-	TexWriteData_s *next;
 } TexWriteData;
 
+// pipeline stage stats, times are in seconds summed over stage threads
+typedef struct
+{
+	int           threads;
+	int           items;
+	double        busy;
+	double        starved;    // waiting for input
+	double        blocked;    // waiting for memory or output queue space
+} TexStageStats;
+
+// per-codec counters of one thread
 typedef struct
 {
-	// stats
-	size_t         num_exported_files;
-	size_t        num_original_files;
+	double        inputDiskMB;
+	double        inputRamMB;
+	double        inputPOTRamMB;
+	double        outputDiskMB;
+	double        outputRamMB;
+	size_t        numTextures;
+	size_t        numImages;
+	double        encodeTime; // seconds spent in Compress
+	double        pixels;     // source pixels encoded
+} TexCodecStats;
+
+// mip generators quality comparison (-mipreport)
+typedef struct
+{
+	int           levels;
+	double        error;      // sum of squared differences
+	double        samples;
+	double        worstPSNR;
+	FS_File      *worstFile;
+	double        time;       // seconds spent generating mips with selected generator
+} TexMipCompare;
+
+// counters of one thread, blocks are cache line aligned so threads update them without locking
+typedef struct
+{
+	size_t        num_exported_files;
+	size_t        num_tiled_textures;
 	double        size_original_files;
+	TexMipCompare mipCompare;
+	TexCodecStats codecs[1];  // tex_numCodecs entries
+} TexThreadStats;
+
+typedef struct
+{
+	// stats, summed from thread stats when conversion is finished
+	size_t        num_exported_files;
+	size_t        num_tiled_textures;
+	double        size_original_files;
+	volatile int  num_original_files; // advanced atomically, pacifier reads it
+	TexMipCompare mipCompare;
+	void         *thread_stats;
+	size_t        thread_stats_stride;
+	int           thread_stats_num;
 
 	// zip file in memory
 	void         *zip_data;
 	size_t        zip_len;
 	size_t        zip_maxlen;
 
-	// write chain
-	TexWriteData *writeData;
+	// pipeline: loaders -> loadQueue -> encoders -> writeQueue -> writer (central thread)
+	int           num_loaders;
+	int           num_encoders;
+	ThreadQueue   loadQueue;
+	ThreadQueue   writeQueue;
+	volatile int  loaders_finished;
+	volatile int  encoders_finished;
+
+	// pipeline stats
+	ThreadMutex   stats_mutex;
+	TexStageStats stageLoad;
+	TexStageStats stageEncode;
+	TexStageStats stageWrite;
+	WriterStats   writerStats; // directory output
+
+	// options fingerprint, part of output cache keys
+	unsigned __int64 options;
 } TexCompressData;
 
 // generic
+void  PreprocessMap_SelectKernel(MapProcessParms *parms, int bpp);
+void  PreprocessMap(ImageMap *map, MapProcessParms *parms, int bpp, bool rgbSwap);
+void  TexCompress_BlockRows(TexEncodeTask *task, TexBlockMap *maps, int nummaps, void *parms, void (*compressRows)(TexEncodeTask *task, TexBlockMap *map, int firstRow, int numRows, void *parms));
 void  TexCompress_WorkerThread(ThreadData *thread);
 void  TexCompress_MainThread(ThreadData *thread);
+void  TexCompress_PrintStageStats(TexCompressData *SharedData, double timeelapsed);
+void  TexCompress_InitThreadStats(TexCompressData *SharedData, int numthreads);
+void  TexCompress_MergeThreadStats(TexCompressData *SharedData);
+TexThreadStats *TexCompress_GetThreadStats(ThreadData *thread);
+void  TexCompress_PrintMipCompare(TexCompressData *SharedData);
 void  TexCompress_Option(const char *section, const char *group, const char *key, const char *val, const char *filename, int linenum);
 void  TexCompress_CodecOption(TexCodec *codec, const char *group, const char *key, const char *val, const char *filename, int linenum);
 void  TexCompress_ToolOption(TexTool *tool, const char *group, const char *key, const char *val, const char *filename, int linenum);
 void  TexCompress_Load(void);
+unsigned __int64 TexCompress_OptionsHash(int argc, char **argv);
+void  TexCompress_SortByCost(void);
+size_t TexCompress_EstimateMemory(FS_File *file);
 
 #endif
\ No newline at end of file
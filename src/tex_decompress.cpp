@@ -446,6 +446,7 @@ void Decompress(TexDecodeTask *task, bool exportFile, LoadedImage *original_imag
 byte *TexDecompress(char *filename, TexEncodeTask *encodetask, size_t *outdatasize)
 {
 	TexDecodeTask task = { 0 };
+	ImageStats *stats;
 
 	if (!encodetask->container)
 		return false;
@@ -455,10 +456,11 @@ byte *TexDecompress(char *filename, TexEncodeTask *encodetask, size_t *outdatasi
 	task.datasize = encodetask->streamLen;
 	task.ImageParms.sRGB = encodetask->image->maps->sRGB;
 	task.ImageParms.isNormalmap = (encodetask->image->datatype == IMAGE_NORMALMAP) ? true : false;
-	task.ImageParms.hasAverageColor = encodetask->image->hasAverageColor;
-	task.ImageParms.averagecolor[0] = encodetask->image->averagecolor[0]; 
-	task.ImageParms.averagecolor[1] = encodetask->image->averagecolor[1]; 
-	task.ImageParms.averagecolor[2] = encodetask->image->averagecolor[2]; 
+	stats = Image_GetStats(encodetask->image);
+	task.ImageParms.hasAverageColor = stats->valid;
+	task.ImageParms.averagecolor[0] = stats->averageColor[0]; 
+	task.ImageParms.averagecolor[1] = stats->averageColor[1]; 
+	task.ImageParms.averagecolor[2] = stats->averageColor[2]; 
 	task.ImageParms.colorSwap = encodetask->image->colorSwap;
 	task.ImageParms.hasAlpha = encodetask->image->hasAlpha;
 	Decompress(&task, false, encodetask->image);
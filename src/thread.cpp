@@ -11,20 +11,30 @@
 #include "main.h"
 #include "cmd.h"
 
+int	num_cpu_cores = -1;
+char num_cpu_limit[256] = "";
+
+static void Thread_FinishWork(ThreadData *thread)
+{
+	if (!thread->working)
+		return;
+	thread->working = false;
+	Thread_AtomicAdd(&thread->pool->work_pending, -1);
+}
+
 // get a new work for thread
 int	GetWorkForThread(ThreadData *thread)
 {
 	int	r;
 
-	WaitForSingleObject(thread->pool->work_mutex, INFINITE);
-	if (thread->pool->work_pending >= thread->pool->work_num)
-		r = -1;
-	else
-	{
-		r = thread->pool->work_pending;
-		thread->pool->work_pending++;
-	}
-	ReleaseMutex(thread->pool->work_mutex);
+	// thread asks for next work when previous one is finished
+	Thread_FinishWork(thread);
+
+	// workers that overshoot work_num just keep getting -1
+	r = Thread_AtomicAdd(&thread->pool->work_next, 1);
+	if (r >= thread->pool->work_num)
+		return -1;
+	thread->working = true;
 	return r;
 }
 
@@ -40,20 +50,878 @@ WIN32
 
 #include <windows.h>
 
-int	num_cpu_cores = -1;
+#ifndef STACK_SIZE_PARAM_IS_A_RESERVATION
+#define STACK_SIZE_PARAM_IS_A_RESERVATION 0x00010000
+#endif
+#define THREAD_ALL_PROCESSOR_GROUPS 0xffff
+
+// machines with more than 64 processors split them into groups (Windows 7 and later)
+// functions are looked up at runtime, older systems and SDKs dont have them
+typedef struct
+{
+	ULONG_PTR Mask;
+	WORD      Group;
+	WORD      Reserved[3];
+}ThreadGroupAffinity;
+typedef WORD  (WINAPI *GetActiveProcessorGroupCountFunc)(void);
+typedef DWORD (WINAPI *GetActiveProcessorCountFunc)(WORD group);
+typedef BOOL  (WINAPI *SetThreadGroupAffinityFunc)(HANDLE thread, const ThreadGroupAffinity *affinity, ThreadGroupAffinity *previous);
+
+// GetLogicalProcessorInformationEx(RelationGroup) result, union of relations is flattened to group one
+#define THREAD_RELATION_GROUP 4
+typedef struct
+{
+	BYTE      MaximumProcessorCount;
+	BYTE      ActiveProcessorCount;
+	BYTE      Reserved[38];
+	ULONG_PTR ActiveProcessorMask;
+}ThreadProcessorGroupInfo;
+typedef struct
+{
+	DWORD     Relationship;
+	DWORD     Size;
+	WORD      MaximumGroupCount;
+	WORD      ActiveGroupCount;
+	BYTE      Reserved[20];
+	ThreadProcessorGroupInfo GroupInfo[1];
+}ThreadGroupRelationship;
+typedef BOOL  (WINAPI *GetLogicalProcessorInformationExFunc)(int relationship, void *buffer, DWORD *length);
+
+static SetThreadGroupAffinityFunc pSetThreadGroupAffinity = NULL;
+static int                        thread_numGroups = 1;
+static DWORD                      thread_groupCores[64];
+static ULONG_PTR                  thread_groupMask[64];
+
+// active processors of each group, they are not always the low bits of mask
+static void Thread_InitGroupMasks(HMODULE kernel)
+{
+	GetLogicalProcessorInformationExFunc pGetLogicalProcessorInformationEx;
+	ThreadGroupRelationship *relation;
+	DWORD length;
+	int i;
+
+	for (i = 0; i < thread_numGroups; i++)
+	{
+		if (thread_groupCores[i] >= sizeof(ULONG_PTR) * 8)
+			thread_groupMask[i] = (ULONG_PTR)-1;
+		else
+			thread_groupMask[i] = ((ULONG_PTR)1 << thread_groupCores[i]) - 1;
+	}
+	pGetLogicalProcessorInformationEx = (GetLogicalProcessorInformationExFunc)GetProcAddress(kernel, "GetLogicalProcessorInformationEx");
+	if (!pGetLogicalProcessorInformationEx)
+		return;
+	length = 0;
+	if (pGetLogicalProcessorInformationEx(THREAD_RELATION_GROUP, NULL, &length) || GetLastError() != ERROR_INSUFFICIENT_BUFFER || length < sizeof(ThreadGroupRelationship))
+		return;
+	relation = (ThreadGroupRelationship *)mem_alloc(length);
+	if (pGetLogicalProcessorInformationEx(THREAD_RELATION_GROUP, relation, &length) && relation->Relationship == THREAD_RELATION_GROUP)
+	{
+		for (i = 0; i < thread_numGroups && i < relation->ActiveGroupCount; i++)
+			if (relation->GroupInfo[i].ActiveProcessorMask)
+				thread_groupMask[i] = relation->GroupInfo[i].ActiveProcessorMask;
+	}
+	mem_free(relation);
+}
 
 void Thread_Init(void)
 {
+	GetActiveProcessorGroupCountFunc pGetActiveProcessorGroupCount;
+	GetActiveProcessorCountFunc pGetActiveProcessorCount;
 	SYSTEM_INFO info;
+	HMODULE kernel;
+	int i;
+
+	DWORD_PTR processMask, systemMask;
+	int allowed;
 
 	GetSystemInfo(&info);
 	num_cpu_cores = info.dwNumberOfProcessors;
-	if (num_cpu_cores < 1 || num_cpu_cores > 32)
+	num_cpu_limit[0] = 0;
+
+	// count processors of all groups
+	kernel = GetModuleHandleA("kernel32.dll");
+	pGetActiveProcessorGroupCount = (GetActiveProcessorGroupCountFunc)GetProcAddress(kernel, "GetActiveProcessorGroupCount");
+	pGetActiveProcessorCount = (GetActiveProcessorCountFunc)GetProcAddress(kernel, "GetActiveProcessorCount");
+	pSetThreadGroupAffinity = (SetThreadGroupAffinityFunc)GetProcAddress(kernel, "SetThreadGroupAffinity");
+	if (pGetActiveProcessorGroupCount && pGetActiveProcessorCount && pSetThreadGroupAffinity)
+	{
+		thread_numGroups = min(max(1, (int)pGetActiveProcessorGroupCount()), 64);
+		if (thread_numGroups > 1)
+		{
+			for (i = 0; i < thread_numGroups; i++)
+				thread_groupCores[i] = pGetActiveProcessorCount((WORD)i);
+			num_cpu_cores = (int)pGetActiveProcessorCount(THREAD_ALL_PROCESSOR_GROUPS);
+			Thread_InitGroupMasks(kernel);
+		}
+	}
+
+	// process may be pinned to a subset of processors (only meaningful within one group)
+	if (thread_numGroups < 2 && GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+	{
+		for (allowed = 0; processMask; processMask &= processMask - 1)
+			allowed++;
+		if (allowed > 0 && allowed < num_cpu_cores)
+		{
+			sprintf(num_cpu_limit, "affinity mask, %i of %i processors", allowed, num_cpu_cores);
+			num_cpu_cores = allowed;
+		}
+	}
+	if (num_cpu_cores < 1)
 		num_cpu_cores = 1;
 }
 
+// spread threads over processor groups by their size, otherwise they all stay in group of the process
+static void Thread_SetGroup(ThreadData *thread)
+{
+	ThreadGroupAffinity affinity;
+	int group, slot;
+
+	if (thread_numGroups < 2)
+		return;
+	slot = thread->num % max(1, num_cpu_cores);
+	for (group = 0; group < thread_numGroups - 1 && slot >= (int)thread_groupCores[group]; group++)
+		slot -= (int)thread_groupCores[group];
+	memset(&affinity, 0, sizeof(affinity));
+	affinity.Group = (WORD)group;
+	affinity.Mask = thread_groupMask[group];
+	pSetThreadGroupAffinity(thread->handle, &affinity, NULL);
+}
+
+void Thread_MutexInit(ThreadMutex *mutex)
+{
+	InitializeCriticalSection(mutex);
+}
+
+void Thread_MutexDestroy(ThreadMutex *mutex)
+{
+	DeleteCriticalSection(mutex);
+}
+
+void Thread_MutexLock(ThreadMutex *mutex)
+{
+	EnterCriticalSection(mutex);
+}
+
+void Thread_MutexUnlock(ThreadMutex *mutex)
+{
+	LeaveCriticalSection(mutex);
+}
+
+void Thread_SemaphoreInit(ThreadSemaphore *sem, int count)
+{
+	*sem = CreateSemaphore(NULL, count, 0x7FFFFFFF, NULL);
+	if (!*sem)
+		Error("Thread_SemaphoreInit: CreateSemaphore failed (error %i)\n", GetLastError());
+}
+
+void Thread_SemaphoreDestroy(ThreadSemaphore *sem)
+{
+	CloseHandle(*sem);
+}
+
+void Thread_SemaphoreWait(ThreadSemaphore *sem)
+{
+	WaitForSingleObject(*sem, INFINITE);
+}
+
+bool Thread_SemaphoreTryWait(ThreadSemaphore *sem)
+{
+	return (WaitForSingleObject(*sem, 0) == WAIT_OBJECT_0) ? true : false;
+}
+
+void Thread_SemaphorePost(ThreadSemaphore *sem, int count)
+{
+	if (count > 0)
+		ReleaseSemaphore(*sem, count, NULL);
+}
+
+void Thread_Yield(void)
+{
+	Sleep(0);
+}
+
+static DWORD WINAPI Thread_Entry(LPVOID param)
+{
+	ThreadData *thread = (ThreadData *)param;
+
+	thread->func(thread);
+	return 0;
+}
+
+void Thread_Start(ThreadData *thread)
+{
+	// stack is only reserved, pages are committed as thread uses them
+	thread->handle = CreateThread(NULL, THREAD_STACK_SIZE, Thread_Entry, (LPVOID)thread, CREATE_SUSPENDED | STACK_SIZE_PARAM_IS_A_RESERVATION, (LPDWORD)&thread->id);
+	if (!thread->handle)
+		Error("Thread_Start: CreateThread failed (error %i)\n", GetLastError());
+	Thread_SetGroup(thread);
+	ResumeThread(thread->handle);
+}
+
+void Thread_Wait(ThreadData *thread)
+{
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+}
+
+/*
+===================================================================
+
+POSIX
+
+===================================================================
+*/
+
+#else
+
+#include <sched.h>
+#include <errno.h>
+
+static int Thread_CountAffinityCores(void)
+{
+#if defined(__linux__) && defined(CPU_ALLOC)
+	cpu_set_t *set;
+	size_t setsize;
+	int cpus, count;
+
+	// set should be big enough for kernel's mask, grow it until it is
+	for (cpus = 1024; cpus <= 1024 * 1024; cpus *= 2)
+	{
+		set = CPU_ALLOC(cpus);
+		if (!set)
+			break;
+		setsize = CPU_ALLOC_SIZE(cpus);
+		CPU_ZERO_S(setsize, set);
+		if (sched_getaffinity(0, setsize, set) == 0)
+		{
+			count = CPU_COUNT_S(setsize, set);
+			CPU_FREE(set);
+			return count;
+		}
+		CPU_FREE(set);
+		if (errno != EINVAL)
+			break;
+	}
+#endif
+	return -1;
+}
+
+static bool Thread_ReadLine(const char *filename, char *line, int linesize)
+{
+	FILE *f;
+	bool read;
+
+	f = fopen(filename, "r");
+	if (!f)
+		return false;
+	read = fgets(line, linesize, f) ? true : false;
+	fclose(f);
+	return read;
+}
+
+// container CPU quota rounded up to whole cores, -1 if there is none
+static int Thread_CountQuotaCores(char *source)
+{
+	char cgroup[MAX_FPATH], path[MAX_FPATH + 64], line[MAX_FPATH], *c;
+	long long quota, period;
+	int cores, best;
+	FILE *f;
+
+	// cgroup v2, own group is listed as "0::/path" and every group up to root may have a quota
+	cgroup[0] = 0;
+	f = fopen("/proc/self/cgroup", "r");
+	if (f)
+	{
+		while(fgets(line, sizeof(line), f))
+		{
+			if (!strncmp(line, "0::", 3))
+			{
+				strlcpy(cgroup, line + 3, sizeof(cgroup));
+				cgroup[strcspn(cgroup, "\r\n")] = 0;
+				break;
+			}
+		}
+		fclose(f);
+	}
+	if (!strcmp(cgroup, "/"))
+		cgroup[0] = 0;
+	best = -1;
+	while(1)
+	{
+		// "max 100000" means no quota
+		sprintf(path, "/sys/fs/cgroup%s/cpu.max", cgroup);
+		if (Thread_ReadLine(path, line, sizeof(line)) && sscanf(line, "%lld %lld", &quota, &period) == 2 && quota > 0 && period > 0)
+		{
+			cores = (int)((quota + period - 1) / period);
+			if (best < 0 || cores < best)
+			{
+				best = cores;
+				sprintf(source, "cgroup v2 quota %.2f cpus", (double)quota / (double)period);
+			}
+		}
+		c = strrchr(cgroup, '/');
+		if (!c)
+			break;
+		*c = 0;
+	}
+	if (best > 0)
+		return best;
+
+	// cgroup v1, -1 means no quota
+	const char *v1dirs[] = { "/sys/fs/cgroup/cpu", "/sys/fs/cgroup/cpu,cpuacct", NULL };
+	for (int i = 0; v1dirs[i]; i++)
+	{
+		sprintf(path, "%s/cpu.cfs_quota_us", v1dirs[i]);
+		if (!Thread_ReadLine(path, line, sizeof(line)))
+			continue;
+		quota = atoll(line);
+		sprintf(path, "%s/cpu.cfs_period_us", v1dirs[i]);
+		if (!Thread_ReadLine(path, line, sizeof(line)))
+			continue;
+		period = atoll(line);
+		if (quota > 0 && period > 0)
+		{
+			sprintf(source, "cgroup v1 quota %.2f cpus", (double)quota / (double)period);
+			return (int)((quota + period - 1) / period);
+		}
+	}
+	return -1;
+}
+
+void Thread_Init(void)
+{
+	char source[256];
+	int online, affinity, quota;
+
+	num_cpu_limit[0] = 0;
+	online = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	num_cpu_cores = online;
+
+	// process may be pinned to a subset of cores
+	affinity = Thread_CountAffinityCores();
+	if (affinity > 0 && (num_cpu_cores < 1 || affinity < num_cpu_cores))
+	{
+		num_cpu_cores = affinity;
+		sprintf(num_cpu_limit, "affinity mask, %i of %i cpus", affinity, online);
+	}
+
+	// container may be allowed to use less cpu time than it can see
+	quota = Thread_CountQuotaCores(source);
+	if (quota > 0 && (num_cpu_cores < 1 || quota < num_cpu_cores))
+	{
+		num_cpu_cores = quota;
+		strlcpy(num_cpu_limit, source, sizeof(num_cpu_limit));
+	}
+	if (num_cpu_cores < 1)
+		num_cpu_cores = 1;
+}
+
+void Thread_MutexInit(ThreadMutex *mutex)
+{
+	pthread_mutex_init(mutex, NULL);
+}
+
+void Thread_MutexDestroy(ThreadMutex *mutex)
+{
+	pthread_mutex_destroy(mutex);
+}
+
+void Thread_MutexLock(ThreadMutex *mutex)
+{
+	pthread_mutex_lock(mutex);
+}
+
+void Thread_MutexUnlock(ThreadMutex *mutex)
+{
+	pthread_mutex_unlock(mutex);
+}
+
+void Thread_SemaphoreInit(ThreadSemaphore *sem, int count)
+{
+	pthread_mutex_init(&sem->mutex, NULL);
+	pthread_cond_init(&sem->cond, NULL);
+	sem->count = count;
+}
+
+void Thread_SemaphoreDestroy(ThreadSemaphore *sem)
+{
+	pthread_cond_destroy(&sem->cond);
+	pthread_mutex_destroy(&sem->mutex);
+}
+
+void Thread_SemaphoreWait(ThreadSemaphore *sem)
+{
+	pthread_mutex_lock(&sem->mutex);
+	while(sem->count <= 0)
+		pthread_cond_wait(&sem->cond, &sem->mutex);
+	sem->count--;
+	pthread_mutex_unlock(&sem->mutex);
+}
+
+bool Thread_SemaphoreTryWait(ThreadSemaphore *sem)
+{
+	bool taken = false;
+
+	pthread_mutex_lock(&sem->mutex);
+	if (sem->count > 0)
+	{
+		sem->count--;
+		taken = true;
+	}
+	pthread_mutex_unlock(&sem->mutex);
+	return taken;
+}
+
+void Thread_SemaphorePost(ThreadSemaphore *sem, int count)
+{
+	if (count <= 0)
+		return;
+	pthread_mutex_lock(&sem->mutex);
+	sem->count += count;
+	if (count > 1)
+		pthread_cond_broadcast(&sem->cond);
+	else
+		pthread_cond_signal(&sem->cond);
+	pthread_mutex_unlock(&sem->mutex);
+}
+
+void Thread_Yield(void)
+{
+	sched_yield();
+}
+
+static void *Thread_Entry(void *param)
+{
+	ThreadData *thread = (ThreadData *)param;
+
+	thread->func(thread);
+	return NULL;
+}
+
+void Thread_Start(ThreadData *thread)
+{
+	pthread_attr_t attr;
+	int err;
+
+	// stack is mapped, pages are committed as thread uses them
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, THREAD_STACK_SIZE);
+	err = pthread_create(&thread->handle, &attr, Thread_Entry, (void *)thread);
+	pthread_attr_destroy(&attr);
+	if (err)
+		Error("Thread_Start: pthread_create failed (%s)\n", strerror(err));
+	thread->id = thread->num;
+}
+
+void Thread_Wait(ThreadData *thread)
+{
+	pthread_join(thread->handle, NULL);
+}
+
+#endif
+
+/*
+===================================================================
+
+Generic
+
+===================================================================
+*/
+
+// buffers of code which runs without a pool
+static void  *thread_scratch[THREAD_SCRATCH_SLOTS];
+static size_t thread_scratch_size[THREAD_SCRATCH_SLOTS];
+
+void *Thread_Scratch(ThreadData *thread, int slot, size_t size)
+{
+	void **buffer;
+	size_t *buffersize;
+
+	if (slot < 0 || slot >= THREAD_SCRATCH_SLOTS)
+		Error("Thread_Scratch: bad slot %i", slot);
+	buffer = (thread) ? &thread->scratch[slot] : &thread_scratch[slot];
+	buffersize = (thread) ? &thread->scratch_size[slot] : &thread_scratch_size[slot];
+	if (*buffersize < size)
+	{
+		if (*buffer)
+			mem_free(*buffer);
+		*buffer = mem_alloc(size);
+		*buffersize = size;
+	}
+	return *buffer;
+}
+
+void Thread_TrimScratch(ThreadData *thread)
+{
+	bool visited[THREAD_SCRATCH_SLOTS];
+	void **buffer;
+	size_t *buffersize, kept;
+	bool pressure;
+	int i, largest;
+
+	buffer = (thread) ? thread->scratch : thread_scratch;
+	buffersize = (thread) ? thread->scratch_size : thread_scratch_size;
+	pressure = Mem_Pressure();
+	memset(visited, 0, sizeof(visited));
+	kept = 0;
+	// walk buffers from the largest, so the ones that are expensive to allocate again are kept
+	for (;;)
+	{
+		largest = -1;
+		for (i = 0; i < THREAD_SCRATCH_SLOTS; i++)
+			if (!visited[i] && buffer[i] && (largest < 0 || buffersize[i] > buffersize[largest]))
+				largest = i;
+		if (largest < 0)
+			break;
+		visited[largest] = true;
+		if (buffersize[largest] <= THREAD_SCRATCH_KEEP || (!pressure && kept + buffersize[largest] <= THREAD_SCRATCH_CAP))
+		{
+			kept += buffersize[largest];
+			continue;
+		}
+		mem_free(buffer[largest]);
+		buffer[largest] = NULL;
+		buffersize[largest] = 0;
+	}
+}
+
+void Thread_FreeScratch(ThreadData *thread)
+{
+	void **buffer;
+	size_t *buffersize;
+	int i;
+
+	buffer = (thread) ? thread->scratch : thread_scratch;
+	buffersize = (thread) ? thread->scratch_size : thread_scratch_size;
+	for (i = 0; i < THREAD_SCRATCH_SLOTS; i++)
+	{
+		if (buffer[i])
+			mem_free(buffer[i]);
+		buffer[i] = NULL;
+		buffersize[i] = 0;
+	}
+}
+
 void Thread_Shutdown(void)
 {
+	Thread_FreeScratch(NULL);
+}
+
+/*
+===================================================================
+
+Multiple producers / single consumer queue
+
+Intrusive queue by Dmitry Vyukov: producer swaps the head and then
+links previous node to the new one, consumer walks from the tail.
+Between these two steps a consumer may see the queue as empty for a
+moment, so it yields until the link appears.
+
+===================================================================
+*/
+
+void Thread_QueueInit(ThreadQueue *queue, size_t maxbytes)
+{
+	memset(queue, 0, sizeof(ThreadQueue));
+	queue->stub.next = NULL;
+	queue->head = &queue->stub;
+	queue->tail = &queue->stub;
+	queue->closed = false;
+	queue->bytes = 0;
+	queue->maxbytes = maxbytes;
+	queue->space_waiters = 0;
+	queue->peakbytes = 0;
+	Thread_SemaphoreInit(&queue->items, 0);
+	Thread_SemaphoreInit(&queue->space, 0);
+	Thread_MutexInit(&queue->space_mutex);
+	Thread_MutexInit(&queue->pop_mutex);
+}
+
+void Thread_QueueDestroy(ThreadQueue *queue)
+{
+	Thread_SemaphoreDestroy(&queue->items);
+	Thread_SemaphoreDestroy(&queue->space);
+	Thread_MutexDestroy(&queue->space_mutex);
+	Thread_MutexDestroy(&queue->pop_mutex);
+}
+
+static void Thread_QueueLink(ThreadQueue *queue, ThreadQueueNode *node)
+{
+	ThreadQueueNode *prev;
+
+	node->next = NULL;
+	prev = (ThreadQueueNode *)Thread_AtomicExchangePointer((void *volatile *)&queue->head, node);
+	prev->next = node;
+}
+
+void Thread_QueuePush(ThreadQueue *queue, ThreadQueueNode *node, size_t bytes)
+{
+	size_t pending;
+
+	pending = Thread_AtomicAddSize(&queue->bytes, (ptrdiff_t)bytes) + bytes;
+	// not exact when producers race, it's only used for stats
+	if (pending > queue->peakbytes)
+		queue->peakbytes = pending;
+	Thread_QueueLink(queue, node);
+	Thread_SemaphorePost(&queue->items, 1);
+}
+
+// block while there is too much bytes pending
+void Thread_QueueWaitSpace(ThreadQueue *queue)
+{
+	if (!queue->maxbytes)
+		return;
+	while(queue->bytes >= queue->maxbytes)
+	{
+		// register as waiter and recheck, so release can't slip between
+		Thread_MutexLock(&queue->space_mutex);
+		queue->space_waiters++;
+		if (queue->bytes < queue->maxbytes)
+		{
+			queue->space_waiters--;
+			Thread_MutexUnlock(&queue->space_mutex);
+			break;
+		}
+		Thread_MutexUnlock(&queue->space_mutex);
+		Thread_SemaphoreWait(&queue->space);
+	}
+}
+
+// take node counted by items semaphore, returns NULL if queue is closed and empty
+static ThreadQueueNode *Thread_QueueTake(ThreadQueue *queue)
+{
+	ThreadQueueNode *tail, *next;
+
+	while(1)
+	{
+		tail = queue->tail;
+		next = tail->next;
+		if (tail == &queue->stub)
+		{
+			if (next)
+			{
+				// skip stub
+				queue->tail = next;
+				tail = next;
+				next = next->next;
+			}
+			else if (queue->closed && queue->head == &queue->stub)
+			{
+				// pass wakeup to next consumer
+				Thread_SemaphorePost(&queue->items, 1);
+				return NULL;
+			}
+		}
+		if (tail != &queue->stub)
+		{
+			if (next)
+			{
+				queue->tail = next;
+				return tail;
+			}
+			if (tail == queue->head)
+			{
+				// last node, put stub behind it so it can be taken
+				Thread_QueueLink(queue, &queue->stub);
+				next = tail->next;
+				if (next)
+				{
+					queue->tail = next;
+					return tail;
+				}
+			}
+		}
+		// producer is in the middle of push
+		Thread_Yield();
+	}
+}
+
+// consumer: get next node, blocks until there is one, returns NULL if queue is closed and empty
+ThreadQueueNode *Thread_QueuePop(ThreadQueue *queue)
+{
+	Thread_SemaphoreWait(&queue->items);
+	return Thread_QueueTake(queue);
+}
+
+// consumer: get next node if there is one, closed is set if queue is closed and empty
+ThreadQueueNode *Thread_QueueTryPop(ThreadQueue *queue, bool *closed)
+{
+	ThreadQueueNode *node;
+
+	*closed = false;
+	if (!Thread_SemaphoreTryWait(&queue->items))
+		return NULL;
+	node = Thread_QueueTake(queue);
+	if (!node)
+		*closed = true;
+	return node;
+}
+
+// same as Thread_QueuePop, but for queues with several consumers
+ThreadQueueNode *Thread_QueuePopShared(ThreadQueue *queue)
+{
+	ThreadQueueNode *node;
+
+	Thread_MutexLock(&queue->pop_mutex);
+	node = Thread_QueuePop(queue);
+	Thread_MutexUnlock(&queue->pop_mutex);
+	return node;
+}
+
+// consumer: done with popped bytes, wake producers waiting for space
+void Thread_QueueRelease(ThreadQueue *queue, size_t bytes)
+{
+	Thread_AtomicAddSize(&queue->bytes, -(ptrdiff_t)bytes);
+	if (queue->space_waiters > 0)
+	{
+		Thread_MutexLock(&queue->space_mutex);
+		Thread_SemaphorePost(&queue->space, queue->space_waiters);
+		queue->space_waiters = 0;
+		Thread_MutexUnlock(&queue->space_mutex);
+	}
+}
+
+// called when all producers are finished, wakes consumer
+void Thread_QueueClose(ThreadQueue *queue)
+{
+	queue->closed = true;
+	Thread_SemaphorePost(&queue->items, 1);
+}
+
+/*
+===================================================================
+
+Sub-jobs
+
+A worker that got a big piece of work may split it into jobs with
+ParallelJobs. Workers that ran out of own work wait for such jobs
+instead of exiting, until all workers of the pool are finished.
+
+===================================================================
+*/
+
+typedef struct ThreadJobs_s
+{
+	int                  num;      // number of jobs
+	int                  next;     // next job to pick, guarded by pool jobs_mutex
+	volatile int         done;     // number of finished jobs
+	void                *data;
+	void               (*func)(void *data, int job);
+	ThreadSemaphore     *finished; // owner's semaphore, posted by whoever finishes the last job
+	struct ThreadJobs_s *next_jobs;
+}ThreadJobs;
+
+// pick a job from batch (or from any batch if NULL), pool jobs_mutex should be locked
+static ThreadJobs *Thread_PickJob(ThreadPool *pool, ThreadJobs *batch, int *job)
+{
+	ThreadJobs **link, *jobs;
+
+	for (link = (ThreadJobs **)&pool->jobs; *link; link = &(*link)->next_jobs)
+		if (batch == NULL || *link == batch)
+			break;
+	jobs = *link;
+	if (!jobs)
+		return NULL;
+	*job = jobs->next++;
+	// batch with no jobs left to pick is unlinked, but stays alive until it's jobs are done
+	if (jobs->next >= jobs->num)
+		*link = jobs->next_jobs;
+	return jobs;
+}
+
+static void Thread_RunJob(ThreadJobs *jobs, int job)
+{
+	ThreadSemaphore *finished;
+	int num;
+
+	jobs->func(jobs->data, job);
+	// batch may be released by it's owner as soon as last job is counted
+	finished = jobs->finished;
+	num = jobs->num;
+	if (Thread_AtomicAdd(&jobs->done, 1) + 1 == num)
+		Thread_SemaphorePost(finished, 1);
+}
+
+void ParallelJobs(ThreadData *thread, int num_jobs, void *data, void(*job_func)(void *data, int job))
+{
+	ThreadPool *pool;
+	ThreadJobs jobs, *picked;
+	int i, wake;
+
+	if (num_jobs <= 0)
+		return;
+
+	// nobody to share with
+	pool = (thread) ? thread->pool : NULL;
+	if (!pool || !pool->work_func || num_jobs == 1 || pool->threads_num < 2)
+	{
+		for (i = 0; i < num_jobs; i++)
+			job_func(data, i);
+		return;
+	}
+
+	// publish jobs and wake idle threads
+	memset(&jobs, 0, sizeof(jobs));
+	jobs.num = num_jobs;
+	jobs.data = data;
+	jobs.func = job_func;
+	jobs.finished = &thread->jobs_done;
+	Thread_MutexLock(&pool->jobs_mutex);
+	jobs.next_jobs = (ThreadJobs *)pool->jobs;
+	pool->jobs = &jobs;
+	wake = min(pool->jobs_idle, num_jobs - 1);
+	pool->jobs_idle -= wake;
+	Thread_SemaphorePost(&pool->jobs_signal, wake);
+
+	// run own jobs
+	while((picked = Thread_PickJob(pool, &jobs, &i)) != NULL)
+	{
+		Thread_MutexUnlock(&pool->jobs_mutex);
+		Thread_RunJob(picked, i);
+		Thread_MutexLock(&pool->jobs_mutex);
+	}
+	Thread_MutexUnlock(&pool->jobs_mutex);
+
+	// wait for jobs picked by other threads
+	Thread_SemaphoreWait(&thread->jobs_done);
+}
+
+// runs work function, then helps other workers with their jobs
+static void Thread_WorkerMain(ThreadData *thread)
+{
+	ThreadPool *pool = thread->pool;
+	ThreadJobs *picked;
+	int job;
+
+	pool->work_func(thread);
+	Thread_FinishWork(thread);
+
+	Thread_MutexLock(&pool->jobs_mutex);
+	pool->workers_active--;
+	if (pool->workers_active == 0)
+	{
+		// release idle threads
+		Thread_SemaphorePost(&pool->jobs_signal, pool->jobs_idle);
+		pool->jobs_idle = 0;
+	}
+	while(1)
+	{
+		picked = Thread_PickJob(pool, NULL, &job);
+		if (picked)
+		{
+			Thread_MutexUnlock(&pool->jobs_mutex);
+			Thread_RunJob(picked, job);
+			Thread_MutexLock(&pool->jobs_mutex);
+			continue;
+		}
+		if (pool->workers_active == 0)
+			break;
+		pool->jobs_idle++;
+		Thread_MutexUnlock(&pool->jobs_mutex);
+		Thread_SemaphoreWait(&pool->jobs_signal);
+		Thread_MutexLock(&pool->jobs_mutex);
+	}
+	Thread_MutexUnlock(&pool->jobs_mutex);
 }
 
 // run thread in parallel
@@ -76,12 +944,19 @@ double ParallelThreads(int num_threads, int work_count, void *common_data, void(
 
 	// create thread pool
 	pool.work_num = work_count;
-	pool.work_pending = 0;
-	pool.work_mutex = CreateMutex(NULL, FALSE, NULL);
-	pool.threads_num = max(1, min(num_threads, work_count)) + startThread;
+	pool.work_next = 0;
+	pool.work_pending = work_count;
+	// keep all threads even if there is less works, spare ones are used for sub-jobs
+	pool.threads_num = max(1, num_threads) + startThread;
 	pool.threads = mem_alloc(sizeof(ThreadData) * pool.threads_num);
 	memset(pool.threads, 0, sizeof(ThreadData) * pool.threads_num);
+	pool.work_func = thread_func;
 	pool.finished = false;
+	Thread_MutexInit(&pool.jobs_mutex);
+	Thread_SemaphoreInit(&pool.jobs_signal, 0);
+	pool.jobs = NULL;
+	pool.jobs_idle = 0;
+	pool.workers_active = pool.threads_num - startThread;
 
 	// start threads
 	threads = (ThreadData *)pool.threads;
@@ -89,47 +964,49 @@ double ParallelThreads(int num_threads, int work_count, void *common_data, void(
 	{
 		threads[i].num = i;
 		threads[i].pool = &pool;
+		threads[i].func = (i < startThread) ? central_thread : Thread_WorkerMain;
 		threads[i].data = common_data;
+		Thread_SemaphoreInit(&threads[i].jobs_done, 0);
 	}
 
 	// run works
 	if (central_thread)
 	{
 		// run central thread and wait until it will initialize things
-		threads[0].handle = CreateThread(NULL, THREAD_STACK_SIZE, (LPTHREAD_START_ROUTINE)central_thread, (LPVOID)&threads[0], 0, (LPDWORD)&threads[0].id);
+		Thread_Start(&threads[0]);
 		while(pool.started == false && pool.stop == false)
 			Sleep(10);
 		if (pool.stop == false)
 		{
 			// run works in paralel
 			for (i = startThread; i < pool.threads_num; i++)
-				threads[i].handle = CreateThread(NULL, THREAD_STACK_SIZE, (LPTHREAD_START_ROUTINE)thread_func, (LPVOID)&threads[i], 0, (LPDWORD)&threads[i].id);
+				Thread_Start(&threads[i]);
 			for (i = startThread; i < pool.threads_num; i++)
-				WaitForSingleObject(threads[i].handle, INFINITE);
+				Thread_Wait(&threads[i]);
 		}
 		// set finished mark so central thread will know that we are finished
 		pool.finished = true;
-		WaitForSingleObject(threads[0].handle, INFINITE);
+		Thread_Wait(&threads[0]);
 	}
 	else
 	{
 		// run works in paralel
 		for (i = startThread; i < pool.threads_num; i++)
-			threads[i].handle = CreateThread(NULL, THREAD_STACK_SIZE, (LPTHREAD_START_ROUTINE)thread_func, (LPVOID)&threads[i], 0, (LPDWORD)&threads[i].id);
+			Thread_Start(&threads[i]);
 		for (i = startThread; i < pool.threads_num; i++)
-			WaitForSingleObject(threads[i].handle, INFINITE);
+			Thread_Wait(&threads[i]);
 	}
 
 	// delete threads pool
-	CloseHandle(pool.work_mutex);
+	for (i = 0; i < pool.threads_num; i++)
+	{
+		Thread_SemaphoreDestroy(&threads[i].jobs_done);
+		Thread_FreeScratch(&threads[i]);
+	}
+	Thread_SemaphoreDestroy(&pool.jobs_signal);
+	Thread_MutexDestroy(&pool.jobs_mutex);
 	mem_free(pool.threads);
 
 	// return whole time
 	return I_DoubleTime() - start;
 }
-
-#else
-
-#error "Threads not implemented!"
-
-#endif
\ No newline at end of file
@@ -2,48 +2,218 @@
 #ifndef H_TEX_THREAD_H
 #define H_TEX_THREAD_H
 
+#include <stddef.h>
+
 #ifdef WIN32
 #include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
 #endif
 
-#define	MAX_THREADS 32
 #define THREAD_STACK_SIZE (4 * 1024 * 1024)
+#define THREAD_CACHE_LINE 64
+#define THREAD_SCRATCH_SLOTS 8
+#define THREAD_SCRATCH_KEEP (1024 * 1024) // bigger scratch buffers are freed by Thread_TrimScratch under memory pressure
+#define THREAD_SCRATCH_CAP (64 * 1024 * 1024) // scratch kept by one thread between work items
+
+extern int  num_cpu_cores;
+extern char num_cpu_limit[256]; // what made num_cpu_cores less than machine has, empty if nothing
+
+/*
+==========================================================================================
+
+  Platform primitives
+
+==========================================================================================
+*/
+
+#ifdef WIN32
+typedef HANDLE           ThreadHandle;
+typedef CRITICAL_SECTION ThreadMutex;
+typedef HANDLE           ThreadSemaphore;
+#else
+typedef pthread_t        ThreadHandle;
+typedef pthread_mutex_t  ThreadMutex;
+typedef struct
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t  cond;
+	int             count;
+}ThreadSemaphore;
+#define Sleep(msec) usleep((msec) * 1000)
+#endif
+
+void Thread_MutexInit(ThreadMutex *mutex);
+void Thread_MutexDestroy(ThreadMutex *mutex);
+void Thread_MutexLock(ThreadMutex *mutex);
+void Thread_MutexUnlock(ThreadMutex *mutex);
+
+void Thread_SemaphoreInit(ThreadSemaphore *sem, int count);
+void Thread_SemaphoreDestroy(ThreadSemaphore *sem);
+void Thread_SemaphoreWait(ThreadSemaphore *sem);
+bool Thread_SemaphoreTryWait(ThreadSemaphore *sem);
+void Thread_SemaphorePost(ThreadSemaphore *sem, int count);
+
+// atomically adds value to variable, returns previous value
+inline int Thread_AtomicAdd(volatile int *value, int add)
+{
+#ifdef WIN32
+	return (int)InterlockedExchangeAdd((volatile LONG *)value, (LONG)add);
+#else
+	return __sync_fetch_and_add(value, add);
+#endif
+}
+
+// atomically adds value to size counter, returns previous value
+inline size_t Thread_AtomicAddSize(volatile size_t *value, ptrdiff_t add)
+{
+#if defined(_WIN64)
+	return (size_t)InterlockedExchangeAdd64((volatile LONGLONG *)value, (LONGLONG)add);
+#elif defined(WIN32)
+	return (size_t)InterlockedExchangeAdd((volatile LONG *)value, (LONG)add);
+#else
+	return __sync_fetch_and_add(value, (size_t)add);
+#endif
+}
+
+// atomically swaps pointer, returns previous value
+inline void *Thread_AtomicExchangePointer(void *volatile *ptr, void *value)
+{
+#ifdef WIN32
+	return InterlockedExchangePointer(ptr, value);
+#else
+	__sync_synchronize();
+	return __sync_lock_test_and_set(ptr, value);
+#endif
+}
 
-extern int num_cpu_cores;
+// give up the rest of time slice
+void Thread_Yield(void);
 
-typedef struct 
+/*
+==========================================================================================
+
+  Multiple producers / single consumer queue
+
+  Lock-free for producers, consumer blocks until there is something to pop.
+  Queue counts bytes of pushed items, producers may wait until consumer
+  releases them to keep memory use bounded. Several consumers may share
+  a queue by using Thread_QueuePopShared.
+
+==========================================================================================
+*/
+
+typedef struct ThreadQueueNode_s
+{
+	struct ThreadQueueNode_s *volatile next;
+}ThreadQueueNode;
+
+typedef struct
 {
-	int    work_num;     // total work count
-	int    work_pending; // work counter
-	HANDLE work_mutex;   // mutex to access work
-	int    threads_num;  // number of threads in this pool
-	void  *threads;      // pointer to threads data 
+	ThreadQueueNode *volatile head;     // last pushed node, producers push here
+	ThreadQueueNode          *tail;     // consumer pops from here
+	ThreadQueueNode           stub;
+	ThreadSemaphore           items;    // one count per pushed node
+	volatile bool             closed;   // no more pushes will be made
+	ThreadMutex               pop_mutex; // serializes shared consumers
+
+	// memory limit
+	volatile size_t           bytes;    // bytes of pushed items not yet released
+	size_t                    maxbytes; // 0 is unlimited
+	ThreadMutex               space_mutex;
+	ThreadSemaphore           space;    // wakes producers waiting for space
+	volatile int              space_waiters;
+	size_t                    peakbytes; // most bytes pending at once, for stats
+}ThreadQueue;
+
+void             Thread_QueueInit(ThreadQueue *queue, size_t maxbytes);
+void             Thread_QueueDestroy(ThreadQueue *queue);
+void             Thread_QueuePush(ThreadQueue *queue, ThreadQueueNode *node, size_t bytes);
+void             Thread_QueueWaitSpace(ThreadQueue *queue);
+ThreadQueueNode *Thread_QueuePop(ThreadQueue *queue);
+ThreadQueueNode *Thread_QueueTryPop(ThreadQueue *queue, bool *closed);
+ThreadQueueNode *Thread_QueuePopShared(ThreadQueue *queue);
+void             Thread_QueueRelease(ThreadQueue *queue, size_t bytes);
+void             Thread_QueueClose(ThreadQueue *queue);
+
+/*
+==========================================================================================
+
+  Thread pool
+
+==========================================================================================
+*/
+
+typedef struct
+{
+	int           work_num;     // total work count
+	int           threads_num;  // number of threads in this pool
+	void         *threads;      // pointer to threads data
+	void        (*work_func)(struct ThreadData_s *thread); // worker function
+
+	// sub-jobs that workers share with idle threads, see ParallelJobs
+	ThreadMutex     jobs_mutex;     // guards everything below
+	ThreadSemaphore jobs_signal;    // wakes idle threads
+	void           *jobs;           // job batches that still have jobs to pick
+	int             jobs_idle;      // number of threads waiting on jobs_signal
+	int             workers_active; // worker threads that are still running their work function
 
 	// start & finish marks
-	bool   stop;         // stop all threads, this only can be set before started mark
-	bool   started;      // central thread is started
-	bool   finished;     // work threads are finished
+	volatile bool stop;         // stop all threads, this only can be set before started mark
+	volatile bool started;      // central thread is started
+	volatile bool finished;     // work threads are finished
+
+	// work counters are hit by all threads, keep them away from fields they only read
+	char          pad0[THREAD_CACHE_LINE];
+	volatile int  work_next;    // next work to hand out, advanced atomically
+	volatile int  work_pending; // works handed out or not yet, which are not finished
+	char          pad1[THREAD_CACHE_LINE];
 }ThreadPool;
 
-typedef struct
+typedef struct ThreadData_s
 {
-	int         id;		// thread system id
-	int         num;    // thread num (0 - number of threads)
-	HANDLE      handle; // thread handle
-	ThreadPool *pool;   // pointer to shared thread pool
+	int           id;		// thread system id
+	int           num;    // thread num (0 - number of threads)
+	ThreadHandle  handle; // thread handle
+	ThreadPool   *pool;   // pointer to shared thread pool
+	bool          working; // thread got a work from GetWorkForThread and did not finish it yet
+	void        (*func)(struct ThreadData_s *thread); // thread function
+	ThreadSemaphore jobs_done; // signalled when a batch of jobs issued by this thread is complete
 
 	// shared data
-	void       *data;   
+	void         *data;
+
+	// scratch buffers, see Thread_Scratch
+	void         *scratch[THREAD_SCRATCH_SLOTS];
+	size_t        scratch_size[THREAD_SCRATCH_SLOTS];
 } ThreadData;
 
 // get a new work for thread
 int	GetWorkForThread(ThreadData *thread);
 
+// run jobs on the calling worker thread and any idle workers of it's pool
+// returns when all jobs are finished, runs them serially if there is no pool to share with
+void ParallelJobs(ThreadData *thread, int num_jobs, void *data, void(*job_func)(void *data, int job));
+
 // run thread in parallel
 double ParallelThreads(int num_threads, int work_count, void *common_data, void(*thread_func)(ThreadData *thread), void(*central_thread)(ThreadData *thread) = NULL);
 
+// per-thread scratch buffer, grows to the largest size asked for a slot and is kept until the pool is deleted,
+// so the same work repeated on a thread does not hit the allocator. Contents are lost when buffer grows.
+// Code running without a pool (thread is NULL) gets buffers freed by Thread_Shutdown
+// Thread_TrimScratch is called when a work item is done, it keeps largest buffers up to THREAD_SCRATCH_CAP
+// so next item reuses them, and frees ones bigger than THREAD_SCRATCH_KEEP if threads wait for memory budget
+void *Thread_Scratch(ThreadData *thread, int slot, size_t size);
+void  Thread_TrimScratch(ThreadData *thread);
+void  Thread_FreeScratch(ThreadData *thread);
+
+// start a standalone thread running thread->func, and wait for it to exit
+void Thread_Start(ThreadData *thread);
+void Thread_Wait(ThreadData *thread);
+
 // init threading system
 void Thread_Init(void);
 void Thread_Shutdown(void);
 
-#endif
\ No newline at end of file
+#endif
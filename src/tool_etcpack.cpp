@@ -13,7 +13,7 @@
 TexTool TOOL_ETCPACK =
 {
 	"ETCPack", "Ericsson ETCPack", "etcpack",
-	TEXINPUT_RGB | TEXINPUT_RGBA,
+	TEXINPUT_RGB | TEXINPUT_RGBA | TEXINPUT_STRIPES,
 	&ETCPack_Init,
 	&ETCPack_Option,
 	&ETCPack_Load,
@@ -340,29 +340,42 @@ void ETCPack_CompressBlockETC2A1(byte **stream, byte *imagedata, byte *imagealph
 	ETCPack_WriteColorBlock(stream, block1, block2);
 }
 
-size_t ETCPack_CompressSingleImage(byte *stream, TexEncodeTask *t, int imagewidth, int imageheight, byte *imagedata, void (*compressBlockFunction)(byte **stream, byte *imagedata, byte *imagealpha, byte *decoded, int w, int h, int x, int y))
+// map prepared for compression
+typedef struct
 {
-	byte *data, *dec, *src, *src_alpha, *block_src, *block_src_alpha, *block_dec;
-	int resized, x, y, w, h;
-	size_t out = 0;
-	
-	resized = 0;
-	data = stream;
-	ETCPack_Prepare(imagedata, imagewidth, imageheight, t->image->bpp, &src, &src_alpha, &w, &h, &dec, &resized, (compressBlockFunction == ETCPack_CompressBlockETC2A1) ? true : false);
-	block_src = src;
-	block_src_alpha = src_alpha;
-	block_dec = dec;
-	for (y = 0; y < h / 4; y++)
-		for (x = 0; x < w / 4; x++)
-			compressBlockFunction(&data, block_src, block_src_alpha, block_dec, w, h, x*4, y*4);
-	ETCPack_Free(src, src_alpha, dec, resized);
-	return data - stream;
+	byte *src;
+	byte *src_alpha;
+	byte *dec;
+	int   w;
+	int   h;
+	int   resized;
+} etcpack_map_t;
+
+// compress band of block rows
+void ETCPack_CompressRows(TexEncodeTask *t, TexBlockMap *blockmap, int firstRow, int numRows, void *parms)
+{
+	void (*compressBlockFunction)(byte **stream, byte *imagedata, byte *imagealpha, byte *decoded, int w, int h, int x, int y);
+	etcpack_map_t *prepared = (etcpack_map_t *)blockmap->data;
+	size_t blocksize;
+	byte *data;
+	int x, y;
+
+	compressBlockFunction = *(void (**)(byte **, byte *, byte *, byte *, int, int, int, int))parms;
+	blocksize = (compressBlockFunction == ETCPack_CompressBlockETC2A) ? 16 : 8;
+	data = blockmap->stream + firstRow * (prepared->w / 4) * blocksize;
+	for (y = firstRow; y < firstRow + numRows; y++)
+		for (x = 0; x < prepared->w / 4; x++)
+			compressBlockFunction(&data, prepared->src, prepared->src_alpha, prepared->dec, prepared->w, prepared->h, x*4, y*4);
 }
 
 bool ETCPack_Compress(TexEncodeTask *t)
 {
 	void (*compressBlockFunction)(byte **stream, byte *imagedata, byte *imagealpha, byte *decoded, int w, int h, int x, int y);
-	size_t output_size;
+	TexBlockMap *blockmaps;
+	etcpack_map_t *prepared;
+	ImageMap *map;
+	size_t blocksize;
+	int nummaps, i;
 
 	// options
 	if (t->format->block == &B_ETC1)
@@ -378,14 +391,30 @@ bool ETCPack_Compress(TexEncodeTask *t)
 		Warning("ETCPack: %s%s.dds - unsupported compression %s/%s", t->file->path.c_str(), t->file->name.c_str(), t->format->name, t->format->block->name);
 		return 0;
 	}
-
-	// compress
+	blocksize = (compressBlockFunction == ETCPack_CompressBlockETC2A) ? 16 : 8;
+
+	// prepare maps
+	nummaps = 0;
+	for (map = t->image->maps; map; map = map->next)
+		nummaps++;
+	blockmaps = (TexBlockMap *)mem_alloc(sizeof(TexBlockMap) * nummaps);
+	prepared = (etcpack_map_t *)mem_alloc(sizeof(etcpack_map_t) * nummaps);
 	byte *stream = t->stream;
-	for (ImageMap *map = t->image->maps; map; map = map->next)
+	for (map = t->image->maps, i = 0; map; map = map->next, i++)
 	{
-		output_size = ETCPack_CompressSingleImage(stream, t, map->width, map->height, map->data, compressBlockFunction);
-		if (output_size)
-			stream += output_size;
+		ETCPack_Prepare(map->data, map->width, map->height, t->image->bpp, &prepared[i].src, &prepared[i].src_alpha, &prepared[i].w, &prepared[i].h, &prepared[i].dec, &prepared[i].resized, (compressBlockFunction == ETCPack_CompressBlockETC2A1) ? true : false);
+		blockmaps[i].map = map;
+		blockmaps[i].stream = stream;
+		blockmaps[i].blockRows = prepared[i].h / 4;
+		blockmaps[i].data = &prepared[i];
+		stream += (prepared[i].w / 4) * (prepared[i].h / 4) * blocksize;
 	}
+
+	// compress
+	TexCompress_BlockRows(t, blockmaps, nummaps, &compressBlockFunction, ETCPack_CompressRows);
+	for (i = 0; i < nummaps; i++)
+		ETCPack_Free(prepared[i].src, prepared[i].src_alpha, prepared[i].dec, prepared[i].resized);
+	mem_free(prepared);
+	mem_free(blockmaps);
 	return true;
-}
\ No newline at end of file
+}
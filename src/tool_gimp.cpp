@@ -12,7 +12,7 @@
 TexTool TOOL_GIMPDDS =
 {
 	"GimpDDS", "Gimp DDS Plugin", "gimp",
-	TEXINPUT_BGRA,
+	TEXINPUT_BGRA | TEXINPUT_STRIPES,
 	&GimpDDS_Init,
 	&GimpDDS_Option,
 	&GimpDDS_Load,
@@ -183,11 +183,29 @@ int GimpDDS_CompressSingleImage(byte *dst, byte *src, int w, int h, gimpdds_opti
 	return GimpGetCompressedSize(w, h, 0, 0, 1, options->compressionType);
 }
 
+// compress band of block rows
+void GimpDDS_CompressRows(TexEncodeTask *t, TexBlockMap *blockmap, int firstRow, int numRows, void *parms)
+{
+	gimpdds_options_t *options = (gimpdds_options_t *)parms;
+	ImageMap *map = blockmap->map;
+	int w, h, y;
+	size_t rowsize;
+
+	// block rows are independent, so band is compressed as image of it's own
+	y = firstRow * 4;
+	w = map->width;
+	h = min(numRows * 4, map->height - y);
+	rowsize = GimpGetCompressedSize(w, 4, 0, 0, 1, options->compressionType);
+	GimpDDS_CompressSingleImage(blockmap->stream + rowsize * firstRow, map->data + y * w * t->image->bpp, w, h, options);
+}
+
 bool GimpDDS_Compress(TexEncodeTask *t)
 {
 	gimpdds_options_t options;
+	TexBlockMap *blockmaps;
+	ImageMap *map;
 	byte *data;
-	size_t res;
+	int nummaps, i;
 
 	// get options
 	if (t->format->block == &B_DXT1)
@@ -211,21 +229,23 @@ bool GimpDDS_Compress(TexEncodeTask *t)
 	options.colorBlockMethod = gimpdds_colorBlockMethod;
 	options.dithering = gimpdds_dithering;
 
-	// compress
+	// layout maps
+	nummaps = 0;
+	for (map = t->image->maps; map; map = map->next)
+		nummaps++;
+	blockmaps = (TexBlockMap *)mem_alloc(sizeof(TexBlockMap) * nummaps);
 	data = t->stream;
-	for (ImageMap *map = t->image->maps; map; map = map->next)
+	for (map = t->image->maps, i = 0; map; map = map->next, i++)
 	{
-		res = GimpDDS_CompressSingleImage(data, map->data, map->width, map->height, &options);
-		if (res < 0)
-			break;
-		data += res;
+		blockmaps[i].map = map;
+		blockmaps[i].stream = data;
+		blockmaps[i].blockRows = (map->height + 3) / 4;
+		blockmaps[i].data = NULL;
+		data += GimpGetCompressedSize(map->width, map->height, 0, 0, 1, options.compressionType);
 	}
 
-	// end, advance stats
-	if (res < 0)
-	{
-		Warning("GimpDDS : %s%s.dds - compressor fail (error code %i)", t->file->path.c_str(), t->file->name.c_str(), res);
-		return false;
-	}
+	// compress
+	TexCompress_BlockRows(t, blockmaps, nummaps, &options, GimpDDS_CompressRows);
+	mem_free(blockmaps);
 	return true;
-}
\ No newline at end of file
+}
@@ -13,7 +13,7 @@
 TexTool TOOL_RGETC1 =
 {
 	"RgETC1", "Rg-Etc1 Packer", "rgetc1",
-	TEXINPUT_RGBA,
+	TEXINPUT_RGBA | TEXINPUT_STRIPES,
 	&RgEtc1_Init,
 	&RgEtc1_Option,
 	&RgEtc1_Load,
@@ -98,48 +98,68 @@ const char *RgEtc1_Version(void)
 ==========================================================================================
 */
 
-// compress texture
-size_t RgEtc1_CompressSingleImage(byte *stream, TexEncodeTask *t, int imagewidth, int imageheight, byte *imagedata, int pitch, rg_etc1::etc1_pack_params &options)
+// compress band of block rows
+void RgEtc1_CompressRows(TexEncodeTask *t, TexBlockMap *blockmap, int firstRow, int numRows, void *parms)
 {
+	rg_etc1::etc1_pack_params *options = (rg_etc1::etc1_pack_params *)parms;
+	ImageMap *map = blockmap->map;
 	unsigned int block[16];
+	int pitch = map->width * t->image->bpp;
 
-	rg_etc1::pack_etc1_block_init();
-	for (int y = 0; y < imageheight / 4; y++)
+	byte *stream = blockmap->stream + firstRow * (map->width / 4) * 8;
+	for (int y = firstRow; y < firstRow + numRows; y++)
 	{
-		for (int x = 0; x < imagewidth / 4; x++)
+		for (int x = 0; x < map->width / 4; x++)
 		{
 			// extract block 
-			CodecETC1_ExtractBlockRGBA(imagedata, x * 4, y * 4, imagewidth, imageheight, pitch, (unsigned char*)block);
+			CodecETC1_ExtractBlockRGBA(map->data, x * 4, y * 4, map->width, map->height, pitch, (unsigned char*)block);
 			// pack block
-			rg_etc1::pack_etc1_block(stream, block, options);
+			rg_etc1::pack_etc1_block(stream, block, *options);
 			stream += 8;
 		}
 	}
-	return imagewidth*imageheight/2;
 }
 
 bool RgEtc1_Compress(TexEncodeTask *t)
 {
-	size_t output_size;
 	rg_etc1::etc1_pack_params options;
-	int pitch;
+	TexBlockMap *blockmaps;
+	ImageMap *map;
+	byte *data, *end;
+	int nummaps, i;
 
 	// RgEtc1 requires 32-bit images to have all alpha  == 255
-	Image_SetAlpha(t->image, 255);
+	// set on maps, as they may be stripes of image in tiled mode
+	for (map = t->image->maps; map; map = map->next)
+		for (data = map->data, end = map->data + map->datasize; data < end; data += 4)
+			data[3] = 255;
+	// maps may share memory with image, so it must be reloaded for the next codec
+	t->image->swizzled = true;
+	t->image->stats.valid = false;
 
 	// set parameters
 	options.clear();
 	options.m_dithering = rgetc1_dithering;
 	options.m_quality = rgetc1_quality[tex_profile];
 
-	// compress
+	// layout maps
+	nummaps = 0;
+	for (map = t->image->maps; map; map = map->next)
+		nummaps++;
+	blockmaps = (TexBlockMap *)mem_alloc(sizeof(TexBlockMap) * nummaps);
 	byte *stream = t->stream;
-	byte *data = Image_GetData(t->image, NULL, &pitch);
-	for (ImageMap *map = t->image->maps; map; map = map->next)
+	for (map = t->image->maps, i = 0; map; map = map->next, i++)
 	{
-		output_size = RgEtc1_CompressSingleImage(stream, t, map->width, map->height, map->data, map->width*t->image->bpp, options);
-		if (output_size)
-			stream += output_size;
+		blockmaps[i].map = map;
+		blockmaps[i].stream = stream;
+		blockmaps[i].blockRows = map->height / 4;
+		blockmaps[i].data = NULL;
+		stream += map->width*map->height/2;
 	}
+
+	// compress
+	rg_etc1::pack_etc1_block_init();
+	TexCompress_BlockRows(t, blockmaps, nummaps, &options, RgEtc1_CompressRows);
+	mem_free(blockmaps);
 	return true;
-}
\ No newline at end of file
+}
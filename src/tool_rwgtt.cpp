@@ -12,7 +12,7 @@
 TexTool TOOL_RWGTP =
 {
 	"RWGTP", "RwgTex Packer", "rwgtp",
-	TEXINPUT_BGR | TEXINPUT_BGRA,
+	TEXINPUT_BGR | TEXINPUT_BGRA | TEXINPUT_STRIPES,
 	&ToolRWGTP_Init,
 	&ToolRWGTP_Option,
 	&ToolRWGTP_Load,
@@ -99,8 +99,17 @@ size_t PackBGRAData(TexEncodeTask *t, byte *stream, byte *data, int width, int h
 
 bool ToolRWGTP_Compress(TexEncodeTask *t)
 {
+	ImageMap *map, *last;
 	byte *stream = t->stream;
-	for (ImageMap *map = t->image->maps; map; map = map->next)
-		stream += PackBGRAData(t, stream, map->data, map->width, map->height);
+	int pixels;
+
+	// levels lying one after another in memory are packed as one run
+	for (map = t->image->maps; map; map = last->next)
+	{
+		pixels = map->width * map->height;
+		for (last = map; last->next && last->data + last->datasize == last->next->data; last = last->next)
+			pixels += last->next->width * last->next->height;
+		stream += PackBGRAData(t, stream, map->data, pixels, 1);
+	}
 	return true;
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <string.h>
 #include <tchar.h>
 #include "unzip.h"
+#include "hash.h"
 
 // THIS FILE is almost entirely based upon code by Jean-loup Gailly
 // and Mark Adler. It has been modified by Lucian Wischik.
@@ -2189,17 +2190,10 @@ const uLong * get_crc_table()
 { return (const uLong *)crc_table;
 }
 
-#define CRC_DO1(buf) crc = crc_table[((int)crc ^ (*buf++)) & 0xff] ^ (crc >> 8);
-#define CRC_DO2(buf)  CRC_DO1(buf); CRC_DO1(buf);
-#define CRC_DO4(buf)  CRC_DO2(buf); CRC_DO2(buf);
-#define CRC_DO8(buf)  CRC_DO4(buf); CRC_DO4(buf);
 
 uLong ucrc32(uLong crc, const Byte *buf, uInt len)
 { if (buf == Z_NULL) return 0L;
-  crc = crc ^ 0xffffffffL;
-  while (len >= 8)  {CRC_DO8(buf); len -= 8;}
-  if (len) do {CRC_DO1(buf);} while (--len);
-  return crc ^ 0xffffffffL;
+  return Hash_CRC32((unsigned int)crc, buf, len); // slicing-by-8 or PCLMULQDQ
 }
 
 
@@ -0,0 +1,517 @@
+////////////////////////////////////////////////////////////////
+//
+// RwgTex / asynchronous file writer
+// (c) Pavel [VorteX] Timofeyev
+// See LICENSE text file for a license agreement
+//
+////////////////////////////////
+
+#include "main.h"
+#include "writer.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register)
+#include <linux/io_uring.h>
+#ifdef IO_URING_OP_SUPPORTED // headers know openat and close operations and opcode probe (5.6)
+#define WRITER_RING
+#endif
+#endif
+#endif
+
+typedef struct WriterFile_s
+{
+	ThreadQueueNode node; // should be first
+	char            filename[MAX_FPATH];
+	byte           *data;
+	size_t          datasize;
+#ifdef WRITER_RING
+	int             state; // operation in flight
+	int             fd;
+	size_t          written;
+	bool            failed;
+	struct iovec    iov;
+#endif
+}WriterFile;
+
+ThreadQueue  writer_queue;
+ThreadData  *writer_threads;
+int          writer_numthreads;
+ThreadMutex  writer_stats_mutex;
+WriterStats  writer_stats;
+double       writer_firstWrite;
+double       writer_lastDone;
+
+// file is written (or failed), free it and let producer continue
+static void Writer_Done(WriterFile *file, bool written)
+{
+	Thread_MutexLock(&writer_stats_mutex);
+	if (written)
+	{
+		writer_stats.files++;
+		writer_stats.bytes += (double)file->datasize;
+	}
+	else
+		writer_stats.failed++;
+	writer_lastDone = I_DoubleTime();
+	Thread_MutexUnlock(&writer_stats_mutex);
+
+	Thread_QueueRelease(&writer_queue, file->datasize);
+	mem_free(file->data);
+	mem_free(file);
+}
+
+/*
+==========================================================================================
+
+  Thread pool backend
+
+  Each thread writes one file at a time with blocking calls.
+
+==========================================================================================
+*/
+
+static bool Writer_WriteFile(WriterFile *file)
+{
+	FILE *f;
+	bool written;
+
+	CreatePath(file->filename);
+	f = fopen(file->filename, "wb");
+	if (!f)
+	{
+		Warning("Writer(%s): cannot open file (%s) for writing", file->filename, strerror(errno));
+		return false;
+	}
+	written = true;
+	if (file->datasize && !fwrite(file->data, file->datasize, 1, f))
+	{
+		Warning("Writer(%s): cannot write file (%s)", file->filename, strerror(errno));
+		written = false;
+	}
+	fclose(f);
+	return written;
+}
+
+static void Writer_PoolThread(ThreadData *thread)
+{
+	WriterFile *file;
+
+	while((file = (WriterFile *)Thread_QueuePopShared(&writer_queue)) != NULL)
+		Writer_Done(file, Writer_WriteFile(file));
+}
+
+/*
+==========================================================================================
+
+  io_uring backend
+
+  Single thread keeps up to WRITER_RING_ENTRIES files in flight, each file
+  goes through open, write and close operations submitted to the ring, so
+  the thread never blocks on filesystem except to create directories
+  (which is done once per directory). Operations are submitted and reaped
+  in batches with one syscall. Kernel older than 5.6 has no open and close
+  operations, the thread pool is used then.
+
+==========================================================================================
+*/
+
+#ifdef WRITER_RING
+
+#define WRITER_RING_ENTRIES   64
+#define WRITER_RING_DIRCACHE  64
+
+enum
+{
+	WRITER_RING_OPEN,
+	WRITER_RING_WRITE,
+	WRITER_RING_CLOSE
+};
+
+typedef struct
+{
+	int                  fd;
+	unsigned             entries;
+	unsigned             queued;   // prepared but not yet submitted
+	unsigned             inflight; // submitted but not yet completed
+	unsigned            *sq_head;
+	unsigned            *sq_tail;
+	unsigned            *sq_mask;
+	unsigned            *sq_array;
+	unsigned            *cq_head;
+	unsigned            *cq_tail;
+	unsigned            *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void                *sq_ptr;
+	void                *cq_ptr;
+	size_t               sq_size;
+	size_t               cq_size;
+	size_t               sqes_size;
+}WriterRing;
+
+WriterRing writer_ring;
+char       writer_ring_dirs[WRITER_RING_DIRCACHE][MAX_FPATH]; // recently created directories
+int        writer_ring_nextdir;
+
+static void Writer_RingFree(WriterRing *ring)
+{
+	if (ring->sqes && ring->sqes != MAP_FAILED)
+		munmap(ring->sqes, ring->sqes_size);
+	if (ring->cq_ptr && ring->cq_ptr != MAP_FAILED)
+		munmap(ring->cq_ptr, ring->cq_size);
+	if (ring->sq_ptr && ring->sq_ptr != MAP_FAILED)
+		munmap(ring->sq_ptr, ring->sq_size);
+	if (ring->fd >= 0)
+		close(ring->fd);
+	memset(ring, 0, sizeof(WriterRing));
+	ring->fd = -1;
+}
+
+// kernel may have io_uring without some of operations writer needs
+static bool Writer_RingProbe(WriterRing *ring)
+{
+	const int ops[3] = { IORING_OP_OPENAT, IORING_OP_WRITEV, IORING_OP_CLOSE };
+	struct io_uring_probe *probe;
+	size_t size;
+	bool supported;
+	int i;
+
+	size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+	probe = (struct io_uring_probe *)mem_alloc(size);
+	memset(probe, 0, size);
+	supported = (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) >= 0) ? true : false;
+	for (i = 0; i < 3 && supported; i++)
+		if (ops[i] > probe->last_op || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED))
+			supported = false;
+	mem_free(probe);
+	return supported;
+}
+
+// returns false if kernel has no io_uring, it's not allowed or lacks needed operations
+static bool Writer_RingInit(WriterRing *ring, unsigned entries)
+{
+	struct io_uring_params p;
+	byte *sq, *cq;
+
+	memset(ring, 0, sizeof(WriterRing));
+	memset(&p, 0, sizeof(p));
+	ring->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+	if (ring->fd < 0)
+		return false;
+	if (!Writer_RingProbe(ring))
+	{
+		Writer_RingFree(ring);
+		return false;
+	}
+
+	// map rings
+	ring->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ring->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+	ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sq_ptr == MAP_FAILED || ring->cq_ptr == MAP_FAILED || ring->sqes == MAP_FAILED)
+	{
+		Writer_RingFree(ring);
+		return false;
+	}
+	sq = (byte *)ring->sq_ptr;
+	cq = (byte *)ring->cq_ptr;
+	ring->sq_head = (unsigned *)(sq + p.sq_off.head);
+	ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+	ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+	ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	ring->entries = p.sq_entries;
+	memset(writer_ring_dirs, 0, sizeof(writer_ring_dirs));
+	writer_ring_nextdir = 0;
+	return true;
+}
+
+// get next submission entry
+static struct io_uring_sqe *Writer_RingSQE(WriterRing *ring, WriterFile *file, int state)
+{
+	struct io_uring_sqe *sqe;
+	unsigned index;
+
+	index = *ring->sq_tail & *ring->sq_mask;
+	sqe = &ring->sqes[index];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->user_data = (unsigned long long)(size_t)file;
+	ring->sq_array[index] = index;
+	file->state = state;
+	return sqe;
+}
+
+static void Writer_RingPush(WriterRing *ring)
+{
+	__atomic_store_n(ring->sq_tail, *ring->sq_tail + 1, __ATOMIC_RELEASE);
+	ring->queued++;
+}
+
+// prepare open of file
+static void Writer_RingQueueOpen(WriterRing *ring, WriterFile *file)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = Writer_RingSQE(ring, file, WRITER_RING_OPEN);
+	sqe->opcode = IORING_OP_OPENAT;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (unsigned long long)(size_t)file->filename;
+	sqe->len = 0666;
+	sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC;
+	Writer_RingPush(ring);
+}
+
+// prepare write of the rest of file
+static void Writer_RingQueueWrite(WriterRing *ring, WriterFile *file)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = Writer_RingSQE(ring, file, WRITER_RING_WRITE);
+	file->iov.iov_base = file->data + file->written;
+	file->iov.iov_len = file->datasize - file->written;
+	sqe->opcode = IORING_OP_WRITEV;
+	sqe->fd = file->fd;
+	sqe->addr = (unsigned long long)(size_t)&file->iov;
+	sqe->len = 1;
+	sqe->off = file->written;
+	Writer_RingPush(ring);
+}
+
+static void Writer_RingQueueClose(WriterRing *ring, WriterFile *file)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = Writer_RingSQE(ring, file, WRITER_RING_CLOSE);
+	sqe->opcode = IORING_OP_CLOSE;
+	sqe->fd = file->fd;
+	Writer_RingPush(ring);
+}
+
+// handle finished operations, each one queues next step of it's file
+static void Writer_RingReap(WriterRing *ring)
+{
+	struct io_uring_cqe *cqe;
+	WriterFile *file;
+	unsigned head;
+	int res;
+
+	head = *ring->cq_head;
+	while(head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+	{
+		cqe = &ring->cqes[head & *ring->cq_mask];
+		file = (WriterFile *)(size_t)cqe->user_data;
+		res = cqe->res;
+		head++;
+		__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+		ring->inflight--;
+
+		// opened, empty files are closed right away
+		if (file->state == WRITER_RING_OPEN)
+		{
+			if (res < 0)
+			{
+				Warning("Writer(%s): cannot open file (%s) for writing", file->filename, strerror(-res));
+				Writer_Done(file, false);
+				continue;
+			}
+			file->fd = res;
+			if (file->datasize)
+				Writer_RingQueueWrite(ring, file);
+			else
+				Writer_RingQueueClose(ring, file);
+			continue;
+		}
+
+		// written, partial writes are continued
+		if (file->state == WRITER_RING_WRITE)
+		{
+			if (res > 0)
+			{
+				file->written += res;
+				if (file->written < file->datasize)
+				{
+					Writer_RingQueueWrite(ring, file);
+					continue;
+				}
+			}
+			else
+			{
+				Warning("Writer(%s): cannot write file (%s)", file->filename, strerror(res < 0 ? -res : EIO));
+				file->failed = true;
+			}
+			Writer_RingQueueClose(ring, file);
+			continue;
+		}
+
+		// closed
+		if (res < 0)
+		{
+			Warning("Writer(%s): cannot close file (%s)", file->filename, strerror(-res));
+			file->failed = true;
+		}
+		Writer_Done(file, !file->failed);
+	}
+}
+
+// create directory of file, unless it was created recently
+static void Writer_RingCreatePath(const char *filename)
+{
+	char dir[MAX_FPATH];
+	int i;
+
+	strlcpy(dir, filename, sizeof(dir));
+	for (i = (int)strlen(dir) - 1; i >= 0 && dir[i] != '/' && dir[i] != '\\'; i--);
+	dir[max(0, i)] = 0;
+	for (i = 0; i < WRITER_RING_DIRCACHE; i++)
+		if (!strcmp(writer_ring_dirs[i], dir))
+			return;
+	CreatePath((char *)filename);
+	strlcpy(writer_ring_dirs[writer_ring_nextdir], dir, MAX_FPATH);
+	writer_ring_nextdir = (writer_ring_nextdir + 1) % WRITER_RING_DIRCACHE;
+}
+
+// start file, it is opened by the ring
+static void Writer_RingOpen(WriterRing *ring, WriterFile *file)
+{
+	Writer_RingCreatePath(file->filename);
+	file->fd = -1;
+	file->written = 0;
+	file->failed = false;
+	Writer_RingQueueOpen(ring, file);
+}
+
+static void Writer_RingThread(ThreadData *thread)
+{
+	WriterRing *ring = &writer_ring;
+	WriterFile *file;
+	bool closed;
+	int submitted;
+
+	closed = false;
+	while(1)
+	{
+		// take pending files while there is room in the ring, block only if there is nothing to wait for
+		while(!closed && ring->queued + ring->inflight < ring->entries)
+		{
+			if (ring->queued + ring->inflight == 0)
+			{
+				file = (WriterFile *)Thread_QueuePop(&writer_queue);
+				if (!file)
+					closed = true;
+			}
+			else
+				file = (WriterFile *)Thread_QueueTryPop(&writer_queue, &closed);
+			if (!file)
+				break;
+			Writer_RingOpen(ring, file);
+		}
+		if (closed && !ring->queued && !ring->inflight)
+			break;
+		if (!ring->queued && !ring->inflight)
+			continue;
+
+		// submit batch and wait for at least one write to finish
+		submitted = (int)syscall(__NR_io_uring_enter, ring->fd, ring->queued, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+		if (submitted < 0)
+		{
+			if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+				Error("Writer: io_uring_enter failed (%s)\n", strerror(errno));
+		}
+		else
+		{
+			ring->queued -= min((unsigned)submitted, ring->queued);
+			ring->inflight += submitted;
+		}
+		Writer_RingReap(ring);
+	}
+	Writer_RingFree(ring);
+}
+
+#endif
+
+/*
+==========================================================================================
+
+  Writer
+
+==========================================================================================
+*/
+
+void Writer_Init(int threads, bool allowRing, size_t maxbytes)
+{
+	int i;
+
+	Thread_QueueInit(&writer_queue, maxbytes);
+	Thread_MutexInit(&writer_stats_mutex);
+	memset(&writer_stats, 0, sizeof(writer_stats));
+	writer_firstWrite = 0;
+	writer_lastDone = 0;
+
+	// pick backend
+	writer_numthreads = max(1, threads);
+	writer_stats.backend = "threads";
+#ifdef WRITER_RING
+	if (allowRing && Writer_RingInit(&writer_ring, WRITER_RING_ENTRIES))
+	{
+		writer_numthreads = 1;
+		writer_stats.backend = "io_uring";
+	}
+#endif
+	writer_stats.threads = writer_numthreads;
+
+	// start threads
+	writer_threads = (ThreadData *)mem_alloc(sizeof(ThreadData) * writer_numthreads);
+	memset(writer_threads, 0, sizeof(ThreadData) * writer_numthreads);
+	for (i = 0; i < writer_numthreads; i++)
+	{
+		writer_threads[i].num = i;
+		writer_threads[i].func = Writer_PoolThread;
+#ifdef WRITER_RING
+		if (!strcmp(writer_stats.backend, "io_uring"))
+			writer_threads[i].func = Writer_RingThread;
+#endif
+		Thread_Start(&writer_threads[i]);
+	}
+}
+
+void Writer_Write(const char *filename, byte *data, size_t datasize)
+{
+	WriterFile *file;
+
+	file = (WriterFile *)mem_alloc(sizeof(WriterFile));
+	memset(file, 0, sizeof(WriterFile));
+	strlcpy(file->filename, filename, sizeof(file->filename));
+	file->data = data;
+	file->datasize = datasize;
+	if (!writer_firstWrite)
+		writer_firstWrite = I_DoubleTime();
+	Thread_QueuePush(&writer_queue, &file->node, datasize);
+	Thread_QueueWaitSpace(&writer_queue);
+}
+
+void Writer_Shutdown(WriterStats *stats)
+{
+	int i;
+
+	Thread_QueueClose(&writer_queue);
+	for (i = 0; i < writer_numthreads; i++)
+		Thread_Wait(&writer_threads[i]);
+	mem_free(writer_threads);
+	Thread_QueueDestroy(&writer_queue);
+	Thread_MutexDestroy(&writer_stats_mutex);
+
+	writer_stats.time = (writer_firstWrite > 0) ? max(0.0, writer_lastDone - writer_firstWrite) : 0;
+	if (stats)
+		memcpy(stats, &writer_stats, sizeof(WriterStats));
+}
@@ -0,0 +1,24 @@
+// writer.h
+#ifndef H_TEX_WRITER_H
+#define H_TEX_WRITER_H
+
+typedef struct
+{
+	const char *backend;   // "io_uring" or "threads"
+	int         threads;
+	size_t      files;
+	size_t      failed;
+	double      bytes;
+	double      time;      // seconds from first write to last finished one
+}WriterStats;
+
+// start writer, maxbytes limits data waiting to be written
+void Writer_Init(int threads, bool allowRing, size_t maxbytes);
+
+// queue file for writing, writer takes ownership of data, blocks if too much data is pending
+void Writer_Write(const char *filename, byte *data, size_t datasize);
+
+// wait for all writes to finish and stop writer
+void Writer_Shutdown(WriterStats *stats);
+
+#endif
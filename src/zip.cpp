@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <tchar.h>
 #include "zip.h"
+#include "hash.h"
 
 
 // THIS FILE is almost entirely based upon code by info-zip.
@@ -2095,17 +2096,10 @@ const ulg crc_table[256] = {
 };
 
 #define CRC32(c, b) (crc_table[((int)(c) ^ (b)) & 0xff] ^ ((c) >> 8))
-#define DO1(buf)  crc = CRC32(crc, *buf++)
-#define DO2(buf)  DO1(buf); DO1(buf)
-#define DO4(buf)  DO2(buf); DO2(buf)
-#define DO8(buf)  DO4(buf); DO4(buf)
 
 ulg crc32(ulg crc, const uch *buf, extent len)
 { if (buf==NULL) return 0L;
-  crc = crc ^ 0xffffffffL;
-  while (len >= 8) {DO8(buf); len -= 8;}
-  if (len) do {DO1(buf);} while (--len);
-  return crc ^ 0xffffffffL;  // (instead of ~c for 64-bit machines)
+  return Hash_CRC32((unsigned int)crc, buf, len); // slicing-by-8 or PCLMULQDQ
 }
 
 